@@ -312,6 +312,8 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
             strcpy(cp->CChexstr,AssetsCChexstr);
             memcpy(cp->CCpriv,AssetsCCpriv,32);
             cp->validate = AssetsValidate;
+            cp->validatetx = 1;
+            cp->evalshared = CC_SHARED_CONTRACT;
             cp->ismyvin = IsAssetsInput;
             break;
         case EVAL_FAUCET:
@@ -320,6 +322,8 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
             strcpy(cp->CChexstr,FaucetCChexstr);
             memcpy(cp->CCpriv,FaucetCCpriv,32);
             cp->validate = FaucetValidate;
+            cp->validatetx = 1;
+            cp->evalshared = CC_SHARED_CONTRACT;
             cp->ismyvin = IsFaucetInput;
             break;
         case EVAL_REWARDS:
@@ -328,6 +332,8 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
             strcpy(cp->CChexstr,RewardsCChexstr);
             memcpy(cp->CCpriv,RewardsCCpriv,32);
             cp->validate = RewardsValidate;
+            cp->validatetx = 1;
+            cp->evalshared = CC_SHARED_CONTRACT;
             cp->ismyvin = IsRewardsInput;
             break;
         case EVAL_DICE:
@@ -368,6 +374,8 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
             strcpy(cp->CChexstr,HeirCChexstr);
             memcpy(cp->CCpriv,HeirCCpriv,32);
             cp->validate = HeirValidate;
+            cp->validatetx = 1;
+            cp->evalshared = CC_SHARED_CONTRACT;
             cp->ismyvin = IsHeirInput;
             break;
         case EVAL_CHANNELS:
@@ -376,6 +384,8 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
             strcpy(cp->CChexstr,ChannelsCChexstr);
             memcpy(cp->CCpriv,ChannelsCCpriv,32);
             cp->validate = ChannelsValidate;
+            cp->validatetx = 1;
+            cp->evalshared = CC_SHARED_CONTRACT;
             cp->ismyvin = IsChannelsInput;
             break;
         case EVAL_ORACLES:
@@ -416,6 +426,7 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
             strcpy(cp->CChexstr,PaymentsCChexstr);
             memcpy(cp->CCpriv,PaymentsCCpriv,32);
             cp->validate = PaymentsValidate;
+            cp->validatetx = 1;
             cp->ismyvin = IsPaymentsInput;
             break;
         case EVAL_GATEWAYS:
@@ -433,6 +444,8 @@ struct CCcontract_info *CCinit(struct CCcontract_info *cp, uint8_t evalcode)
 			strcpy(cp->CChexstr, TokensCChexstr);
 			memcpy(cp->CCpriv, TokensCCpriv, 32);
 			cp->validate = TokensValidate;
+			cp->validatetx = 1;
+			cp->evalshared = CC_SHARED_CONTRACT;
 			cp->ismyvin = IsTokensInput;
 			break;
         case EVAL_IMPORTGATEWAY:
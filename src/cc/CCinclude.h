@@ -48,6 +48,7 @@ one other technical note is that komodod has the insight-explorer extensions bui
 #include "../wallet/wallet.h"
 #include <univalue.h>
 #include <exception>
+#include <functional>
 #include "../komodo_defs.h"
 #include "../utlist.h"
 #include "../uthash.h"
@@ -98,6 +99,14 @@ struct CC_utxo
     int32_t vout;
 };
 
+struct CC_unspent
+{
+    uint256 txid;
+    int64_t nValue;
+    int32_t vout,height;
+    CScript scriptPubKey,opret;
+};
+
 // these are the parameters stored after Verus crypto-condition vouts. new versions may change
 // the format
 struct CC_meta
@@ -136,8 +145,14 @@ struct CCcontract_info
     bool (*validate)(struct CCcontract_info *cp, Eval* eval, const CTransaction &tx, uint32_t nIn);  // cc contract tx validation callback
     bool (*ismyvin)(CScript const& scriptSig);	// checks if evalcode is present in the scriptSig param
 
+    uint8_t evalshared;  // CC_SHARED_GLOBAL unless CCinit declares the validation only shares state within the contract
+    uint8_t validatetx;  // validate checks the whole tx whatever nIn is, so one passing input covers the others
     uint8_t didinit;
 };
+
+// how much state a contract's validation shares with other evals, see RunCCEval
+#define CC_SHARED_GLOBAL 0      // komodo globals or other contracts, runs alone under KOMODO_CC_mutex
+#define CC_SHARED_CONTRACT 1    // only the contract's own code, runs concurrently with other contracts
 struct CCcontract_info *CCinit(struct CCcontract_info *cp,uint8_t evalcode);
 
 struct oracleprice_info
@@ -192,6 +207,7 @@ uint256 OraclesBatontxid(uint256 oracletxid,CPubKey pk);
 uint8_t DecodeOraclesCreateOpRet(const CScript &scriptPubKey,std::string &name,std::string &description,std::string &format);
 uint8_t DecodeOraclesOpRet(const CScript &scriptPubKey,uint256 &oracletxid,CPubKey &pk,int64_t &num);
 uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint256 &batontxid,CPubKey &pk,std::vector <uint8_t>&data);
+int32_t OracleSamplesWalk(uint256 reforacletxid,uint256 batontxid,const std::function<bool(uint256 txid,uint256 batontxid,std::vector<uint8_t> &data)> &f);
 int32_t oracle_format(uint256 *hashp,int64_t *valp,char *str,uint8_t fmt,uint8_t *data,int32_t offset,int32_t datalen);
 
 //int64_t AddAssetInputs(struct CCcontract_info *cp,CMutableTransaction &mtx,CPubKey pk,uint256 assetid,int64_t total,int32_t maxinputs);
@@ -284,6 +300,7 @@ extern std::vector<CPubKey> NULL_pubkeys;
 std::string FinalizeCCTx(uint64_t skipmask,struct CCcontract_info *cp,CMutableTransaction &mtx,CPubKey mypk,uint64_t txfee,CScript opret,std::vector<CPubKey> pubkeys = NULL_pubkeys);
 void SetCCunspents(std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,char *coinaddr,bool CCflag = true);
 void SetCCtxids(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,char *coinaddr,bool CCflag = true);
+int32_t CCunspents(std::vector<struct CC_unspent> &unspents,char *coinaddr,bool CCflag,int32_t mempoolflag,int32_t opretflag);
 int64_t AddNormalinputs(CMutableTransaction &mtx,CPubKey mypk,int64_t total,int32_t maxinputs);
 int64_t AddNormalinputs2(CMutableTransaction &mtx,int64_t total,int32_t maxinputs);
 int64_t CCutxovalue(char *coinaddr,uint256 utxotxid,int32_t utxovout,int32_t CCflag);
@@ -344,6 +344,39 @@ void SetCCtxids(std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex
     }
 }
 
+/*
+ unspent outputs of coinaddr from one scan of the address index, value, script and height come from the index.
+ with mempoolflag the outputs spent in the mempool are dropped, with opretflag the last vout of each tx is added
+ */
+int32_t CCunspents(std::vector<struct CC_unspent> &unspents,char *coinaddr,bool CCflag,int32_t mempoolflag,int32_t opretflag)
+{
+    uint256 hashBlock; CTransaction tx; std::vector<bool> spent; struct CC_unspent u;
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    SetCCunspents(unspentOutputs,coinaddr,CCflag);
+    spent.resize(unspentOutputs.size());
+    if ( mempoolflag != 0 )
+    {
+        LOCK(mempool.cs);
+        for (int32_t i=0; i<unspentOutputs.size(); i++)
+            spent[i] = mempool.mapNextTx.count(COutPoint(unspentOutputs[i].first.txhash,unspentOutputs[i].first.index)) != 0;
+    }
+    for (int32_t i=0; i<unspentOutputs.size(); i++)
+    {
+        if ( spent[i] )
+            continue;
+        u.txid = unspentOutputs[i].first.txhash;
+        u.vout = (int32_t)unspentOutputs[i].first.index;
+        u.nValue = unspentOutputs[i].second.satoshis;
+        u.height = unspentOutputs[i].second.blockHeight;
+        u.scriptPubKey = unspentOutputs[i].second.script;
+        u.opret = CScript();
+        if ( opretflag != 0 && myGetTransaction(u.txid,tx,hashBlock) != 0 && tx.vout.size() > 0 )
+            u.opret = tx.vout.back().scriptPubKey;
+        unspents.push_back(u);
+    }
+    return((int32_t)unspents.size());
+}
+
 int64_t CCutxovalue(char *coinaddr,uint256 utxotxid,int32_t utxovout,int32_t CCflag)
 {
     uint256 txid; std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
@@ -429,23 +462,21 @@ int64_t CCfullsupply(uint256 tokenid)
 
 int64_t CCtoken_balance(char *coinaddr,uint256 reftokenid)
 {
-    int64_t price,sum = 0; int32_t numvouts; CTransaction tx; uint256 tokenid,txid,hashBlock; 
+    int64_t sum = 0; uint256 tokenid; 
 	std::vector<uint8_t>  vopretExtra;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::vector<struct CC_unspent> unspents;
 	uint8_t evalCode;
 
-    SetCCunspents(unspentOutputs,coinaddr,true);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    CCunspents(unspents,coinaddr,true,0,1);
+    for (std::vector<struct CC_unspent>::const_iterator it=unspents.begin(); it!=unspents.end(); it++)
     {
-        txid = it->first.txhash;
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && (numvouts=tx.vout.size()) > 0 )
+        if ( it->opret.size() > 0 )
         {
-            char str[65];
 			std::vector<CPubKey> voutTokenPubkeys;
             std::vector<std::pair<uint8_t, vscript_t>>  oprets;
-            if ( reftokenid==txid || (DecodeTokenOpRet(tx.vout[numvouts-1].scriptPubKey, evalCode, tokenid, voutTokenPubkeys, oprets) != 0 && reftokenid == tokenid))
+            if ( reftokenid==it->txid || (DecodeTokenOpRet(it->opret, evalCode, tokenid, voutTokenPubkeys, oprets) != 0 && reftokenid == tokenid))
             {
-                sum += it->second.satoshis;
+                sum += it->nValue;
             }
         }
     }
@@ -604,7 +635,7 @@ int64_t AddNormalinputs(CMutableTransaction &mtx,CPubKey mypk,int64_t total,int3
 int64_t AddNormalinputs2(CMutableTransaction &mtx,int64_t total,int32_t maxinputs)
 {
     int32_t abovei,belowi,ind,vout,i,n = 0; int64_t sum,threshold,above,below; int64_t remains,nValue,totalinputs = 0; char coinaddr[64]; uint256 txid,hashBlock; CTransaction tx; struct CC_utxo *utxos,*up;
-    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+    std::vector<struct CC_unspent> unspents;
     utxos = (struct CC_utxo *)calloc(CC_MAXVINS,sizeof(*utxos));
     if ( maxinputs > CC_MAXVINS )
         maxinputs = CC_MAXVINS;
@@ -613,14 +644,14 @@ int64_t AddNormalinputs2(CMutableTransaction &mtx,int64_t total,int32_t maxinput
     else threshold = total;
     sum = 0;
     Getscriptaddress(coinaddr,CScript() << Mypubkey() << OP_CHECKSIG);
-    SetCCunspents(unspentOutputs,coinaddr,false);
-    for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=unspentOutputs.begin(); it!=unspentOutputs.end(); it++)
+    CCunspents(unspents,coinaddr,false,1,0);
+    for (std::vector<struct CC_unspent>::const_iterator it=unspents.begin(); it!=unspents.end(); it++)
     {
-        txid = it->first.txhash;
-        vout = (int32_t)it->first.index;
-        if ( it->second.satoshis < threshold )
+        txid = it->txid;
+        vout = it->vout;
+        if ( it->nValue < threshold )
             continue;
-        if ( myGetTransaction(txid,tx,hashBlock) != 0 && tx.vout.size() > 0 && vout < tx.vout.size() && tx.vout[vout].scriptPubKey.IsPayToCryptoCondition() == 0 )
+        if ( it->scriptPubKey.IsPayToCryptoCondition() == 0 )
         {
             //fprintf(stderr,"check %.8f to vins array.%d of %d %s/v%d\n",(double)out.tx->vout[out.i].nValue/COIN,n,maxutxos,txid.GetHex().c_str(),(int32_t)vout);
             if ( mtx.vin.size() > 0 )
@@ -639,17 +670,14 @@ int64_t AddNormalinputs2(CMutableTransaction &mtx,int64_t total,int32_t maxinput
                 if ( i != n )
                     continue;
             }
-            if ( myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
-            {
-                up = &utxos[n++];
-                up->txid = txid;
-                up->nValue = it->second.satoshis;
-                up->vout = vout;
-                sum += up->nValue;
-                //fprintf(stderr,"add %.8f to vins array.%d of %d\n",(double)up->nValue/COIN,n,maxutxos);
-                if ( n >= maxinputs || sum >= total )
-                    break;
-            }
+            up = &utxos[n++];
+            up->txid = txid;
+            up->nValue = it->nValue;
+            up->vout = vout;
+            sum += up->nValue;
+            //fprintf(stderr,"add %.8f to vins array.%d of %d\n",(double)up->nValue/COIN,n,maxutxos);
+            if ( n >= maxinputs || sum >= total )
+                break;
         }
     }
     remains = total;
@@ -520,42 +520,41 @@ int64_t CCduration(int32_t &numblocks,uint256 txid)
 
 uint256 CCOraclesReverseScan(char const *logcategory,uint256 &txid,int32_t height,uint256 reforacletxid,uint256 batontxid)
 {
-    CTransaction tx; uint256 hash,mhash,bhash,hashBlock,oracletxid; int32_t len,len2,numvouts;
-    int64_t val,merkleht; CPubKey pk; std::vector<uint8_t>data; char str[65],str2[65];
+    uint256 hash,mhash = zeroid; int32_t len,len2; int64_t val,merkleht; char str[65],str2[65];
     
     txid = zeroid;
     LogPrint(logcategory,"start reverse scan %s\n",uint256_str(str,batontxid));
-    while ( myGetTransaction(batontxid,tx,hashBlock) != 0 && (numvouts= tx.vout.size()) > 0 )
+    OracleSamplesWalk(reforacletxid,batontxid,[&](uint256 sampletxid,uint256 bhash,std::vector<uint8_t> &data)
     {
-        LogPrint(logcategory,"check %s\n",uint256_str(str,batontxid));
-        if ( DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,bhash,pk,data) == 'D' && oracletxid == reforacletxid )
+        LogPrint(logcategory,"decoded %s\n",uint256_str(str,sampletxid));
+        if ( oracle_format(&hash,&merkleht,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t) && merkleht == height )
         {
-            LogPrint(logcategory,"decoded %s\n",uint256_str(str,batontxid));
-            if ( oracle_format(&hash,&merkleht,0,'I',(uint8_t *)data.data(),0,(int32_t)data.size()) == sizeof(int32_t) && merkleht == height )
-            {
-                len = oracle_format(&hash,&val,0,'h',(uint8_t *)data.data(),sizeof(int32_t),(int32_t)data.size());
-                len2 = oracle_format(&mhash,&val,0,'h',(uint8_t *)data.data(),(int32_t)(sizeof(int32_t)+sizeof(uint256)),(int32_t)data.size());
+            len = oracle_format(&hash,&val,0,'h',(uint8_t *)data.data(),sizeof(int32_t),(int32_t)data.size());
+            len2 = oracle_format(&mhash,&val,0,'h',(uint8_t *)data.data(),(int32_t)(sizeof(int32_t)+sizeof(uint256)),(int32_t)data.size());
 
-                LogPrint(logcategory,"found merkleht.%d len.%d len2.%d %s %s\n",(int32_t)merkleht,len,len2,uint256_str(str,hash),uint256_str(str2,mhash));
-                if ( len == sizeof(hash)+sizeof(int32_t) && len2 == 2*sizeof(mhash)+sizeof(int32_t) && mhash != zeroid )
-                {
-                    txid = batontxid;
-                    LogPrint(logcategory,"set txid\n");
-                    return(mhash);
-                }
-                else
-                {
-                    LogPrint(logcategory,"missing hash\n");
-                    return(zeroid);
-                }
+            LogPrint(logcategory,"found merkleht.%d len.%d len2.%d %s %s\n",(int32_t)merkleht,len,len2,uint256_str(str,hash),uint256_str(str2,mhash));
+            if ( len == sizeof(hash)+sizeof(int32_t) && len2 == 2*sizeof(mhash)+sizeof(int32_t) && mhash != zeroid )
+            {
+                txid = sampletxid;
+                LogPrint(logcategory,"set txid\n");
             }
-            else LogPrint(logcategory,"height.%d vs search ht.%d\n",(int32_t)merkleht,(int32_t)height);
-            batontxid = bhash;
-            LogPrint(logcategory,"new hash %s\n",uint256_str(str,batontxid));
-        } else break;
+            else
+            {
+                LogPrint(logcategory,"missing hash\n");
+                mhash = zeroid;
+            }
+            return(false);
+        }
+        else LogPrint(logcategory,"height.%d vs search ht.%d\n",(int32_t)merkleht,(int32_t)height);
+        LogPrint(logcategory,"new hash %s\n",uint256_str(str,bhash));
+        return(true);
+    });
+    if ( txid == zeroid )
+    {
+        LogPrint(logcategory,"end of loop\n");
+        return(zeroid);
     }
-    LogPrint(logcategory,"end of loop\n");
-    return(zeroid);
+    return(mhash);
 }
 
 int32_t myIs_coinaddr_inmempoolvout(char const *logcategory,char *coinaddr)
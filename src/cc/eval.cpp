@@ -14,6 +14,9 @@
  ******************************************************************************/
 
 #include <assert.h>
+#include <map>
+#include <mutex>
+#include <set>
 #include <cryptoconditions.h>
 
 #include "primitives/block.h"
@@ -33,13 +36,101 @@ char *CClib_name();
 Eval* EVAL_TEST = 0;
 struct CCcontract_info CCinfos[0x100];
 extern pthread_mutex_t KOMODO_CC_mutex;
+static std::once_flag CCinfosOnce[0x100];
+static std::mutex CCcontract_mutex[0x100];
 
+static struct CCcontract_info *CCgetinfo(uint8_t ecode)
+{
+    struct CCcontract_info *cp = &CCinfos[ecode];
+    std::call_once(CCinfosOnce[ecode], [cp, ecode]() { CCinit(cp,ecode); cp->didinit = 1; });
+    return(cp);
+}
+
+/*
+ * Results of validators declared validatetx in CCinit, per (txid, eval code). Once one input of a tx
+ * passed, the other inputs with the same eval code pass too, as long as the tip and KOMODO_CONNECTING
+ * are the same. An input asked for a second time means a new validation pass, which starts over.
+ * Failures are not kept, they end the pass anyway.
+ */
+struct CCevalMemo
+{
+    uint256 hashTip;
+    int32_t connecting;
+    std::set<unsigned int> inputs;
+};
+#define CC_EVALMEMO_MAX 10000
+static std::mutex CCevalMemo_mutex;
+static std::map<std::pair<uint256,uint8_t>,CCevalMemo> CCevalMemos;
+
+static bool CCevalMemoCheck(const uint256 &txid, uint8_t ecode, unsigned int nIn, const uint256 &hashTip, int32_t connecting)
+{
+    std::lock_guard<std::mutex> lock(CCevalMemo_mutex);
+    std::map<std::pair<uint256,uint8_t>,CCevalMemo>::iterator it = CCevalMemos.find(std::make_pair(txid,ecode));
+    if ( it == CCevalMemos.end() )
+        return(false);
+    CCevalMemo &memo = it->second;
+    if ( memo.hashTip != hashTip || memo.connecting != connecting || memo.inputs.count(nIn) != 0 )
+    {
+        CCevalMemos.erase(it);
+        return(false);
+    }
+    memo.inputs.insert(nIn);
+    return(true);
+}
+
+static void CCevalMemoAdd(const uint256 &txid, uint8_t ecode, unsigned int nIn, const uint256 &hashTip, int32_t connecting)
+{
+    std::lock_guard<std::mutex> lock(CCevalMemo_mutex);
+    if ( CCevalMemos.size() >= CC_EVALMEMO_MAX )
+        CCevalMemos.clear();
+    CCevalMemo &memo = CCevalMemos[std::make_pair(txid,ecode)];
+    if ( memo.hashTip != hashTip || memo.connecting != connecting )
+    {
+        memo.hashTip = hashTip;
+        memo.connecting = connecting;
+        memo.inputs.clear();
+    }
+    memo.inputs.insert(nIn);
+}
+
+/*
+ * Evals of contracts declared CC_SHARED_CONTRACT in CCinit only lock their own contract, so the
+ * script check threads can validate different contracts at once. Everything else, cclib and
+ * imports included, still runs alone under KOMODO_CC_mutex.
+ */
 bool RunCCEval(const CC *cond, const CTransaction &tx, unsigned int nIn)
 {
     EvalRef eval;
-    pthread_mutex_lock(&KOMODO_CC_mutex);
-    bool out = eval->Dispatch(cond, tx, nIn);
-    pthread_mutex_unlock(&KOMODO_CC_mutex);
+    bool out;
+    uint8_t ecode = cond->codeLength != 0 ? cond->code[0] : 0;
+    struct CCcontract_info *cp = 0;
+    if ( cond->codeLength != 0 && (ecode < EVAL_FIRSTUSER || ecode > EVAL_LASTUSER) )
+        cp = CCgetinfo(ecode);
+    // only plain evals without params can share a result, params are checked per input
+    bool fMemo = cp != 0 && cp->validatetx != 0 && cond->codeLength == 1 && KOMODO_CONNECTING >= 0;
+    uint256 txid,hashTip; int32_t connecting = KOMODO_CONNECTING;
+    if ( fMemo )
+    {
+        CBlockIndex *tip = chainActive.LastTip();
+        if ( tip != 0 )
+            hashTip = tip->GetBlockHash();
+        txid = tx.GetHash();
+        if ( CCevalMemoCheck(txid, ecode, nIn, hashTip, connecting) )
+            return true;
+    }
+    if ( cp != 0 && cp->evalshared == CC_SHARED_CONTRACT )
+    {
+        std::lock_guard<std::mutex> lock(CCcontract_mutex[ecode]);
+        out = eval->Dispatch(cond, tx, nIn);
+    }
+    else
+    {
+        pthread_mutex_lock(&KOMODO_CC_mutex);
+        out = eval->Dispatch(cond, tx, nIn);
+        pthread_mutex_unlock(&KOMODO_CC_mutex);
+    }
+    if ( fMemo && out && eval->state.IsValid() )
+        CCevalMemoAdd(txid, ecode, nIn, hashTip, connecting);
     if ( eval->state.IsValid() != out)
         fprintf(stderr,"out %d vs %d isValid\n",(int32_t)out,(int32_t)eval->state.IsValid());
     //assert(eval->state.IsValid() == out);
@@ -88,12 +179,9 @@ bool Eval::Dispatch(const CC *cond, const CTransaction &txTo, unsigned int nIn)
             return CClib_Dispatch(cond,this,vparams,txTo,nIn);
         else return Invalid("mismatched -ac_cclib vs CClib_name");
     }
-    cp = &CCinfos[(int32_t)ecode];
-    if ( cp->didinit == 0 )
-    {
-        CCinit(cp,ecode);
-        cp->didinit = 1;
-    }
+    // validators scribble on the contract info, so each eval works on its own copy
+    struct CCcontract_info C = *CCgetinfo(ecode);
+    cp = &C;
 
     switch ( ecode )
     {
@@ -163,6 +163,38 @@ uint8_t DecodeOraclesData(const CScript &scriptPubKey,uint256 &oracletxid,uint25
     return(0);
 }
 
+#define ORACLES_SAMPLEBATCH 1000
+
+// walks the baton chain of an oracle back from batontxid until f returns false or a tx is not a sample of reforacletxid
+// unconfirmed samples are looked up one by one, confirmed ones come from the oracle sample index in batches
+int32_t OracleSamplesWalk(uint256 reforacletxid,uint256 batontxid,const std::function<bool(uint256 txid,uint256 batontxid,std::vector<uint8_t> &data)> &f)
+{
+    CTransaction tx; uint256 hashBlock,oracletxid,btxid; CPubKey pk; int32_t numvouts,height,n = 0; std::vector<uint8_t> data;
+    std::vector<std::pair<COracleSampleKey,COracleSampleValue> > samples; size_t next = 0;
+    while ( batontxid != zeroid )
+    {
+        if ( next < samples.size() && samples[next].second.txid == batontxid )
+        {
+            btxid = samples[next].second.batontxid;
+            data = samples[next].second.data;
+            next++;
+        }
+        else if ( myGetTransaction(batontxid,tx,hashBlock) != 0 && (numvouts= tx.vout.size()) > 0 && DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,btxid,pk,data) == 'D' && oracletxid == reforacletxid )
+        {
+            samples.clear();
+            next = 0;
+            if ( hashBlock != zeroid && (height= komodo_blockheight(hashBlock)) > 0 )
+                GetOracleSamples(reforacletxid,pk.GetID(),height,btxid,ORACLES_SAMPLEBATCH,samples);
+        }
+        else break;
+        n++;
+        if ( f(batontxid,btxid,data) == false )
+            break;
+        batontxid = btxid;
+    }
+    return(n);
+}
+
 CPubKey OracleBatonPk(char *batonaddr,struct CCcontract_info *cp)
 {
     static secp256k1_context *ctx;
@@ -940,29 +972,24 @@ UniValue OracleFormat(uint8_t *data,int32_t datalen,char *format,int32_t formatl
 
 UniValue OracleDataSamples(uint256 reforacletxid,uint256 batontxid,int32_t num)
 {
-    UniValue result(UniValue::VOBJ),b(UniValue::VARR); CTransaction tx,oracletx; uint256 hashBlock,btxid,oracletxid; 
-    CPubKey pk; std::string name,description,format; int32_t numvouts,n=0; std::vector<uint8_t> data; char str[67], *formatstr = 0;
+    UniValue result(UniValue::VOBJ),b(UniValue::VARR); CTransaction oracletx; uint256 hashBlock; 
+    std::string name,description,format; int32_t numvouts,n=0; char str[67], *formatstr = 0;
     
     result.push_back(Pair("result","success"));
     if ( GetTransaction(reforacletxid,oracletx,hashBlock,false) != 0 && (numvouts=oracletx.vout.size()) > 0 )
     {
         if ( DecodeOraclesCreateOpRet(oracletx.vout[numvouts-1].scriptPubKey,name,description,format) == 'C' )
         {
-            while ( GetTransaction(batontxid,tx,hashBlock,false) != 0 && (numvouts=tx.vout.size()) > 0 )
+            if ( (formatstr= (char *)format.c_str()) == 0 )
+                formatstr = (char *)"";
+            OracleSamplesWalk(reforacletxid,batontxid,[&](uint256 txid,uint256 btxid,std::vector<uint8_t> &data)
             {
-                if ( DecodeOraclesData(tx.vout[numvouts-1].scriptPubKey,oracletxid,btxid,pk,data) == 'D' && reforacletxid == oracletxid )
-                {
-                    if ( (formatstr= (char *)format.c_str()) == 0 )
-                        formatstr = (char *)"";
-                    UniValue a(UniValue::VARR);
-                    a.push_back(OracleFormat((uint8_t *)data.data(),(int32_t)data.size(),formatstr,(int32_t)format.size()));
-                    a.push_back(uint256_str(str,batontxid));
-                    b.push_back(a);
-                    batontxid = btxid;
-                    if ( ++n >= num && num != 0)
-                        break;
-                } else break;
-            }
+                UniValue a(UniValue::VARR);
+                a.push_back(OracleFormat((uint8_t *)data.data(),(int32_t)data.size(),formatstr,(int32_t)format.size()));
+                a.push_back(uint256_str(str,txid));
+                b.push_back(a);
+                return(++n < num || num == 0);
+            });
         }
     }
     result.push_back(Pair("samples",b));
@@ -36,6 +36,9 @@ extern int8_t is_STAKED(const char *chain_name);
 
 static const int SPROUT_VALUE_VERSION = 1001400;
 static const int SAPLING_VALUE_VERSION = 1010100;
+static const int STAKESEGID_VERSION = 2001527;
+static const int MINERPUBKEY_VERSION = 2001528;
+static const int SUPPLYTOTALS_VERSION = 2001529;
 extern int32_t ASSETCHAINS_LWMAPOS;
 extern char ASSETCHAINS_SYMBOL[65];
 extern uint64_t ASSETCHAINS_NOTARY_PAY[];
@@ -121,7 +124,9 @@ enum BlockStatus: uint32_t {
     BLOCK_FAILED_MASK        =   BLOCK_FAILED_VALID | BLOCK_FAILED_CHILD,
 
     BLOCK_ACTIVATES_UPGRADE  =   128, //! block activates a network upgrade
-    BLOCK_IN_TMPFILE         =   256 
+    BLOCK_IN_TMPFILE         =   256,
+
+    BLOCK_HAVE_MINERPUBKEY   =   512, //! pubkey33 holds the coinbase pubkey of this block
 };
 
 //! Short-hand for the highest consensus validity we implement.
@@ -242,6 +247,17 @@ public:
 
     //! height of the entry in the chain. The genesis block has height 0
     int64_t newcoins,zfunds,sproutfunds,nNotaryPay; int8_t segid; // jl777 fields
+
+    //! segid of the address staked in this block as used by komodo_segids, -1 for PoW, -2 if not computed yet
+    int8_t stakesegid;
+
+    //! coinbase pubkey of this block as returned by komodo_block2pubkey33, only valid if nStatus has BLOCK_HAVE_MINERPUBKEY
+    uint8_t pubkey33[33];
+
+    //! newcoins, zfunds and sproutfunds summed over blocks 1 through this one, only valid once supplytotals is set
+    int64_t nSupplyTotal,nZfundsTotal,nSproutfundsTotal;
+    int8_t supplytotals;
+
     //! Which # file this block is stored in (blk?????.dat)
     int nFile;
 
@@ -312,6 +328,10 @@ public:
         phashBlock = NULL;
         newcoins = zfunds = 0;
         segid = -2;
+        stakesegid = -2;
+        memset(pubkey33,0,sizeof(pubkey33));
+        nSupplyTotal = nZfundsTotal = nSproutfundsTotal = 0;
+        supplytotals = 0;
         nNotaryPay = 0;
         pprev = NULL;
         pskip = NULL;
@@ -552,6 +572,33 @@ public:
             READWRITE(nNotaryPay);
             READWRITE(segid);
         }
+
+        // Only read/write stakesegid if the client version used to create
+        // this index was storing it.
+        if ((s.GetType() & SER_DISK) && (nVersion >= STAKESEGID_VERSION)) {
+            READWRITE(stakesegid);
+        }
+
+        // Only read/write the miner pubkey if it was computed and the client
+        // version used to create this index was storing it.
+        if ((s.GetType() & SER_DISK) && (nVersion >= MINERPUBKEY_VERSION) && (nStatus & BLOCK_HAVE_MINERPUBKEY)) {
+            READWRITE(FLATDATA(pubkey33));
+        } else if (ser_action.ForRead()) {
+            // An older client that rewrote this entry kept the status bit but
+            // dropped pubkey33, so it has to be computed again.
+            nStatus &= ~BLOCK_HAVE_MINERPUBKEY;
+        }
+
+        // Only read/write the cumulative coin supply if the client version
+        // used to create this index was storing it.
+        if ((s.GetType() & SER_DISK) && (nVersion >= SUPPLYTOTALS_VERSION)) {
+            READWRITE(supplytotals);
+            if (supplytotals) {
+                READWRITE(nSupplyTotal);
+                READWRITE(nZfundsTotal);
+                READWRITE(nSproutfundsTotal);
+            }
+        }
     }
 
     uint256 GetBlockHash() const
@@ -33,7 +33,7 @@
 #define CLIENT_VERSION_MAJOR 2
 #define CLIENT_VERSION_MINOR 0
 #define CLIENT_VERSION_REVISION 15
-#define CLIENT_VERSION_BUILD 26
+#define CLIENT_VERSION_BUILD 29
 
 //! Set to true for release, false for prerelease or test build
 #define CLIENT_VERSION_IS_RELEASE true
@@ -67,80 +67,60 @@ uint256 CalculateProofRoot(const char* symbol, uint32_t targetCCid, int kmdHeigh
     if (kmdHeight < 0 || kmdHeight > chainActive.Height())
         return uint256();
 
-    int seenOwnNotarisations = 0, i = 0;
+    int seenOwnNotarisations = 0, firstHeight = 0, seventhHeight = 0;
 
     int authority = GetSymbolAuthority(symbol);
     std::set<uint256> tmp_moms;
 
-    for (i=0; i<NOTARISATION_SCAN_LIMIT_BLOCKS; i++) {
-        if (i > kmdHeight) break;
-        NotarisationsInBlock notarisations;
-        uint256 blockHash = *chainActive[kmdHeight-i]->phashBlock;
-        if (!GetBlockNotarisations(blockHash, notarisations))
-            continue;
-
-        // See if we have an own notarisation in this block
-        BOOST_FOREACH(Notarisation& nota, notarisations) {
-            if (strcmp(nota.second.symbol, symbol) == 0)
-            {
-                seenOwnNotarisations++;
-                if (seenOwnNotarisations == 1)
-                    destNotarisationTxid = nota.first;
-                else if (seenOwnNotarisations == 7)
-                    goto end;
-                //break;
-            }
+    // Find own notarisations going back, the first one is the destination
+    auto isSeventh = [&](int h, const Notarisation &nota) {
+        seenOwnNotarisations++;
+        if (seenOwnNotarisations == 1) {
+            destNotarisationTxid = nota.first;
+            firstHeight = h;
         }
+        seventhHeight = h;
+        return seenOwnNotarisations == 7;
+    };
+    Notarisation seventh;
+    if (!ScanSymbolNotarisations(symbol, kmdHeight-NOTARISATION_SCAN_LIMIT_BLOCKS+1, kmdHeight, true, isSeventh, seventh)) {
+        // Not enough own notarisations found to return determinate MoMoM
+        destNotarisationTxid = uint256();
+        moms.clear();
+        return uint256();
+    }
 
-        if (seenOwnNotarisations >= 1) {
-            BOOST_FOREACH(Notarisation& nota, notarisations) {
-                if (GetSymbolAuthority(nota.second.symbol) == authority)
-                    if (nota.second.ccId == targetCCid) {
-                      tmp_moms.insert(nota.second.MoM);
-                      //fprintf(stderr, "added mom: %s\n",nota.second.MoM.GetHex().data());
-                    }
-            }
+    // Include MoMs from the blocks after the 7th own notarisation up to the first one
+    NotarisationsInBlock ccNotarisations;
+    GetCCIdNotarisations(targetCCid, seventhHeight+1, firstHeight, ccNotarisations);
+    BOOST_FOREACH(Notarisation& nota, ccNotarisations) {
+        if (GetSymbolAuthority(nota.second.symbol) == authority) {
+            tmp_moms.insert(nota.second.MoM);
+            //fprintf(stderr, "added mom: %s\n",nota.second.MoM.GetHex().data());
         }
     }
 
-    // Not enough own notarisations found to return determinate MoMoM
-    destNotarisationTxid = uint256();
-    moms.clear();
-    return uint256();
-
-end:
     // add set to vector. Set makes sure there are no dupes included. 
     moms.clear();
     std::copy(tmp_moms.begin(), tmp_moms.end(), std::back_inserter(moms));
-    //fprintf(stderr, "SeenOwnNotarisations.%i moms.size.%li blocks scanned.%i\n",seenOwnNotarisations, moms.size(), i);
+    //fprintf(stderr, "SeenOwnNotarisations.%i moms.size.%li\n",seenOwnNotarisations, moms.size());
     return GetMerkleRoot(moms);
 }
 
 
 /*
- * Get a notarisation from a given height
+ * Get a notarisation of symbol from a given height
  *
- * Will scan notarisations leveldb up to a limit
+ * Will scan the notarisations index up to a limit
  */
 template <typename IsTarget>
-int ScanNotarisationsFromHeight(int nHeight, const IsTarget f, Notarisation &found)
+int ScanNotarisationsFromHeight(int nHeight, const char* symbol, const IsTarget f, Notarisation &found)
 {
     int limit = std::min(nHeight + NOTARISATION_SCAN_LIMIT_BLOCKS, chainActive.Height());
     int start = std::max(nHeight, 1);
 
-    for (int h=start; h<limit; h++) {
-        NotarisationsInBlock notarisations;
-
-        if (!GetBlockNotarisations(*chainActive[h]->phashBlock, notarisations))
-            continue;
-
-        BOOST_FOREACH(found, notarisations) {
-            if (f(found)) {
-                return h;
-            }
-        }
-    }
-    return 0;
+    auto isTarget = [&](int h, const Notarisation &nota) { return f(nota); };
+    return ScanSymbolNotarisations(symbol, start, limit-1, false, isTarget, found);
 }
 
 
@@ -175,10 +155,8 @@ TxProof GetCrossChainProof(const uint256 txid, const char* targetSymbol, uint32_
     // at all. So, the thing we need to do is scan forwards to find the notarisation for B,
     // that is inclusive of A.
     Notarisation nota;
-    auto isTarget = [&](Notarisation &nota) {
-        return strcmp(nota.second.symbol, targetSymbol) == 0;
-    };
-    kmdHeight = ScanNotarisationsFromHeight(kmdHeight, isTarget, nota);
+    auto isTarget = [&](const Notarisation &nota) { return true; };
+    kmdHeight = ScanNotarisationsFromHeight(kmdHeight, targetSymbol, isTarget, nota);
     if (!kmdHeight)
         throw std::runtime_error("Cannot find notarisation for target inclusive of source");
         
@@ -277,7 +255,7 @@ bool GetNextBacknotarisation(uint256 kmdNotarisationTxid, Notarisation &out)
         return false;
     }
 
-    return (bool) ScanNotarisationsFromHeight(block.GetHeight()+1, &IsSameAssetChain, out);
+    return (bool) ScanNotarisationsFromHeight(block.GetHeight()+1, ASSETCHAINS_SYMBOL, &IsSameAssetChain, out);
 }
 
 
@@ -304,11 +282,12 @@ bool CheckMoMoM(uint256 kmdNotarisationHash, uint256 momom)
     }
 
     Notarisation nota;
-    auto checkMoMoM = [&](Notarisation &nota) {
+    auto checkMoMoM = [&](const Notarisation &nota) {
         return nota.second.MoMoM == momom;
     };
 
-    return (bool) ScanNotarisationsFromHeight(block.GetHeight()-100, checkMoMoM, nota);
+    // MoMoMs only come in backnotarisations, which carry our own symbol
+    return (bool) ScanNotarisationsFromHeight(block.GetHeight()-100, ASSETCHAINS_SYMBOL, checkMoMoM, nota);
 
 }
 
@@ -444,11 +423,10 @@ TxProof GetAssetchainProof(uint256 hash,CTransaction burnTx)
         // The assumption here is that the first notarisation for a height GTE than
         // the transaction block height will contain the corresponding MoM. If there
         // are sequence issues with the notarisations this may fail.
-        auto isTarget = [&](Notarisation &nota) {
-            if (!IsSameAssetChain(nota)) return false;
+        auto isTarget = [&](const Notarisation &nota) {
             return nota.second.height >= blockIndex->GetHeight();
         };
-        if (!ScanNotarisationsFromHeight(blockIndex->GetHeight(), isTarget, nota))
+        if (!ScanNotarisationsFromHeight(blockIndex->GetHeight(), ASSETCHAINS_SYMBOL, isTarget, nota))
             throw std::runtime_error("backnotarisation not yet confirmed");
 
         // index of block in MoM leaves
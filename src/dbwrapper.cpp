@@ -82,6 +82,9 @@ bool CDBWrapper::IsEmpty()
     return !(it->Valid());
 }
 
+CDBSnapshot::CDBSnapshot(const CDBWrapper &_parent) : parent(_parent), psnapshot(parent.pdb->GetSnapshot()) { }
+CDBSnapshot::~CDBSnapshot() { parent.pdb->ReleaseSnapshot(psnapshot); }
+
 CDBIterator::~CDBIterator() { delete piter; }
 bool CDBIterator::Valid() { return piter->Valid(); }
 void CDBIterator::SeekToFirst() { piter->SeekToFirst(); }
@@ -154,8 +154,23 @@ public:
 
 };
 
+/** Consistent read-only view of a CDBWrapper, held until destroyed */
+class CDBSnapshot
+{
+private:
+    const CDBWrapper &parent;
+    const leveldb::Snapshot *psnapshot;
+
+public:
+    CDBSnapshot(const CDBWrapper &_parent);
+    ~CDBSnapshot();
+
+    const leveldb::Snapshot *Get() const { return psnapshot; }
+};
+
 class CDBWrapper
 {
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
@@ -267,6 +282,14 @@ public:
         return new CDBIterator(*this, pdb->NewIterator(iteroptions));
     }
 
+    //! Iterator over the state of the database when snapshot was taken
+    CDBIterator *NewIterator(const CDBSnapshot &snapshot)
+    {
+        leveldb::ReadOptions options = iteroptions;
+        options.snapshot = snapshot.Get();
+        return new CDBIterator(*this, pdb->NewIterator(options));
+    }
+
     /**
      * Return true if the database managed by this class contains no entries.
      */
@@ -4,6 +4,7 @@
 #include "httprpc.cpp"
 #include "httpserver.h"
 
+using ::testing::Invoke;
 using ::testing::Return;
 
 class MockHTTPRequest : public HTTPRequest {
@@ -13,6 +14,9 @@ public:
     MOCK_METHOD1(GetHeader, std::pair<bool, std::string>(const std::string& hdr));
     MOCK_METHOD2(WriteHeader, void(const std::string& hdr, const std::string& value));
     MOCK_METHOD2(WriteReply, void(int nStatus, const std::string& strReply));
+    MOCK_METHOD1(StartReplyChunks, void(int nStatus));
+    MOCK_METHOD1(WriteReplyChunk, void(const std::string& strChunk));
+    MOCK_METHOD0(EndReplyChunks, void());
 
     MockHTTPRequest() : HTTPRequest(nullptr) {}
     void CleanUp() {
@@ -60,3 +64,76 @@ TEST(HTTPRPC, FailsWithBadAuth) {
     EXPECT_FALSE(HTTPReq_JSONRPC(&req, ""));
     req.CleanUp();
 }
+
+static bool StreamNumbers(CJSONStream& out, int n, bool fThrow)
+{
+    out.BeginArray();
+    for (int i = 0; i < n; i++)
+        out.Value(i);
+    if (fThrow)
+        throw JSONRPCError(RPC_MISC_ERROR, "stream failed");
+    out.EndArray();
+    return true;
+}
+
+TEST(HTTPRPC, StreamFallsBackToNormalReply) {
+    MockHTTPRequest req;
+    EXPECT_CALL(req, StartReplyChunks(::testing::_)).Times(0);
+    EXPECT_CALL(req, WriteHeader("Content-Type", "application/json")).Times(1);
+    EXPECT_CALL(req, WriteReply(HTTP_OK, "{\"result\":[0,1,2],\"error\":null,\"id\":7}\n")).Times(1);
+    EXPECT_TRUE(JSONRPCStreamReply(&req, "test", UniValue(7), boost::bind(StreamNumbers, _1, 3, false)));
+    req.CleanUp();
+}
+
+TEST(HTTPRPC, StreamDeclined) {
+    MockHTTPRequest req;
+    EXPECT_CALL(req, WriteReply(::testing::_, ::testing::_)).Times(0);
+    EXPECT_CALL(req, StartReplyChunks(::testing::_)).Times(0);
+    auto decline = [](CJSONStream& out) { return false; };
+    EXPECT_FALSE(JSONRPCStreamReply(&req, "test", UniValue(7), decline));
+    req.CleanUp();
+}
+
+TEST(HTTPRPC, StreamErrorBeforeFirstChunkThrows) {
+    MockHTTPRequest req;
+    EXPECT_CALL(req, WriteReply(::testing::_, ::testing::_)).Times(0);
+    EXPECT_CALL(req, StartReplyChunks(::testing::_)).Times(0);
+    EXPECT_THROW(JSONRPCStreamReply(&req, "test", UniValue(7), boost::bind(StreamNumbers, _1, 3, true)), UniValue);
+    req.CleanUp();
+}
+
+TEST(HTTPRPC, StreamChunked) {
+    MockHTTPRequest req;
+    std::string body;
+    EXPECT_CALL(req, WriteHeader("Content-Type", "application/json")).Times(1);
+    EXPECT_CALL(req, StartReplyChunks(HTTP_OK)).Times(1);
+    EXPECT_CALL(req, WriteReplyChunk(::testing::_)).WillRepeatedly(Invoke([&](const std::string& chunk) { body += chunk; }));
+    EXPECT_CALL(req, EndReplyChunks()).Times(1);
+    EXPECT_CALL(req, WriteReply(::testing::_, ::testing::_)).Times(0);
+    EXPECT_TRUE(JSONRPCStreamReply(&req, "test", UniValue(7), boost::bind(StreamNumbers, _1, 1000, false), 64));
+
+    UniValue reply;
+    ASSERT_TRUE(reply.read(body));
+    EXPECT_EQ(1000, reply["result"].size());
+    EXPECT_TRUE(reply["error"].isNull());
+    EXPECT_EQ(7, reply["id"].get_int());
+    req.CleanUp();
+}
+
+TEST(HTTPRPC, StreamErrorAfterFirstChunkEndsWithError) {
+    MockHTTPRequest req;
+    std::string body;
+    EXPECT_CALL(req, WriteHeader("Content-Type", "application/json")).Times(1);
+    EXPECT_CALL(req, StartReplyChunks(HTTP_OK)).Times(1);
+    EXPECT_CALL(req, WriteReplyChunk(::testing::_)).WillRepeatedly(Invoke([&](const std::string& chunk) { body += chunk; }));
+    EXPECT_CALL(req, EndReplyChunks()).Times(1);
+    EXPECT_TRUE(JSONRPCStreamReply(&req, "test", UniValue(7), boost::bind(StreamNumbers, _1, 1000, true), 64));
+
+    // the reply is cut short but still valid JSON, with the error set
+    UniValue reply;
+    ASSERT_TRUE(reply.read(body));
+    EXPECT_EQ(RPC_MISC_ERROR, find_value(reply["error"], "code").get_int());
+    EXPECT_EQ("stream failed", find_value(reply["error"], "message").get_str());
+    EXPECT_EQ(7, reply["id"].get_int());
+    req.CleanUp();
+}
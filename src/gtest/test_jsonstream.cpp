@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include "rpc/jsonstream.h"
+
+#include <boost/bind.hpp>
+
+static void AppendChunk(std::string* pstr, int* pnChunks, const std::string& chunk)
+{
+    pstr->append(chunk);
+    (*pnChunks)++;
+}
+
+TEST(JSONStream, SameAsUniValue) {
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", 250));
+    info.push_back(Pair("quote", "a \"b\"\n"));
+
+    UniValue txs(UniValue::VARR);
+    UniValue expected(UniValue::VOBJ);
+    expected.push_back(Pair("hash", "00ff"));
+    expected.push_back(Pair("info", info));
+    for (int i = 0; i < 100; i++)
+        txs.push_back(info);
+    expected.push_back(Pair("tx", txs));
+    expected.push_back(Pair("empty", UniValue(UniValue::VARR)));
+
+    std::string str;
+    int nChunks = 0;
+    CJSONStream out(boost::bind(AppendChunk, &str, &nChunks, _1), 256);
+    out.BeginObject();
+    out.PushKV("hash", "00ff");
+    out.Key("info");
+    out.Value(info);
+    out.Key("tx");
+    out.BeginArray();
+    for (int i = 0; i < 100; i++)
+        out.Value(info);
+    out.EndArray();
+    out.Key("empty");
+    out.BeginArray();
+    out.EndArray();
+    out.EndObject();
+    EXPECT_TRUE(out.Flushed());
+    out.Flush();
+
+    EXPECT_EQ(expected.write(), str);
+    EXPECT_GT(nChunks, 1);
+}
+
+TEST(JSONStream, NotFlushedBelowFlushSize) {
+    std::string str;
+    int nChunks = 0;
+    CJSONStream out(boost::bind(AppendChunk, &str, &nChunks, _1));
+    out.Raw("{\"result\":");
+    out.BeginArray();
+    out.Value(1);
+    out.Value("two");
+    out.EndArray();
+    out.Raw("}");
+
+    EXPECT_FALSE(out.Flushed());
+    EXPECT_EQ(0, nChunks);
+    EXPECT_EQ("{\"result\":[1,\"two\"]}", out.Buffer());
+}
+
+TEST(JSONStream, UnwindClosesOpenContainers) {
+    std::string str;
+    int nChunks = 0;
+    CJSONStream out(boost::bind(AppendChunk, &str, &nChunks, _1));
+    out.BeginObject();
+    out.Key("result");
+    out.BeginArray();
+    out.BeginObject();
+    out.PushKV("n", 1);
+    out.Key("tx");
+    EXPECT_EQ(3, out.Depth());
+    out.Unwind(1);
+    EXPECT_EQ(1, out.Depth());
+    out.PushKV("error", "failed");
+    out.EndObject();
+    out.Flush();
+
+    EXPECT_EQ("{\"result\":[{\"n\":1,\"tx\":null}],\"error\":\"failed\"}", str);
+}
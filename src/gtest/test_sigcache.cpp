@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include "key.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+TEST(SigCache, SetAndGet) {
+    CSignatureCache cache(1 << 20);
+    CKey key;
+    key.MakeNewKey(true);
+    uint256 sighash = GetRandHash();
+    std::vector<unsigned char> vchSig;
+    ASSERT_TRUE(key.Sign(sighash, vchSig));
+
+    uint256 entry = cache.EntryECDSA(sighash, vchSig, key.GetPubKey());
+    EXPECT_FALSE(cache.Get(entry));
+    cache.Set(entry);
+    EXPECT_TRUE(cache.Get(entry));
+
+    // a different message, signature or key is a different entry
+    EXPECT_NE(entry, cache.EntryECDSA(GetRandHash(), vchSig, key.GetPubKey()));
+    std::vector<unsigned char> vchOther(vchSig);
+    vchOther.back() ^= 1;
+    EXPECT_FALSE(cache.Get(cache.EntryECDSA(sighash, vchOther, key.GetPubKey())));
+
+    // condition and fulfillment bytes cannot be shifted between the two
+    std::vector<unsigned char> a {1, 2, 3}, b {4, 5}, c {1, 2}, d {3, 4, 5};
+    EXPECT_NE(cache.EntryCryptoCondition(sighash, a, b), cache.EntryCryptoCondition(sighash, c, d));
+}
+
+TEST(SigCache, Salted) {
+    CSignatureCache cache1(1 << 20), cache2(1 << 20);
+    uint256 sighash = GetRandHash();
+    std::vector<unsigned char> cond {1, 2, 3}, ffill {4, 5, 6};
+    EXPECT_NE(cache1.EntryCryptoCondition(sighash, cond, ffill), cache2.EntryCryptoCondition(sighash, cond, ffill));
+}
+
+TEST(SigCache, BoundedSize) {
+    // two buckets of four entries
+    CSignatureCache cache(8 * 32);
+    std::vector<uint256> entries;
+    for (int i = 0; i < 100; i++) {
+        entries.push_back(GetRandHash());
+        cache.Set(entries.back());
+        EXPECT_TRUE(cache.Get(entries.back()));
+    }
+    int nFound = 0;
+    for (const uint256 &entry : entries)
+        nFound += cache.Get(entry);
+    EXPECT_LE(nFound, 8);
+}
+
+TEST(SigCache, Disabled) {
+    CSignatureCache cache(0);
+    uint256 entry = GetRandHash();
+    cache.Set(entry);
+    EXPECT_FALSE(cache.Get(entry));
+}
@@ -18,6 +18,7 @@
 #include "chainparams.h"
 #include "httpserver.h"
 #include "key_io.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -27,6 +28,7 @@
 #include "ui_interface.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/bind.hpp>
 
 // WWW-Authenticate to present with 401 Unauthorized response
 static const char *WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
@@ -102,6 +104,71 @@ static bool RPCAuthorized(const std::string& strAuth)
     return TimingResistantEqual(strUserPass, strRPCUserColonPass);
 }
 
+/** Sink of a streamed reply, the chunked reply is started with the first chunk */
+static void JSONRPCStreamChunk(HTTPRequest* req, bool* pfStarted, const std::string& strChunk)
+{
+    if (!*pfStarted) {
+        req->WriteHeader("Content-Type", "application/json");
+        req->StartReplyChunks(HTTP_OK);
+        *pfStarted = true;
+    }
+    req->WriteReplyChunk(strChunk);
+}
+
+/** Write the reply envelope around a streamed result.
+ * Replies that stay below one chunk are sent as a normal reply, and errors are
+ * thrown as long as nothing was sent. After that the open containers are closed
+ * and the envelope ends with the error, so the client still gets valid JSON.
+ * Returns false if the command is not streamed.
+ */
+static bool JSONRPCStreamReply(HTTPRequest* req, const std::string& strMethod, const UniValue& id,
+                               const boost::function<bool(CJSONStream&)>& streamer,
+                               size_t nFlushSize = CJSONStream::DEFAULT_FLUSH_SIZE)
+{
+    bool fStarted = false;
+    CJSONStream out(boost::bind(JSONRPCStreamChunk, req, &fStarted, _1), nFlushSize);
+
+    out.BeginObject();
+    out.Key("result");
+    UniValue objError;
+    try {
+        if (!streamer(out))
+            return false;
+    } catch (const UniValue& objErr) {
+        if (!fStarted)
+            throw;
+        objError = objErr;
+    } catch (const std::exception& e) {
+        if (!fStarted)
+            throw;
+        objError = JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+    if (!objError.isNull()) {
+        LogPrintf("JSON-RPC %s: error after reply started: %s\n", SanitizeString(strMethod), find_value(objError, "message").getValStr());
+        out.Unwind(1);
+    }
+    out.PushKV("error", objError);
+    out.PushKV("id", id);
+    out.EndObject();
+    out.Raw("\n");
+
+    if (fStarted) {
+        out.Flush();
+        req->EndReplyChunks();
+    } else {
+        req->WriteHeader("Content-Type", "application/json");
+        req->WriteReply(HTTP_OK, out.Buffer());
+    }
+    return true;
+}
+
+/** Reply to a singleton request with a command that streams its result */
+static bool HTTPReq_JSONRPCStream(HTTPRequest* req, const JSONRequest& jreq)
+{
+    return JSONRPCStreamReply(req, jreq.strMethod, jreq.id,
+        boost::bind(&CRPCTable::executeStream, &tableRPC, jreq.strMethod, jreq.params, _1));
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -151,6 +218,9 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
                 return false;
             }
 
+            if (HTTPReq_JSONRPCStream(req, jreq))
+                return true;
+
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
             // Send reply
@@ -536,12 +536,16 @@ void HTTPEvent::trigger(struct timeval* tv)
         evtimer_add(ev, tv); // trigger after timeval passed
 }
 HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
-                                                       replySent(false)
+                                                       replySent(false),
+                                                       chunksStarted(false)
 {
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (!replySent && chunksStarted) {
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndReplyChunks();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -606,6 +610,46 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+/** Send one chunk of a chunked reply from the main http thread. evhttp moves the
+ * data into the connection buffer, so the chunk buffer can be freed right away.
+ * If the client has gone away evhttp ignores the chunk.
+ */
+static void http_send_reply_chunk(struct evhttp_request* req, struct evbuffer* chunk)
+{
+    evhttp_send_reply_chunk(req, chunk);
+    evbuffer_free(chunk);
+}
+
+void HTTPRequest::StartReplyChunks(int nStatus)
+{
+    assert(!replySent && !chunksStarted && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(evhttp_send_reply_start, req, nStatus, (const char*)NULL));
+    ev->trigger(0);
+    chunksStarted = true;
+}
+
+void HTTPRequest::WriteReplyChunk(const std::string& strChunk)
+{
+    assert(!replySent && chunksStarted && req);
+    if (strChunk.empty())
+        return;
+    struct evbuffer* chunk = evbuffer_new();
+    assert(chunk);
+    evbuffer_add(chunk, strChunk.data(), strChunk.size());
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(http_send_reply_chunk, req, chunk));
+    ev->trigger(0);
+}
+
+void HTTPRequest::EndReplyChunks()
+{
+    assert(!replySent && chunksStarted && req);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true, boost::bind(evhttp_send_reply_end, req));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -63,6 +63,7 @@ private:
     // For test access
 protected:
     bool replySent;
+    bool chunksStarted;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -118,6 +119,21 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     virtual void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Start a reply with chunked transfer encoding, as an alternative to WriteReply.
+     * Send the body with WriteReplyChunk and finish it with EndReplyChunks.
+     *
+     * @note Chunks are queued to the main http thread, there is no backpressure
+     * when the client reads slower than they are produced.
+     */
+    virtual void StartReplyChunks(int nStatus);
+    virtual void WriteReplyChunk(const std::string& strChunk);
+    /**
+     * Finish a chunked reply. Like WriteReply this gives the request back to the
+     * main thread, do not call any other HTTPRequest methods after calling this.
+     */
+    virtual void EndReplyChunks();
 };
 
 /** Event handler closure.
@@ -45,6 +45,7 @@
 #include "net.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
+#include "script/sigcache.h"
 #include "script/standard.h"
 #include "scheduler.h"
 #include "txdb.h"
@@ -92,6 +93,7 @@ using namespace std;
 
 extern void ThreadSendAlert();
 extern bool komodo_dailysnapshot(int32_t height);
+extern void komodo_supplybackfill();
 extern int32_t KOMODO_LOADINGBLOCKS;
 extern bool VERUS_MINTBLOCKS;
 extern char ASSETCHAINS_SYMBOL[];
@@ -501,7 +503,7 @@ std::string HelpMessage(HelpMessageMode mode)
     {
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", 15));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", 0));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (default: %u)", 50000));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> entries (0 to %u, default: %u)", MAX_MAX_SIG_CACHE_SIZE, DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying (default: %s)"),
@@ -653,6 +655,8 @@ void CleanupBlockRevFiles()
     }
     path komodostate = GetDataDir() / "komodostate";
     remove(komodostate);
+    path komodostatesnap = GetDataDir() / "komodostate.snap";
+    remove(komodostatesnap);
     path minerids = GetDataDir() / "minerids";
     remove(minerids);
     // Remove all block files that aren't part of a contiguous set starting at
@@ -1147,6 +1151,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     nMaxTipAge = GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
+    // The signature cache table is allocated in full on first use
+    int64_t nMaxSigCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE);
+    if (nMaxSigCacheSize < 0 || nMaxSigCacheSize > MAX_MAX_SIG_CACHE_SIZE)
+        return InitError(strprintf(_("Invalid -maxsigcachesize=<n>: '%s' (must be 0 to %u entries)"), mapArgs["-maxsigcachesize"], MAX_MAX_SIG_CACHE_SIZE));
+
 #ifdef ENABLE_MINING
     if (mapArgs.count("-mineraddress")) {
         CTxDestination addr = DecodeDestination(mapArgs["-mineraddress"]);
@@ -1278,6 +1287,13 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
+#ifdef ENABLE_WALLET
+    // the same number of threads trial-decrypt Sapling outputs for the wallet
+    if (nScriptCheckThreads && !fDisableWallet) {
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadSaplingDecrypt);
+    }
+#endif
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1591,6 +1607,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
                 if (fReindex) {
                     boost::filesystem::remove(GetDataDir() / "komodostate");
+                    boost::filesystem::remove(GetDataDir() / "komodostate.snap");
                     boost::filesystem::remove(GetDataDir() / "signedmasks");
                     pblocktree->WriteReindexing(true);
                     //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
@@ -1614,6 +1631,14 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     break;
                 }
                 KOMODO_LOADINGBLOCKS = 0;
+                if (!pnotarisations->BuildIndexes()) {
+                    strLoadError = _("Error indexing notarisations database");
+                    break;
+                }
+                if (!BuildOracleSampleIndex()) {
+                    strLoadError = _("Error building oracle sample index");
+                    break;
+                }
                 // Check for changed -txindex state
                 if (fTxIndex != GetBoolArg("-txindex", true)) {
                     strLoadError = _("You need to rebuild the database using -reindex to change -txindex");
@@ -1910,6 +1935,8 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
             vImportFiles.push_back(strFile);
     }
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
+    // coin supply totals of blocks indexed by older versions
+    threadGroup.create_thread(boost::bind(&TraceThread<void (*)()>, "supply", &komodo_supplybackfill));
     if (chainActive.Tip() == NULL) {
         LogPrintf("Waiting for genesis block to be imported...\n");
         while (!fRequestShutdown && chainActive.Tip() == NULL)
@@ -36,6 +36,8 @@ uint256 NOTARIZED_HASH,NOTARIZED_DESTTXID;
 #include <ctype.h>
 #include "uthash.h"
 #include "utlist.h"
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
 
 int32_t gettxout_scriptPubKey(uint8_t *scriptPubkey,int32_t maxsize,uint256 txid,int32_t n);
 void komodo_event_rewind(struct komodo_state *sp,char *symbol,int32_t height);
@@ -352,9 +354,244 @@ int32_t komodo_parsestatefiledata(struct komodo_state *sp,uint8_t *filedata,long
     return(-1);
 }
 
+// komodostate.snap holds the komodo_state that replaying the first fpos bytes of komodostate produces, so startup maps
+// it and only replays the tail. komodostate keeps its record format and stays authoritative: a snapshot whose fpos is
+// past the end of the log or whose preceding bytes no longer hash the same is ignored and the whole log is replayed
+
+int32_t komodo_statesnap_enabled()
+{
+    // pax totals are rebuilt from komodostate opreturns and are not part of the snapshot
+    return(KOMODO_PAX == 0 && (ASSETCHAINS_SYMBOL[0] == 0 || komodo_baseid(ASSETCHAINS_SYMBOL) < 0));
+}
+
+void komodo_statesnap_fname(char *snapfname,char *fname)
+{
+    safecopy(snapfname,fname,512 - 5);
+    strcat(snapfname,".snap");
+}
+
+int32_t komodo_statesnap_tailhash(uint8_t hash[32],FILE *fp,long fpos)
+{
+    uint8_t buf[KOMODO_STATESNAP_TAILCHECK]; long n = (fpos < (long)sizeof(buf)) ? fpos : (long)sizeof(buf);
+    if ( fseek(fp,fpos - n,SEEK_SET) != 0 || (long)fread(buf,1,n,fp) != n )
+        return(-1);
+    vcalc_sha256(0,hash,buf,(int32_t)n);
+    return(0);
+}
+
+void komodo_statesnap_append(std::vector<uint8_t> &buf,const void *ptr,long len)
+{
+    buf.insert(buf.end(),(const uint8_t *)ptr,(const uint8_t *)ptr + len);
+}
+
+std::atomic<bool> KOMODO_STATESNAP_WRITING(false);
+
+// runs on its own thread with the serialized state, so neither the caller nor komodo_mutex waits on the disk
+void komodo_statesnap_write(std::vector<uint8_t> *bufp,std::string snapfname)
+{
+    std::string tmpfname = snapfname + ".tmp"; FILE *snapfp; int32_t n = -1;
+    if ( (snapfp= fopen(tmpfname.c_str(),"wb")) != 0 )
+    {
+        n = (fwrite(&(*bufp)[0],1,bufp->size(),snapfp) == bufp->size()) ? 0 : -1;
+        if ( fclose(snapfp) != 0 )
+            n = -1;
+    }
+    if ( n < 0 || RenameOver(tmpfname,snapfname) == false )
+    {
+        fprintf(stderr,"error writing %s\n",snapfname.c_str());
+        boost::filesystem::remove(tmpfname);
+    }
+    delete bufp;
+    KOMODO_STATESNAP_WRITING = false;
+}
+
+int32_t komodo_statesnap_save(struct komodo_state *sp,char *fname,FILE *fp)
+{
+    std::vector<uint8_t> *bufp; char snapfname[512]; uint8_t hash[32]; uint32_t magic = KOMODO_STATESNAP_MAGIC,version = KOMODO_STATESNAP_VERSION; int64_t fpos; int32_t i,n; uint16_t len; struct komodo_event *ep;
+    if ( KOMODO_STATESNAP_WRITING.exchange(true) )
+        return(-1); // the previous snapshot is still being written, the next interval catches up
+    fflush(fp);
+    fseek(fp,0,SEEK_END);
+    fpos = ftell(fp);
+    n = komodo_statesnap_tailhash(hash,fp,fpos);
+    fseek(fp,0,SEEK_END);
+    if ( n < 0 )
+    {
+        KOMODO_STATESNAP_WRITING = false;
+        return(-1);
+    }
+    bufp = new std::vector<uint8_t>();
+    std::vector<uint8_t> &buf = *bufp;
+    komodo_statesnap_append(buf,&magic,sizeof(magic));
+    komodo_statesnap_append(buf,&version,sizeof(version));
+    komodo_statesnap_append(buf,&fpos,sizeof(fpos));
+    komodo_statesnap_append(buf,hash,sizeof(hash));
+    portable_mutex_lock(&komodo_mutex);
+    {
+        boost::shared_lock<boost::shared_mutex> lock(komodo_npmutex);
+        komodo_statesnap_append(buf,&sp->NOTARIZED_HASH,sizeof(sp->NOTARIZED_HASH));
+        komodo_statesnap_append(buf,&sp->NOTARIZED_DESTTXID,sizeof(sp->NOTARIZED_DESTTXID));
+        komodo_statesnap_append(buf,&sp->MoM,sizeof(sp->MoM));
+        komodo_statesnap_append(buf,&sp->SAVEDHEIGHT,sizeof(sp->SAVEDHEIGHT));
+        komodo_statesnap_append(buf,&sp->CURRENT_HEIGHT,sizeof(sp->CURRENT_HEIGHT));
+        komodo_statesnap_append(buf,&sp->NOTARIZED_HEIGHT,sizeof(sp->NOTARIZED_HEIGHT));
+        komodo_statesnap_append(buf,&sp->MoMdepth,sizeof(sp->MoMdepth));
+        komodo_statesnap_append(buf,&sp->SAVEDTIMESTAMP,sizeof(sp->SAVEDTIMESTAMP));
+        komodo_statesnap_append(buf,&sp->prevMoMheight,sizeof(sp->prevMoMheight));
+        komodo_statesnap_append(buf,&sp->NUM_NPOINTS,sizeof(sp->NUM_NPOINTS));
+        komodo_statesnap_append(buf,sp->NPOINTS,(long)sp->NUM_NPOINTS * sizeof(*sp->NPOINTS));
+    }
+    n = (int32_t)KOMODO_RATIFIED.size();
+    komodo_statesnap_append(buf,&n,sizeof(n));
+    for (i=0; i<n; i++)
+    {
+        komodo_statesnap_append(buf,&KOMODO_RATIFIED[i].first,sizeof(KOMODO_RATIFIED[i].first));
+        komodo_statesnap_append(buf,&KOMODO_RATIFIED[i].second.num,sizeof(KOMODO_RATIFIED[i].second.num));
+        komodo_statesnap_append(buf,KOMODO_RATIFIED[i].second.pubkeys,33 * KOMODO_RATIFIED[i].second.num);
+    }
+    komodo_statesnap_append(buf,&NUM_PRICES,sizeof(NUM_PRICES));
+    komodo_statesnap_append(buf,PVALS,(long)NUM_PRICES * sizeof(*PVALS) * 36);
+    komodo_statesnap_append(buf,&sp->Komodo_numevents,sizeof(sp->Komodo_numevents));
+    for (i=0; i<sp->Komodo_numevents; i++)
+    {
+        ep = sp->Komodo_events[i];
+        len = (uint16_t)(ep->len - sizeof(*ep));
+        komodo_statesnap_append(buf,&ep->height,sizeof(ep->height));
+        komodo_statesnap_append(buf,&ep->type,sizeof(ep->type));
+        komodo_statesnap_append(buf,ep->symbol,sizeof(ep->symbol));
+        komodo_statesnap_append(buf,&len,sizeof(len));
+        komodo_statesnap_append(buf,ep->space,len);
+    }
+    portable_mutex_unlock(&komodo_mutex);
+    komodo_statesnap_fname(snapfname,fname);
+    boost::thread(boost::bind(&komodo_statesnap_write,bufp,std::string(snapfname))).detach();
+    return(0);
+}
+
+long komodo_statesnap_load(struct komodo_state *sp,char *fname,FILE *fp)
+{
+    char snapfname[512],symbol[KOMODO_ASSETCHAIN_MAXLEN]; uint8_t *data,hash[32],loghash[32]; long datalen,logsize,fpos = 0,npos,rpos,ppos,epos; int64_t snappos; uint32_t magic,version; int32_t i,numnpoints,numratified,numprices,numevents,height; uint8_t num,type; uint16_t len; struct notarized_checkpoint *np; struct komodo_event_pubkeys P; struct komodo_state S;
+    komodo_statesnap_fname(snapfname,fname);
+    if ( boost::filesystem::exists(snapfname) == false )
+        return(-1);
+    try
+    {
+        boost::interprocess::file_mapping mapping(snapfname,boost::interprocess::read_only);
+        boost::interprocess::mapped_region region(mapping,boost::interprocess::read_only);
+        data = (uint8_t *)region.get_address();
+        datalen = (long)region.get_size();
+        if ( memread(&magic,sizeof(magic),data,&fpos,datalen) < 0 || memread(&version,sizeof(version),data,&fpos,datalen) < 0 || magic != KOMODO_STATESNAP_MAGIC || version != KOMODO_STATESNAP_VERSION )
+            return(-1);
+        if ( memread(&snappos,sizeof(snappos),data,&fpos,datalen) < 0 || memread(hash,sizeof(hash),data,&fpos,datalen) < 0 )
+            return(-1);
+        fseek(fp,0,SEEK_END);
+        logsize = ftell(fp);
+        if ( snappos < 0 || snappos > logsize || komodo_statesnap_tailhash(loghash,fp,snappos) < 0 || memcmp(hash,loghash,sizeof(hash)) != 0 )
+        {
+            fprintf(stderr,"%s does not match %s, replaying it\n",snapfname,fname);
+            return(-1);
+        }
+        // check every section fits before touching sp, a truncated snapshot falls back to the full replay
+        if ( memread(&S.NOTARIZED_HASH,sizeof(S.NOTARIZED_HASH),data,&fpos,datalen) < 0 || memread(&S.NOTARIZED_DESTTXID,sizeof(S.NOTARIZED_DESTTXID),data,&fpos,datalen) < 0 || memread(&S.MoM,sizeof(S.MoM),data,&fpos,datalen) < 0 || memread(&S.SAVEDHEIGHT,sizeof(S.SAVEDHEIGHT),data,&fpos,datalen) < 0 || memread(&S.CURRENT_HEIGHT,sizeof(S.CURRENT_HEIGHT),data,&fpos,datalen) < 0 || memread(&S.NOTARIZED_HEIGHT,sizeof(S.NOTARIZED_HEIGHT),data,&fpos,datalen) < 0 || memread(&S.MoMdepth,sizeof(S.MoMdepth),data,&fpos,datalen) < 0 || memread(&S.SAVEDTIMESTAMP,sizeof(S.SAVEDTIMESTAMP),data,&fpos,datalen) < 0 || memread(&S.prevMoMheight,sizeof(S.prevMoMheight),data,&fpos,datalen) < 0 )
+            return(-1);
+        if ( memread(&numnpoints,sizeof(numnpoints),data,&fpos,datalen) < 0 || numnpoints < 0 || (datalen - fpos) / (long)sizeof(*np) < numnpoints )
+            return(-1);
+        npos = fpos, fpos += (long)numnpoints * sizeof(*np);
+        if ( memread(&numratified,sizeof(numratified),data,&fpos,datalen) < 0 || numratified < 0 )
+            return(-1);
+        rpos = fpos;
+        for (i=0; i<numratified; i++)
+            if ( memread(&height,sizeof(height),data,&fpos,datalen) < 0 || memread(&num,sizeof(num),data,&fpos,datalen) < 0 || num > 64 || (fpos += 33 * num) > datalen )
+                return(-1);
+        if ( memread(&numprices,sizeof(numprices),data,&fpos,datalen) < 0 || numprices < 0 || (datalen - fpos) / (long)(sizeof(*PVALS) * 36) < numprices )
+            return(-1);
+        ppos = fpos, fpos += (long)numprices * sizeof(*PVALS) * 36;
+        if ( memread(&numevents,sizeof(numevents),data,&fpos,datalen) < 0 || numevents < 0 )
+            return(-1);
+        epos = fpos;
+        for (i=0; i<numevents; i++)
+            if ( (fpos += sizeof(height) + sizeof(type) + KOMODO_ASSETCHAIN_MAXLEN) > datalen || memread(&len,sizeof(len),data,&fpos,datalen) < 0 || (fpos += len) > datalen )
+                return(-1);
+        portable_mutex_lock(&komodo_mutex);
+        {
+            boost::unique_lock<boost::shared_mutex> lock(komodo_npmutex);
+            sp->NOTARIZED_HASH = S.NOTARIZED_HASH;
+            sp->NOTARIZED_DESTTXID = S.NOTARIZED_DESTTXID;
+            sp->MoM = S.MoM;
+            sp->SAVEDHEIGHT = S.SAVEDHEIGHT;
+            sp->CURRENT_HEIGHT = S.CURRENT_HEIGHT;
+            sp->NOTARIZED_HEIGHT = S.NOTARIZED_HEIGHT;
+            sp->MoMdepth = S.MoMdepth;
+            sp->SAVEDTIMESTAMP = S.SAVEDTIMESTAMP;
+            sp->prevMoMheight = S.prevMoMheight;
+            if ( numnpoints > 0 )
+            {
+                sp->NPOINTS = (struct notarized_checkpoint *)realloc(sp->NPOINTS,numnpoints * sizeof(*sp->NPOINTS));
+                memcpy(sp->NPOINTS,&data[npos],numnpoints * sizeof(*sp->NPOINTS));
+            }
+            sp->NUM_NPOINTS = numnpoints;
+            sp->NPCOVER.clear();
+            sp->NPMAXHT.clear();
+            for (i=0; i<numnpoints; i++)
+            {
+                np = &sp->NPOINTS[i];
+                if ( np->MoMdepth != 0 )
+                    komodo_npcover_add(sp,np->notarized_height - (np->MoMdepth & 0xffff) + 1,np->notarized_height,i);
+                sp->NPMAXHT.push_back(sp->NPMAXHT.empty() ? np->nHeight : std::max(sp->NPMAXHT.back(),np->nHeight));
+            }
+        }
+        if ( numprices > 0 )
+        {
+            PVALS = (uint32_t *)realloc(PVALS,numprices * sizeof(*PVALS) * 36);
+            memcpy(PVALS,&data[ppos],numprices * sizeof(*PVALS) * 36);
+        }
+        NUM_PRICES = numprices;
+        portable_mutex_unlock(&komodo_mutex);
+        for (fpos=rpos,i=0; i<numratified; i++)
+        {
+            memset(&P,0,sizeof(P));
+            memread(&height,sizeof(height),data,&fpos,datalen);
+            memread(&P.num,sizeof(P.num),data,&fpos,datalen);
+            memread(P.pubkeys,33 * P.num,data,&fpos,datalen);
+            portable_mutex_lock(&komodo_mutex);
+            KOMODO_RATIFIED.push_back(std::make_pair(height,P));
+            portable_mutex_unlock(&komodo_mutex);
+            komodo_notarysinit(height,P.pubkeys,P.num);
+        }
+        for (fpos=epos,i=0; i<numevents; i++)
+        {
+            memread(&height,sizeof(height),data,&fpos,datalen);
+            memread(&type,sizeof(type),data,&fpos,datalen);
+            memread(symbol,sizeof(symbol),data,&fpos,datalen);
+            symbol[sizeof(symbol) - 1] = 0;
+            memread(&len,sizeof(len),data,&fpos,datalen);
+            komodo_eventadd(sp,height,symbol,type,&data[fpos],len);
+            fpos += len;
+        }
+        fprintf(stderr,"loaded %s: %d notarizations, %d notary sets, %d prices, %d events, replaying %ldKB of %s\n",snapfname,numnpoints,numratified,numprices,numevents,(logsize - (long)snappos)/1024,fname);
+    }
+    catch (const boost::interprocess::interprocess_exception &e)
+    {
+        fprintf(stderr,"error mapping %s: %s\n",snapfname,e.what());
+        return(-1);
+    }
+    return((long)snappos);
+}
+
+void komodo_statesnap_check(struct komodo_state *sp,FILE *fp,long *lastsnapposp)
+{
+    char fname[512]; long fpos;
+    if ( komodo_statesnap_enabled() != 0 && (fpos= ftell(fp)) >= *lastsnapposp + KOMODO_STATESNAP_INTERVAL )
+    {
+        komodo_statefname(fname,ASSETCHAINS_SYMBOL,(char *)"komodostate");
+        komodo_statesnap_save(sp,fname,fp);
+        *lastsnapposp = fpos;
+    }
+}
+
 void komodo_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnotaries,uint8_t notaryid,uint256 txhash,uint64_t voutmask,uint8_t numvouts,uint32_t *pvals,uint8_t numpvals,int32_t KMDheight,uint32_t KMDtimestamp,uint64_t opretvalue,uint8_t *opretbuf,uint16_t opretlen,uint16_t vout,uint256 MoM,int32_t MoMdepth)
 {
-    static FILE *fp; static int32_t errs,didinit; static uint256 zero;
+    static FILE *fp; static long lastsnappos; static int32_t errs,didinit; static uint256 zero;
     struct komodo_state *sp; char fname[512],symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t retval,ht,func; uint8_t num,pubkeys[64][33];
     if ( didinit == 0 )
     {
@@ -374,14 +611,23 @@ void komodo_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnotar
         komodo_statefname(fname,ASSETCHAINS_SYMBOL,(char *)"komodostate");
         if ( (fp= fopen(fname,"rb+")) != 0 )
         {
-            if ( (retval= komodo_faststateinit(sp,fname,symbol,dest)) > 0 )
-                fseek(fp,0,SEEK_END);
-            else
+            if ( komodo_statesnap_enabled() != 0 && (lastsnappos= komodo_statesnap_load(sp,fname,fp)) >= 0 )
+            {
+                fseek(fp,lastsnappos,SEEK_SET);
+                while ( komodo_parsestatefile(sp,fp,symbol,dest) >= 0 )
+                    ;
+            }
+            else if ( (retval= komodo_faststateinit(sp,fname,symbol,dest)) <= 0 )
             {
                 fprintf(stderr,"komodo_faststateinit retval.%d\n",retval);
+                fseek(fp,0,SEEK_SET);
                 while ( komodo_parsestatefile(sp,fp,symbol,dest) >= 0 )
                     ;
             }
+            fseek(fp,0,SEEK_END);
+            if ( lastsnappos < 0 )
+                lastsnappos = 0;
+            komodo_statesnap_check(sp,fp,&lastsnappos);
         } else fp = fopen(fname,"wb+");
         KOMODO_INITDONE = (uint32_t)time(NULL);
     }
@@ -506,6 +752,7 @@ void komodo_stateupdate(int32_t height,uint8_t notarypubs[][33],uint8_t numnotar
             }
         }
         fflush(fp);
+        komodo_statesnap_check(sp,fp,&lastsnappos);
     }
 }
 
@@ -789,17 +1036,12 @@ int32_t komodo_voutupdate(bool fJustCheck,int32_t *isratificationp,int32_t notar
 
 int32_t gettxout_scriptPubKey(uint8_t *scriptPubKey,int32_t maxsize,uint256 txid,int32_t n);
 
-int32_t komodo_notarycmp(uint8_t *scriptPubKey,int32_t scriptlen,uint8_t pubkeys[64][33],int32_t numnotaries,uint8_t rmd160[20])
+int32_t komodo_notarycmp(uint8_t *scriptPubKey,int32_t scriptlen,const struct komodo_notaryset *notaries,uint8_t rmd160[20])
 {
-    int32_t i;
     if ( scriptlen == 25 && memcmp(&scriptPubKey[3],rmd160,20) == 0 )
         return(0);
     else if ( scriptlen == 35 )
-    {
-        for (i=0; i<numnotaries; i++)
-            if ( memcmp(&scriptPubKey[1],pubkeys[i],33) == 0 )
-                return(i);
-    }
+        return(komodo_notarysetid(notaries,&scriptPubKey[1]));
     return(-1);
 }
 
@@ -811,6 +1053,7 @@ int32_t komodo_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block)
     std::vector<int32_t> notarisations;
     uint64_t signedmask,voutmask; char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
     uint8_t scriptbuf[10001],pubkeys[64][33],rmd160[20],scriptPubKey[35]; uint256 zero,btctxid,txhash;
+    const struct komodo_notaryset *notaries; std::unique_ptr<struct komodo_notaryset> ratified;
     int32_t i,j,k,numnotaries,notarized,scriptlen,isratification,nid,numvalid,specialtx,notarizedheight,notaryid,len,numvouts,numvins,height,txn_count;
     if ( pindex == 0 )
     {
@@ -839,8 +1082,9 @@ int32_t komodo_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block)
             lastStakedEra = staked_era;
         }
     }
-    numnotaries = komodo_notaries(pubkeys,pindex->GetHeight(),pindex->GetBlockTime());
-    calc_rmd160_sha256(rmd160,pubkeys[0],33);
+    notaries = komodo_notarysetget(pindex->GetHeight(),pindex->GetBlockTime());
+    numnotaries = notaries->numnotaries;
+    memcpy(rmd160,notaries->rmd160s[0],20);
     if ( pindex->GetHeight() > hwmheight )
         hwmheight = pindex->GetHeight();
     else
@@ -884,7 +1128,7 @@ int32_t komodo_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block)
                     continue;
                 if ( (scriptlen= gettxout_scriptPubKey(scriptPubKey,sizeof(scriptPubKey),block.vtx[i].vin[j].prevout.hash,block.vtx[i].vin[j].prevout.n)) > 0 )
                 {
-                    if ( (k= komodo_notarycmp(scriptPubKey,scriptlen,pubkeys,numnotaries,rmd160)) >= 0 )
+                    if ( (k= komodo_notarycmp(scriptPubKey,scriptlen,notaries,rmd160)) >= 0 )
                         signedmask |= (1LL << k);
                     else if ( 0 && numvins >= 17 )
                     {
@@ -998,6 +1242,9 @@ int32_t komodo_connectblock(bool fJustCheck, CBlockIndex *pindex,CBlock& block)
                             }
                         }
                     }
+                    // later txs in this block are still matched against the first numnotaries of the ratified list
+                    ratified.reset(komodo_notaryset_create(pubkeys,numnotaries));
+                    notaries = ratified.get();
                     if ( ASSETCHAINS_SYMBOL[0] != 0 || height < 100000 )
                     {
                         if ( ((signedmask & 1) != 0 && numvalid >= KOMODO_MINRATIFY) || bitweight(signedmask) > (numnotaries/3) )
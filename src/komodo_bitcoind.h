@@ -22,9 +22,12 @@
 #include "komodo_defs.h"
 #include "script/standard.h"
 #include "cc/CCinclude.h"
+#include "crypto/sha256.h"
 
 int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestamp);
 int32_t komodo_electednotary(int32_t *numnotariesp,uint8_t *pubkey33,int32_t height,uint32_t timestamp);
+const struct komodo_notaryset *komodo_notarysetget(int32_t height,uint32_t timestamp);
+int32_t komodo_notarysetid(const struct komodo_notaryset *set,uint8_t *pubkey33);
 int32_t komodo_voutupdate(bool fJustCheck,int32_t *isratificationp,int32_t notaryid,uint8_t *scriptbuf,int32_t scriptlen,int32_t height,uint256 txhash,int32_t i,int32_t j,uint64_t *voutmaskp,int32_t *specialtxp,int32_t *notarizedheightp,uint64_t value,int32_t notarized,uint64_t signedmask,uint32_t timestamp);
 unsigned int lwmaGetNextPOSRequired(const CBlockIndex* pindexLast, const Consensus::Params& params);
 bool EnsureWalletIsAvailable(bool avoidException);
@@ -835,6 +838,29 @@ int32_t komodo_blockload(CBlock& block,CBlockIndex *pindex)
     return(0);
 }
 
+// computed once per block at ConnectBlock, or on first use for indexes written before MINERPUBKEY_VERSION, caller holds cs_main
+void komodo_setminerpubkey(CBlockIndex *pindex,CBlock *pblock)
+{
+    komodo_block2pubkey33(pindex->pubkey33,pblock);
+    pindex->nStatus |= BLOCK_HAVE_MINERPUBKEY;
+    setDirtyBlockIndex.insert(pindex);
+}
+
+int32_t komodo_pindex_pubkey33(uint8_t *pubkey33,CBlockIndex *pindex)
+{
+    CBlock block;
+    if ( (pindex->nStatus & BLOCK_HAVE_MINERPUBKEY) == 0 )
+    {
+        if ( komodo_blockload(block,pindex) != 0 )
+            return(-1);
+        LOCK(cs_main); // the miner calls in here without cs_main, setDirtyBlockIndex is only touched under it
+        if ( (pindex->nStatus & BLOCK_HAVE_MINERPUBKEY) == 0 )
+            komodo_setminerpubkey(pindex,&block);
+    }
+    memcpy(pubkey33,pindex->pubkey33,33);
+    return(0);
+}
+
 uint32_t komodo_chainactive_timestamp()
 {
     if ( chainActive.LastTip() != 0 )
@@ -906,13 +932,9 @@ uint32_t komodo_heightstamp(int32_t height)
 
 void komodo_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height)
 {
-    int32_t num,i; CBlock block;
     memset(pubkey33,0,33);
-    if ( pindex != 0 )
-    {
-        if ( komodo_blockload(block,pindex) == 0 )
-            komodo_block2pubkey33(pubkey33,&block);
-    }
+    if ( pindex != 0 && komodo_pindex_pubkey33(pubkey33,pindex) < 0 )
+        memset(pubkey33,0,33);
 }
 
 /*int8_t komodo_minerid(int32_t height,uint8_t *destpubkey33)
@@ -945,25 +967,20 @@ void komodo_index2pubkey33(uint8_t *pubkey33,CBlockIndex *pindex,int32_t height)
 
 int32_t komodo_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t blocktimes[66],int32_t *nonzpkeysp,int32_t height)
 {
-    int32_t i,j,n,duplicate; CBlock block; CBlockIndex *pindex; uint8_t notarypubs33[64][33];
+    int32_t i,j,duplicate; CBlockIndex *pindex = 0; const struct komodo_notaryset *notaries;
     memset(mids,-1,sizeof(*mids)*66);
-    n = komodo_notaries(notarypubs33,height,0);
+    notaries = komodo_notarysetget(height,0);
     for (i=duplicate=0; i<66; i++)
     {
-        if ( (pindex= komodo_chainactive(height-i)) != 0 )
+        if ( (pindex= (pindex != 0) ? pindex->pprev : komodo_chainactive(height-i)) != 0 )
         {
             blocktimes[i] = pindex->nTime;
-            if ( komodo_blockload(block,pindex) == 0 )
+            if ( komodo_pindex_pubkey33(pubkeys[i],pindex) == 0 )
             {
-                komodo_block2pubkey33(pubkeys[i],&block);
-                for (j=0; j<n; j++)
+                if ( (j= komodo_notarysetid(notaries,pubkeys[i])) >= 0 )
                 {
-                    if ( memcmp(notarypubs33[j],pubkeys[i],33) == 0 )
-                    {
-                        mids[i] = j;
-                        (*nonzpkeysp)++;
-                        break;
-                    }
+                    mids[i] = j;
+                    (*nonzpkeysp)++;
                 }
             } else fprintf(stderr,"couldnt load block.%d\n",height);
             if ( mids[0] >= 0 && i > 0 && mids[i] == mids[0] )
@@ -977,27 +994,19 @@ int32_t komodo_eligiblenotary(uint8_t pubkeys[66][33],int32_t *mids,uint32_t blo
 
 int32_t komodo_minerids(uint8_t *minerids,int32_t height,int32_t width)
 {
-    int32_t i,j,nonz,numnotaries; CBlock block; CBlockIndex *pindex; uint8_t notarypubs33[64][33],pubkey33[33];
-    numnotaries = komodo_notaries(notarypubs33,height,0);
+    int32_t i,j,nonz; CBlockIndex *pindex; const struct komodo_notaryset *notaries; uint8_t pubkey33[33];
+    notaries = komodo_notarysetget(height,0);
     for (i=nonz=0; i<width; i++)
     {
         if ( height-i <= 0 )
             continue;
         if ( (pindex= komodo_chainactive(height-width+i+1)) != 0 )
         {
-            if ( komodo_blockload(block,pindex) == 0 )
+            if ( komodo_pindex_pubkey33(pubkey33,pindex) == 0 )
             {
-                komodo_block2pubkey33(pubkey33,&block);
-                for (j=0; j<numnotaries; j++)
-                {
-                    if ( memcmp(notarypubs33[j],pubkey33,33) == 0 )
-                    {
-                        minerids[nonz++] = j;
-                        break;
-                    }
-                }
-                if ( j == numnotaries )
-                    minerids[nonz++] = j;
+                if ( (j= komodo_notarysetid(notaries,pubkey33)) < 0 )
+                    j = notaries->numnotaries;
+                minerids[nonz++] = j;
             } else fprintf(stderr,"couldnt load block.%d\n",height);
         }
     }
@@ -1293,43 +1302,74 @@ uint32_t komodo_segid32(char *coinaddr)
     return(addrhash.uints[0]);
 }
 
+// segid of the address a PoS block stakes from, -1 if the block does not have the shape of a PoS block
+int8_t komodo_stakesegid(const CBlock *pblock)
+{
+    CTxDestination voutaddress; uint64_t value; uint32_t txtime; char voutaddr[64],destaddr[64]; int32_t txn_count,vout; uint256 txid; CScript opret; int8_t segid = -1;
+    txn_count = pblock->vtx.size();
+    if ( txn_count > 1 && pblock->vtx[txn_count-1].vin.size() == 1 && pblock->vtx[txn_count-1].vout.size() == 1 )
+    {
+        txid = pblock->vtx[txn_count-1].vin[0].prevout.hash;
+        vout = pblock->vtx[txn_count-1].vin[0].prevout.n;
+        txtime = komodo_txtime(opret,&value,txid,vout,destaddr);
+        if ( ExtractDestination(pblock->vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
+        {
+            strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
+            if ( strcmp(destaddr,voutaddr) == 0 && pblock->vtx[txn_count-1].vout[0].nValue == value )
+                segid = komodo_segid32(voutaddr) & 0x3f;
+        } else fprintf(stderr,"komodo_stakesegid couldnt extract voutaddress\n");
+    }
+    return(segid);
+}
+
+// computed once per block at ConnectBlock, or on first use for indexes written before STAKESEGID_VERSION, caller holds cs_main
+void komodo_setstakesegid(CBlockIndex *pindex,const CBlock *pblock)
+{
+    pindex->stakesegid = komodo_stakesegid(pblock);
+    setDirtyBlockIndex.insert(pindex);
+}
+
 int8_t komodo_segid(int32_t nocache,int32_t height)
 {
-    CTxDestination voutaddress; CBlock block; CBlockIndex *pindex; uint64_t value; uint32_t txtime; char voutaddr[64],destaddr[64]; int32_t txn_count,vout; uint256 txid; CScript opret; int8_t segid = -1;
+    CBlock block; CBlockIndex *pindex; int8_t segid = -1;
     if ( height > 0 && (pindex= komodo_chainactive(height)) != 0 )
     {
         if ( nocache == 0 && pindex->segid >= -1 )
             return(pindex->segid);
-        if ( komodo_blockload(block,pindex) == 0 )
+        if ( pindex->stakesegid < -1 && komodo_blockload(block,pindex) != 0 )
+            return(segid);
+        LOCK(cs_main); // the staker calls in here without cs_main, setDirtyBlockIndex is only touched under it
+        if ( pindex->stakesegid < -1 )
+            komodo_setstakesegid(pindex,&block);
+        if ( pindex->stakesegid >= 0 )
         {
-            txn_count = block.vtx.size();
-            if ( txn_count > 1 && block.vtx[txn_count-1].vin.size() == 1 && block.vtx[txn_count-1].vout.size() == 1 )
-            {
-                txid = block.vtx[txn_count-1].vin[0].prevout.hash;
-                vout = block.vtx[txn_count-1].vin[0].prevout.n;
-                txtime = komodo_txtime(opret,&value,txid,vout,destaddr);
-                if ( ExtractDestination(block.vtx[txn_count-1].vout[0].scriptPubKey,voutaddress) )
-                {
-                    strcpy(voutaddr,CBitcoinAddress(voutaddress).ToString().c_str());
-                    if ( strcmp(destaddr,voutaddr) == 0 && block.vtx[txn_count-1].vout[0].nValue == value )
-                    {
-                        segid = komodo_segid32(voutaddr) & 0x3f;
-                        pindex->segid = segid;
-                        //fprintf(stderr,"komodo_segid.(%d) -> %d\n",height,pindex->segid);
-                    }
-                } else fprintf(stderr,"komodo_segid ht.%d couldnt extract voutaddress\n",height);
-            }
+            segid = pindex->stakesegid;
+            pindex->segid = segid;
+            //fprintf(stderr,"komodo_segid.(%d) -> %d\n",height,pindex->segid);
         }
     }
     return(segid);
 }
 
+// the cached window is guarded by cs_main rather than a mutex of its own, komodo_segid may need cs_main for a lazy
+// stakesegid upgrade and validation already holds it when it gets here, so any inner lock would invert that order
 void komodo_segids(uint8_t *hashbuf,int32_t height,int32_t n)
 {
-    static uint8_t prevhashbuf[100]; static int32_t prevheight;
-    int32_t i;
-    if ( height == prevheight && n == 100 )
+    static uint8_t prevhashbuf[100]; static int32_t prevheight; static CBlockIndex *prevlast;
+    CBlockIndex *last; int32_t i;
+    LOCK(cs_main);
+    last = (n == 100) ? komodo_chainactive(height+n-1) : 0;
+    if ( last != 0 && last == prevlast && height == prevheight )
+        memcpy(hashbuf,prevhashbuf,100);
+    else if ( last != 0 && prevlast != 0 && last->pprev == prevlast && height == prevheight+1 )
+    {
+        // the window moved up by one block, only the newest entry is new
+        memmove(prevhashbuf,&prevhashbuf[1],99);
+        prevhashbuf[99] = (uint8_t)komodo_segid(1,height+99);
         memcpy(hashbuf,prevhashbuf,100);
+        prevheight = height;
+        prevlast = last;
+    }
     else
     {
         memset(hashbuf,0xff,n);
@@ -1342,15 +1382,14 @@ void komodo_segids(uint8_t *hashbuf,int32_t height,int32_t n)
         {
             memcpy(prevhashbuf,hashbuf,100);
             prevheight = height;
+            prevlast = last;
             //fprintf(stderr,"prevsegids.%d\n",height+n);
         }
     }
 }
 
-uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout)
+uint32_t komodo_stakehash2(uint256 *hashp,bits256 addrhash,uint8_t *hashbuf,uint256 txid,int32_t vout)
 {
-    bits256 addrhash;
-    vcalc_sha256(0,(uint8_t *)&addrhash,(uint8_t *)address,(int32_t)strlen(address));
     memcpy(&hashbuf[100],&addrhash,sizeof(addrhash));
     memcpy(&hashbuf[100+sizeof(addrhash)],&txid,sizeof(txid));
     memcpy(&hashbuf[100+sizeof(addrhash)+sizeof(txid)],&vout,sizeof(vout));
@@ -1358,43 +1397,102 @@ uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256
     return(addrhash.uints[0]);
 }
 
+uint32_t komodo_stakehash(uint256 *hashp,char *address,uint8_t *hashbuf,uint256 txid,int32_t vout)
+{
+    bits256 addrhash;
+    vcalc_sha256(0,(uint8_t *)&addrhash,(uint8_t *)address,(int32_t)strlen(address));
+    return(komodo_stakehash2(hashp,addrhash,hashbuf,txid,vout));
+}
+
+// trailing 100 block window of komodo_PoWtarget, keyed on the last block of the window so that moving the tip by one
+// block in either direction only touches the entry leaving and the entry entering the window
+struct komodo_powwindow { CBlockIndex *last; int32_t height,n,m; int8_t ispos[100]; arith_uint256 hashes[100],sum; };
+
+void komodo_powwindow_update(struct komodo_powwindow *wp,int32_t ht,int32_t addflag)
+{
+    CBlockIndex *pindex; int32_t slot;
+    if ( ht <= 1 )
+        return;
+    slot = ht % 100;
+    if ( addflag != 0 )
+    {
+        if ( (pindex= komodo_chainactive(ht)) == 0 )
+            wp->ispos[slot] = -1;
+        else if ( komodo_segid(0,ht) >= 0 )
+        {
+            wp->ispos[slot] = 1;
+            wp->n++;
+        }
+        else
+        {
+            wp->ispos[slot] = 0;
+            wp->hashes[slot] = UintToArith256(pindex->GetBlockHash());
+            wp->sum += wp->hashes[slot];
+            wp->m++;
+        }
+    }
+    else
+    {
+        if ( wp->ispos[slot] > 0 )
+            wp->n--;
+        else if ( wp->ispos[slot] == 0 )
+        {
+            wp->sum -= wp->hashes[slot];
+            wp->m--;
+        }
+        wp->ispos[slot] = -1;
+    }
+}
+
+// W is guarded by cs_main, like the komodo_segids window: komodo_segid can take cs_main and the miner calls in here without it
+void komodo_powwindow(int32_t *np,int32_t *mp,arith_uint256 *sump,int32_t height)
+{
+    static struct komodo_powwindow W;
+    CBlockIndex *last; int32_t i;
+    LOCK(cs_main);
+    last = komodo_chainactive(height-1);
+    if ( last == 0 || last != W.last || height != W.height )
+    {
+        if ( last != 0 && W.last != 0 && last->pprev == W.last && height == W.height+1 )
+        {
+            komodo_powwindow_update(&W,height-101,0);
+            komodo_powwindow_update(&W,height-1,1);
+        }
+        else if ( last != 0 && W.last != 0 && W.last->pprev == last && height == W.height-1 )
+        {
+            komodo_powwindow_update(&W,height,0);
+            komodo_powwindow_update(&W,height-100,1);
+        }
+        else
+        {
+            memset(W.ispos,0xff,sizeof(W.ispos));
+            W.n = W.m = 0;
+            W.sum = arith_uint256(0);
+            for (i=0; i<100; i++)
+                komodo_powwindow_update(&W,height - 100 + i,1);
+        }
+        W.last = last;
+        W.height = height;
+    }
+    *np = W.n;
+    *mp = W.m;
+    *sump = W.sum;
+}
+
 arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t height,int32_t goalperc)
 {
     int32_t oldflag = 0,dispflag = 0;
-    CBlockIndex *pindex; arith_uint256 easydiff,bnTarget,hashval,sum,ave; bool fNegative,fOverflow; int32_t i,n,m,ht,percPoS,diff,val;
+    arith_uint256 easydiff,bnTarget,hashval,sum,ave; bool fNegative,fOverflow; int32_t i,n,m,percPoS,diff,val;
     *percPoSp = percPoS = 0;
     
     if ( height <= 10 || (ASSETCHAINS_STAKED == 100 && height <= 100) ) 
         return(target);
         
-    sum = arith_uint256(0);
-    ave = sum;
     easydiff.SetCompact(STAKING_MIN_DIFF,&fNegative,&fOverflow);
-    for (i=n=m=0; i<100; i++)
-    {
-        ht = height - 100 + i;
-        if ( ht <= 1 )
-            continue;
-        if ( (pindex= komodo_chainactive(ht)) != 0 )
-        {
-            if ( komodo_segid(0,ht) >= 0 )
-            {
-                n++;
-                percPoS++;
-                if ( dispflag != 0 && ASSETCHAINS_STAKED < 100 )
-                    fprintf(stderr,"0");
-            }
-            else
-            {
-                if ( dispflag != 0 && ASSETCHAINS_STAKED < 100 )
-                    fprintf(stderr,"1");
-                sum += UintToArith256(pindex->GetBlockHash());
-                m++;
-            }
-        } //else fprintf(stderr, "pindex returned null ht.%i\n",ht);
-        if ( dispflag != 0 && ASSETCHAINS_STAKED < 100 && (i % 10) == 9 )
-            fprintf(stderr," %d, ",percPoS);
-    }
+    komodo_powwindow(&n,&m,&sum,height);
+    percPoS = n;
+    if ( dispflag != 0 && ASSETCHAINS_STAKED < 100 )
+        fprintf(stderr,"PoS %d PoW %d ",n,m);
     if ( m+n < 100 )
     {
         // We do actual PoS % at the start. Requires coin distribution in first 10 blocks! 
@@ -1470,34 +1568,10 @@ arith_uint256 komodo_PoWtarget(int32_t *percPoSp,arith_uint256 target,int32_t he
     return(bnTarget);
 }
 
-uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc)
+// the consensus part of komodo_stake, once the utxo's value (in whole coins), txtime and stake hash are known
+uint32_t komodo_stakeloop(int32_t validateflag,arith_uint256 bnTarget,arith_uint256 ratio,int32_t nHeight,int32_t minage,uint256 hash,int32_t segid,uint64_t value,uint32_t txtime,uint32_t blocktime,uint32_t prevtime,int32_t PoSperc)
 {
-    bool fNegative,fOverflow; uint8_t hashbuf[256]; char address[64]; bits256 addrhash; arith_uint256 hashval,mindiff,ratio,coinage256; uint256 hash,pasthash; int32_t segid,minage,i,iter=0; int64_t diff=0; uint32_t txtime,segid32,winner = 0 ; uint64_t value,coinage;
-    txtime = komodo_txtime2(&value,txid,vout,address);
-    if ( validateflag == 0 )
-    {
-        //fprintf(stderr,"blocktime.%u -> ",blocktime);
-        if ( blocktime < prevtime+3 )
-            blocktime = prevtime+3;
-        if ( blocktime < GetAdjustedTime()-60 )
-            blocktime = GetAdjustedTime()+30;
-        //fprintf(stderr,"blocktime.%u txtime.%u\n",blocktime,txtime);
-    }
-    if ( value == 0 || txtime == 0 || blocktime == 0 || prevtime == 0 )
-    {
-        //fprintf(stderr,"komodo_stake null %.8f %u %u %u\n",dstr(value),txtime,blocktime,prevtime);
-        return(0);
-    }
-    if ( value < SATOSHIDEN )
-        return(0);
-    value /= SATOSHIDEN;
-    mindiff.SetCompact(STAKING_MIN_DIFF,&fNegative,&fOverflow);
-    ratio = (mindiff / bnTarget);
-    if ( (minage= nHeight*3) > 6000 ) // about 100 blocks
-        minage = 6000;
-    komodo_segids(hashbuf,nHeight-101,100);
-    segid32 = komodo_stakehash(&hash,address,hashbuf,txid,vout);
-    segid = ((nHeight + segid32) & 0x3f);
+    arith_uint256 hashval,coinage256; int32_t iter; int64_t diff=0; uint32_t winner = 0; uint64_t coinage;
     for (iter=0; iter<600; iter++)
     {
         if ( blocktime+iter+segid*2 < txtime+minage )
@@ -1568,21 +1642,42 @@ uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeigh
             break;
         }
     }
-    //fprintf(stderr,"iterated until i.%d winner.%d\n",i,winner);
-    if ( 0 && validateflag != 0 )
-    {
-        for (i=31; i>=24; i--)
-            fprintf(stderr,"%02x",((uint8_t *)&hashval)[i]);
-        fprintf(stderr," vs ");
-        for (i=31; i>=24; i--)
-            fprintf(stderr,"%02x",((uint8_t *)&bnTarget)[i]);
-        fprintf(stderr," segid.%d iter.%d winner.%d coinage.%llu %d ht.%d t.%u v%d diff.%d ht.%d\n",segid,iter,winner,(long long)coinage,(int32_t)(blocktime - txtime),nHeight,blocktime,(int32_t)value,(int32_t)diff,nHeight);
-    }
     if ( nHeight < 10 )
         return(blocktime);
     return(blocktime * winner);
 }
 
+uint32_t komodo_stake(int32_t validateflag,arith_uint256 bnTarget,int32_t nHeight,uint256 txid,int32_t vout,uint32_t blocktime,uint32_t prevtime,char *destaddr,int32_t PoSperc)
+{
+    bool fNegative,fOverflow; uint8_t hashbuf[256]; char address[64]; arith_uint256 mindiff,ratio; uint256 hash; int32_t segid,minage; uint32_t txtime,segid32; uint64_t value;
+    txtime = komodo_txtime2(&value,txid,vout,address);
+    if ( validateflag == 0 )
+    {
+        //fprintf(stderr,"blocktime.%u -> ",blocktime);
+        if ( blocktime < prevtime+3 )
+            blocktime = prevtime+3;
+        if ( blocktime < GetAdjustedTime()-60 )
+            blocktime = GetAdjustedTime()+30;
+        //fprintf(stderr,"blocktime.%u txtime.%u\n",blocktime,txtime);
+    }
+    if ( value == 0 || txtime == 0 || blocktime == 0 || prevtime == 0 )
+    {
+        //fprintf(stderr,"komodo_stake null %.8f %u %u %u\n",dstr(value),txtime,blocktime,prevtime);
+        return(0);
+    }
+    if ( value < SATOSHIDEN )
+        return(0);
+    value /= SATOSHIDEN;
+    mindiff.SetCompact(STAKING_MIN_DIFF,&fNegative,&fOverflow);
+    ratio = (mindiff / bnTarget);
+    if ( (minage= nHeight*3) > 6000 ) // about 100 blocks
+        minage = 6000;
+    komodo_segids(hashbuf,nHeight-101,100);
+    segid32 = komodo_stakehash(&hash,address,hashbuf,txid,vout);
+    segid = ((nHeight + segid32) & 0x3f);
+    return(komodo_stakeloop(validateflag,bnTarget,ratio,nHeight,minage,hash,segid,value,txtime,blocktime,prevtime,PoSperc));
+}
+
 int32_t komodo_is_PoSblock(int32_t slowflag,int32_t height,CBlock *pblock,arith_uint256 bnTarget,arith_uint256 bhash)
 {
     CBlockIndex *previndex,*pindex; char voutaddr[64],destaddr[64]; uint256 txid; uint32_t txtime,prevtime=0; int32_t vout,PoSperc,txn_count,eligible=0,isPoS = 0,segid; uint64_t value; CTxDestination voutaddress; arith_uint256 POWTarget;
@@ -2181,7 +2276,7 @@ bool KOMODO_TEST_ASSETCHAIN_SKIP_POW = 0;
 
 int32_t komodo_checkPOW(int32_t slowflag,CBlock *pblock,int32_t height)
 {
-    uint256 hash; arith_uint256 bnTarget,bhash; bool fNegative,fOverflow; uint8_t *script,pubkey33[33],pubkeys[64][33]; int32_t i,scriptlen,possible,PoSperc,is_PoSblock=0,n,failed = 0,notaryid = -1; int64_t checktoshis,value; CBlockIndex *pprev;
+    uint256 hash; arith_uint256 bnTarget,bhash; bool fNegative,fOverflow; uint8_t *script,pubkey33[33]; int32_t i,scriptlen,possible,PoSperc,is_PoSblock=0,n,failed = 0,notaryid = -1; int64_t checktoshis,value; CBlockIndex *pprev;
     if ( KOMODO_TEST_ASSETCHAIN_SKIP_POW == 0 && Params().NetworkIDString() == "regtest" )
         KOMODO_TEST_ASSETCHAIN_SKIP_POW = 1;
     if ( !CheckEquihashSolution(pblock, Params()) )
@@ -2219,15 +2314,8 @@ int32_t komodo_checkPOW(int32_t slowflag,CBlock *pblock,int32_t height)
         failed = 1;
         if ( height > 0 && ASSETCHAINS_SYMBOL[0] == 0 ) // for the fast case
         {
-            if ( (n= komodo_notaries(pubkeys,height,pblock->nTime)) > 0 )
-            {
-                for (i=0; i<n; i++)
-                    if ( memcmp(pubkey33,pubkeys[i],33) == 0 )
-                    {
-                        notaryid = i;
-                        break;
-                    }
-            }
+            if ( (i= komodo_electednotary(&n,pubkey33,height,pblock->nTime)) >= 0 )
+                notaryid = i;
         }
         else if ( possible == 0 || ASSETCHAINS_SYMBOL[0] != 0 )
         {
@@ -2358,107 +2446,206 @@ int32_t komodo_acpublic(uint32_t tiptime)
     return(acpublic);
 }
 
+int32_t komodo_isburnaddress(const CTxDestination &address)
+{
+    static CTxDestination burndest; static int32_t didinit;
+    if ( didinit == 0 )
+    {
+        burndest = CBitcoinAddress("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY").Get();
+        didinit = 1;
+    }
+    return(address == burndest);
+}
+
+int64_t komodo_voutvalue(const CTxOut &txout)
+{
+    CTxDestination address;
+    if ( ExtractDestination(txout.scriptPubKey,address) == 0 )
+        return(0);
+    else if ( komodo_isburnaddress(address) != 0 )
+    {
+        printf("skip %.8f -> %s\n",dstr(txout.nValue),CBitcoinAddress(address).ToString().c_str());
+        return(0);
+    }
+    return(txout.nValue);
+}
+
+// adds the vins, vouts and shielded flows of the i-th tx of a block, vins are looked up in view if it is not null.
+// An import spends nothing on this chain, its payouts are new coins. A tx with a vin that can't be found adds
+// nothing and returns -1, so every caller ends up with the same sums for a block.
+int32_t komodo_txnewcoins(int64_t *vinsump,int64_t *voutsump,int64_t *zfundsp,int64_t *sproutfundsp,const CTransaction &tx,int32_t i,const CCoinsViewCache *view)
+{
+    int32_t j,m,vout; uint8_t *script; uint256 txid,hashBlock; CTransaction vintx; int64_t vinsum=0,voutsum=0,zfunds=0,sproutfunds=0;
+    if ( i != 0 && tx.IsCoinImport() == 0 && (m= tx.vin.size()) > 0 )
+    {
+        for (j=0; j<m; j++)
+        {
+            txid = tx.vin[j].prevout.hash;
+            vout = tx.vin[j].prevout.n;
+            if ( view != 0 && view->HaveCoins(txid) != 0 )
+                vinsum += view->GetOutputFor(tx.vin[j]).nValue;
+            else if ( !GetTransaction(txid,vintx,hashBlock, false) || vout >= vintx.vout.size() )
+            {
+                fprintf(stderr,"ERROR: %s/v%d cant find, skip %s\n",txid.ToString().c_str(),vout,tx.GetHash().ToString().c_str());
+                return(-1);
+            }
+            else vinsum += vintx.vout[vout].nValue;
+        }
+    }
+    if ( (m= tx.vout.size()) > 0 )
+    {
+        for (j=0; j<m-1; j++)
+            voutsum += komodo_voutvalue(tx.vout[j]);
+        script = (uint8_t *)&tx.vout[j].scriptPubKey[0];
+        if ( script == 0 || script[0] != 0x6a )
+            voutsum += komodo_voutvalue(tx.vout[j]);
+    }
+    BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit)
+    {
+        zfunds -= joinsplit.vpub_new;
+        zfunds += joinsplit.vpub_old;
+        sproutfunds -= joinsplit.vpub_new;
+        sproutfunds += joinsplit.vpub_old;
+    }
+    zfunds -= tx.valueBalance;
+    *vinsump += vinsum;
+    *voutsump += voutsum;
+    *zfundsp += zfunds;
+    *sproutfundsp += sproutfunds;
+    return(0);
+}
+
+int64_t komodo_blocknewcoins(int64_t vinsum,int64_t voutsum)
+{
+    if ( ASSETCHAINS_SYMBOL[0] == 0 && (voutsum-vinsum) == 100003*SATOSHIDEN ) // 15 times
+        return(3 * SATOSHIDEN);
+    return(voutsum - vinsum);
+}
+
 int64_t komodo_newcoins(int64_t *zfundsp,int64_t *sproutfundsp,int32_t nHeight,CBlock *pblock)
 {
-    CTxDestination address; int32_t i,j,m,n,vout; uint8_t *script; uint256 txid,hashBlock; int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0;
+    int32_t i,n; int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0;
     n = pblock->vtx.size();
     for (i=0; i<n; i++)
+        komodo_txnewcoins(&vinsum,&voutsum,&zfunds,&sproutfunds,pblock->vtx[i],i,0);
+    *zfundsp = zfunds;
+    *sproutfundsp = sproutfunds;
+    //if ( voutsum-vinsum+zfunds > 100000*SATOSHIDEN || voutsum-vinsum+zfunds < 0 )
+    //.    fprintf(stderr,"ht.%d vins %.8f, vouts %.8f -> %.8f zfunds %.8f\n",nHeight,dstr(vinsum),dstr(voutsum),dstr(voutsum)-dstr(vinsum),dstr(zfunds));
+    return(komodo_blocknewcoins(vinsum,voutsum));
+}
+
+// records the coins created by a connected block and, when pprev already has them, the totals through it
+void komodo_setsupply(CBlockIndex *pindex,int64_t newcoins,int64_t zfunds,int64_t sproutfunds)
+{
+    CBlockIndex *pprev = pindex->pprev;
+    pindex->newcoins = newcoins;
+    pindex->zfunds = zfunds;
+    pindex->sproutfunds = sproutfunds;
+    if ( pprev == 0 || (pprev->GetHeight() > 0 && pprev->supplytotals == 0) )
+        return;
+    pindex->nSupplyTotal = pprev->nSupplyTotal + newcoins;
+    pindex->nZfundsTotal = pprev->nZfundsTotal + zfunds;
+    pindex->nSproutfundsTotal = pprev->nSproutfundsTotal + sproutfunds;
+    if ( pindex->supplytotals == 0 )
     {
-        CTransaction vintx,&tx = pblock->vtx[i];
-        if ( (m= tx.vin.size()) > 0 )
+        pindex->supplytotals = 1;
+        setDirtyBlockIndex.insert(pindex);
+    }
+}
+
+#define KOMODO_SUPPLYBATCH 1000
+
+// fills in the totals of blocks indexed by older versions, started once at init. cs_main is only held to
+// collect and to store a batch, the blocks are read in between. Blocks connected meanwhile get their totals
+// from komodo_setsupply as soon as their pprev has them.
+void komodo_supplybackfill()
+{
+    std::vector<std::pair<CBlockIndex *,bool> > batch; std::vector<int64_t> sums; CBlock block; CBlockIndex *pindex;
+    int32_t i,j,height = 1,nFilled = 0;
+    while ( 1 )
+    {
+        boost::this_thread::interruption_point();
+        batch.clear();
         {
-            for (j=0; j<m; j++)
+            LOCK(cs_main);
+            if ( height > 1 && (chainActive[height-1] == 0 || chainActive[height-1]->supplytotals == 0) )
+                height = 1; // reorged below the filled part
+            while ( (pindex= chainActive[height]) != 0 && batch.size() < KOMODO_SUPPLYBATCH )
             {
-                if ( i == 0 )
-                    continue;
-                txid = tx.vin[j].prevout.hash;
-                vout = tx.vin[j].prevout.n;
-                if ( !GetTransaction(txid,vintx,hashBlock, false) || vout >= vintx.vout.size() )
-                {
-                    fprintf(stderr,"ERROR: %s/v%d cant find\n",txid.ToString().c_str(),vout);
-                    return(0);
-                }
-                vinsum += vintx.vout[vout].nValue;
+                if ( pindex->supplytotals == 0 )
+                    batch.push_back(std::make_pair(pindex,pindex->newcoins == 0 && pindex->zfunds == 0));
+                height++;
             }
         }
-        if ( (m= tx.vout.size()) > 0 )
+        if ( batch.size() == 0 )
+            break;
+        sums.assign(batch.size() * 3,0);
+        for (i=0; i<batch.size(); i++)
         {
-            for (j=0; j<m-1; j++)
-            {
-                if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
-                    voutsum += tx.vout[j].nValue;
-                else printf("skip %.8f -> %s\n",dstr(tx.vout[j].nValue),CBitcoinAddress(address).ToString().c_str());
-            }
-            script = (uint8_t *)&tx.vout[j].scriptPubKey[0];
-            if ( script == 0 || script[0] != 0x6a )
+            if ( batch[i].second == 0 )
+                continue;
+            int64_t zfunds=0,vinsum=0,voutsum=0,sproutfunds=0;
+            if ( komodo_blockload(block,batch[i].first) != 0 )
+                fprintf(stderr,"error loading block.%d, counted as no new coins\n",batch[i].first->GetHeight());
+            else
             {
-                if ( ExtractDestination(tx.vout[j].scriptPubKey,address) != 0 && strcmp("RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY",CBitcoinAddress(address).ToString().c_str()) != 0 )
-                    voutsum += tx.vout[j].nValue;
+                for (j=0; j<block.vtx.size(); j++)
+                    komodo_txnewcoins(&vinsum,&voutsum,&zfunds,&sproutfunds,block.vtx[j],j,0);
             }
+            sums[i*3] = komodo_blocknewcoins(vinsum,voutsum);
+            sums[i*3 + 1] = zfunds;
+            sums[i*3 + 2] = sproutfunds;
         }
-        BOOST_FOREACH(const JSDescription& joinsplit, tx.vjoinsplit)
         {
-            zfunds -= joinsplit.vpub_new;
-            zfunds += joinsplit.vpub_old;
-            sproutfunds -= joinsplit.vpub_new;
-            sproutfunds += joinsplit.vpub_old;
+            LOCK(cs_main);
+            for (i=0; i<batch.size(); i++)
+            {
+                pindex = batch[i].first;
+                if ( pindex->supplytotals != 0 )
+                    continue;
+                if ( batch[i].second != 0 && pindex->newcoins == 0 && pindex->zfunds == 0 )
+                    komodo_setsupply(pindex,sums[i*3],sums[i*3 + 1],sums[i*3 + 2]);
+                else komodo_setsupply(pindex,pindex->newcoins,pindex->zfunds,pindex->sproutfunds);
+                if ( pindex->supplytotals != 0 )
+                    nFilled++;
+            }
         }
-        zfunds -= tx.valueBalance;
     }
-    *zfundsp = zfunds;
-    *sproutfundsp = sproutfunds;
-    if ( ASSETCHAINS_SYMBOL[0] == 0 && (voutsum-vinsum) == 100003*SATOSHIDEN ) // 15 times
-        return(3 * SATOSHIDEN);
-    //if ( voutsum-vinsum+zfunds > 100000*SATOSHIDEN || voutsum-vinsum+zfunds < 0 )
-    //.    fprintf(stderr,"ht.%d vins %.8f, vouts %.8f -> %.8f zfunds %.8f\n",nHeight,dstr(vinsum),dstr(voutsum),dstr(voutsum)-dstr(vinsum),dstr(zfunds));
-    return(voutsum - vinsum);
+    if ( nFilled > 0 )
+        LogPrintf("%s: filled in the coin supply totals of %d blocks\n",__func__,nFilled);
 }
 
 int64_t komodo_coinsupply(int64_t *zfundsp,int64_t *sproutfundsp,int32_t height)
 {
-    CBlockIndex *pindex; CBlock block; int64_t zfunds=0,sproutfunds=0,supply = 0;
+    CBlockIndex *pindex;
     //fprintf(stderr,"coinsupply %d\n",height);
     *zfundsp = *sproutfundsp = 0;
-    if ( (pindex= komodo_chainactive(height)) != 0 )
-    {
-        while ( pindex != 0 && pindex->GetHeight() > 0 )
-        {
-            if ( pindex->newcoins == 0 && pindex->zfunds == 0 )
-            {
-                if ( komodo_blockload(block,pindex) == 0 )
-                    pindex->newcoins = komodo_newcoins(&pindex->zfunds,&pindex->sproutfunds,pindex->GetHeight(),&block);
-                else
-                {
-                    fprintf(stderr,"error loading block.%d\n",pindex->GetHeight());
-                    return(0);
-                }
-            }
-            supply += pindex->newcoins;
-            zfunds += pindex->zfunds;
-            sproutfunds += pindex->sproutfunds;
-            //printf("start ht.%d new %.8f -> supply %.8f zfunds %.8f -> %.8f\n",pindex->GetHeight(),dstr(pindex->newcoins),dstr(supply),dstr(pindex->zfunds),dstr(zfunds));
-            pindex = pindex->pprev;
-        }
-    }
-    *zfundsp = zfunds;
-    *sproutfundsp = sproutfunds;
-    return(supply);
+    LOCK(cs_main);
+    if ( (pindex= komodo_chainactive(height)) == 0 || pindex->GetHeight() <= 0 )
+        return(0);
+    if ( pindex->supplytotals == 0 ) // komodo_supplybackfill has not got there yet
+        return(0);
+    *zfundsp = pindex->nZfundsTotal;
+    *sproutfundsp = pindex->nSproutfundsTotal;
+    return(pindex->nSupplyTotal);
 }
+
 struct komodo_staking
 {
     char address[64];
     uint256 txid;
     arith_uint256 hashval;
+    bits256 addrhash;
     uint64_t nValue;
-    uint32_t segid32,txtime;
+    uint32_t segid32,txtime,eligible;
     int32_t vout;
     CScript scriptPubKey;
 };
 
-struct komodo_staking *komodo_addutxo(struct komodo_staking *array,int32_t *numkp,int32_t *maxkp,uint32_t txtime,uint64_t nValue,uint256 txid,int32_t vout,char *address,uint8_t *hashbuf,CScript pk)
+struct komodo_staking *komodo_addutxo(struct komodo_staking *array,int32_t *numkp,int32_t *maxkp,uint32_t txtime,uint64_t nValue,uint256 txid,int32_t vout,char *address,CScript pk,uint256 *addrhashp)
 {
-    uint256 hash; uint32_t segid32; struct komodo_staking *kp;
-    segid32 = komodo_stakehash(&hash,address,hashbuf,txid,vout);
+    struct komodo_staking *kp;
     if ( *numkp >= *maxkp )
     {
         *maxkp += 1000;
@@ -2469,21 +2656,104 @@ struct komodo_staking *komodo_addutxo(struct komodo_staking *array,int32_t *numk
     //fprintf(stderr,"kp.%p num.%d\n",kp,*numkp);
     memset(kp,0,sizeof(*kp));
     strcpy(kp->address,address);
+    if ( addrhashp != 0 )
+        memcpy(&kp->addrhash,addrhashp,sizeof(kp->addrhash));
+    else vcalc_sha256(0,(uint8_t *)&kp->addrhash,(uint8_t *)address,(int32_t)strlen(address));
     kp->txid = txid;
     kp->vout = vout;
-    kp->hashval = UintToArith256(hash);
     kp->txtime = txtime;
-    kp->segid32 = segid32;
+    kp->segid32 = kp->addrhash.uints[0];
     kp->nValue = nValue;
     kp->scriptPubKey = pk;
     return(array);
 }
 
+struct komodo_stakingscan
+{
+    struct komodo_staking *array;
+    CSHA256 prefix; // sha256 state after the first 64 bytes of the segid window, shared by every utxo
+    uint8_t *hashbuf;
+    arith_uint256 bnTarget,ratio;
+    int32_t nHeight,minage,PoSperc;
+    uint32_t starttime,prevtime,rejecttime;
+    int64_t deadline;
+};
+
+// same answer as komodo_stake(0,...) followed by stepping back one second at a time with komodo_stake(1,...)
+// while it still validates, without the GetTransaction and segid reloads per call
+uint32_t komodo_stake_earliest(struct komodo_stakingscan *scan,struct komodo_staking *kp)
+{
+    uint256 hash; uint64_t value; int32_t segid; uint32_t eligible,lo,hi,mid,besttime,floortime;
+    if ( kp->nValue == 0 || kp->txtime == 0 || kp->nValue < SATOSHIDEN )
+        return(0);
+    value = kp->nValue / SATOSHIDEN;
+    CSHA256 hasher = scan->prefix;
+    hasher.Write(&scan->hashbuf[64],100-64).Write((const uint8_t *)&kp->addrhash,sizeof(kp->addrhash));
+    hasher.Write((const uint8_t *)&kp->txid,sizeof(kp->txid)).Write((const uint8_t *)&kp->vout,sizeof(kp->vout)).Finalize(hash.begin());
+    kp->hashval = UintToArith256(hash);
+    segid = ((scan->nHeight + kp->segid32) & 0x3f);
+    if ( (eligible= komodo_stakeloop(0,scan->bnTarget,scan->ratio,scan->nHeight,scan->minage,hash,segid,value,kp->txtime,scan->starttime,scan->prevtime,scan->PoSperc)) == 0 )
+        return(0);
+    #define KOMODO_STAKEVALID(t) (komodo_stakeloop(1,scan->bnTarget,scan->ratio,scan->nHeight,scan->minage,hash,segid,value,kp->txtime,t,scan->prevtime,scan->PoSperc) == (t))
+    if ( !KOMODO_STAKEVALID(eligible) )
+        return(0);
+    if ( eligible <= scan->rejecttime )
+        return(eligible);
+    // at or after txtime+minage the coinage only grows with blocktime, so validity is monotonic and the
+    // earliest valid time can be bisected. below that the diff clamp breaks monotonicity, so step as before
+    floortime = kp->txtime + scan->minage;
+    if ( floortime < scan->rejecttime )
+        floortime = scan->rejecttime;
+    if ( eligible <= floortime )
+        besttime = eligible;
+    else
+    {
+        lo = floortime, hi = eligible;
+        while ( lo < hi )
+        {
+            mid = lo + (hi - lo) / 2;
+            if ( KOMODO_STAKEVALID(mid) )
+                hi = mid;
+            else lo = mid + 1;
+        }
+        besttime = lo;
+        if ( besttime > floortime )
+            return(besttime);
+    }
+    while ( besttime > scan->rejecttime && KOMODO_STAKEVALID(besttime-1) )
+        besttime--;
+    #undef KOMODO_STAKEVALID
+    return(besttime);
+}
+
+// earliest winner wins, ties go to the smaller utxo, then to the lower index
+int32_t komodo_stakebetter(struct komodo_staking *kp,struct komodo_staking *best)
+{
+    return(best == 0 || kp->eligible < best->eligible || (kp->eligible == best->eligible && kp->nValue < best->nValue));
+}
+
+void komodo_stakingworker(struct komodo_stakingscan *scan,int32_t start,int32_t end,int32_t *bestip)
+{
+    struct komodo_staking *kp,*best = 0; int32_t i;
+    *bestip = -1;
+    for (i=start; i<end; i++)
+    {
+        if ( ((i - start) & 0xff) == 0 && (fRequestShutdown || GetTimeMillis() > scan->deadline || chainActive.Height()+1 > scan->nHeight) )
+            break;
+        kp = &scan->array[i];
+        if ( (kp->eligible= komodo_stake_earliest(scan,kp)) != 0 && komodo_stakebetter(kp,best) != 0 )
+        {
+            best = kp;
+            *bestip = i;
+        }
+    }
+}
+
 int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blocktimep,uint32_t *txtimep,uint256 *utxotxidp,int32_t *utxovoutp,uint64_t *utxovaluep,uint8_t *utxosig)
 {
     static struct komodo_staking *array; static int32_t numkp,maxkp; static uint32_t lasttime;
     int32_t PoSperc;
-    set<CBitcoinAddress> setAddress; struct komodo_staking *kp; int32_t winners,segid,minage,nHeight,counter=0,i,m,siglen=0,nMinDepth = 1,nMaxDepth = 99999999; vector<COutput> vecOutputs; uint32_t block_from_future_rejecttime,besttime,eligible,earliest = 0; CScript best_scriptPubKey; arith_uint256 mindiff,ratio,bnTarget,tmpTarget; CBlockIndex *tipindex,*pindex; CTxDestination address; bool fNegative,fOverflow; uint8_t hashbuf[256]; CTransaction tx; uint256 hashBlock;
+    struct komodo_staking *kp; int32_t minage,nHeight,counter=0,i,siglen=0; uint32_t earliest = 0; CScript best_scriptPubKey; arith_uint256 mindiff,ratio,bnTarget,tmpTarget; CBlockIndex *tipindex,*pindex; bool fNegative,fOverflow; uint8_t hashbuf[256]; CTransaction tx; uint256 hashBlock;
     if (!EnsureWalletIsAvailable(0))
         return 0;
     
@@ -2505,24 +2775,21 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
         *blocktimep = tipindex->nTime+60;
 //fprintf(stderr,"Start scan of utxo for staking %u ht.%d\n",(uint32_t)time(NULL),nHeight);
 
-    bool resetstaker = false;
-    if ( array != 0 )
+    if ( ASSETCHAINS_MARMARA == 0 )
     {
-        CBlockIndex* pblockindex = chainActive[tipindex->GetHeight()];
-        CBlock block; CTxDestination addressout;
-        if ( ASSETCHAINS_MARMARA != 0 )
-            resetstaker = true;
-        else if( ReadBlockFromDisk(block, pblockindex, 1) && komodo_WhoStaked(&block, addressout) != 0 && IsMine(*pwalletMain,addressout) != 0 )
+        // the wallet keeps its staking candidates current from ChainTip, only the per-height stake hashes need refreshing
+        std::vector<CStakingCandidate> vCandidates;
+        pwalletMain->GetStakingCandidates(vCandidates);
+        numkp = 0;
+        BOOST_FOREACH(const CStakingCandidate& c, vCandidates)
         {
-              resetstaker = true;
-              fprintf(stderr, "Reset ram staker after mining a block!\n");
+            array = komodo_addutxo(array,&numkp,&maxkp,c.txtime,(uint64_t)c.nValue,c.outpoint.hash,(int32_t)c.outpoint.n,(char *)c.address.c_str(),c.scriptPubKey,(uint256 *)&c.addrhash);
+            counter++;
         }
     }
-
-    if ( resetstaker || array == 0 || time(NULL) > lasttime+600 )
+    else
     {
         LOCK2(cs_main, pwalletMain->cs_wallet);
-        pwalletMain->AvailableCoins(vecOutputs, false, NULL, true);
         if ( array != 0 )
         {
             free(array);
@@ -2530,38 +2797,6 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
             maxkp = numkp = 0;
             lasttime = 0;
         }
-        if ( ASSETCHAINS_MARMARA == 0 )
-        {
-            BOOST_FOREACH(const COutput& out, vecOutputs)
-            {
-                if ( (tipindex= chainActive.Tip()) == 0 || tipindex->GetHeight()+1 > nHeight )
-                {
-                    fprintf(stderr,"chain tip changed during staking loop t.%u counter.%d\n",(uint32_t)time(NULL),counter);
-                    return(0);
-                }
-                counter++;
-                if ( out.nDepth < nMinDepth || out.nDepth > nMaxDepth )
-                {
-                    //fprintf(stderr,"komodo_staked invalid depth %d\n",(int32_t)out.nDepth);
-                    continue;
-                }
-                CAmount nValue = out.tx->vout[out.i].nValue;
-                if ( nValue < COIN  || !out.fSpendable )
-                    continue;
-                const CScript& pk = out.tx->vout[out.i].scriptPubKey;
-                if ( ExtractDestination(pk,address) != 0 )
-                {
-                    if ( IsMine(*pwalletMain,address) == 0 )
-                        continue;
-                    if ( GetTransaction(out.tx->GetHash(),tx,hashBlock,true) != 0 && (pindex= komodo_getblockindex(hashBlock)) != 0 )
-                    {
-                        array = komodo_addutxo(array,&numkp,&maxkp,(uint32_t)pindex->nTime,(uint64_t)nValue,out.tx->GetHash(),out.i,(char *)CBitcoinAddress(address).ToString().c_str(),hashbuf,(CScript)pk);
-                        //fprintf(stderr,"addutxo numkp.%d vs max.%d\n",numkp,maxkp);
-                    }
-                }
-            }
-        }
-        else
         {
             struct CCcontract_info *cp,C; uint256 txid; int32_t vout,ht,unlockht; CAmount nValue; char coinaddr[64]; CPubKey mypk,Marmarapk,pk;
             std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
@@ -2579,9 +2814,11 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
                 if ( GetTransaction(txid,tx,hashBlock,true) != 0 && (pindex= komodo_getblockindex(hashBlock)) != 0 && myIsutxo_spentinmempool(ignoretxid,ignorevin,txid,vout) == 0 )
                 {
                     const CScript &scriptPubKey = tx.vout[vout].scriptPubKey;
-                    if ( DecodeMaramaraCoinbaseOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,pk,ht,unlockht) != 0 && pk == mypk )
+                    CTxDestination dest;
+                    // the stake hash is over the address validation extracts from the utxo, see komodo_txtime2
+                    if ( DecodeMaramaraCoinbaseOpRet(tx.vout[tx.vout.size()-1].scriptPubKey,pk,ht,unlockht) != 0 && pk == mypk && ExtractDestination(scriptPubKey,dest) != 0 )
                     {
-                        array = komodo_addutxo(array,&numkp,&maxkp,(uint32_t)pindex->nTime,(uint64_t)nValue,txid,vout,coinaddr,hashbuf,(CScript)scriptPubKey);
+                        array = komodo_addutxo(array,&numkp,&maxkp,(uint32_t)pindex->nTime,(uint64_t)nValue,txid,vout,(char *)CBitcoinAddress(dest).ToString().c_str(),(CScript)scriptPubKey,0);
                     }
                     // else fprintf(stderr,"SKIP addutxo %.8f numkp.%d vs max.%d\n",(double)nValue/COIN,numkp,maxkp);
                 }
@@ -2591,9 +2828,40 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
 //fprintf(stderr,"finished kp data of utxo for staking %u ht.%d numkp.%d maxkp.%d\n",(uint32_t)time(NULL),nHeight,numkp,maxkp);
     }
 //fprintf(stderr,"numkp.%d blocktime.%u\n",numkp,*blocktimep);
-    block_from_future_rejecttime = (uint32_t)GetAdjustedTime() + 57;    
-    for (i=winners=0; i<numkp; i++)
-    {
+    if ( numkp > 0 )
+    {
+        struct komodo_stakingscan scan; std::vector<int32_t> bestis; int32_t numthreads,chunk;
+        scan.array = array;
+        scan.hashbuf = hashbuf;
+        scan.prefix.Write(hashbuf,64);
+        scan.bnTarget = bnTarget;
+        mindiff.SetCompact(STAKING_MIN_DIFF,&fNegative,&fOverflow);
+        scan.ratio = (mindiff / bnTarget);
+        scan.nHeight = nHeight;
+        scan.minage = minage;
+        scan.PoSperc = PoSperc;
+        scan.prevtime = (uint32_t)tipindex->nTime+27;
+        scan.starttime = scan.prevtime+3;
+        if ( scan.starttime < GetAdjustedTime()-60 )
+            scan.starttime = GetAdjustedTime()+30;
+        scan.rejecttime = (uint32_t)GetAdjustedTime() + 57; // nothing gained by going earlier than block_from_future allows
+        // a scan that outlives a quarter of the block interval is racing stakers that already submitted
+        scan.deadline = GetTimeMillis() + (int64_t)ASSETCHAINS_BLOCKTIME * 250;
+        numthreads = std::min(std::max((int32_t)boost::thread::hardware_concurrency(),1),KOMODO_STAKING_MAXTHREADS);
+        if ( numkp < KOMODO_STAKING_MINPERTHREAD*2 )
+            numthreads = 1;
+        else numthreads = std::min(numthreads,numkp / KOMODO_STAKING_MINPERTHREAD);
+        chunk = (numkp + numthreads - 1) / numthreads;
+        bestis.resize(numthreads,-1);
+        if ( numthreads == 1 )
+            komodo_stakingworker(&scan,0,numkp,&bestis[0]);
+        else
+        {
+            boost::thread_group workers;
+            for (i=0; i<numthreads; i++)
+                workers.create_thread(boost::bind(&komodo_stakingworker,&scan,i*chunk,std::min(numkp,(i+1)*chunk),&bestis[i]));
+            workers.join_all();
+        }
         if ( fRequestShutdown || !GetBoolArg("-gen",false) )
             return(0);
         if ( (tipindex= chainActive.Tip()) == 0 || tipindex->GetHeight()+1 > nHeight )
@@ -2601,44 +2869,23 @@ int32_t komodo_staked(CMutableTransaction &txNew,uint32_t nBits,uint32_t *blockt
             fprintf(stderr,"chain tip changed during staking loop t.%u counter.%d\n",(uint32_t)time(NULL),counter);
             return(0);
         }
-        kp = &array[i];
-        eligible = komodo_stake(0,bnTarget,nHeight,kp->txid,kp->vout,0,(uint32_t)tipindex->nTime+27,kp->address,PoSperc);
-        //fprintf(stderr,"i.%d %u vs %u\n",i,eligible2,eligible);
-        if ( eligible > 0 )
+        if ( GetTimeMillis() > scan.deadline )
+            fprintf(stderr,"staking scan of %d utxo hit its %d seconds budget\n",numkp,ASSETCHAINS_BLOCKTIME/4);
+        for (i=0,kp=0; i<numthreads; i++)
         {
-            besttime = m = 0;
-            if ( eligible == komodo_stake(1,bnTarget,nHeight,kp->txid,kp->vout,eligible,(uint32_t)tipindex->nTime+27,kp->address,PoSperc) )
-            {
-                while ( eligible == komodo_stake(1,bnTarget,nHeight,kp->txid,kp->vout,eligible,(uint32_t)tipindex->nTime+27,kp->address,PoSperc) )
-                {
-                    besttime = eligible;
-                    eligible--;
-                    if ( eligible < block_from_future_rejecttime ) // nothing gained by going earlier
-                        break;
-                    m++;
-//fprintf(stderr,"m.%d ht.%d validated winning blocktime %u -> %.8f eligible.%u test prior\n",m,nHeight,*blocktimep,(double)kp->nValue/COIN,eligible);
-                }
-            }
-            else
-            {
-                //fprintf(stderr,"ht.%d error validating winning blocktime %u -> %.8f eligible.%u test prior\n",nHeight,*blocktimep,(double)kp->nValue/COIN,eligible);
-                continue;
-            }
-            eligible = besttime;
-            winners++;
-//fprintf(stderr,"ht.%d validated winning [%d] -> %.8f eligible.%u test prior\n",nHeight,(int32_t)(eligible - tipindex->nTime),(double)kp->nValue/COIN,eligible);
-            if ( earliest == 0 || eligible < earliest || (eligible == earliest && (*utxovaluep == 0 || kp->nValue < *utxovaluep)) )
-            {
-                earliest = eligible;
-                best_scriptPubKey = kp->scriptPubKey; //out.tx->vout[out.i].scriptPubKey;
-                *utxovaluep = (uint64_t)kp->nValue;
-                //decode_hex((uint8_t *)utxotxidp,32,(char *)out.tx->GetHash().GetHex().c_str());
-                decode_hex((uint8_t *)utxotxidp,32,(char *)kp->txid.GetHex().c_str());
-                *utxovoutp = kp->vout;
-                *txtimep = kp->txtime;//(uint32_t)out.tx->nLockTime;
-                //fprintf(stderr,"ht.%d earliest.%u [%d].%d (%s) nValue %.8f locktime.%u counter.%d winners.%d\n",nHeight,earliest,(int32_t)(earliest - tipindex->nTime),m,kp->address,(double)kp->nValue/COIN,*txtimep,counter,winners);
-            }
-        } //else fprintf(stderr,"utxo not eligible\n");
+            if ( bestis[i] >= 0 && komodo_stakebetter(&array[bestis[i]],kp) != 0 )
+                kp = &array[bestis[i]];
+        }
+        if ( kp != 0 )
+        {
+            earliest = kp->eligible;
+            best_scriptPubKey = kp->scriptPubKey;
+            *utxovaluep = (uint64_t)kp->nValue;
+            decode_hex((uint8_t *)utxotxidp,32,(char *)kp->txid.GetHex().c_str());
+            *utxovoutp = kp->vout;
+            *txtimep = kp->txtime;
+            //fprintf(stderr,"ht.%d earliest.%u [%d] (%s) nValue %.8f locktime.%u counter.%d\n",nHeight,earliest,(int32_t)(earliest - tipindex->nTime),kp->address,(double)kp->nValue/COIN,*txtimep,counter);
+        }
     }
     if ( numkp < 1000 && array != 0 )
     {
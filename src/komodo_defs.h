@@ -30,6 +30,12 @@
 #define KOMODO_SAPLING_ACTIVATION 1544832000 // Dec 15th, 2018
 #define KOMODO_SAPLING_DEADLINE 1550188800 // Feb 15th, 2019
 #define _COINBASE_MATURITY 100
+#define KOMODO_STAKING_MAXTHREADS 8
+#define KOMODO_STAKING_MINPERTHREAD 500
+#define KOMODO_STATESNAP_MAGIC 0x504e534b // "KSNP"
+#define KOMODO_STATESNAP_VERSION 1
+#define KOMODO_STATESNAP_INTERVAL (1 << 20) // komodostate bytes appended between snapshots
+#define KOMODO_STATESNAP_TAILCHECK 4096 // komodostate bytes before the snapshot offset that must still match
 
 #define SETBIT(bits,bitoffset) (((uint8_t *)bits)[(bitoffset) >> 3] |= (1 << ((bitoffset) & 7)))
 #define GETBIT(bits,bitoffset) (((uint8_t *)bits)[(bitoffset) >> 3] & (1 << ((bitoffset) & 7)))
@@ -92,6 +98,8 @@ void komodo_netevent(std::vector<uint8_t> payload);
 #define IGUANA_MAXSCRIPTSIZE 10001
 #define KOMODO_KVDURATION 1440
 #define KOMODO_KVBINARY 2
+#define KOMODO_KVUNDODEPTH 1000 // blocks of kv index undo kept for reorgs
+#define KOMODO_KVMEMPOOL_MAX 10000
 #define PRICES_SMOOTHWIDTH 1
 #define PRICES_MAXDATAPOINTS 8
 uint64_t komodo_paxprice(uint64_t *seedp,int32_t height,char *base,char *rel,uint64_t basevolume);
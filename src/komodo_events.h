@@ -63,6 +63,8 @@ void komodo_eventadd_notarized(struct komodo_state *sp,char *symbol,int32_t heig
     }
 }
 
+std::vector<std::pair<int32_t,struct komodo_event_pubkeys> > KOMODO_RATIFIED; // notary sets applied from komodostate, kept for komodostate.snap
+
 void komodo_eventadd_pubkeys(struct komodo_state *sp,char *symbol,int32_t height,uint8_t num,uint8_t pubkeys[64][33])
 {
     struct komodo_event_pubkeys P;
@@ -72,7 +74,12 @@ void komodo_eventadd_pubkeys(struct komodo_state *sp,char *symbol,int32_t height
     memcpy(P.pubkeys,pubkeys,33 * num);
     komodo_eventadd(sp,height,symbol,KOMODO_EVENT_RATIFY,(uint8_t *)&P,(int32_t)(sizeof(P.num) + 33 * num));
     if ( sp != 0 )
+    {
+        portable_mutex_lock(&komodo_mutex); // komodo_statesnap_save reads it under komodo_mutex
+        KOMODO_RATIFIED.push_back(std::make_pair(height,P));
+        portable_mutex_unlock(&komodo_mutex);
         komodo_notarysinit(height,pubkeys,num);
+    }
 }
 
 void komodo_eventadd_pricefeed(struct komodo_state *sp,char *symbol,int32_t height,uint32_t *prices,uint8_t num)
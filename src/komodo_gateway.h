@@ -816,7 +816,7 @@ const char *komodo_opreturn(int32_t height,uint64_t value,uint8_t *opretbuf,int3
     tokomodo = (komodo_is_issuer() == 0);
     if ( opretbuf[0] == 'K' && opretlen != 40 )
     {
-        komodo_kvupdate(opretbuf,opretlen,value);
+        komodo_kvupdate(height,opretbuf,opretlen,value);
         return("kv");
     }
     else if ( ASSETCHAINS_SYMBOL[0] == 0 && KOMODO_PAX == 0 )
@@ -1574,7 +1574,6 @@ struct komodo_extremeprice
 
 struct komodo_priceinfo
 {
-    FILE *fp;
     char symbol[64];
 } PRICES[KOMODO_MAXPRICES];
 
@@ -2657,17 +2656,124 @@ int64_t komodo_priceave(int64_t *buf,int64_t *correlated,int32_t cskip)
     return((price*7 + halfave*5 + thirdave*3 + fourthave*2 + decayprice + buf[PRICES_DAYWINDOW-1]) / 19);
 }
 
+// PRICES store layout, one file prices/pricestore mapped in segments of PRICES_SEGHEIGHTS heights
+// each segment is columnar, so the window of one symbol is contiguous:
+// [0] numprices rawprice32 columns, column 0 is the timestamp
+// [1] for every ind > 0, a correlated and a 24hr ave int64 column
+// segments are never unmapped, readers find them through PRICES_segments and take seqlock snapshots
+#define PRICES_SEGHEIGHTS 4096
+#define PRICES_MAXSEGMENTS 4096
+#define PRICES_SEGALIGN 0x10000 // mapping offsets have to be multiples of the windows allocation granularity
+
+std::atomic<uint8_t *> PRICES_segments[PRICES_MAXSEGMENTS];
+boost::interprocess::mapped_region *PRICES_regions[PRICES_MAXSEGMENTS];
+std::atomic<uint32_t> PRICES_seq;
+boost::filesystem::path PRICES_storefname;
+int32_t PRICES_numprices,PRICES_numsegments; int64_t PRICES_segsize;
+pthread_mutex_t pricemutex = PTHREAD_MUTEX_INITIALIZER;
+
+struct komodo_pricewindow // 24hr ave state of one symbol, sum and number of zeros of its last PRICES_DAYWINDOW correlated prices
+{
+    int64_t sum;
+    int32_t height,nzeros;
+} PRICES_windows[KOMODO_MAXPRICES];
+
+uint32_t *komodo_pricerawp(int32_t ind,int32_t height)
+{
+    uint8_t *seg;
+    if ( height < 0 || height >= PRICES_MAXSEGMENTS*PRICES_SEGHEIGHTS || ind < 0 || ind >= PRICES_numprices || (seg= PRICES_segments[height / PRICES_SEGHEIGHTS].load(std::memory_order_acquire)) == 0 )
+        return(0);
+    return((uint32_t *)seg + (ind * PRICES_SEGHEIGHTS) + (height % PRICES_SEGHEIGHTS));
+}
+
+// col 0 is the correlated price, 1 the 24hr ave
+int64_t *komodo_pricecolp(int32_t ind,int32_t col,int32_t height)
+{
+    uint8_t *seg;
+    if ( height < 0 || height >= PRICES_MAXSEGMENTS*PRICES_SEGHEIGHTS || ind <= 0 || ind >= PRICES_numprices || (seg= PRICES_segments[height / PRICES_SEGHEIGHTS].load(std::memory_order_acquire)) == 0 )
+        return(0);
+    seg += (int64_t)PRICES_numprices * PRICES_SEGHEIGHTS * sizeof(uint32_t);
+    return((int64_t *)seg + (((ind-1)*2 + col) * PRICES_SEGHEIGHTS) + (height % PRICES_SEGHEIGHTS));
+}
+
+// maps the store through segment seg, extending the file as needed. only called by the writer or at init
+int32_t komodo_pricesmap(int32_t seg)
+{
+    if ( seg >= PRICES_MAXSEGMENTS )
+    {
+        fprintf(stderr,"prices store is full at segment.%d\n",seg);
+        return(-1);
+    }
+    try
+    {
+        if ( (int64_t)boost::filesystem::file_size(PRICES_storefname) < (seg+1) * PRICES_segsize )
+            boost::filesystem::resize_file(PRICES_storefname,(seg+1) * PRICES_segsize);
+        boost::interprocess::file_mapping mapping(PRICES_storefname.string().c_str(),boost::interprocess::read_write);
+        for (; PRICES_numsegments<=seg; PRICES_numsegments++)
+        {
+            PRICES_regions[PRICES_numsegments] = new boost::interprocess::mapped_region(mapping,boost::interprocess::read_write,PRICES_numsegments * PRICES_segsize,PRICES_segsize);
+            PRICES_segments[PRICES_numsegments].store((uint8_t *)PRICES_regions[PRICES_numsegments]->get_address(),std::memory_order_release);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        fprintf(stderr,"error mapping prices store segment.%d: %s\n",seg,e.what());
+        return(-1);
+    }
+    return(0);
+}
+
+// one time conversion of the per symbol files written by older versions
+int32_t komodo_pricesimport(boost::filesystem::path pricesdir)
+{
+    FILE *fps[KOMODO_MAXPRICES]; uint32_t *row,*rawp; int64_t rec[PRICES_MAXDATAPOINTS],*colp; int32_t i,ind,height,numheights; long fsize;
+    memset(fps,0,sizeof(fps));
+    for (ind=0; ind<PRICES_numprices; ind++)
+        fps[ind] = fopen((pricesdir / PRICES[ind].symbol).string().c_str(),"rb");
+    if ( fps[0] == 0 )
+        return(0);
+    fseek(fps[0],0,SEEK_END);
+    fsize = ftell(fps[0]);
+    rewind(fps[0]);
+    numheights = (int32_t)(fsize / (PRICES_numprices * sizeof(uint32_t)));
+    fprintf(stderr,"importing %d heights of prices\n",numheights);
+    row = (uint32_t *)calloc(PRICES_numprices,sizeof(uint32_t));
+    for (height=0; height<numheights; height++)
+    {
+        if ( height % PRICES_SEGHEIGHTS == 0 && komodo_pricesmap(height / PRICES_SEGHEIGHTS) < 0 )
+            break;
+        if ( fread(row,sizeof(uint32_t),PRICES_numprices,fps[0]) != PRICES_numprices )
+            break;
+        for (ind=0; ind<PRICES_numprices; ind++)
+            if ( (rawp= komodo_pricerawp(ind,height)) != 0 )
+                *rawp = row[ind];
+        for (ind=1; ind<PRICES_numprices; ind++)
+        {
+            if ( fps[ind] == 0 || fread(rec,sizeof(int64_t),PRICES_MAXDATAPOINTS,fps[ind]) != PRICES_MAXDATAPOINTS )
+                continue;
+            for (i=0; i<2; i++)
+                if ( (colp= komodo_pricecolp(ind,i,height)) != 0 )
+                    *colp = rec[1+i];
+        }
+    }
+    free(row);
+    for (ind=0; ind<PRICES_numprices; ind++)
+        if ( fps[ind] != 0 )
+            fclose(fps[ind]);
+    return(height);
+}
+
 int32_t komodo_pricesinit()
 {
     static int32_t didinit;
-    int32_t i,num=0,createflag = 0;
+    int32_t i,numsegments,importflag = 0; int64_t rowsize;
     if ( didinit != 0 )
         return(-1);
     didinit = 1;
-    boost::filesystem::path pricefname,pricesdir = GetDataDir() / "prices";
+    boost::filesystem::path pricesdir = GetDataDir() / "prices";
     fprintf(stderr,"pricesinit (%s)\n",pricesdir.string().c_str());
     if (!boost::filesystem::exists(pricesdir))
-        boost::filesystem::create_directories(pricesdir), createflag = 1;
+        boost::filesystem::create_directories(pricesdir);
     for (i=0; i<KOMODO_MAXPRICES; i++)
     {
         if ( komodo_pricename(PRICES[i].symbol,i) == 0 )
@@ -2675,30 +2781,29 @@ int32_t komodo_pricesinit()
         //fprintf(stderr,"%s.%d ",PRICES[i].symbol,i);
         if ( i == 0 )
             strcpy(PRICES[i].symbol,"rawprices");
-        pricefname = pricesdir / PRICES[i].symbol;
-        if ( createflag != 0 )
-            PRICES[i].fp = fopen(pricefname.string().c_str(),"wb+");
-        else if ( (PRICES[i].fp= fopen(pricefname.string().c_str(),"rb+")) == 0 )
-            PRICES[i].fp = fopen(pricefname.string().c_str(),"wb+");
-        if ( PRICES[i].fp != 0 )
-        {
-            num++;
-            if ( createflag != 0 )
-            {
-                fseek(PRICES[i].fp,(2*PRICES_DAYWINDOW+PRICES_SMOOTHWIDTH) * sizeof(int64_t) * PRICES_MAXDATAPOINTS,SEEK_SET);
-                fputc(0,PRICES[i].fp);
-                fflush(PRICES[i].fp);
-            }
-        } else fprintf(stderr,"error opening %s createflag.%d\n",pricefname.string().c_str(), createflag);
     }
-    if ( i > 0 && PRICES[0].fp != 0 && createflag != 0 )
+    PRICES_numprices = i;
+    rowsize = PRICES_numprices * sizeof(uint32_t) + (PRICES_numprices - 1) * 2 * sizeof(int64_t);
+    PRICES_segsize = ((PRICES_SEGHEIGHTS * rowsize + PRICES_SEGALIGN - 1) / PRICES_SEGALIGN) * PRICES_SEGALIGN;
+    PRICES_storefname = pricesdir / "pricestore";
+    if ( !boost::filesystem::exists(PRICES_storefname) )
+    {
+        FILE *fp;
+        if ( (fp= fopen(PRICES_storefname.string().c_str(),"wb")) != 0 )
+            fclose(fp);
+        importflag = 1;
+    }
+    numsegments = boost::filesystem::exists(PRICES_storefname) != 0 ? (int32_t)(boost::filesystem::file_size(PRICES_storefname) / PRICES_segsize) : -1;
+    if ( numsegments < 0 || komodo_pricesmap(numsegments > 0 ? numsegments-1 : 0) < 0 )
     {
-        fseek(PRICES[0].fp,(2*PRICES_DAYWINDOW+PRICES_SMOOTHWIDTH) * sizeof(uint32_t) * i,SEEK_SET);
-        fputc(0,PRICES[0].fp);
-        fflush(PRICES[0].fp);
+        fprintf(stderr,"fatal error opening prices store, start shutdown\n");
+        StartShutdown();
+        return(-1);
     }
-    fprintf(stderr,"pricesinit done i.%d num.%d numprices.%d\n",i,num,(int32_t)(komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t)));
-    if ( i != num || i != komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t) )
+    if ( importflag != 0 )
+        komodo_pricesimport(pricesdir);
+    fprintf(stderr,"pricesinit done i.%d segments.%d numprices.%d\n",i,PRICES_numsegments,(int32_t)(komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t)));
+    if ( i != komodo_cbopretsize(ASSETCHAINS_CBOPRET)/sizeof(uint32_t) )
     {
         fprintf(stderr,"fatal error opening prices files, start shutdown\n");
         StartShutdown();
@@ -2706,98 +2811,135 @@ int32_t komodo_pricesinit()
     return(0);
 }
 
-pthread_mutex_t pricemutex;
-
-// PRICES file layouts
-// [0] rawprice32 / timestamp
-// [1] correlated
-// [2] 24hr ave
-// [3] to [7] reserved
+// sets the 24hr ave state of ind for the window ending at height, incrementally if the previous update was at height-1
+void komodo_pricewindow(struct komodo_pricewindow *wp,int32_t ind,int32_t height)
+{
+    int64_t *newp,*oldp; int32_t i;
+    if ( wp->height == height-1 && (newp= komodo_pricecolp(ind,0,height)) != 0 && (oldp= komodo_pricecolp(ind,0,height-PRICES_DAYWINDOW)) != 0 )
+    {
+        wp->sum += *newp - *oldp;
+        wp->nzeros += (*newp == 0) - (*oldp == 0);
+    }
+    else
+    {
+        wp->sum = wp->nzeros = 0;
+        for (i=0; i<PRICES_DAYWINDOW; i++)
+        {
+            if ( (newp= komodo_pricecolp(ind,0,height-i)) == 0 )
+                break;
+            wp->sum += *newp;
+            wp->nzeros += (*newp == 0);
+        }
+        if ( i < PRICES_DAYWINDOW )
+        {
+            wp->height = 0;
+            return;
+        }
+    }
+    wp->height = height;
+}
 
 void komodo_pricesupdate(int32_t height,CBlock *pblock)
 {
-    static int numprices; static uint32_t *ptr32; static int64_t *ptr64,*tmpbuf;
-    int32_t ind,offset,width; int64_t correlated,smoothed; uint64_t seed,rngval; uint32_t rawprices[KOMODO_MAXPRICES],buf[PRICES_MAXDATAPOINTS*2];
+    static int numprices; static uint32_t *window32; static int64_t *window64,*tmpbuf;
+    int32_t i,ind,width; int64_t correlated,smoothed,*colp; uint64_t seed,rngval; uint32_t rawprices[KOMODO_MAXPRICES],*rawp; struct komodo_pricewindow *wp;
     width = PRICES_DAYWINDOW;//(2*PRICES_DAYWINDOW + PRICES_SMOOTHWIDTH);
     if ( numprices == 0 )
     {
-        pthread_mutex_init(&pricemutex,0);
         numprices = (int32_t)(komodo_cbopretsize(ASSETCHAINS_CBOPRET) / sizeof(uint32_t));
-        ptr32 = (uint32_t *)calloc(sizeof(uint32_t),numprices * width);
-        ptr64 = (int64_t *)calloc(sizeof(int64_t),PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS);
+        window32 = (uint32_t *)calloc(sizeof(uint32_t),width);
+        window64 = (int64_t *)calloc(sizeof(int64_t),PRICES_DAYWINDOW);
         tmpbuf = (int64_t *)calloc(sizeof(int64_t),2*PRICES_DAYWINDOW);
-        fprintf(stderr,"prices update: numprices.%d %p %p\n",numprices,ptr32,ptr64);
+        fprintf(stderr,"prices update: numprices.%d\n",numprices);
     }
-    if ( _komodo_heightpricebits(&seed,rawprices,pblock) == numprices )
+    if ( _komodo_heightpricebits(&seed,rawprices,pblock) == numprices && numprices == PRICES_numprices )
     {
         //for (ind=0; ind<numprices; ind++)
         //    fprintf(stderr,"%u ",rawprices[ind]);
         //fprintf(stderr,"numprices.%d\n",numprices);
-        if ( PRICES[0].fp != 0 )
-        {
-            pthread_mutex_lock(&pricemutex);
-            fseek(PRICES[0].fp,height * numprices * sizeof(uint32_t),SEEK_SET);
-            if ( fwrite(rawprices,sizeof(uint32_t),numprices,PRICES[0].fp) != numprices )
-                fprintf(stderr,"error writing rawprices for ht.%d\n",height);
-            else fflush(PRICES[0].fp);
-            if ( height > PRICES_DAYWINDOW )
+        pthread_mutex_lock(&pricemutex);
+        if ( height >= 0 && height / PRICES_SEGHEIGHTS >= PRICES_numsegments && komodo_pricesmap(height / PRICES_SEGHEIGHTS) < 0 )
+        {
+            pthread_mutex_unlock(&pricemutex);
+            return;
+        }
+        PRICES_seq.fetch_add(1,std::memory_order_acq_rel);
+        for (ind=0; ind<numprices; ind++)
+            if ( (rawp= komodo_pricerawp(ind,height)) != 0 )
+                *rawp = rawprices[ind];
+        PRICES_seq.fetch_add(1,std::memory_order_release);
+        if ( height > PRICES_DAYWINDOW )
+        {
+            rngval = seed;
+            for (ind=1; ind<numprices; ind++)
             {
-                fseek(PRICES[0].fp,(height-width+1) * numprices * sizeof(uint32_t),SEEK_SET);
-                if ( fread(ptr32,sizeof(uint32_t),width*numprices,PRICES[0].fp) == width*numprices )
+                wp = &PRICES_windows[ind];
+                rngval = (rngval*11109 + 13849);
+                for (i=0; i<width; i++)
                 {
-                    rngval = seed;
-                    for (ind=1; ind<numprices; ind++)
+                    if ( (rawp= komodo_pricerawp(ind,height-width+1+i)) == 0 )
+                        break;
+                    window32[i] = *rawp;
+                }
+                if ( i == width && (correlated= komodo_pricecorrelated(rngval,ind,&window32[width-1],-1,0,PRICES_SMOOTHWIDTH)) > 0 )
+                {
+                    PRICES_seq.fetch_add(1,std::memory_order_acq_rel);
+                    *komodo_pricecolp(ind,0,height) = correlated;
+                    PRICES_seq.fetch_add(1,std::memory_order_release);
+                    if ( height > PRICES_DAYWINDOW*2 )
                     {
-                        if ( PRICES[ind].fp == 0 )
+                        komodo_pricewindow(wp,ind,height);
+                        if ( wp->height == height && wp->nzeros == 0 )
+                            smoothed = wp->sum / PRICES_DAYWINDOW; // what komodo_priceave returns when there is nothing to fill in
+                        else
                         {
-                            fprintf(stderr,"PRICES[%d].fp is null\n",ind);
-                            continue;
+                            for (i=0; i<PRICES_DAYWINDOW; i++)
+                                window64[i] = ((colp= komodo_pricecolp(ind,0,height-PRICES_DAYWINDOW+1+i)) != 0) ? *colp : 0;
+                            smoothed = komodo_priceave(tmpbuf,&window64[PRICES_DAYWINDOW-1],-1);
                         }
-                        offset = (width-1)*numprices + ind;
-                        rngval = (rngval*11109 + 13849);
-                        if ( (correlated= komodo_pricecorrelated(rngval,ind,&ptr32[offset],-numprices,0,PRICES_SMOOTHWIDTH)) > 0 )
+                        if ( smoothed > 0 )
                         {
-                            fseek(PRICES[ind].fp,height * sizeof(int64_t) * PRICES_MAXDATAPOINTS,SEEK_SET);
-                            memset(buf,0,sizeof(buf));
-                            buf[0] = rawprices[ind];
-                            buf[1] = rawprices[0]; // timestamp
-                            memcpy(&buf[2],&correlated,sizeof(correlated));
-                            if ( fwrite(buf,1,sizeof(buf),PRICES[ind].fp) != sizeof(buf) )
-                                fprintf(stderr,"error fwrite buf for ht.%d ind.%d\n",height,ind);
-                            else if ( height > PRICES_DAYWINDOW*2 )
-                            {
-                                fseek(PRICES[ind].fp,(height-PRICES_DAYWINDOW+1) * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
-                                if ( fread(ptr64,sizeof(int64_t),PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS,PRICES[ind].fp) == PRICES_DAYWINDOW*PRICES_MAXDATAPOINTS )
-                                {
-                                    if ( (smoothed= komodo_priceave(tmpbuf,&ptr64[(PRICES_DAYWINDOW-1)*PRICES_MAXDATAPOINTS+1],-PRICES_MAXDATAPOINTS)) > 0 )
-                                    {
-                                        fseek(PRICES[ind].fp,(height * PRICES_MAXDATAPOINTS + 2) * sizeof(int64_t),SEEK_SET);
-                                        if ( fwrite(&smoothed,1,sizeof(smoothed),PRICES[ind].fp) != sizeof(smoothed) )
-                                            fprintf(stderr,"error fwrite smoothed for ht.%d ind.%d\n",height,ind);
-                                        else fflush(PRICES[ind].fp);
-                                    } else fprintf(stderr,"error price_smoothed ht.%d ind.%d\n",height,ind);
-                                } else fprintf(stderr,"error fread ptr64 for ht.%d ind.%d\n",height,ind);
-                            }
-                        } else fprintf(stderr,"error komodo_pricecorrelated for ht.%d ind.%d\n",height,ind);
-                    }
-                    fprintf(stderr,"height.%d\n",height);
-                } else fprintf(stderr,"error reading rawprices for ht.%d\n",height);
-            } else fprintf(stderr,"height.%d <= width.%d\n",height,width);
-            pthread_mutex_unlock(&pricemutex);
-        } else fprintf(stderr,"null PRICES[0].fp\n");
+                            PRICES_seq.fetch_add(1,std::memory_order_acq_rel);
+                            *komodo_pricecolp(ind,1,height) = smoothed;
+                            PRICES_seq.fetch_add(1,std::memory_order_release);
+                        } else fprintf(stderr,"error price_smoothed ht.%d ind.%d\n",height,ind);
+                    } else wp->height = 0;
+                }
+                else
+                {
+                    if ( height > PRICES_DAYWINDOW*2 )
+                        komodo_pricewindow(wp,ind,height); // the stale value at height is still part of later windows
+                    else wp->height = 0;
+                    fprintf(stderr,"error komodo_pricecorrelated for ht.%d ind.%d\n",height,ind);
+                }
+            }
+            fprintf(stderr,"height.%d\n",height);
+        } else fprintf(stderr,"height.%d <= width.%d\n",height,width);
+        pthread_mutex_unlock(&pricemutex);
     } else fprintf(stderr,"numprices mismatch, height.%d\n",height);
 }
 
+// returns PRICES_MAXDATAPOINTS int64 per block in the layout of the older per symbol files:
+// [0] rawprice32 / timestamp, [1] correlated, [2] 24hr ave, [3] to [7] reserved
 int32_t komodo_priceget(int64_t *buf64,int32_t ind,int32_t height,int32_t numblocks)
 {
-    FILE *fp; int32_t retval = PRICES_MAXDATAPOINTS;
-    pthread_mutex_lock(&pricemutex);
-    if ( ind < KOMODO_MAXPRICES && (fp= PRICES[ind].fp) != 0 )
+    uint32_t seq,*rawp,*timep; int64_t *corrp,*avep; int32_t i;
+    if ( ind <= 0 || ind >= PRICES_numprices )
+        return(-1);
+    memset(buf64,0,sizeof(*buf64) * PRICES_MAXDATAPOINTS * numblocks);
+    for (i=0; i<numblocks; i++,buf64+=PRICES_MAXDATAPOINTS)
     {
-        fseek(fp,height * PRICES_MAXDATAPOINTS * sizeof(int64_t),SEEK_SET);
-        if ( fread(buf64,sizeof(int64_t),numblocks*PRICES_MAXDATAPOINTS,fp) != numblocks*PRICES_MAXDATAPOINTS )
-            retval = -1;
+        if ( (rawp= komodo_pricerawp(ind,height+i)) == 0 || (timep= komodo_pricerawp(0,height+i)) == 0 || (corrp= komodo_pricecolp(ind,0,height+i)) == 0 || (avep= komodo_pricecolp(ind,1,height+i)) == 0 )
+            return(-1);
+        do
+        {
+            while ( ((seq= PRICES_seq.load(std::memory_order_acquire)) & 1) != 0 )
+                ;
+            buf64[0] = (int64_t)(((uint64_t)*timep << 32) | *rawp);
+            buf64[1] = *corrp;
+            buf64[2] = *avep;
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while ( PRICES_seq.load(std::memory_order_relaxed) != seq );
     }
-    pthread_mutex_unlock(&pricemutex);
-    return(retval);
+    return(PRICES_MAXDATAPOINTS);
 }
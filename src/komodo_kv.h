@@ -17,6 +17,7 @@
 #define H_KOMODOKV_H
 
 #include "komodo_defs.h"
+#include "kvindex.h"
 
 int32_t komodo_kvcmp(uint8_t *refvalue,uint16_t refvaluesize,uint8_t *value,uint16_t valuesize)
 {
@@ -53,56 +54,81 @@ uint64_t komodo_kvfee(uint32_t flags,int32_t opretlen,int32_t keylen)
     return(fee);
 }
 
-int32_t komodo_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
+// KV entries live in the block tree db (see CBlockTreeDB::UpdateKVIndex). Updates made while a block is being connected
+// collect in KOMODO_KVPENDING and are written with undo data by komodo_kvconnect, so a restart does not need to replay
+// komodostate and a reorg can put the previous values back. Unconfirmed updates are only tracked in KOMODO_KVMEMPOOL.
+std::map<std::vector<uint8_t>,CKVIndexValue> KOMODO_KVPENDING;
+std::map<std::vector<uint8_t>,std::pair<uint256,CKVIndexValue> > KOMODO_KVMEMPOOL;
+int32_t KOMODO_KVHEIGHT = -2;
+
+int32_t komodo_kvindexheight()
+{
+    int height;
+    if ( KOMODO_KVHEIGHT == -2 && pblocktree != 0 )
+    {
+        if ( pblocktree->ReadKVIndexHeight(height) == false )
+            height = -1;
+        KOMODO_KVHEIGHT = height;
+    }
+    return(KOMODO_KVHEIGHT);
+}
+
+// caller holds KOMODO_KV_mutex
+int32_t komodo_kvread(CKVIndexValue &kv,uint8_t *key,int32_t keylen)
+{
+    std::vector<uint8_t> vkey(key,key+keylen); std::map<std::vector<uint8_t>,CKVIndexValue>::iterator it;
+    if ( (it= KOMODO_KVPENDING.find(vkey)) != KOMODO_KVPENDING.end() )
+        kv = it->second;
+    else if ( pblocktree == 0 || pblocktree->ReadKVIndex(vkey,kv) == false )
+        kv.SetNull();
+    return(kv.IsNull() == false);
+}
+
+int32_t komodo_kvresult(uint256 *pubkeyp,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],const CKVIndexValue &kv)
+{
+    *heightp = kv.height;
+    *flagsp = kv.flags;
+    memcpy(pubkeyp,&kv.pubkey,sizeof(*pubkeyp));
+    if ( kv.value.size() > 0 )
+        memcpy(value,&kv.value[0],kv.value.size());
+    return((int32_t)kv.value.size());
+}
+
+int32_t komodo_kvlookup(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
 {
-    struct komodo_kv *ptr; int32_t duration,retval = -1;
+    CKVIndexValue kv; int32_t retval = -1;
     *heightp = -1;
     *flagsp = 0;
     memset(pubkeyp,0,sizeof(*pubkeyp));
     portable_mutex_lock(&KOMODO_KV_mutex);
-    HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-    if ( ptr != 0 )
-    {
-        duration = komodo_kvduration(ptr->flags);
-        //fprintf(stderr,"duration.%d flags.%d current.%d ht.%d keylen.%d valuesize.%d\n",duration,ptr->flags,current_height,ptr->height,ptr->keylen,ptr->valuesize);
-        if ( current_height > (ptr->height + duration) )
-        {
-            HASH_DELETE(hh,KOMODO_KV,ptr);
-            if ( ptr->value != 0 )
-                free(ptr->value);
-            if ( ptr->key != 0 )
-                free(ptr->key);
-            free(ptr);
-        }
-        else
-        {
-            *heightp = ptr->height;
-            *flagsp = ptr->flags;
-            int32_t i; for (i=0; i<32; i++)
-            {
-                //printf("%02x",((uint8_t *)&ptr->pubkey)[31-i]);
-                ((uint8_t *)pubkeyp)[i] = ((uint8_t *)&ptr->pubkey)[31-i];
-            }
-            //printf(" ptr->pubkey\n");
-            memcpy(pubkeyp,&ptr->pubkey,sizeof(*pubkeyp));
-            if ( (retval= ptr->valuesize) > 0 )
-                memcpy(value,ptr->value,retval);
-        }
-    } //else fprintf(stderr,"couldnt find (%s)\n",(char *)key);
+    if ( komodo_kvread(kv,key,keylen) != 0 && current_height <= kv.expiry )
+        retval = komodo_kvresult(pubkeyp,flagsp,heightp,value,kv);
     portable_mutex_unlock(&KOMODO_KV_mutex);
-    if ( retval < 0 )
+    return(retval);
+}
+
+int32_t komodo_kvsearch(uint256 *pubkeyp,int32_t current_height,uint32_t *flagsp,int32_t *heightp,uint8_t value[IGUANA_MAXSCRIPTSIZE],uint8_t *key,int32_t keylen)
+{
+    std::map<std::vector<uint8_t>,std::pair<uint256,CKVIndexValue> >::iterator it; CKVIndexValue kv; uint256 txid; int32_t retval;
+    if ( (retval= komodo_kvlookup(pubkeyp,current_height,flagsp,heightp,value,key,keylen)) < 0 )
     {
         // search rawmempool
+        portable_mutex_lock(&KOMODO_KV_mutex);
+        if ( (it= KOMODO_KVMEMPOOL.find(std::vector<uint8_t>(key,key+keylen))) != KOMODO_KVMEMPOOL.end() )
+        {
+            txid = it->second.first;
+            kv = it->second.second;
+        }
+        portable_mutex_unlock(&KOMODO_KV_mutex);
+        if ( kv.IsNull() == false && mempool.exists(txid) )
+            retval = komodo_kvresult(pubkeyp,flagsp,heightp,value,kv);
     }
     return(retval);
 }
 
-void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
+int32_t komodo_kvparse(uint8_t *opretbuf,int32_t opretlen,uint64_t value,CKVIndexValue &kv,uint8_t **keyp,uint16_t *keylenp,uint256 *sigp)
 {
-    static uint256 zeroes;
-    uint32_t flags; uint256 pubkey,refpubkey,sig; int32_t i,refvaluesize,hassig,coresize,haspubkey,height,kvheight; uint16_t keylen,valuesize,newflag = 0; uint8_t *key,*valueptr,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; struct komodo_kv *ptr; char *transferpubstr,*tstr; uint64_t fee;
-    if ( ASSETCHAINS_SYMBOL[0] == 0 ) // disable KV for KMD
-        return;
+    uint32_t flags; int32_t i,coresize,height; uint16_t keylen,valuesize; uint8_t *key,*valueptr; uint64_t fee;
     iguana_rwnum(0,&opretbuf[1],sizeof(keylen),&keylen);
     iguana_rwnum(0,&opretbuf[3],sizeof(valuesize),&valuesize);
     iguana_rwnum(0,&opretbuf[5],sizeof(height),&height);
@@ -113,89 +139,181 @@ void komodo_kvupdate(uint8_t *opretbuf,int32_t opretlen,uint64_t value)
         static uint32_t counter;
         if ( ++counter < 1 )
             fprintf(stderr,"komodo_kvupdate: keylen.%d + 13 > opretlen.%d, this can be ignored\n",keylen,opretlen);
-        return;
+        return(-1);
     }
     valueptr = &key[keylen];
     fee = komodo_kvfee(flags,opretlen,keylen);
     //fprintf(stderr,"fee %.8f vs %.8f flags.%d keylen.%d valuesize.%d height.%d (%02x %02x %02x) (%02x %02x %02x)\n",(double)fee/COIN,(double)value/COIN,flags,keylen,valuesize,height,key[0],key[1],key[2],valueptr[0],valueptr[1],valueptr[2]);
-    if ( value >= fee )
+    if ( value < fee )
+    {
+        fprintf(stderr,"not enough fee\n");
+        return(-1);
+    }
+    coresize = (int32_t)(sizeof(flags)+sizeof(height)+sizeof(keylen)+sizeof(valuesize)+keylen+valuesize+1);
+    if ( opretlen != coresize && opretlen != coresize+sizeof(uint256) && opretlen != coresize+2*sizeof(uint256) )
+    {
+        fprintf(stderr,"KV update size mismatch %d vs %d\n",opretlen,coresize);
+        return(-1);
+    }
+    kv.SetNull();
+    memset(sigp,0,sizeof(*sigp));
+    if ( opretlen >= coresize+sizeof(uint256) )
+    {
+        for (i=0; i<32; i++)
+            ((uint8_t *)&kv.pubkey)[i] = opretbuf[coresize+i];
+    }
+    if ( opretlen == coresize+sizeof(uint256)*2 )
+    {
+        for (i=0; i<32; i++)
+            ((uint8_t *)sigp)[i] = opretbuf[coresize+sizeof(uint256)+i];
+    }
+    kv.height = height;
+    kv.flags = flags;
+    kv.value.assign(valueptr,valueptr+valuesize);
+    *keyp = key;
+    *keylenp = keylen;
+    return(0);
+}
+
+void komodo_kvupdate(int32_t blockheight,uint8_t *opretbuf,int32_t opretlen,uint64_t value)
+{
+    static uint256 zeroes;
+    CKVIndexValue kv,prev; uint32_t flags; uint256 refpubkey,sig; int32_t i,refvaluesize,kvheight; uint16_t keylen; uint8_t *key,keyvalue[IGUANA_MAXSCRIPTSIZE*8]; char *transferpubstr,*tstr;
+    if ( ASSETCHAINS_SYMBOL[0] == 0 ) // disable KV for KMD
+        return;
+    if ( blockheight <= komodo_kvindexheight() ) // komodostate replay of a block already in the kv index
+        return;
+    if ( komodo_kvparse(opretbuf,opretlen,value,kv,&key,&keylen,&sig) < 0 )
+        return;
+    memcpy(keyvalue,key,keylen);
+    flags = kv.flags;
+    if ( (refvaluesize= komodo_kvlookup((uint256 *)&refpubkey,kv.height,&flags,&kvheight,&keyvalue[keylen],key,keylen)) >= 0 )
     {
-        coresize = (int32_t)(sizeof(flags)+sizeof(height)+sizeof(keylen)+sizeof(valuesize)+keylen+valuesize+1);
-        if ( opretlen == coresize || opretlen == coresize+sizeof(uint256) || opretlen == coresize+2*sizeof(uint256) )
+        if ( memcmp(&zeroes,&refpubkey,sizeof(refpubkey)) != 0 )
         {
-            memset(&pubkey,0,sizeof(pubkey));
-            memset(&sig,0,sizeof(sig));
-            if ( (haspubkey= (opretlen >= coresize+sizeof(uint256))) != 0 )
+            if ( komodo_kvsigverify(keyvalue,keylen+refvaluesize,refpubkey,sig) < 0 )
             {
-                for (i=0; i<32; i++)
-                    ((uint8_t *)&pubkey)[i] = opretbuf[coresize+i];
+                //fprintf(stderr,"komodo_kvsigverify error [%d]\n",coresize-13);
+                return;
             }
-            if ( (hassig= (opretlen == coresize+sizeof(uint256)*2)) != 0 )
+        }
+    }
+    portable_mutex_lock(&KOMODO_KV_mutex);
+    // an entry that expired as of the claimed height counts as new, like the old lazy delete in komodo_kvsearch
+    if ( refvaluesize >= 0 && komodo_kvread(prev,key,keylen) != 0 )
+    {
+        //fprintf(stderr,"(%s) already there\n",(char *)key);
+        //if ( (ptr->flags & KOMODO_KVPROTECTED) != 0 )
+        {
+            tstr = (char *)"transfer:";
+            transferpubstr = (char *)&key[keylen+strlen(tstr)];
+            if ( strncmp(tstr,(char *)&key[keylen],strlen(tstr)) == 0 && is_hexstr(transferpubstr,0) == 64 )
             {
+                printf("transfer.(%s) to [%s]? ishex.%d\n",key,transferpubstr,is_hexstr(transferpubstr,0));
                 for (i=0; i<32; i++)
-                    ((uint8_t *)&sig)[i] = opretbuf[coresize+sizeof(uint256)+i];
-            }
-            memcpy(keyvalue,key,keylen);
-            if ( (refvaluesize= komodo_kvsearch((uint256 *)&refpubkey,height,&flags,&kvheight,&keyvalue[keylen],key,keylen)) >= 0 )
-            {
-                if ( memcmp(&zeroes,&refpubkey,sizeof(refpubkey)) != 0 )
-                {
-                    if ( komodo_kvsigverify(keyvalue,keylen+refvaluesize,refpubkey,sig) < 0 )
-                    {
-                        //fprintf(stderr,"komodo_kvsigverify error [%d]\n",coresize-13);
-                        return;
-                    }
-                }
-            }
-            portable_mutex_lock(&KOMODO_KV_mutex);
-            HASH_FIND(hh,KOMODO_KV,key,keylen,ptr);
-            if ( ptr != 0 )
-            {
-                //fprintf(stderr,"(%s) already there\n",(char *)key);
-                //if ( (ptr->flags & KOMODO_KVPROTECTED) != 0 )
-                {
-                    tstr = (char *)"transfer:";
-                    transferpubstr = (char *)&valueptr[strlen(tstr)];
-                    if ( strncmp(tstr,(char *)valueptr,strlen(tstr)) == 0 && is_hexstr(transferpubstr,0) == 64 )
-                    {
-                        printf("transfer.(%s) to [%s]? ishex.%d\n",key,transferpubstr,is_hexstr(transferpubstr,0));
-                        for (i=0; i<32; i++)
-                            ((uint8_t *)&pubkey)[31-i] = _decode_hex(&transferpubstr[i*2]);
-                    }
-                }
-            }
-            else if ( ptr == 0 )
-            {
-                ptr = (struct komodo_kv *)calloc(1,sizeof(*ptr));
-                ptr->key = (uint8_t *)calloc(1,keylen);
-                ptr->keylen = keylen;
-                memcpy(ptr->key,key,keylen);
-                newflag = 1;
-                HASH_ADD_KEYPTR(hh,KOMODO_KV,ptr->key,ptr->keylen,ptr);
-                //fprintf(stderr,"KV add.(%s) (%s)\n",ptr->key,valueptr);
+                    ((uint8_t *)&kv.pubkey)[31-i] = _decode_hex(&transferpubstr[i*2]);
             }
-            if ( newflag != 0 || (ptr->flags & KOMODO_KVPROTECTED) == 0 )
-            {
-                if ( ptr->value != 0 )
-                    free(ptr->value), ptr->value = 0;
-                if ( (ptr->valuesize= valuesize) != 0 )
-                {
-                    ptr->value = (uint8_t *)calloc(1,valuesize);
-                    memcpy(ptr->value,valueptr,valuesize);
-                }
-            } else fprintf(stderr,"newflag.%d zero or protected %d\n",newflag,(ptr->flags & KOMODO_KVPROTECTED));
-            /*for (i=0; i<32; i++)
-                printf("%02x",((uint8_t *)&ptr->pubkey)[i]);
-            printf(" <- ");
-            for (i=0; i<32; i++)
-                printf("%02x",((uint8_t *)&pubkey)[i]);
-            printf(" new pubkey\n");*/
-            memcpy(&ptr->pubkey,&pubkey,sizeof(ptr->pubkey));
-            ptr->height = height;
-            ptr->flags = flags; // jl777 used to or in KVPROTECTED
-            portable_mutex_unlock(&KOMODO_KV_mutex);
-        } else fprintf(stderr,"KV update size mismatch %d vs %d\n",opretlen,coresize);
-    } else fprintf(stderr,"not enough fee\n");
+        }
+        if ( (prev.flags & KOMODO_KVPROTECTED) != 0 )
+        {
+            fprintf(stderr,"newflag.%d zero or protected %d\n",0,(prev.flags & KOMODO_KVPROTECTED));
+            kv.value = prev.value;
+        }
+    }
+    kv.flags = flags; // jl777 used to or in KVPROTECTED
+    kv.expiry = kv.height + komodo_kvduration(kv.flags);
+    KOMODO_KVPENDING[std::vector<uint8_t>(key,key+keylen)] = kv;
+    portable_mutex_unlock(&KOMODO_KV_mutex);
+}
+
+void komodo_kvconnect(int32_t height)
+{
+    std::vector<std::pair<std::vector<uint8_t>,CKVIndexValue> > updates; std::vector<std::vector<uint8_t> > expired; std::vector<uint256> txids; std::set<uint256> stale;
+    std::map<std::vector<uint8_t>,CKVIndexValue>::iterator it; std::map<std::vector<uint8_t>,std::pair<uint256,CKVIndexValue> >::iterator mit; int32_t i;
+    if ( ASSETCHAINS_SYMBOL[0] == 0 || pblocktree == 0 )
+        return;
+    portable_mutex_lock(&KOMODO_KV_mutex);
+    if ( height > komodo_kvindexheight() )
+    {
+        pblocktree->ReadKVExpired(height,expired);
+        for (i=0; i<expired.size(); i++)
+            if ( KOMODO_KVPENDING.find(expired[i]) == KOMODO_KVPENDING.end() )
+                KOMODO_KVPENDING[expired[i]].SetNull();
+        for (it=KOMODO_KVPENDING.begin(); it!=KOMODO_KVPENDING.end(); it++)
+        {
+            if ( it->second.IsNull() == false && it->second.expiry < height )
+                it->second.SetNull();
+            updates.push_back(*it);
+        }
+        if ( pblocktree->UpdateKVIndex(height,updates,KOMODO_KVUNDODEPTH) != false )
+            KOMODO_KVHEIGHT = height;
+        else fprintf(stderr,"komodo_kvconnect ht.%d error updating kv index\n",height);
+    }
+    KOMODO_KVPENDING.clear();
+    for (mit=KOMODO_KVMEMPOOL.begin(); mit!=KOMODO_KVMEMPOOL.end(); mit++)
+        txids.push_back(mit->second.first);
+    portable_mutex_unlock(&KOMODO_KV_mutex);
+    for (i=0; i<txids.size(); i++) // mempool.exists takes mempool.cs, keep it out from under KOMODO_KV_mutex
+        if ( mempool.exists(txids[i]) == false )
+            stale.insert(txids[i]);
+    if ( stale.size() > 0 )
+    {
+        portable_mutex_lock(&KOMODO_KV_mutex);
+        for (mit=KOMODO_KVMEMPOOL.begin(); mit!=KOMODO_KVMEMPOOL.end(); )
+        {
+            if ( stale.count(mit->second.first) != 0 )
+                KOMODO_KVMEMPOOL.erase(mit++);
+            else mit++;
+        }
+        portable_mutex_unlock(&KOMODO_KV_mutex);
+    }
+}
+
+void komodo_kvdisconnect(int32_t height)
+{
+    if ( ASSETCHAINS_SYMBOL[0] == 0 || pblocktree == 0 )
+        return;
+    portable_mutex_lock(&KOMODO_KV_mutex);
+    KOMODO_KVPENDING.clear();
+    if ( height <= komodo_kvindexheight() )
+    {
+        if ( pblocktree->RewindKVIndex(height) == false )
+            fprintf(stderr,"komodo_kvdisconnect ht.%d error rewinding kv index\n",height);
+        KOMODO_KVHEIGHT = height - 1;
+    }
+    portable_mutex_unlock(&KOMODO_KV_mutex);
+}
+
+void komodo_kvmempool(const CTransaction &tx)
+{
+    CKVIndexValue kv; uint256 sig; int32_t i,len,opretlen; uint16_t keylen; uint8_t *script,*key;
+    if ( ASSETCHAINS_SYMBOL[0] == 0 )
+        return;
+    for (i=0; i<tx.vout.size(); i++)
+    {
+        const CScript &scriptPubKey = tx.vout[i].scriptPubKey;
+        if ( scriptPubKey.size() < 3 || scriptPubKey[0] != OP_RETURN )
+            continue;
+        script = (uint8_t *)&scriptPubKey[0];
+        len = 1;
+        if ( (opretlen= script[len++]) == 0x4c )
+            opretlen = script[len++];
+        else if ( opretlen == 0x4d )
+        {
+            opretlen = script[len++];
+            opretlen += (script[len++] << 8);
+        }
+        if ( len+opretlen > scriptPubKey.size() || opretlen <= 13 || script[len] != 'K' || opretlen == 40 )
+            continue;
+        if ( komodo_kvparse(&script[len],opretlen,tx.vout[i].nValue,kv,&key,&keylen,&sig) < 0 )
+            continue;
+        kv.expiry = kv.height + komodo_kvduration(0); // a new key is stored with zero flags by komodo_kvupdate
+        kv.flags = 0;
+        portable_mutex_lock(&KOMODO_KV_mutex);
+        if ( KOMODO_KVMEMPOOL.size() < KOMODO_KVMEMPOOL_MAX )
+            KOMODO_KVMEMPOOL[std::vector<uint8_t>(key,key+keylen)] = std::make_pair(tx.GetHash(),kv);
+        portable_mutex_unlock(&KOMODO_KV_mutex);
+    }
 }
 
 #endif
@@ -19,6 +19,8 @@
 
 #include "notaries_staked.h"
 
+#include <atomic>
+
 #define KOMODO_MAINNET_START 178999
 
 const char *Notaries_genesis[][2] =
@@ -200,10 +202,53 @@ const char *Notaries_elected1[][2] =
 };
 #define CRYPTO777_PUBSECPSTR "020e46e79a2a8d12b9b5d12c7a91adb4e454edfae43c0a0cb805427d2ac7613fd9"
 
-int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestamp)
+// one flattened notary set per election era. Sets are never freed once published, so a reader can keep using the
+// pointer it loaded while komodo_notarysinit publishes a newer set for the same heights
+std::atomic<const struct komodo_notaryset *> *KOMODO_NOTARYSETS; // parallel to Pubkeys
+std::atomic<const struct komodo_notaryset *> KOMODO_ELECTEDSETS[2],KOMODO_STAKEDSETS[NUM_STAKED_ERAS+1];
+
+struct komodo_notaryset *komodo_notaryset_create(uint8_t pubkeys[64][33],int32_t num)
 {
-    static uint8_t elected_pubkeys0[64][33],elected_pubkeys1[64][33],did0,did1; static int32_t n0,n1;
-    int32_t i,htind,n; uint64_t mask = 0; struct knotary_entry *kp,*tmp;
+    struct komodo_notaryset *set; int32_t i;
+    set = new komodo_notaryset();
+    if ( num < 0 )
+        num = 0;
+    else if ( num > 64 )
+        num = 64;
+    set->numnotaries = num;
+    for (i=0; i<num; i++)
+    {
+        memcpy(set->pubkeys[i],pubkeys[i],33);
+        calc_rmd160_sha256(set->rmd160s[i],set->pubkeys[i],33);
+        if ( set->notaryids.insert(std::make_pair(std::string((char *)pubkeys[i],33),i)).second == false )
+            set->duplicates = 1;
+    }
+    return(set);
+}
+
+const struct komodo_notaryset *komodo_notaryset_publish(std::atomic<const struct komodo_notaryset *> *slotp,uint8_t pubkeys[64][33],int32_t num)
+{
+    const struct komodo_notaryset *prev = 0; struct komodo_notaryset *set = komodo_notaryset_create(pubkeys,num);
+    if ( slotp->compare_exchange_strong(prev,set) == false )
+    {
+        delete set; // lost the race to another thread building the same era
+        return(prev);
+    }
+    return(set);
+}
+
+int32_t komodo_notarysetid(const struct komodo_notaryset *set,uint8_t *pubkey33)
+{
+    std::unordered_map<std::string,int32_t>::const_iterator it;
+    if ( set != 0 && (it= set->notaryids.find(std::string((char *)pubkey33,33))) != set->notaryids.end() )
+        return(it->second);
+    return(-1);
+}
+
+const struct komodo_notaryset *komodo_notarysetget(int32_t height,uint32_t timestamp)
+{
+    static const struct komodo_notaryset emptyset = komodo_notaryset();
+    const struct komodo_notaryset *set; uint8_t pubkeys[64][33]; int32_t i,n,htind,staked_era;
 
     if ( timestamp == 0 && ASSETCHAINS_SYMBOL[0] != 0 )
         timestamp = komodo_heightstamp(height);
@@ -217,43 +262,38 @@ int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestam
             timestamp = 0;
         if ( (timestamp != 0 && timestamp <= KOMODO_NOTARIES_TIMESTAMP1) || (ASSETCHAINS_SYMBOL[0] == 0 && height <= KOMODO_NOTARIES_HEIGHT1) )
         {
-            if ( did0 == 0 )
+            if ( (set= KOMODO_ELECTEDSETS[0].load()) == 0 )
             {
-                n0 = (int32_t)(sizeof(Notaries_elected0)/sizeof(*Notaries_elected0));
-                for (i=0; i<n0; i++) {
-                    decode_hex(elected_pubkeys0[i],33,(char *)Notaries_elected0[i][1]);
-                }
-                did0 = 1;
+                n = (int32_t)(sizeof(Notaries_elected0)/sizeof(*Notaries_elected0));
+                for (i=0; i<n; i++)
+                    decode_hex(pubkeys[i],33,(char *)Notaries_elected0[i][1]);
+                set = komodo_notaryset_publish(&KOMODO_ELECTEDSETS[0],pubkeys,n);
             }
-            memcpy(pubkeys,elected_pubkeys0,n0 * 33);
-            //if ( ASSETCHAINS_SYMBOL[0] != 0 )
-            //fprintf(stderr,"%s height.%d t.%u elected.%d notaries\n",ASSETCHAINS_SYMBOL,height,timestamp,n0);
-            return(n0);
+            return(set);
         }
         else //if ( (timestamp != 0 && timestamp <= KOMODO_NOTARIES_TIMESTAMP2) || height <= KOMODO_NOTARIES_HEIGHT2 )
         {
-          if ( did1 == 0 )
+            if ( (set= KOMODO_ELECTEDSETS[1].load()) == 0 )
             {
-    	          n1 = (int32_t)(sizeof(Notaries_elected1)/sizeof(*Notaries_elected1));
-                for (i=0; i<n1; i++) {
-                  decode_hex(elected_pubkeys1[i],33,(char *)Notaries_elected1[i][1]);
-                }
-                if ( 0 && ASSETCHAINS_SYMBOL[0] != 0 )
-                    fprintf(stderr,"%s height.%d t.%u elected.%d notaries2\n",ASSETCHAINS_SYMBOL,height,timestamp,n1);
-                did1 = 1;
+                n = (int32_t)(sizeof(Notaries_elected1)/sizeof(*Notaries_elected1));
+                for (i=0; i<n; i++)
+                    decode_hex(pubkeys[i],33,(char *)Notaries_elected1[i][1]);
+                set = komodo_notaryset_publish(&KOMODO_ELECTEDSETS[1],pubkeys,n);
             }
-            memcpy(pubkeys,elected_pubkeys1,n1 * 33);
-            return(n1);
+            return(set);
         }
     }
     else if (timestamp != 0)
     { // here we can activate our pubkeys for STAKED chains everythig is in notaries_staked.cpp
-        int32_t staked_era; int8_t numSN;
-        uint8_t staked_pubkeys[64][33];
         staked_era = STAKED_era(timestamp);
-        numSN = numStakedNotaries(staked_pubkeys,staked_era);
-        memcpy(pubkeys,staked_pubkeys,numSN * 33);
-        return(numSN);
+        if ( staked_era < 0 || staked_era > NUM_STAKED_ERAS )
+            return(&emptyset);
+        if ( (set= KOMODO_STAKEDSETS[staked_era].load()) == 0 )
+        {
+            n = numStakedNotaries(pubkeys,staked_era);
+            set = komodo_notaryset_publish(&KOMODO_STAKEDSETS[staked_era],pubkeys,n);
+        }
+        return(set);
     }
 
     htind = height / KOMODO_ELECTION_GAP;
@@ -264,36 +304,23 @@ int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestam
         komodo_init(height);
         //printf("Pubkeys.%p htind.%d vs max.%d\n",Pubkeys,htind,KOMODO_MAXBLOCKS / KOMODO_ELECTION_GAP);
     }
-    pthread_mutex_lock(&komodo_mutex);
-    n = Pubkeys[htind].numnotaries;
-    if ( 0 && ASSETCHAINS_SYMBOL[0] != 0 )
-        fprintf(stderr,"%s height.%d t.%u genesis.%d\n",ASSETCHAINS_SYMBOL,height,timestamp,n);
-    HASH_ITER(hh,Pubkeys[htind].Notaries,kp,tmp)
-    {
-        if ( kp->notaryid < n )
-        {
-            mask |= (1LL << kp->notaryid);
-            memcpy(pubkeys[kp->notaryid],kp->pubkey,33);
-        } else printf("illegal notaryid.%d vs n.%d\n",kp->notaryid,n);
-    }
-    pthread_mutex_unlock(&komodo_mutex);
-    if ( (n < 64 && mask == ((1LL << n)-1)) || (n == 64 && mask == 0xffffffffffffffffLL) )
-        return(n);
-    printf("error retrieving notaries ht.%d got mask.%llx for n.%d\n",height,(long long)mask,n);
-    return(-1);
+    if ( (set= KOMODO_NOTARYSETS[htind].load()) == 0 )
+        return(&emptyset);
+    return(set);
+}
+
+int32_t komodo_notaries(uint8_t pubkeys[64][33],int32_t height,uint32_t timestamp)
+{
+    const struct komodo_notaryset *set = komodo_notarysetget(height,timestamp);
+    memcpy(pubkeys,set->pubkeys,set->numnotaries * 33);
+    return(set->numnotaries);
 }
 
 int32_t komodo_electednotary(int32_t *numnotariesp,uint8_t *pubkey33,int32_t height,uint32_t timestamp)
 {
-    int32_t i,n; uint8_t pubkeys[64][33];
-    n = komodo_notaries(pubkeys,height,timestamp);
-    *numnotariesp = n;
-    for (i=0; i<n; i++)
-    {
-        if ( memcmp(pubkey33,pubkeys[i],33) == 0 )
-            return(i);
-    }
-    return(-1);
+    const struct komodo_notaryset *set = komodo_notarysetget(height,timestamp);
+    *numnotariesp = set->numnotaries;
+    return(komodo_notarysetid(set,pubkey33));
 }
 
 int32_t komodo_ratify_threshold(int32_t height,uint64_t signedmask)
@@ -314,9 +341,12 @@ int32_t komodo_ratify_threshold(int32_t height,uint64_t signedmask)
 void komodo_notarysinit(int32_t origheight,uint8_t pubkeys[64][33],int32_t num)
 {
     static int32_t hwmheight;
-    int32_t k,i,htind,height; struct knotary_entry *kp; struct knotaries_entry N;
+    int32_t i,htind,height,published = 0; struct knotaries_entry N; struct komodo_notaryset *set;
     if ( Pubkeys == 0 )
+    {
+        KOMODO_NOTARYSETS = new std::atomic<const struct komodo_notaryset *>[1 + (KOMODO_MAXBLOCKS / KOMODO_ELECTION_GAP)]();
         Pubkeys = (struct knotaries_entry *)calloc(1 + (KOMODO_MAXBLOCKS / KOMODO_ELECTION_GAP),sizeof(*Pubkeys));
+    }
     memset(&N,0,sizeof(N));
     if ( origheight > 0 )
     {
@@ -328,20 +358,8 @@ void komodo_notarysinit(int32_t origheight,uint8_t pubkeys[64][33],int32_t num)
             htind = (KOMODO_MAXBLOCKS / KOMODO_ELECTION_GAP) - 1;
         //printf("htind.%d activation %d from %d vs %d | hwmheight.%d %s\n",htind,height,origheight,(((origheight+KOMODO_ELECTION_GAP/2)/KOMODO_ELECTION_GAP)+1)*KOMODO_ELECTION_GAP,hwmheight,ASSETCHAINS_SYMBOL);
     } else htind = 0;
+    set = komodo_notaryset_create(pubkeys,num);
     pthread_mutex_lock(&komodo_mutex);
-    for (k=0; k<num; k++)
-    {
-        kp = (struct knotary_entry *)calloc(1,sizeof(*kp));
-        memcpy(kp->pubkey,pubkeys[k],33);
-        kp->notaryid = k;
-        HASH_ADD_KEYPTR(hh,N.Notaries,kp->pubkey,33,kp);
-        if ( 0 && height > 10000 )
-        {
-            for (i=0; i<33; i++)
-                printf("%02x",pubkeys[k][i]);
-            printf(" notarypubs.[%d] ht.%d active at %d\n",k,origheight,htind*KOMODO_ELECTION_GAP);
-        }
-    }
     N.numnotaries = num;
     for (i=htind; i<KOMODO_MAXBLOCKS / KOMODO_ELECTION_GAP; i++)
     {
@@ -352,8 +370,12 @@ void komodo_notarysinit(int32_t origheight,uint8_t pubkeys[64][33],int32_t num)
         }
         Pubkeys[i] = N;
         Pubkeys[i].height = i * KOMODO_ELECTION_GAP;
+        KOMODO_NOTARYSETS[i].store(set);
+        published = 1;
     }
     pthread_mutex_unlock(&komodo_mutex);
+    if ( published == 0 )
+        delete set;
     if ( origheight > hwmheight )
         hwmheight = origheight;
 }
@@ -361,7 +383,7 @@ void komodo_notarysinit(int32_t origheight,uint8_t pubkeys[64][33],int32_t num)
 int32_t komodo_chosennotary(int32_t *notaryidp,int32_t height,uint8_t *pubkey33,uint32_t timestamp)
 {
     // -1 if not notary, 0 if notary, 1 if special notary
-    struct knotary_entry *kp; int32_t numnotaries=0,htind,modval = -1;
+    const struct komodo_notaryset *set; int32_t i,numnotaries=0,htind,notaryid,modval = -1;
     *notaryidp = -1;
     if ( height < 0 )//|| height >= KOMODO_MAXBLOCKS )
     {
@@ -383,16 +405,21 @@ int32_t komodo_chosennotary(int32_t *notaryidp,int32_t height,uint8_t *pubkey33,
     htind = height / KOMODO_ELECTION_GAP;
     if ( htind >= KOMODO_MAXBLOCKS / KOMODO_ELECTION_GAP )
         htind = (KOMODO_MAXBLOCKS / KOMODO_ELECTION_GAP) - 1;
-    pthread_mutex_lock(&komodo_mutex);
-    HASH_FIND(hh,Pubkeys[htind].Notaries,pubkey33,33,kp);
-    pthread_mutex_unlock(&komodo_mutex);
-    if ( kp != 0 )
+    set = KOMODO_NOTARYSETS[htind].load();
+    if ( (notaryid= komodo_notarysetid(set,pubkey33)) >= 0 )
     {
-        if ( (numnotaries= Pubkeys[htind].numnotaries) > 0 )
+        if ( set->duplicates != 0 ) // the old uthash lookup found the highest notaryid of a repeated pubkey
+        {
+            for (i=set->numnotaries-1; i>notaryid; i--)
+                if ( memcmp(set->pubkeys[i],pubkey33,33) == 0 )
+                    break;
+            notaryid = i;
+        }
+        if ( (numnotaries= set->numnotaries) > 0 )
         {
-            *notaryidp = kp->notaryid;
-            modval = ((height % numnotaries) == kp->notaryid);
-            //printf("found notary.%d ht.%d modval.%d\n",kp->notaryid,height,modval);
+            *notaryidp = notaryid;
+            modval = ((height % numnotaries) == notaryid);
+            //printf("found notary.%d ht.%d modval.%d\n",notaryid,height,modval);
         } else printf("unexpected zero notaries at height.%d\n",height);
     } //else printf("cant find kp at htind.%d ht.%d\n",htind,height);
     //int32_t i; for (i=0; i<33; i++)
@@ -403,17 +430,40 @@ int32_t komodo_chosennotary(int32_t *notaryidp,int32_t height,uint8_t *pubkey33,
 
 //struct komodo_state *komodo_stateptr(char *symbol,char *dest);
 
+// NPOINTS is append only, so every new checkpoint outranks all older ones over its MoM range. NPCOVER keeps the
+// resulting piecewise constant "newest covering index" function as runs keyed by their first height, which makes
+// komodo_npptr_for_height a single map lookup. komodo_npmutex is only taken exclusively by komodo_notarized_update
+boost::shared_mutex komodo_npmutex;
+
+int32_t komodo_npcover_at(struct komodo_state *sp,int32_t height)
+{
+    std::map<int32_t,int32_t>::iterator it = sp->NPCOVER.upper_bound(height);
+    if ( it == sp->NPCOVER.begin() )
+        return(-1);
+    return((--it)->second);
+}
+
+void komodo_npcover_add(struct komodo_state *sp,int32_t lo,int32_t hi,int32_t idx)
+{
+    int32_t after;
+    if ( lo > hi )
+        return;
+    after = komodo_npcover_at(sp,hi+1);
+    sp->NPCOVER.erase(sp->NPCOVER.lower_bound(lo),sp->NPCOVER.upper_bound(hi+1));
+    sp->NPCOVER[lo] = idx;
+    sp->NPCOVER[hi+1] = after;
+}
+
 struct notarized_checkpoint *komodo_npptr_for_height(int32_t height, int *idx)
 {
-    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp; struct notarized_checkpoint *np = 0;
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp;
     if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
     {
-        for (i=sp->NUM_NPOINTS-1; i>=0; i--)
+        boost::shared_lock<boost::shared_mutex> lock(komodo_npmutex);
+        if ( (i= komodo_npcover_at(sp,height)) >= 0 && i < sp->NUM_NPOINTS )
         {
             *idx = i;
-            np = &sp->NPOINTS[i];
-            if ( np->MoMdepth != 0 && height > np->notarized_height-(np->MoMdepth&0xffff) && height <= np->notarized_height )
-                return(np);
+            return(&sp->NPOINTS[i]);
         }
     }
     *idx = -1;
@@ -437,17 +487,9 @@ struct notarized_checkpoint *komodo_npptr_at(int idx)
 
 int32_t komodo_prevMoMheight()
 {
-    static uint256 zero;
-    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp; struct notarized_checkpoint *np = 0;
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
     if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
-    {
-        for (i=sp->NUM_NPOINTS-1; i>=0; i--)
-        {
-            np = &sp->NPOINTS[i];
-            if ( np->MoM != zero )
-                return(np->notarized_height);
-        }
-    }
+        return(sp->prevMoMheight);
     return(0);
 }
 
@@ -487,18 +529,23 @@ int32_t komodo_dpowconfs(int32_t txheight,int32_t numconfs)
 
 int32_t komodo_MoMdata(int32_t *notarized_htp,uint256 *MoMp,uint256 *kmdtxidp,int32_t height,uint256 *MoMoMp,int32_t *MoMoMoffsetp,int32_t *MoMoMdepthp,int32_t *kmdstartip,int32_t *kmdendip)
 {
-    struct notarized_checkpoint *np = 0;
-    if ( (np= komodo_npptr(height)) != 0 )
+    char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; int32_t i; struct komodo_state *sp; struct notarized_checkpoint *np = 0;
+    if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
     {
-        *notarized_htp = np->notarized_height;
-        *MoMp = np->MoM;
-        *kmdtxidp = np->notarized_desttxid;
-        *MoMoMp = np->MoMoM;
-        *MoMoMoffsetp = np->MoMoMoffset;
-        *MoMoMdepthp = np->MoMoMdepth;
-        *kmdstartip = np->kmdstarti;
-        *kmdendip = np->kmdendi;
-        return(np->MoMdepth & 0xffff);
+        boost::shared_lock<boost::shared_mutex> lock(komodo_npmutex);
+        if ( (i= komodo_npcover_at(sp,height)) >= 0 && i < sp->NUM_NPOINTS )
+        {
+            np = &sp->NPOINTS[i];
+            *notarized_htp = np->notarized_height;
+            *MoMp = np->MoM;
+            *kmdtxidp = np->notarized_desttxid;
+            *MoMoMp = np->MoMoM;
+            *MoMoMoffsetp = np->MoMoMoffset;
+            *MoMoMdepthp = np->MoMoMdepth;
+            *kmdstartip = np->kmdstarti;
+            *kmdendip = np->kmdendi;
+            return(np->MoMdepth & 0xffff);
+        }
     }
     *notarized_htp = *MoMoMoffsetp = *MoMoMdepthp = *kmdstartip = *kmdendip = 0;
     memset(MoMp,0,sizeof(*MoMp));
@@ -509,50 +556,15 @@ int32_t komodo_MoMdata(int32_t *notarized_htp,uint256 *MoMp,uint256 *kmdtxidp,in
 
 int32_t komodo_notarizeddata(int32_t nHeight,uint256 *notarized_hashp,uint256 *notarized_desttxidp)
 {
-    struct notarized_checkpoint *np = 0; int32_t i=0,flag = 0; char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
+    struct notarized_checkpoint *np; int32_t i; char symbol[KOMODO_ASSETCHAIN_MAXLEN],dest[KOMODO_ASSETCHAIN_MAXLEN]; struct komodo_state *sp;
     if ( (sp= komodo_stateptr(symbol,dest)) != 0 )
     {
-        if ( sp->NUM_NPOINTS > 0 )
+        boost::shared_lock<boost::shared_mutex> lock(komodo_npmutex);
+        // the checkpoint just before the first one seen at or above nHeight, ie. the first index where the running max reaches it
+        i = (int32_t)(std::lower_bound(sp->NPMAXHT.begin(),sp->NPMAXHT.end(),nHeight) - sp->NPMAXHT.begin());
+        if ( i > 0 )
         {
-            flag = 0;
-            if ( sp->last_NPOINTSi < sp->NUM_NPOINTS && sp->last_NPOINTSi > 0 )
-            {
-                np = &sp->NPOINTS[sp->last_NPOINTSi-1];
-                if ( np->nHeight < nHeight )
-                {
-                    for (i=sp->last_NPOINTSi; i<sp->NUM_NPOINTS; i++)
-                    {
-                        if ( sp->NPOINTS[i].nHeight >= nHeight )
-                        {
-                            //printf("flag.1 i.%d np->ht %d [%d].ht %d >= nHeight.%d, last.%d num.%d\n",i,np->nHeight,i,sp->NPOINTS[i].nHeight,nHeight,sp->last_NPOINTSi,sp->NUM_NPOINTS);
-                            flag = 1;
-                            break;
-                        }
-                        np = &sp->NPOINTS[i];
-                        sp->last_NPOINTSi = i;
-                    }
-                }
-            }
-            if ( flag == 0 )
-            {
-                np = 0;
-                for (i=0; i<sp->NUM_NPOINTS; i++)
-                {
-                    if ( sp->NPOINTS[i].nHeight >= nHeight )
-                    {
-                        //printf("i.%d np->ht %d [%d].ht %d >= nHeight.%d\n",i,np->nHeight,i,sp->NPOINTS[i].nHeight,nHeight);
-                        break;
-                    }
-                    np = &sp->NPOINTS[i];
-                    sp->last_NPOINTSi = i;
-                }
-            }
-        }
-        if ( np != 0 )
-        {
-            //char str[65],str2[65]; printf("[%s] notarized_ht.%d\n",ASSETCHAINS_SYMBOL,np->notarized_height);
-            if ( np->nHeight >= nHeight || (i < sp->NUM_NPOINTS && np[1].nHeight < nHeight) )
-                printf("warning: flag.%d i.%d np->ht %d [1].ht %d >= nHeight.%d\n",flag,i,np->nHeight,np[1].nHeight,nHeight);
+            np = &sp->NPOINTS[i-1];
             *notarized_hashp = np->notarized_hash;
             *notarized_desttxidp = np->notarized_desttxid;
             return(np->notarized_height);
@@ -565,7 +577,7 @@ int32_t komodo_notarizeddata(int32_t nHeight,uint256 *notarized_hashp,uint256 *n
 
 void komodo_notarized_update(struct komodo_state *sp,int32_t nHeight,int32_t notarized_height,uint256 notarized_hash,uint256 notarized_desttxid,uint256 MoM,int32_t MoMdepth)
 {
-    struct notarized_checkpoint *np;
+    static uint256 zero; struct notarized_checkpoint *np;
     if ( notarized_height >= nHeight )
     {
         fprintf(stderr,"komodo_notarized_update REJECT notarized_height %d > %d nHeight\n",notarized_height,nHeight);
@@ -574,15 +586,24 @@ void komodo_notarized_update(struct komodo_state *sp,int32_t nHeight,int32_t not
     if ( 0 && ASSETCHAINS_SYMBOL[0] != 0 )
         fprintf(stderr,"[%s] komodo_notarized_update nHeight.%d notarized_height.%d\n",ASSETCHAINS_SYMBOL,nHeight,notarized_height);
     portable_mutex_lock(&komodo_mutex);
-    sp->NPOINTS = (struct notarized_checkpoint *)realloc(sp->NPOINTS,(sp->NUM_NPOINTS+1) * sizeof(*sp->NPOINTS));
-    np = &sp->NPOINTS[sp->NUM_NPOINTS++];
-    memset(np,0,sizeof(*np));
-    np->nHeight = nHeight;
-    sp->NOTARIZED_HEIGHT = np->notarized_height = notarized_height;
-    sp->NOTARIZED_HASH = np->notarized_hash = notarized_hash;
-    sp->NOTARIZED_DESTTXID = np->notarized_desttxid = notarized_desttxid;
-    sp->MoM = np->MoM = MoM;
-    sp->MoMdepth = np->MoMdepth = MoMdepth;
+    {
+        boost::unique_lock<boost::shared_mutex> lock(komodo_npmutex);
+        sp->NPOINTS = (struct notarized_checkpoint *)realloc(sp->NPOINTS,(sp->NUM_NPOINTS+1) * sizeof(*sp->NPOINTS));
+        np = &sp->NPOINTS[sp->NUM_NPOINTS];
+        memset(np,0,sizeof(*np));
+        np->nHeight = nHeight;
+        sp->NOTARIZED_HEIGHT = np->notarized_height = notarized_height;
+        sp->NOTARIZED_HASH = np->notarized_hash = notarized_hash;
+        sp->NOTARIZED_DESTTXID = np->notarized_desttxid = notarized_desttxid;
+        sp->MoM = np->MoM = MoM;
+        sp->MoMdepth = np->MoMdepth = MoMdepth;
+        if ( MoM != zero )
+            sp->prevMoMheight = notarized_height;
+        if ( MoMdepth != 0 )
+            komodo_npcover_add(sp,notarized_height - (MoMdepth & 0xffff) + 1,notarized_height,sp->NUM_NPOINTS);
+        sp->NPMAXHT.push_back(sp->NPMAXHT.empty() ? nHeight : std::max(sp->NPMAXHT.back(),nHeight));
+        sp->NUM_NPOINTS++;
+    }
     portable_mutex_unlock(&komodo_mutex);
 }
 
@@ -18,6 +18,11 @@
 #include "uthash.h"
 #include "utlist.h"
 
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 /*#ifdef _WIN32
 #define PACKED
 #else
@@ -57,7 +62,6 @@
 union _bits320 { uint8_t bytes[40]; uint16_t ushorts[20]; uint32_t uints[10]; uint64_t ulongs[5]; uint64_t txid; };
 typedef union _bits320 bits320;
 
-struct komodo_kv { UT_hash_handle hh; bits256 pubkey; uint8_t *key,*value; int32_t height; uint32_t flags; uint16_t keylen,valuesize; };
 
 struct komodo_event_notarized { uint256 blockhash,desttxid,MoM; int32_t notarizedheight,MoMdepth; char dest[16]; };
 struct komodo_event_pubkeys { uint8_t num; uint8_t pubkeys[64][33]; };
@@ -84,8 +88,15 @@ struct pax_transaction
     char symbol[KOMODO_ASSETCHAIN_MAXLEN],source[KOMODO_ASSETCHAIN_MAXLEN],coinaddr[64]; uint8_t rmd160[20],type,buf[35];
 };
 
-struct knotary_entry { UT_hash_handle hh; uint8_t pubkey[33],notaryid; };
-struct knotaries_entry { int32_t height,numnotaries; struct knotary_entry *Notaries; };
+struct knotaries_entry { int32_t height,numnotaries; };
+
+// immutable once published, readers get it without taking komodo_mutex
+struct komodo_notaryset
+{
+    int32_t numnotaries,duplicates;
+    uint8_t pubkeys[64][33],rmd160s[64][20];
+    std::unordered_map<std::string,int32_t> notaryids; // 33 byte pubkey -> lowest notaryid
+};
 struct notarized_checkpoint
 {
     uint256 notarized_hash,notarized_desttxid,MoM,MoMoM;
@@ -122,7 +133,9 @@ struct komodo_state
     int32_t SAVEDHEIGHT,CURRENT_HEIGHT,NOTARIZED_HEIGHT,MoMdepth;
     uint32_t SAVEDTIMESTAMP;
     uint64_t deposited,issued,withdrawn,approved,redeemed,shorted;
-    struct notarized_checkpoint *NPOINTS; int32_t NUM_NPOINTS,last_NPOINTSi;
+    struct notarized_checkpoint *NPOINTS; int32_t NUM_NPOINTS,prevMoMheight;
+    std::map<int32_t,int32_t> NPCOVER; // start of each height run -> newest NPOINTS index whose MoM covers it, -1 for none
+    std::vector<int32_t> NPMAXHT;      // running max of NPOINTS[i].nHeight, for bisecting komodo_notarizeddata
     struct komodo_event **Komodo_events; int32_t Komodo_numevents;
     uint32_t RTbufs[64][3]; uint64_t RTmask;
 };
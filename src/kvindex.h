@@ -0,0 +1,117 @@
+// Copyright (c) 2019 The SuperNET Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_KVINDEX_H
+#define BITCOIN_KVINDEX_H
+
+#include "uint256.h"
+#include "serialize.h"
+
+#include <vector>
+
+/** Current state of one komodo KV key, see komodo_kv.h */
+struct CKVIndexValue {
+    uint256 pubkey;
+    int height;     // height claimed in the KV opreturn
+    unsigned int flags;
+    int expiry;     // evicted once a block above this height connects
+    std::vector<unsigned char> value;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(pubkey);
+        READWRITE(height);
+        READWRITE(flags);
+        READWRITE(expiry);
+        READWRITE(value);
+    }
+
+    CKVIndexValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        pubkey.SetNull();
+        height = -1;
+        flags = 0;
+        expiry = -1;
+        value.clear();
+    }
+
+    bool IsNull() const {
+        return (height < 0);
+    }
+};
+
+/** Expiry queue entry, ordered by height so eviction is a prefix scan */
+struct CKVExpiryKey {
+    int expiry;
+    std::vector<unsigned char> key;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 4 + ::GetSerializeSize(key, nType, nVersion);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, expiry);
+        ::Serialize(s, key);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        expiry = ser_readdata32be(s);
+        ::Unserialize(s, key);
+    }
+
+    CKVExpiryKey(int e, const std::vector<unsigned char> &k) {
+        expiry = e;
+        key = k;
+    }
+
+    CKVExpiryKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        expiry = 0;
+        key.clear();
+    }
+};
+
+/** Undo record of one KV key changed by the block at height */
+struct CKVUndoKey {
+    int height;
+    unsigned int n;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, n);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        height = ser_readdata32be(s);
+        n = ser_readdata32be(s);
+    }
+
+    CKVUndoKey(int h, unsigned int i) {
+        height = h;
+        n = i;
+    }
+
+    CKVUndoKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        height = 0;
+        n = 0;
+    }
+};
+
+#endif // BITCOIN_KVINDEX_H
@@ -0,0 +1,79 @@
+// Copyright (c) 2019 The SuperNET Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LRUCACHE_H
+#define BITCOIN_LRUCACHE_H
+
+#include "sync.h"
+
+#include <list>
+#include <unordered_map>
+
+/** Thread safe map that only keeps the nMaxSize most recently used elements. */
+template <typename K, typename V, typename Hash = std::hash<K> >
+class CLRUCache
+{
+protected:
+    typedef std::list<std::pair<K, V> > list_type;
+    mutable CCriticalSection cs;
+    list_type entries; // most recently used first
+    std::unordered_map<K, typename list_type::iterator, Hash> index;
+    size_t nMaxSize;
+
+public:
+    CLRUCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn) { }
+
+    bool get(const K& key, V& value)
+    {
+        LOCK(cs);
+        typename std::unordered_map<K, typename list_type::iterator, Hash>::iterator it = index.find(key);
+        if (it == index.end())
+            return false;
+        entries.splice(entries.begin(), entries, it->second);
+        value = it->second->second;
+        return true;
+    }
+
+    void insert(const K& key, const V& value)
+    {
+        LOCK(cs);
+        typename std::unordered_map<K, typename list_type::iterator, Hash>::iterator it = index.find(key);
+        if (it != index.end()) {
+            it->second->second = value;
+            entries.splice(entries.begin(), entries, it->second);
+            return;
+        }
+        entries.push_front(std::make_pair(key, value));
+        index[key] = entries.begin();
+        if (entries.size() > nMaxSize) {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+    }
+
+    void erase(const K& key)
+    {
+        LOCK(cs);
+        typename std::unordered_map<K, typename list_type::iterator, Hash>::iterator it = index.find(key);
+        if (it != index.end()) {
+            entries.erase(it->second);
+            index.erase(it);
+        }
+    }
+
+    void clear()
+    {
+        LOCK(cs);
+        entries.clear();
+        index.clear();
+    }
+
+    size_t size() const
+    {
+        LOCK(cs);
+        return entries.size();
+    }
+};
+
+#endif // BITCOIN_LRUCACHE_H
@@ -32,6 +32,7 @@
 #include "consensus/validation.h"
 #include "deprecation.h"
 #include "init.h"
+#include "lrucache.h"
 #include "merkleblock.h"
 #include "metrics.h"
 #include "notarisationdb.h"
@@ -101,6 +102,7 @@ bool fTxIndex = false;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
+bool fOracleIndex = false;
 bool fHavePruned = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = true;
@@ -303,6 +305,10 @@ namespace {
         int nBlocksInFlightValidHeaders;
         //! Whether we consider this a preferred download peer.
         bool fPreferredDownload;
+        //! Height the peer announced in its version message.
+        int nStartingHeight;
+        //! Height this peer adds to the longest chain histogram, -1 while it adds none.
+        int nChainHeight;
 
         CNodeState() {
             fCurrentlyConnected = false;
@@ -316,6 +322,8 @@ namespace {
             nBlocksInFlight = 0;
             nBlocksInFlightValidHeaders = 0;
             fPreferredDownload = false;
+            nStartingHeight = -1;
+            nChainHeight = -1;
         }
     };
 
@@ -335,6 +343,35 @@ namespace {
         return chainActive.LastTip()->GetHeight();
     }
 
+    /** Number of peers at each claimed height. Requires cs_main. */
+    map<int, int> mapPeerChainHeights;
+    /** Highest height in mapPeerChainHeights, readable without locks. */
+    std::atomic<int32_t> nPeersLongestChain(0);
+
+    /** Move a peer to the highest of its announced, best known and common heights in the histogram. Requires cs_main. */
+    void UpdatePeerChainHeight(CNodeState *state, bool fRemove = false)
+    {
+        int nHeight = -1;
+        // peers we know no block of yet do not count
+        if (!fRemove && state->pindexBestKnownBlock != NULL) {
+            nHeight = std::max(0, state->nStartingHeight);
+            nHeight = std::max(nHeight, state->pindexBestKnownBlock->GetHeight());
+            if (state->pindexLastCommonBlock != NULL)
+                nHeight = std::max(nHeight, state->pindexLastCommonBlock->GetHeight());
+        }
+        if (nHeight == state->nChainHeight)
+            return;
+        if (state->nChainHeight >= 0) {
+            map<int, int>::iterator it = mapPeerChainHeights.find(state->nChainHeight);
+            if (--it->second == 0)
+                mapPeerChainHeights.erase(it);
+        }
+        if (nHeight >= 0)
+            mapPeerChainHeights[nHeight]++;
+        state->nChainHeight = nHeight;
+        nPeersLongestChain = mapPeerChainHeights.empty() ? 0 : mapPeerChainHeights.rbegin()->first;
+    }
+
     void UpdatePreferredDownload(CNode* node, CNodeState* state)
     {
         nPreferredDownload -= state->fPreferredDownload;
@@ -373,6 +410,7 @@ namespace {
         mapBlocksInFlight.erase(entry.hash);
         EraseOrphansFor(nodeid);
         nPreferredDownload -= state->fPreferredDownload;
+        UpdatePeerChainHeight(state, true);
 
         mapNodeState.erase(nodeid);
     }
@@ -435,6 +473,7 @@ namespace {
                 if (state->pindexBestKnownBlock == NULL || itOld->second->chainPower >= state->pindexBestKnownBlock->chainPower)
                     state->pindexBestKnownBlock = itOld->second;
                 state->hashLastUnknownBlock.SetNull();
+                UpdatePeerChainHeight(state);
             }
         }
     }
@@ -580,6 +619,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     return true;
 }
 
+int32_t GetPeersLongestChain()
+{
+    return nPeersLongestChain;
+}
+
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
     nodeSignals.GetHeight.connect(&GetHeight);
@@ -642,6 +686,16 @@ UniValue komodo_snapshot(int top)
     return(result);
 }
 
+// streamed getsnapshot, result is left empty without addressindex
+bool komodo_snapshotsorted(int top, UniValue &result, std::vector<std::pair<CAmount, std::string> > &vaddr)
+{
+    LOCK(cs_main);
+    if ( fAddressIndex && pblocktree != 0 )
+        return(pblocktree->SnapshotSorted(top, result, vaddr));
+    fprintf(stderr,"getsnapshot requires -addressindex=1\n");
+    return(false);
+}
+
 bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
 {
     if ( fAddressIndex && pblocktree != 0 ) 
@@ -654,31 +708,262 @@ bool komodo_snapshot2(std::map <std::string, CAmount> &addressAmounts)
 int32_t lastSnapShotHeight = 0;
 std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
-bool komodo_dailysnapshot(int32_t height)
+/** One step of undoing a block for the daily snapshot, in the order komodo_dailysnapshot applies them */
+struct CAddressLedgerOp
 {
-    int reorglimit = 10; // CHANGE BACK TO 100 AFTER TESTING!
-    uint256 notarized_hash,notarized_desttxid; int32_t prevMoMheight,notarized_height,undo_height,extraoffset;
-    if ( (extraoffset= height % KOMODO_SNAPSHOT_INTERVAL) != 0 )
+    CTxDestination dest;
+    CAmount nValue;
+    bool fSpent; // true: prevout spent by the block, gets added back. false: vout, gets removed
+    CAddressLedgerOp(const CTxDestination &destIn, CAmount nValueIn, bool fSpentIn) : dest(destIn), nValue(nValueIn), fSpent(fSpentIn) {}
+};
+
+/**
+ * Balances of the snapshot addresses at hashTip, seeded once from the address index and then kept
+ * current by ConnectBlock/DisconnectBlock, plus the undo steps of the last KOMODO_LEDGER_UNDODEPTH blocks.
+ * This lets komodo_dailysnapshot rewind a few blocks without a full address index scan.
+ *
+ * Nothing here is persisted. The unspent address index already is the on-disk balance state, so the
+ * ledger is seeded from it once per process, from a single leveldb snapshot tagged with the tip it was
+ * taken at. Undo steps are only kept in memory, blocks without them are undone from disk.
+ */
+#define KOMODO_LEDGER_UNDODEPTH 100
+struct CAddressLedger
+{
+    bool fActive;
+    uint256 hashTip;
+    std::map<std::pair<unsigned int,uint160>,CAmount> balances;
+    std::set<CAddressSnapshotEntry> ordered;
+    std::set<std::pair<unsigned int,uint160> > ignored;
+    std::map<uint256,std::pair<int32_t,std::vector<CAddressLedgerOp> > > undo;
+    CAddressLedger() : fActive(false) {}
+};
+static CAddressLedger addressLedger;
+
+static void komodo_ledger_reset()
+{
+    addressLedger.fActive = false;
+    addressLedger.hashTip.SetNull();
+    addressLedger.balances.clear();
+    addressLedger.ordered.clear();
+    addressLedger.undo.clear();
+}
+
+static void komodo_ledger_add(const std::pair<unsigned int,uint160> &key,CAmount delta)
+{
+    std::map<std::pair<unsigned int,uint160>,CAmount>::iterator it = addressLedger.balances.find(key);
+    CAmount amount = 0;
+    if ( it != addressLedger.balances.end() )
     {
-        // we are on chain init, and need to scan all the way back to the correct height, other wise our node will have a diffrent snapshot to online nodes.
-        // use the notarizationsDB to scan back from the consesnus height to get the offset we need.
-        std::string symbol; Notarisation nota;
-        symbol.assign(ASSETCHAINS_SYMBOL);
-        if ( ScanNotarisationsDB(height-extraoffset, symbol, 100, nota) == 0 )
-            undo_height = height-extraoffset-reorglimit; 
-        else undo_height = nota.second.height;
-        //fprintf(stderr, "height.%i-extraoffset.%i = startscanfrom.%i to get undo_height.%i\n", height, extraoffset, height-extraoffset, undo_height);
+        amount = it->second;
+        addressLedger.ordered.erase(CAddressSnapshotEntry(amount,key.first,key.second));
     }
-    else 
+    amount += delta;
+    if ( amount > 0 )
     {
-        // we are at the right height in connect block to scan back to last notarized height. 
-        notarized_height = komodo_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
-        notarized_height > height-reorglimit ? undo_height = notarized_height : undo_height = height-reorglimit; 
+        addressLedger.balances[key] = amount;
+        addressLedger.ordered.insert(CAddressSnapshotEntry(amount,key.first,key.second));
     }
-    fprintf(stderr, "doing snapshot for height.%i undo_height.%i\n", height, undo_height);
-    // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
-    if ( undo_height == lastSnapShotHeight )
-        return true;
+    else if ( it != addressLedger.balances.end() )
+        addressLedger.balances.erase(it);
+}
+
+// apply the address index entries of a block, sign > 0 when connecting and < 0 when disconnecting
+static void komodo_ledger_apply(const std::vector<std::pair<CAddressIndexKey,CAmount> > &addressIndex,int32_t sign)
+{
+    std::map<std::pair<unsigned int,uint160>,CAmount> deltas;
+    std::set<std::pair<unsigned int,uint160> > outputkeys;
+    const CAddressIndexKey *prev = 0;
+    for (std::vector<std::pair<CAddressIndexKey,CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); ++it)
+    {
+        const CAddressIndexKey &k = it->first;
+        // multisig solutions can repeat an address for the same output, the unspent index only holds it once
+        if ( prev == 0 || k.txhash != prev->txhash || k.index != prev->index || k.spending != prev->spending )
+            outputkeys.clear();
+        prev = &k;
+        std::pair<unsigned int,uint160> key(k.type,k.hashBytes);
+        if ( outputkeys.insert(key).second == false || k.type == 3 || addressLedger.ignored.count(key) != 0 )
+            continue;
+        deltas[key] += sign * it->second;
+    }
+    for (std::map<std::pair<unsigned int,uint160>,CAmount>::iterator it = deltas.begin(); it != deltas.end(); ++it)
+        if ( it->second != 0 )
+            komodo_ledger_add(it->first,it->second);
+}
+
+// undo steps of one tx: vouts in reverse, then the spent prevouts in reverse. view == 0 looks the prevouts up on disk
+static void komodo_ledger_txops(const CTransaction &tx,const CCoinsViewCache *view,std::vector<CAddressLedgerOp> &ops)
+{
+    CTxDestination vDest;
+    for (unsigned int k = tx.vout.size(); k-- > 0;)
+    {
+        if ( ExtractDestination(tx.vout[k].scriptPubKey, vDest) )
+            ops.push_back(CAddressLedgerOp(vDest,tx.vout[k].nValue,false));
+    }
+    if ( tx.IsCoinImport() || tx.IsCoinBase() )
+        return;
+    for (unsigned int j = tx.vin.size(); j-- > 0;)
+    {
+        if ( view != 0 )
+        {
+            const CTxOut &prevout = view->GetOutputFor(tx.vin[j]);
+            if ( ExtractDestination(prevout.scriptPubKey, vDest) )
+                ops.push_back(CAddressLedgerOp(vDest,prevout.nValue,true));
+        }
+        else
+        {
+            uint256 blockhash; CTransaction txin;
+            if ( myGetTransaction(tx.vin[j].prevout.hash,txin,blockhash) )
+            {
+                int vout = tx.vin[j].prevout.n;
+                if ( ExtractDestination(txin.vout[vout].scriptPubKey, vDest) )
+                    ops.push_back(CAddressLedgerOp(vDest,txin.vout[vout].nValue,true));
+            }
+        }
+    }
+}
+
+static void komodo_ledger_connect(CBlockIndex *pindex,const std::vector<std::pair<CAddressIndexKey,CAmount> > &addressIndex,std::vector<std::vector<CAddressLedgerOp> > &vTxOps)
+{
+    if ( addressLedger.fActive == false )
+        return;
+    if ( pindex->pprev == 0 || addressLedger.hashTip != pindex->pprev->GetBlockHash() )
+    {
+        komodo_ledger_reset();
+        return;
+    }
+    komodo_ledger_apply(addressIndex,1);
+    addressLedger.hashTip = pindex->GetBlockHash();
+    std::vector<CAddressLedgerOp> &ops = addressLedger.undo[pindex->GetBlockHash()].second;
+    addressLedger.undo[pindex->GetBlockHash()].first = pindex->GetHeight();
+    ops.clear();
+    for (int32_t i = (int32_t)vTxOps.size() - 1; i >= 0; i--)
+        ops.insert(ops.end(),vTxOps[i].begin(),vTxOps[i].end());
+    for (std::map<uint256,std::pair<int32_t,std::vector<CAddressLedgerOp> > >::iterator it = addressLedger.undo.begin(); it != addressLedger.undo.end(); )
+    {
+        if ( it->second.first <= pindex->GetHeight() - KOMODO_LEDGER_UNDODEPTH )
+            addressLedger.undo.erase(it++);
+        else ++it;
+    }
+}
+
+static void komodo_ledger_disconnect(CBlockIndex *pindex,const std::vector<std::pair<CAddressIndexKey,CAmount> > &addressIndex)
+{
+    if ( addressLedger.fActive == false )
+        return;
+    if ( pindex->pprev == 0 || addressLedger.hashTip != pindex->GetBlockHash() )
+    {
+        komodo_ledger_reset();
+        return;
+    }
+    komodo_ledger_apply(addressIndex,-1);
+    addressLedger.hashTip = pindex->pprev->GetBlockHash();
+    addressLedger.undo.erase(pindex->GetBlockHash());
+}
+
+// seed the ledger from a full address index scan, only possible while height is the tip. cs_main keeps the
+// tip from moving between the scan and the check that the snapshot was taken at it.
+static bool komodo_ledger_init(int32_t height)
+{
+    CBlockIndex *pindex; CAddressSnapshot snapshot;
+    LOCK(cs_main);
+    komodo_ledger_reset();
+    if ( !fAddressIndex || pblocktree == 0 || (pindex= chainActive.Tip()) == 0 || pindex->GetHeight() != height )
+        return false;
+    if ( !pblocktree->SnapshotAddresses(snapshot, 0) || snapshot.hashBlock != pindex->GetBlockHash() )
+        return false;
+    GetSnapshotIgnoredAddresses(addressLedger.ignored);
+    for (std::vector<CAddressSnapshotEntry>::const_iterator it = snapshot.vEntries.begin(); it != snapshot.vEntries.end(); ++it)
+    {
+        addressLedger.balances[std::make_pair(it->type,it->hashBytes)] = it->amount;
+        addressLedger.ordered.insert(*it);
+    }
+    addressLedger.hashTip = pindex->GetBlockHash();
+    addressLedger.fActive = true;
+    return true;
+}
+
+/**
+ * Same result as undoing blocks height..undo_height+1 from a full address snapshot, but only the
+ * addresses touched by those blocks are materialised. Everything else comes straight from the ledger.
+ */
+static bool komodo_ledger_snapshot(int32_t height,int32_t undo_height)
+{
+    CBlockIndex *pindex = chainActive[height];
+    if ( pindex == 0 || chainActive.Tip() != pindex )
+        return false;
+    if ( (addressLedger.fActive == false || addressLedger.hashTip != pindex->GetBlockHash()) && !komodo_ledger_init(height) )
+        return false;
+    std::map<std::string,CAmount> addressAmounts;
+    std::set<std::string> seeded;
+    std::set<std::pair<unsigned int,uint160> > seededKeys;
+    for (int32_t n = height; n > undo_height; n--)
+    {
+        CBlockIndex *pblockindex; std::vector<CAddressLedgerOp> diskops;
+        const std::vector<CAddressLedgerOp> *ops = &diskops;
+        if ( (pblockindex= chainActive[n]) == 0 )
+            return false;
+        std::map<uint256,std::pair<int32_t,std::vector<CAddressLedgerOp> > >::const_iterator it = addressLedger.undo.find(pblockindex->GetBlockHash());
+        if ( it != addressLedger.undo.end() )
+            ops = &it->second.second;
+        else
+        {
+            CBlock block;
+            if ( komodo_blockload(block, pblockindex) != 0 )
+                return false;
+            for (int32_t i = block.vtx.size() - 1; i >= 0; i--)
+                komodo_ledger_txops(block.vtx[i],0,diskops);
+        }
+        for (std::vector<CAddressLedgerOp>::const_iterator op = ops->begin(); op != ops->end(); ++op)
+        {
+            std::string address = CBitcoinAddress(op->dest).ToString();
+            if ( seeded.insert(address).second )
+            {
+                // first touch, start from the ledger balance like the full snapshot would
+                CTxDestination dest = DecodeDestination(address);
+                std::pair<unsigned int,uint160> key(0,uint160());
+                if ( CKeyID *keyID = boost::get<CKeyID>(&dest) )
+                    key = std::make_pair(1,uint160(*keyID));
+                else if ( CScriptID *scriptID = boost::get<CScriptID>(&dest) )
+                    key = std::make_pair(2,uint160(*scriptID));
+                if ( key.first != 0 )
+                {
+                    seededKeys.insert(key);
+                    std::map<std::pair<unsigned int,uint160>,CAmount>::const_iterator bal = addressLedger.balances.find(key);
+                    if ( bal != addressLedger.balances.end() )
+                        addressAmounts[address] = bal->second;
+                }
+            }
+            if ( op->fSpent )
+                addressAmounts[address] += op->nValue;
+            else
+            {
+                addressAmounts[address] -= op->nValue;
+                if ( addressAmounts[address] < 1 )
+                    addressAmounts.erase(address);
+            }
+        }
+    }
+    vAddressSnapshot.clear();
+    for ( auto element : addressAmounts )
+        vAddressSnapshot.push_back(make_pair(element.second, DecodeDestination(element.first)));
+    // untouched addresses keep their ledger balance, only the largest can make the cut
+    int32_t n = 0;
+    for (std::set<CAddressSnapshotEntry>::const_reverse_iterator it = addressLedger.ordered.rbegin(); it != addressLedger.ordered.rend() && n < 3999; ++it)
+    {
+        if ( seededKeys.count(std::make_pair(it->type,it->hashBytes)) != 0 )
+            continue;
+        if ( it->type == 1 )
+            vAddressSnapshot.push_back(make_pair(it->amount, CTxDestination(CKeyID(it->hashBytes))));
+        else vAddressSnapshot.push_back(make_pair(it->amount, CTxDestination(CScriptID(it->hashBytes))));
+        n++;
+    }
+    std::sort(vAddressSnapshot.rbegin(), vAddressSnapshot.rend());
+    if ( vAddressSnapshot.size() > 3999 ) vAddressSnapshot.resize(3999);
+    return true;
+}
+
+static bool komodo_fullsnapshot(int32_t height,int32_t undo_height)
+{
     std::map <std::string, int64_t> addressAmounts;
     if ( !komodo_snapshot2(addressAmounts) )
         return false;
@@ -733,6 +1018,36 @@ bool komodo_dailysnapshot(int32_t height)
     //    fprintf(stderr, "j.%i address.%s nValue.%li\n",j, CBitcoinAddress(vAddressSnapshot[j].second).ToString().c_str(), vAddressSnapshot[j].first );
     // include only top 5000 address.
     if ( vAddressSnapshot.size() > 3999 ) vAddressSnapshot.resize(3999);
+    return true;
+}
+
+bool komodo_dailysnapshot(int32_t height)
+{
+    int reorglimit = 10; // CHANGE BACK TO 100 AFTER TESTING!
+    uint256 notarized_hash,notarized_desttxid; int32_t prevMoMheight,notarized_height,undo_height,extraoffset;
+    if ( (extraoffset= height % KOMODO_SNAPSHOT_INTERVAL) != 0 )
+    {
+        // we are on chain init, and need to scan all the way back to the correct height, other wise our node will have a diffrent snapshot to online nodes.
+        // use the notarizationsDB to scan back from the consesnus height to get the offset we need.
+        std::string symbol; Notarisation nota;
+        symbol.assign(ASSETCHAINS_SYMBOL);
+        if ( ScanNotarisationsDB(height-extraoffset, symbol, 100, nota) == 0 )
+            undo_height = height-extraoffset-reorglimit; 
+        else undo_height = nota.second.height;
+        //fprintf(stderr, "height.%i-extraoffset.%i = startscanfrom.%i to get undo_height.%i\n", height, extraoffset, height-extraoffset, undo_height);
+    }
+    else 
+    {
+        // we are at the right height in connect block to scan back to last notarized height. 
+        notarized_height = komodo_notarized_height(&prevMoMheight,&notarized_hash,&notarized_desttxid);
+        notarized_height > height-reorglimit ? undo_height = notarized_height : undo_height = height-reorglimit; 
+    }
+    fprintf(stderr, "doing snapshot for height.%i undo_height.%i\n", height, undo_height);
+    // if we already did this height dont bother doing it again, this is just a reorg. The actual snapshot height cannot be reorged.
+    if ( undo_height == lastSnapShotHeight )
+        return true;
+    if ( !komodo_ledger_snapshot(height,undo_height) && !komodo_fullsnapshot(height,undo_height) )
+        return false;
     lastSnapShotHeight = undo_height; 
     fprintf(stderr, "vAddressSnapshot.size.%li\n", vAddressSnapshot.size());
     return true;
@@ -2041,6 +2356,8 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
         }
     }
 
+    if ( &pool == &mempool )
+        komodo_kvmempool(tx);
     SyncWithWallets(tx, NULL);
 
     return true;
@@ -2095,6 +2412,78 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     return true;
 }
 
+bool GetOracleSamples(const uint256 &oracletxid, const uint160 &publisher, int nHeight, const uint256 &batontxid, size_t nMax,
+                      std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &samples)
+{
+    if (!fOracleIndex)
+        return false;
+
+    if (!pblocktree->ReadOracleSamples(oracletxid, publisher, nHeight, batontxid, nMax, samples))
+        return error("unable to get oracle samples");
+
+    return true;
+}
+
+/** Collect the decoded oracle data samples of a block for the oracle sample index */
+static void GetBlockOracleSamples(const CBlock &block, int nHeight, std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &samples)
+{
+    uint256 oracletxid,batontxid; CPubKey pk; std::vector<uint8_t> vopret,data;
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction &tx = block.vtx[i];
+        if (tx.vout.size() == 0 || !GetOpReturnData(tx.vout.back().scriptPubKey, vopret) || vopret.size() < 2 || vopret[0] != EVAL_ORACLES || vopret[1] != 'D')
+            continue;
+        if (DecodeOraclesData(tx.vout.back().scriptPubKey, oracletxid, batontxid, pk, data) == 'D')
+            samples.push_back(make_pair(COracleSampleKey(oracletxid, pk.GetID(), nHeight, i), COracleSampleValue(tx.GetHash(), batontxid, data)));
+    }
+}
+
+bool BuildOracleSampleIndex()
+{
+    bool fIndexed = false;
+    fOracleIndex = false;
+    if (ASSETCHAINS_CC == 0)
+        return true;
+
+    LOCK(cs_main);
+    if (!pblocktree->ReadFlag("oracleindex", fIndexed) || !fIndexed) {
+        // every block is read once, which can take a long time on a long chain
+        int nHeight = chainActive.Height(), nReportedPct = -1;
+        LogPrintf("Building oracle sample index up to height %d\n", nHeight);
+        uiInterface.ShowProgress(_("Building oracle sample index..."), 0);
+        for (CBlockIndex *pindex = chainActive.Genesis(); pindex != NULL; pindex = chainActive.Next(pindex))
+        {
+            CBlock block;
+            std::vector<std::pair<COracleSampleKey, COracleSampleValue> > samples;
+            int nPct = nHeight > 0 ? (int)(100LL * pindex->GetHeight() / nHeight) : 100;
+            if (nPct / 10 != nReportedPct / 10) {
+                LogPrintf("Building oracle sample index: %d%% (height %d)\n", nPct, pindex->GetHeight());
+                uiInterface.ShowProgress(_("Building oracle sample index..."), std::max(1, std::min(99, nPct)));
+                nReportedPct = nPct;
+            }
+            if (ShutdownRequested()) {
+                // the flag stays unset, so the next start builds the index again
+                LogPrintf("Building oracle sample index interrupted at height %d\n", pindex->GetHeight());
+                uiInterface.ShowProgress("", 100);
+                return true;
+            }
+            if (!(pindex->nStatus & BLOCK_HAVE_DATA))
+                continue;
+            if (!ReadBlockFromDisk(block, pindex, false))
+                return error("%s: cannot read block %d", __func__, pindex->GetHeight());
+            GetBlockOracleSamples(block, pindex->GetHeight(), samples);
+            if (samples.size() != 0 && !pblocktree->WriteOracleSamples(samples))
+                return error("%s: cannot write oracle samples of block %d", __func__, pindex->GetHeight());
+        }
+        uiInterface.ShowProgress("", 100);
+        if (!pblocktree->WriteFlag("oracleindex", true))
+            return error("%s: cannot write oracleindex flag", __func__);
+        LogPrintf("Oracle sample index built\n");
+    }
+    fOracleIndex = true;
+    return true;
+}
+
 struct CompareBlocksByHeightMain
 {
     bool operator()(const CBlockIndex* a, const CBlockIndex* b) const
@@ -2185,6 +2574,9 @@ bool myAddtomempool(CTransaction &tx, CValidationState *pstate, bool fSkipExpiry
     else return(true);
 }
 
+// confirmed transactions read by CC code, cleared whenever a block is disconnected
+static CLRUCache<uint256, std::pair<CTransaction, uint256>, CCoinsKeyHasher> myTxCache(MAX_MYTXCACHE_SIZE);
+
 bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock)
 {
     memset(&hashBlock,0,sizeof(hashBlock));
@@ -2197,6 +2589,13 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
             return true;
         }
     }
+    std::pair<CTransaction, uint256> cached;
+    if (myTxCache.get(hash, cached))
+    {
+        txOut = cached.first;
+        hashBlock = cached.second;
+        return true;
+    }
     //fprintf(stderr,"check disk %s\n",hash.GetHex().c_str());
 
     if (fTxIndex) {
@@ -2220,6 +2619,7 @@ bool myGetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlo
             if (txOut.GetHash() != hash)
                 return error("%s: txid mismatch", __func__);
             //fprintf(stderr,"found on disk %s\n",hash.GetHex().c_str());
+            myTxCache.insert(hash, std::make_pair(txOut, hashBlock));
             return true;
         }
     }
@@ -3042,6 +3442,7 @@ void ConnectNotarisations(const CBlock &block, int height)
         CDBBatch batch = CDBBatch(*pnotarisations);
         batch.Write(block.GetHash(), notarisations);
         WriteBackNotarisations(notarisations, batch);
+        WriteNotarisationIndexes(notarisations, height, batch);
         pnotarisations->WriteBatch(batch, true);
         LogPrintf("ConnectBlock: wrote %i block notarisations in block: %s\n",
                 notarisations.size(), block.GetHash().GetHex().data());
@@ -3049,7 +3450,7 @@ void ConnectNotarisations(const CBlock &block, int height)
 }
 
 
-void DisconnectNotarisations(const CBlock &block)
+void DisconnectNotarisations(const CBlock &block, int height)
 {
     // Delete from notarisations cache
     NotarisationsInBlock nibs;
@@ -3057,6 +3458,7 @@ void DisconnectNotarisations(const CBlock &block)
         CDBBatch batch = CDBBatch(*pnotarisations);
         batch.Erase(block.GetHash());
         EraseBackNotarisations(nibs, batch);
+        EraseNotarisationIndexes(nibs, height, batch);
         pnotarisations->WriteBatch(batch, true);
         LogPrintf("DisconnectTip: deleted %i block notarisations in block: %s\n",
             nibs.size(), block.GetHash().GetHex().data());
@@ -3234,6 +3636,14 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+        komodo_ledger_disconnect(pindex,addressIndex);
+    }
+
+    if (fOracleIndex) {
+        std::vector<std::pair<COracleSampleKey, COracleSampleValue> > oracleSamples;
+        GetBlockOracleSamples(block, pindex->GetHeight(), oracleSamples);
+        if (oracleSamples.size() != 0 && !pblocktree->EraseOracleSamples(oracleSamples))
+            return AbortNode(state, "Failed to delete oracle sample index");
     }
 
     return fClean;
@@ -3520,6 +3930,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
+    // snapshot undo steps, only kept once komodo_dailysnapshot has seeded the address ledger
+    bool fLedger = !fJustCheck && fAddressIndex && addressLedger.fActive;
+    std::vector<std::vector<CAddressLedgerOp> > vLedgerOps(fLedger ? block.vtx.size() : 0);
+    int64_t supplyvins=0,supplyvouts=0,supplyzfunds=0,supplysproutfunds=0;
     for (unsigned int i = 0; i < block.vtx.size(); i++)
     {
         const CTransaction &tx = block.vtx[i];
@@ -3638,6 +4052,11 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             }
         }
 
+        if ( fLedger )
+            komodo_ledger_txops(tx,&view,vLedgerOps[i]);
+        if ( !fJustCheck )
+            komodo_txnewcoins(&supplyvins,&supplyvouts,&supplyzfunds,&supplysproutfunds,tx,i,&view); // before UpdateCoins spends the vins
+
         //if ( ASSETCHAINS_SYMBOL[0] == 0 )
         //    komodo_earned_interest(pindex->GetHeight(),sum);
         CTxUndo undoDummy;
@@ -3765,12 +4184,20 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
+        komodo_ledger_connect(pindex,addressIndex,vLedgerOps);
     }
 
     if (fSpentIndex)
         if (!pblocktree->UpdateSpentIndex(spentIndex))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (fOracleIndex) {
+        std::vector<std::pair<COracleSampleKey, COracleSampleValue> > oracleSamples;
+        GetBlockOracleSamples(block, pindex->GetHeight(), oracleSamples);
+        if (oracleSamples.size() != 0 && !pblocktree->WriteOracleSamples(oracleSamples))
+            return AbortNode(state, "Failed to write oracle sample index");
+    }
+
     if (fTimestampIndex)
     {
         unsigned int logicalTS = pindex->nTime;
@@ -3809,6 +4236,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
     //FlushStateToDisk();
     komodo_connectblock(false,pindex,*(CBlock *)&block);  // dPoW state update.
+    komodo_kvconnect(pindex->GetHeight());
+    if ( ASSETCHAINS_STAKED != 0 && pindex->stakesegid < -1 )
+        komodo_setstakesegid(pindex,&block); // so komodo_segids never has to reload this block
+    if ( (pindex->nStatus & BLOCK_HAVE_MINERPUBKEY) == 0 )
+        komodo_setminerpubkey(pindex,(CBlock *)&block); // nor komodo_eligiblenotary/komodo_minerids
+    komodo_setsupply(pindex,komodo_blocknewcoins(supplyvins,supplyvouts),supplyzfunds,supplysproutfunds); // so komodo_coinsupply reads the totals instead of every block
     if ( ASSETCHAINS_NOTARY_PAY[0] != 0 )
     {
       // Update the notary pay with the latest payment.
@@ -4021,7 +4454,9 @@ bool static DisconnectTip(CValidationState &state, bool fBare = false) {
         if (!DisconnectBlock(block, state, pindexDelete, view))
             return error("DisconnectTip(): DisconnectBlock %s failed", pindexDelete->GetBlockHash().ToString());
         assert(view.Flush());
-        DisconnectNotarisations(block);
+        DisconnectNotarisations(block, pindexDelete->GetHeight());
+        komodo_kvdisconnect(pindexDelete->GetHeight());
+        myTxCache.clear();
     }
     pindexDelete->segid = -2;
     pindexDelete->nNotaryPay = 0; 
@@ -7087,7 +7522,13 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv,
         pfrom->fClient = !(pfrom->nServices & NODE_NETWORK);
 
         // Potentially mark this peer as a preferred download peer.
-        UpdatePreferredDownload(pfrom, State(pfrom->GetId()));
+        {
+            LOCK(cs_main);
+            CNodeState *state = State(pfrom->GetId());
+            UpdatePreferredDownload(pfrom, state);
+            state->nStartingHeight = pfrom->nStartingHeight;
+            UpdatePeerChainHeight(state);
+        }
 
         // Change version
         pfrom->PushMessage("verack");
@@ -8272,6 +8713,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vector<CBlockIndex*> vToDownload;
             NodeId staller = -1;
             FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller);
+            UpdatePeerChainHeight(&state);
             BOOST_FOREACH(CBlockIndex *pindex, vToDownload) {
                 vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
                 MarkBlockAsInFlight(pto->GetId(), pindex->GetBlockHash(), consensusParams, pindex);
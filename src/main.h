@@ -39,6 +39,7 @@
 #include "script/standard.h"
 #include "script/script_ext.h"
 #include "spentindex.h"
+#include "oracleindex.h"
 #include "sync.h"
 #include "tinyformat.h"
 #include "txmempool.h"
@@ -119,6 +120,8 @@ static const unsigned int DATABASE_FLUSH_INTERVAL = 24 * 60 * 60;
 /** Maximum length of reject messages. */
 static const unsigned int MAX_REJECT_MESSAGE_LENGTH = 111;
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
+/** Number of confirmed transactions myGetTransaction keeps in memory for CC code */
+static const unsigned int MAX_MYTXCACHE_SIZE = 10000;
 
 //static const bool DEFAULT_ADDRESSINDEX = false;
 //static const bool DEFAULT_SPENTINDEX = false;
@@ -157,6 +160,7 @@ extern bool fImporting;
 extern bool fReindex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fOracleIndex;
 extern bool fIsBareMultisigStd;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
@@ -281,6 +285,8 @@ void UnlinkPrunedFiles(std::set<int>& setFilesToPrune);
 CBlockIndex * InsertBlockIndex(uint256 hash);
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+/** Highest chain height claimed by any peer, 0 without peers; lock free */
+int32_t GetPeersLongestChain();
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 /** Flush all state, indexes and buffers to disk. */
@@ -632,6 +638,97 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+/** Balance of one address in an address snapshot, fixed 29 bytes on disk */
+struct CAddressSnapshotEntry {
+    CAmount amount;
+    unsigned int type;
+    uint160 hashBytes;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 29;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata64(s, amount);
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        amount = ser_readdata64(s);
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s);
+    }
+
+    CAddressSnapshotEntry(CAmount nAmount, unsigned int addressType, uint160 addressHash) {
+        amount = nAmount;
+        type = addressType;
+        hashBytes = addressHash;
+    }
+
+    CAddressSnapshotEntry() {
+        SetNull();
+    }
+
+    void SetNull() {
+        amount = 0;
+        type = 0;
+        hashBytes.SetNull();
+    }
+
+    // same order as sorting (amount, CTxDestination) pairs
+    friend bool operator<(const CAddressSnapshotEntry& a, const CAddressSnapshotEntry& b) {
+        if (a.amount != b.amount)
+            return a.amount < b.amount;
+        if (a.type != b.type)
+            return a.type < b.type;
+        return a.hashBytes < b.hashBytes;
+    }
+    friend bool operator>(const CAddressSnapshotEntry& a, const CAddressSnapshotEntry& b) {
+        return b < a;
+    }
+};
+
+/** Unspent balances of every transparent address at one block, largest first */
+struct CAddressSnapshot {
+    int nHeight;
+    uint256 hashBlock;
+    CAmount total;
+    CAmount ccTotal;
+    int64_t utxos;
+    int64_t ccUtxos;
+    int64_t totalAddresses;
+    int64_t ignoredAddresses;
+    std::vector<CAddressSnapshotEntry> vEntries;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nHeight);
+        READWRITE(hashBlock);
+        READWRITE(total);
+        READWRITE(ccTotal);
+        READWRITE(utxos);
+        READWRITE(ccUtxos);
+        READWRITE(totalAddresses);
+        READWRITE(ignoredAddresses);
+        READWRITE(vEntries);
+    }
+
+    CAddressSnapshot() {
+        SetNull();
+    }
+
+    void SetNull() {
+        nHeight = -1;
+        hashBlock.SetNull();
+        total = ccTotal = 0;
+        utxos = ccUtxos = totalAddresses = ignoredAddresses = 0;
+        vEntries.clear();
+    }
+};
+
 struct CDiskTxPos : public CDiskBlockPos
 {
     unsigned int nTxOffset; // after header
@@ -802,6 +899,10 @@ bool GetAddressIndex(uint160 addressHash, int type,
                      int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type,
                        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+bool GetOracleSamples(const uint256 &oracletxid, const uint160 &publisher, int nHeight, const uint256 &batontxid, size_t nMax,
+                      std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &samples);
+/** Index the oracle data samples of the active chain if that was never done, see fOracleIndex */
+bool BuildOracleSampleIndex();
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
@@ -158,6 +158,98 @@ int32_t komodo_getnotarizedheight(uint32_t timestamp,int32_t height, uint8_t *sc
 CScript komodo_mineropret(int32_t nHeight);
 bool komodo_appendACscriptpub();
 
+/**
+ * What CreateNewBlock learnt about the inputs of a mempool transaction. Kept between calls, so only
+ * transactions that are new to the mempool need their coins looked up again. Guarded by cs_main.
+ */
+struct CTemplateInput
+{
+    CAmount nValue;
+    int nHeight;            // height of the coin, -1 while the parent is still in the mempool
+    uint256 hashParent;     // mempool parent, only set when nHeight < 0
+    bool fPayToPubkey;      // coin is a 33 byte pay to pubkey, pubkey33 holds the key
+    uint8_t pubkey33[33];
+};
+
+struct CTemplateCandidate
+{
+    unsigned int nTxSize;
+    CAmount nShieldedValueIn;
+    bool fNotaryTx;
+    bool fHasParents;
+    uint64_t nGeneration;   // last CreateNewBlock call that saw this tx in the mempool
+    std::vector<CTemplateInput> vInputs;
+};
+
+static std::map<uint256, CTemplateCandidate> mapTemplateCandidates;
+static uint256 hashTemplateTip;
+static uint64_t nTemplateGeneration;
+
+// inputs of a tx that was mined stay put when the chain grows, but mempool parents may have just been mined
+static void UpdateTemplateCandidates(const CBlockIndex *pindexPrev)
+{
+    if ( hashTemplateTip == pindexPrev->GetBlockHash() )
+        return;
+    if ( pindexPrev->pprev != 0 && hashTemplateTip == pindexPrev->pprev->GetBlockHash() )
+    {
+        for (std::map<uint256, CTemplateCandidate>::iterator it = mapTemplateCandidates.begin(); it != mapTemplateCandidates.end(); )
+        {
+            if ( it->second.fHasParents )
+                mapTemplateCandidates.erase(it++);
+            else ++it;
+        }
+    } else mapTemplateCandidates.clear();
+    hashTemplateTip = pindexPrev->GetBlockHash();
+}
+
+static bool BuildTemplateCandidate(const CTransaction &tx, CCoinsViewCache &view, CTemplateCandidate &cand)
+{
+    cand.nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    cand.nShieldedValueIn = tx.GetShieldedValueIn();
+    cand.fNotaryTx = !tx.IsCoinImport() && komodo_is_notarytx(tx) == 1;
+    cand.fHasParents = false;
+    cand.nGeneration = 0;
+    if ( tx.IsCoinImport() )
+        return true;
+    cand.vInputs.resize(tx.vin.size());
+    for (size_t i = 0; i < tx.vin.size(); i++)
+    {
+        const CTxIn &txin = tx.vin[i];
+        CTemplateInput &input = cand.vInputs[i];
+        input.fPayToPubkey = false;
+        if (!view.HaveCoins(txin.prevout.hash))
+        {
+            // This should never happen; all transactions in the memory
+            // pool should connect to either transactions in the chain
+            // or other transactions in the memory pool.
+            CTxMemPool::indexed_transaction_set::const_iterator parent = mempool.mapTx.find(txin.prevout.hash);
+            if (parent == mempool.mapTx.end())
+            {
+                LogPrintf("ERROR: mempool transaction missing input\n");
+                if (fDebug) assert("mempool transaction missing input" == 0);
+                return false;
+            }
+            // Has to wait for dependencies
+            input.nValue = parent->GetTx().vout[txin.prevout.n].nValue;
+            input.nHeight = -1;
+            input.hashParent = txin.prevout.hash;
+            cand.fHasParents = true;
+            continue;
+        }
+        const CCoins* coins = view.AccessCoins(txin.prevout.hash);
+        assert(coins);
+        const CScript &script = coins->vout[txin.prevout.n].scriptPubKey;
+        input.nValue = coins->vout[txin.prevout.n].nValue;
+        input.nHeight = coins->nHeight;
+        if ( script.size() == 35 && script[0] == 33 && script[34] == OP_CHECKSIG )
+        {
+            input.fPayToPubkey = true;
+            memcpy(input.pubkey33, &script[1], 33);
+        }
+    }
+    return true;
+}
+
 CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32_t gpucount, bool isStake)
 {
     CScript scriptPubKeyIn(_scriptPubKeyIn);
@@ -272,6 +364,9 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
         vector<TxPriority> vecPriority;
         vecPriority.reserve(mempool.mapTx.size() + 1);
 
+        UpdateTemplateCandidates(pindexPrev);
+        nTemplateGeneration++;
+
         // now add transactions from the mem pool
         int32_t Notarisations = 0; uint64_t txvalue;
         for (CTxMemPool::indexed_transaction_set::iterator mi = mempool.mapTx.begin();
@@ -300,10 +395,21 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                 continue;
             }
 
+            uint256 hash = tx.GetHash();
+            std::map<uint256, CTemplateCandidate>::iterator cit = mapTemplateCandidates.find(hash);
+            if ( cit == mapTemplateCandidates.end() )
+            {
+                CTemplateCandidate cand;
+                if ( !BuildTemplateCandidate(tx, view, cand) )
+                    continue;
+                cit = mapTemplateCandidates.insert(std::make_pair(hash, cand)).first;
+            }
+            CTemplateCandidate &cand = cit->second;
+            cand.nGeneration = nTemplateGeneration;
+
             COrphan* porphan = NULL;
             double dPriority = 0;
             CAmount nTotalIn = 0;
-            bool fMissingInputs = false;
             bool fNotarisation = false;
             std::vector<int8_t> TMP_NotarisationNotaries;
             if (tx.IsCoinImport())
@@ -314,27 +420,13 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
             } else {
                 TMP_NotarisationNotaries.clear();
                 bool fToCryptoAddress = false;
-                if ( numSN != 0 && notarypubkeys[0][0] != 0 && komodo_is_notarytx(tx) == 1 )
+                if ( numSN != 0 && notarypubkeys[0][0] != 0 && cand.fNotaryTx )
                     fToCryptoAddress = true;
 
-                BOOST_FOREACH(const CTxIn& txin, tx.vin)
+                BOOST_FOREACH(const CTemplateInput& input, cand.vInputs)
                 {
-                    // Read prev transaction
-                    if (!view.HaveCoins(txin.prevout.hash))
+                    if (input.nHeight < 0)
                     {
-                        // This should never happen; all transactions in the memory
-                        // pool should connect to either transactions in the chain
-                        // or other transactions in the memory pool.
-                        if (!mempool.mapTx.count(txin.prevout.hash))
-                        {
-                            LogPrintf("ERROR: mempool transaction missing input\n");
-                            if (fDebug) assert("mempool transaction missing input" == 0);
-                            fMissingInputs = true;
-                            if (porphan)
-                                vOrphan.pop_back();
-                            break;
-                        }
-
                         // Has to wait for dependencies
                         if (!porphan)
                         {
@@ -342,28 +434,22 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                             vOrphan.push_back(COrphan(&tx));
                             porphan = &vOrphan.back();
                         }
-                        mapDependers[txin.prevout.hash].push_back(porphan);
-                        porphan->setDependsOn.insert(txin.prevout.hash);
-                        nTotalIn += mempool.mapTx.find(txin.prevout.hash)->GetTx().vout[txin.prevout.n].nValue;
+                        mapDependers[input.hashParent].push_back(porphan);
+                        porphan->setDependsOn.insert(input.hashParent);
+                        nTotalIn += input.nValue;
                         continue;
                     }
-                    const CCoins* coins = view.AccessCoins(txin.prevout.hash);
-                    assert(coins);
-
-                    CAmount nValueIn = coins->vout[txin.prevout.n].nValue;
+                    CAmount nValueIn = input.nValue;
                     nTotalIn += nValueIn;
 
-                    int nConf = nHeight - coins->nHeight;
-                    
-                    uint8_t *script; int32_t scriptlen; uint256 hash; CTransaction tx1;
+                    int nConf = nHeight - input.nHeight;
+
                     // loop over notaries array and extract index of signers.
-                    if ( fToCryptoAddress && GetTransaction(txin.prevout.hash,tx1,hash,false) )
+                    if ( fToCryptoAddress && input.fPayToPubkey )
                     {
                         for (int8_t i = 0; i < numSN; i++) 
                         {
-                            script = (uint8_t *)&tx1.vout[txin.prevout.n].scriptPubKey[0];
-                            scriptlen = (int32_t)tx1.vout[txin.prevout.n].scriptPubKey.size();
-                            if ( scriptlen == 35 && script[0] == 33 && script[34] == OP_CHECKSIG && memcmp(script+1,notarypubkeys[i],33) == 0 )
+                            if ( memcmp(input.pubkey33,notarypubkeys[i],33) == 0 )
                             {
                                 // We can add the index of each notary to vector, and clear it if this notarisation is not valid later on.
                                 TMP_NotarisationNotaries.push_back(i);                          
@@ -381,16 +467,13 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                         fprintf(stderr, "possible notarisation is signed multiple times by same notary, passed as normal transaction.\n");
                     } else fNotarisation = true;
                 }
-                nTotalIn += tx.GetShieldedValueIn();
+                nTotalIn += cand.nShieldedValueIn;
             }
 
-            if (fMissingInputs) continue;
-
             // Priority is sum(valuein * age) / modified_txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            unsigned int nTxSize = cand.nTxSize;
             dPriority = tx.ComputePriority(dPriority, nTxSize);
 
-            uint256 hash = tx.GetHash();
             mempool.ApplyDeltas(hash, dPriority, nTotalIn);
 
             CFeeRate feeRate(nTotalIn-tx.GetValueOut(), nTxSize);
@@ -438,6 +521,14 @@ CBlockTemplate* CreateNewBlock(CPubKey _pk,const CScript& _scriptPubKeyIn, int32
                 vecPriority.push_back(TxPriority(dPriority, feeRate, &(mi->GetTx())));
         }
 
+        // forget transactions that have left the mempool
+        for (std::map<uint256, CTemplateCandidate>::iterator it = mapTemplateCandidates.begin(); it != mapTemplateCandidates.end(); )
+        {
+            if ( it->second.nGeneration != nTemplateGeneration && mempool.mapTx.count(it->first) == 0 )
+                mapTemplateCandidates.erase(it++);
+            else ++it;
+        }
+
         // Collect transactions into block
         uint64_t nBlockSize = 1000;
         uint64_t nBlockTx = 0;
@@ -7,14 +7,139 @@
 #include "notaries_staked.h"
 
 #include <boost/foreach.hpp>
+#include <boost/scoped_ptr.hpp>
 
 
 NotarisationDB *pnotarisations;
 
 
+/*
+ * Besides the per block and back notarisation records, which are keyed by a bare hash,
+ * notarisations are indexed by (symbol, height) and (ccId, height) of the block that
+ * confirms them. Heights are big endian and followed by the position in the block so
+ * that a range seek returns them in chain order.
+ *
+ * The index keys share the keyspace with the bare 32 byte hashes, so they are never 32
+ * bytes long. A range is bounded on the raw key bytes and keys of another size inside it
+ * are skipped. The symbol is zero padded to a fixed width, so a symbol range has a common
+ * prefix longer than a hash and no hash can sort into it at all.
+ */
+static const char DB_NOTARISATION_SYMBOL = 'S';
+static const char DB_NOTARISATION_CCID = 'C';
+static const char DB_NOTARISATION_INDEXED = 'I';
+
+static const size_t NOTARISATION_SYMBOL_SIZE = sizeof(NotarisationData().symbol);
+static const unsigned int NOTARISATION_SYMBOL_KEY_SIZE = 1 + NOTARISATION_SYMBOL_SIZE + 8;
+static const unsigned int NOTARISATION_CCID_KEY_SIZE = 1 + 10;
+
+struct NotarisationSymbolKey {
+    std::string symbol;
+    int height;
+    unsigned int n;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return NOTARISATION_SYMBOL_SIZE + 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        char buf[NOTARISATION_SYMBOL_SIZE] = {0};
+        strncpy(buf, symbol.c_str(), sizeof(buf)-1);
+        s.write(buf, sizeof(buf));
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, n);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        char buf[NOTARISATION_SYMBOL_SIZE];
+        s.read(buf, sizeof(buf));
+        symbol.assign(buf, strnlen(buf, sizeof(buf)));
+        height = ser_readdata32be(s);
+        n = ser_readdata32be(s);
+    }
+
+    NotarisationSymbolKey(std::string sym, int h, unsigned int i) : symbol(sym), height(h), n(i) { }
+    NotarisationSymbolKey() : height(0), n(0) { }
+};
+
+struct NotarisationCCIdKey {
+    uint16_t ccId;
+    int height;
+    unsigned int n;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 10;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        ser_writedata8(s, ccId >> 8);
+        ser_writedata8(s, ccId & 0xff);
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, n);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        ccId = ser_readdata8(s) << 8;
+        ccId |= ser_readdata8(s);
+        height = ser_readdata32be(s);
+        n = ser_readdata32be(s);
+    }
+
+    NotarisationCCIdKey(uint16_t id, int h, unsigned int i) : ccId(id), height(h), n(i) { }
+    NotarisationCCIdKey() : ccId(0), height(0), n(0) { }
+};
+
+
+template<typename K>
+static std::string NotarisationRawKey(char prefix, const K &key)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << std::make_pair(prefix, key);
+    return ss.str();
+}
+
+
+static std::string NotarisationRawKey(CDBIterator *iter)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    iter->GetKeyDataStream(ss);
+    return ss.str();
+}
+
+
 NotarisationDB::NotarisationDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "notarisations", nCacheSize, fMemory, fWipe, false, 64) { }
 
 
+/*
+ * Databases written before the height indexes existed only have the per block records,
+ * so index those once for the active chain.
+ */
+bool NotarisationDB::BuildIndexes()
+{
+    if (Exists(DB_NOTARISATION_INDEXED))
+        return true;
+
+    LogPrintf("Indexing notarisations for %i blocks...\n", chainActive.Height());
+    int indexed = 0, h = 1;
+    while (h <= chainActive.Height()) {
+        CDBBatch batch(*this);
+        for (int n=0; h<=chainActive.Height() && n<10000; h++) {
+            NotarisationsInBlock nibs;
+            if (!Read(chainActive[h]->GetBlockHash(), nibs))
+                continue;
+            WriteNotarisationIndexes(nibs, h, batch);
+            n += nibs.size();
+            indexed += nibs.size();
+        }
+        if (!WriteBatch(batch, true))
+            return error("%s: failed to write notarisation index", __func__);
+    }
+    if (!Write(DB_NOTARISATION_INDEXED, '1', true))
+        return error("%s: failed to write notarisation index", __func__);
+    LogPrintf("Indexed %i notarisations\n", indexed);
+    return true;
+}
+
+
 NotarisationsInBlock ScanBlockNotarisations(const CBlock &block, int nHeight)
 {
     EvalRef eval;
@@ -110,28 +235,131 @@ void EraseBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &
     }
 }
 
+void WriteNotarisationIndexes(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch)
+{
+    for (unsigned int i=0; i<notarisations.size(); i++)
+    {
+        const Notarisation &n = notarisations[i];
+        batch.Write(std::make_pair(DB_NOTARISATION_SYMBOL, NotarisationSymbolKey(n.second.symbol, nHeight, i)), n);
+        batch.Write(std::make_pair(DB_NOTARISATION_CCID, NotarisationCCIdKey(n.second.ccId, nHeight, i)), n);
+    }
+}
+
+
+void EraseNotarisationIndexes(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch)
+{
+    for (unsigned int i=0; i<notarisations.size(); i++)
+    {
+        const Notarisation &n = notarisations[i];
+        batch.Erase(std::make_pair(DB_NOTARISATION_SYMBOL, NotarisationSymbolKey(n.second.symbol, nHeight, i)));
+        batch.Erase(std::make_pair(DB_NOTARISATION_CCID, NotarisationCCIdKey(n.second.ccId, nHeight, i)));
+    }
+}
+
+
 /*
- * Scan notarisationsdb backwards for blocks containing a notarisation
- * for given symbol. Return height of matched notarisation or 0.
+ * Walk the notarisations of symbol confirmed at heights nLow to nHigh, upwards or
+ * downwards, keeping block order within a block, until f accepts one.
+ * Return height of matched notarisation or 0.
  */
-int ScanNotarisationsDB(int height, std::string symbol, int scanLimitBlocks, Notarisation& out)
+int ScanSymbolNotarisations(const char* symbol, int nLow, int nHigh, bool fReverse,
+        const std::function<bool(int, const Notarisation&)> &f, Notarisation &found)
 {
-    if (height < 0 || height > chainActive.Height())
+    if (nLow < 0) nLow = 0;
+    if (nLow > nHigh)
+        return 0;
+
+    std::string keyLow = NotarisationRawKey(DB_NOTARISATION_SYMBOL, NotarisationSymbolKey(symbol, nLow, 0));
+    std::string keyHigh = NotarisationRawKey(DB_NOTARISATION_SYMBOL, NotarisationSymbolKey(symbol, nHigh, 0xffffffff));
+    boost::scoped_ptr<CDBIterator> iter(pnotarisations->NewIterator());
+    std::pair<char, NotarisationSymbolKey> key;
+    NotarisationsInBlock block;
+    int blockHeight = -1;
+
+    // going down, a block is only complete once the next key is below it
+    auto flushBlock = [&]() {
+        for (int i=block.size()-1; i>=0; i--)
+            if (f(blockHeight, block[i])) {
+                found = block[i];
+                return true;
+            }
+        block.clear();
         return false;
+    };
 
-    for (int i=0; i<scanLimitBlocks; i++) {
-        if (i > height) break;
-        NotarisationsInBlock notarisations;
-        uint256 blockHash = *chainActive[height-i]->phashBlock;
-        if (!GetBlockNotarisations(blockHash, notarisations))
+    if (!fReverse)
+        iter->Seek(std::make_pair(DB_NOTARISATION_SYMBOL, NotarisationSymbolKey(symbol, nLow, 0)));
+    else {
+        iter->Seek(std::make_pair(DB_NOTARISATION_SYMBOL, NotarisationSymbolKey(symbol, nHigh, 0xffffffff)));
+        if (!iter->Valid())
+            iter->SeekToLast();
+        else if (NotarisationRawKey(iter.get()) > keyHigh)
+            iter->Prev();
+    }
+    for (; iter->Valid(); fReverse ? iter->Prev() : iter->Next())
+    {
+        std::string raw = NotarisationRawKey(iter.get());
+        if (fReverse ? raw < keyLow : raw > keyHigh)
+            break;
+        if (iter->GetKeySize() != NOTARISATION_SYMBOL_KEY_SIZE || !iter->GetKey(key) || key.first != DB_NOTARISATION_SYMBOL)
             continue;
 
-        BOOST_FOREACH(Notarisation& nota, notarisations) {
-            if (strcmp(nota.second.symbol, symbol.data()) == 0) {
-                out = nota;
-                return height-i;
-            }
+        Notarisation nota;
+        if (!iter->GetValue(nota) || strcmp(nota.second.symbol, symbol) != 0)
+            continue;
+        if (fReverse) {
+            if (key.second.height != blockHeight && flushBlock())
+                return blockHeight;
+            blockHeight = key.second.height;
+            block.push_back(nota);
+        } else if (f(key.second.height, nota)) {
+            found = nota;
+            return key.second.height;
         }
     }
+    if (fReverse && flushBlock())
+        return blockHeight;
     return 0;
 }
+
+
+/*
+ * Get notarisations of ccId confirmed at heights nLow to nHigh, in chain order
+ */
+void GetCCIdNotarisations(uint32_t ccId, int nLow, int nHigh, NotarisationsInBlock &out)
+{
+    out.clear();
+    if (ccId > 0xffff || nLow > nHigh || nHigh < 0)
+        return;
+
+    std::string keyHigh = NotarisationRawKey(DB_NOTARISATION_CCID, NotarisationCCIdKey(ccId, nHigh, 0xffffffff));
+    boost::scoped_ptr<CDBIterator> iter(pnotarisations->NewIterator());
+    std::pair<char, NotarisationCCIdKey> key;
+    iter->Seek(std::make_pair(DB_NOTARISATION_CCID, NotarisationCCIdKey(ccId, std::max(nLow, 0), 0)));
+    for (; iter->Valid(); iter->Next())
+    {
+        if (NotarisationRawKey(iter.get()) > keyHigh)
+            break;
+        if (iter->GetKeySize() != NOTARISATION_CCID_KEY_SIZE || !iter->GetKey(key) || key.first != DB_NOTARISATION_CCID)
+            continue;
+        Notarisation nota;
+        if (iter->GetValue(nota) && nota.second.ccId == ccId)
+            out.push_back(nota);
+    }
+}
+
+
+/*
+ * Scan notarisationsdb backwards for blocks containing a notarisation
+ * for given symbol. Return height of matched notarisation or 0.
+ */
+int ScanNotarisationsDB(int height, std::string symbol, int scanLimitBlocks, Notarisation& out)
+{
+    if (height < 0 || height > chainActive.Height())
+        return false;
+
+    if (scanLimitBlocks <= 0)
+        return 0;
+    auto any = [](int h, const Notarisation &nota) { return true; };
+    return ScanSymbolNotarisations(symbol.data(), height-scanLimitBlocks+1, height, true, any, out);
+}
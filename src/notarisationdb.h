@@ -5,11 +5,14 @@
 #include "dbwrapper.h"
 #include "cc/eval.h"
 
+#include <functional>
+
 
 class NotarisationDB : public CDBWrapper
 {
 public:
     NotarisationDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    bool BuildIndexes();
 };
 
 
@@ -23,6 +26,11 @@ bool GetBlockNotarisations(uint256 blockHash, NotarisationsInBlock &nibs);
 bool GetBackNotarisation(uint256 notarisationHash, Notarisation &n);
 void WriteBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &batch);
 void EraseBackNotarisations(const NotarisationsInBlock notarisations, CDBBatch &batch);
+void WriteNotarisationIndexes(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch);
+void EraseNotarisationIndexes(const NotarisationsInBlock notarisations, int nHeight, CDBBatch &batch);
+int ScanSymbolNotarisations(const char* symbol, int nLow, int nHigh, bool fReverse,
+        const std::function<bool(int, const Notarisation&)> &f, Notarisation &found);
+void GetCCIdNotarisations(uint32_t ccId, int nLow, int nHigh, NotarisationsInBlock &out);
 int ScanNotarisationsDB(int height, std::string symbol, int scanLimitBlocks, Notarisation& out);
 bool IsTXSCL(const char* symbol);
 
@@ -0,0 +1,90 @@
+// Copyright (c) 2019 The SuperNET Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ORACLEINDEX_H
+#define BITCOIN_ORACLEINDEX_H
+
+#include "uint256.h"
+#include "serialize.h"
+
+#include <vector>
+
+/** Oracle data sample key, the samples of one publisher on one oracle are contiguous and in chain order */
+struct COracleSampleKey {
+    uint256 oracletxid;
+    uint160 publisher;  // hash160 of the publisher pubkey
+    int height;
+    unsigned int txindex;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 60;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s) const {
+        oracletxid.Serialize(s);
+        publisher.Serialize(s);
+        // Heights are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, height);
+        ser_writedata32be(s, txindex);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s) {
+        oracletxid.Unserialize(s);
+        publisher.Unserialize(s);
+        height = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+    }
+
+    COracleSampleKey(const uint256 &o, const uint160 &p, int h, unsigned int i) {
+        oracletxid = o;
+        publisher = p;
+        height = h;
+        txindex = i;
+    }
+
+    COracleSampleKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        oracletxid.SetNull();
+        publisher.SetNull();
+        height = 0;
+        txindex = 0;
+    }
+};
+
+/** Decoded 'D' opreturn of an oracle data tx */
+struct COracleSampleValue {
+    uint256 txid;
+    uint256 batontxid;  // previous sample in the baton chain
+    std::vector<unsigned char> data;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(batontxid);
+        READWRITE(data);
+    }
+
+    COracleSampleValue(const uint256 &t, const uint256 &b, const std::vector<unsigned char> &d) {
+        txid = t;
+        batontxid = b;
+        data = d;
+    }
+
+    COracleSampleValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        txid.SetNull();
+        batontxid.SetNull();
+        data.clear();
+    }
+};
+
+#endif // BITCOIN_ORACLEINDEX_H
@@ -28,6 +28,7 @@
 #include "cc/eval.h"
 #include "main.h"
 #include "primitives/transaction.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -280,9 +281,9 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+/** Members of the block object before (head) and after (tail) the tx array */
+static void blockFieldsToJSON(const CBlock& block, const CBlockIndex* blockindex, UniValue& result, UniValue& tail)
 {
-    UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
@@ -296,6 +297,31 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
     result.push_back(Pair("merkleroot", block.hashMerkleRoot.GetHex()));
     result.push_back(Pair("segid", (int)komodo_segid(0,blockindex->GetHeight())));
     result.push_back(Pair("finalsaplingroot", block.hashFinalSaplingRoot.GetHex()));
+    tail.push_back(Pair("time", block.GetBlockTime()));
+    tail.push_back(Pair("nonce", block.nNonce.GetHex()));
+    tail.push_back(Pair("solution", HexStr(block.nSolution)));
+    tail.push_back(Pair("bits", strprintf("%08x", block.nBits)));
+    tail.push_back(Pair("difficulty", GetDifficulty(blockindex)));
+    tail.push_back(Pair("chainwork", blockindex->chainPower.chainWork.GetHex()));
+    tail.push_back(Pair("anchor", blockindex->hashFinalSproutRoot.GetHex()));
+    tail.push_back(Pair("blocktype", block.IsVerusPOSBlock() ? "minted" : "mined"));
+
+    UniValue valuePools(UniValue::VARR);
+    valuePools.push_back(ValuePoolDesc("sprout", blockindex->nChainSproutValue, blockindex->nSproutValue));
+    valuePools.push_back(ValuePoolDesc("sapling", blockindex->nChainSaplingValue, blockindex->nSaplingValue));
+    tail.push_back(Pair("valuePools", valuePools));
+
+    if (blockindex->pprev)
+        tail.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
+    CBlockIndex *pnext = chainActive.Next(blockindex);
+    if (pnext)
+        tail.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+}
+
+UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
+{
+    UniValue result(UniValue::VOBJ), tail(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, result, tail);
     UniValue txs(UniValue::VARR);
     BOOST_FOREACH(const CTransaction&tx, block.vtx)
     {
@@ -309,28 +335,35 @@ UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool tx
             txs.push_back(tx.GetHash().GetHex());
     }
     result.push_back(Pair("tx", txs));
-    result.push_back(Pair("time", block.GetBlockTime()));
-    result.push_back(Pair("nonce", block.nNonce.GetHex()));
-    result.push_back(Pair("solution", HexStr(block.nSolution)));
-    result.push_back(Pair("bits", strprintf("%08x", block.nBits)));
-    result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
-    result.push_back(Pair("chainwork", blockindex->chainPower.chainWork.GetHex()));
-    result.push_back(Pair("anchor", blockindex->hashFinalSproutRoot.GetHex()));
-    result.push_back(Pair("blocktype", block.IsVerusPOSBlock() ? "minted" : "mined"));
-
-    UniValue valuePools(UniValue::VARR);
-    valuePools.push_back(ValuePoolDesc("sprout", blockindex->nChainSproutValue, blockindex->nSproutValue));
-    valuePools.push_back(ValuePoolDesc("sapling", blockindex->nChainSaplingValue, blockindex->nSaplingValue));
-    result.push_back(Pair("valuePools", valuePools));
-
-    if (blockindex->pprev)
-        result.push_back(Pair("previousblockhash", blockindex->pprev->GetBlockHash().GetHex()));
-    CBlockIndex *pnext = chainActive.Next(blockindex);
-    if (pnext)
-        result.push_back(Pair("nextblockhash", pnext->GetBlockHash().GetHex()));
+    result.pushKVs(tail);
     return result;
 }
 
+/** Same output as blockToJSON, with the transactions written out one at a time */
+static void blockToJSONStream(const CBlock& block, const CBlockIndex* blockindex, bool txDetails, CJSONStream& out)
+{
+    UniValue head(UniValue::VOBJ), tail(UniValue::VOBJ);
+    blockFieldsToJSON(block, blockindex, head, tail);
+    out.BeginObject();
+    out.PushKVs(head);
+    out.Key("tx");
+    out.BeginArray();
+    BOOST_FOREACH(const CTransaction&tx, block.vtx)
+    {
+        if(txDetails)
+        {
+            UniValue objTx(UniValue::VOBJ);
+            TxToJSON(tx, uint256(), objTx);
+            out.Value(objTx);
+        }
+        else
+            out.Value(tx.GetHash().GetHex());
+    }
+    out.EndArray();
+    out.PushKVs(tail);
+    out.EndObject();
+}
+
 UniValue getblockcount(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 0)
@@ -384,27 +417,13 @@ UniValue getdifficulty(const UniValue& params, bool fHelp)
 
 bool myIsutxo_spentinmempool(uint256 &spenttxid,int32_t &spentvini,uint256 txid,int32_t vout)
 {
-    //char *uint256_str(char *str,uint256); char str[65];
-    //LOCK(mempool.cs);
-    int32_t vini = 0;
-    BOOST_FOREACH(const CTxMemPoolEntry &e,mempool.mapTx)
-    {
-        const CTransaction &tx = e.GetTx();
-        const uint256 &hash = tx.GetHash();
-        BOOST_FOREACH(const CTxIn &txin,tx.vin)
-        {
-            //fprintf(stderr,"%s/v%d ",uint256_str(str,txin.prevout.hash),txin.prevout.n);
-            if ( txin.prevout.n == vout && txin.prevout.hash == txid )
-            {
-                spenttxid = hash;
-                spentvini = vini;
-                return(true);
-            }
-            vini++;
-        }
-        //fprintf(stderr,"are vins for %s\n",uint256_str(str,hash));
-    }
-    return(false);
+    LOCK(mempool.cs);
+    std::map<COutPoint, CInPoint>::const_iterator it = mempool.mapNextTx.find(COutPoint(txid,vout));
+    if ( it == mempool.mapNextTx.end() )
+        return(false);
+    spenttxid = it->second.ptx->GetHash();
+    spentvini = it->second.n;
+    return(true);
 }
 
 bool mytxid_inmempool(uint256 txid)
@@ -419,6 +438,34 @@ bool mytxid_inmempool(uint256 txid)
     return(false);
 }
 
+/** Verbose getrawmempool entry, mempool.cs must be held */
+static UniValue mempoolEntryToJSON(const CTxMemPoolEntry& e)
+{
+    UniValue info(UniValue::VOBJ);
+    info.push_back(Pair("size", (int)e.GetTxSize()));
+    info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
+    info.push_back(Pair("time", e.GetTime()));
+    info.push_back(Pair("height", (int)e.GetHeight()));
+    info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
+    info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
+    const CTransaction& tx = e.GetTx();
+    set<string> setDepends;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (mempool.exists(txin.prevout.hash))
+            setDepends.insert(txin.prevout.hash.ToString());
+    }
+
+    UniValue depends(UniValue::VARR);
+    BOOST_FOREACH(const string& dep, setDepends)
+    {
+        depends.push_back(dep);
+    }
+
+    info.push_back(Pair("depends", depends));
+    return info;
+}
+
 UniValue mempoolToJSON(bool fVerbose = false)
 {
     if (fVerbose)
@@ -428,29 +475,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
         BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
         {
             const uint256& hash = e.GetTx().GetHash();
-            UniValue info(UniValue::VOBJ);
-            info.push_back(Pair("size", (int)e.GetTxSize()));
-            info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
-            info.push_back(Pair("time", e.GetTime()));
-            info.push_back(Pair("height", (int)e.GetHeight()));
-            info.push_back(Pair("startingpriority", e.GetPriority(e.GetHeight())));
-            info.push_back(Pair("currentpriority", e.GetPriority(chainActive.Height())));
-            const CTransaction& tx = e.GetTx();
-            set<string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
-            }
-
-            UniValue depends(UniValue::VARR);
-            BOOST_FOREACH(const string& dep, setDepends)
-            {
-                depends.push_back(dep);
-            }
-
-            info.push_back(Pair("depends", depends));
-            o.push_back(Pair(hash.ToString(), info));
+            o.push_back(Pair(hash.ToString(), mempoolEntryToJSON(e)));
         }
         return o;
     }
@@ -508,6 +533,23 @@ UniValue getrawmempool(const UniValue& params, bool fHelp)
     return mempoolToJSON(fVerbose);
 }
 
+bool getrawmempool_stream(const UniValue& params, CJSONStream& out)
+{
+    // only the verbose object is worth streaming
+    if (params.size() != 1 || !params[0].isBool() || !params[0].get_bool())
+        return false;
+
+    LOCK2(cs_main, mempool.cs);
+    out.BeginObject();
+    BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
+    {
+        const uint256& hash = e.GetTx().GetHash();
+        out.PushKV(hash.ToString(), mempoolEntryToJSON(e));
+    }
+    out.EndObject();
+    return true;
+}
+
 UniValue getblockdeltas(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -763,6 +805,62 @@ UniValue getblockheader(const UniValue& params, bool fHelp)
     return blockheaderToJSON(pblockindex);
 }
 
+/** Parse the getblock arguments and read the block, cs_main must be held */
+static CBlockIndex* getblock_read(const UniValue& params, CBlock& block, int& verbosity)
+{
+    std::string strHash = params[0].get_str();
+
+    // If height is supplied, find the hash
+    if (strHash.size() < (2 * sizeof(uint256))) {
+        // std::stoi allows characters, whereas we want to be strict
+        regex r("[[:digit:]]+");
+        if (!regex_match(strHash, r)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
+        }
+
+        int nHeight = -1;
+        try {
+            nHeight = std::stoi(strHash);
+        }
+        catch (const std::exception &e) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
+        }
+
+        if (nHeight < 0 || nHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
+        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
+    }
+
+    uint256 hash(uint256S(strHash));
+
+    verbosity = 1;
+    if (params.size() > 1) {
+        if(params[1].isNum()) {
+            verbosity = params[1].get_int();
+        } else {
+            verbosity = params[1].get_bool() ? 1 : 0;
+        }
+    }
+
+    if (verbosity < 0 || verbosity > 2) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
+    }
+
+    if (mapBlockIndex.count(hash) == 0)
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+
+    CBlockIndex* pblockindex = mapBlockIndex[hash];
+
+    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+
+    if(!ReadBlockFromDisk(block, pblockindex,1))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    return pblockindex;
+}
+
 UniValue getblock(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() < 1 || params.size() > 2)
@@ -814,66 +912,42 @@ UniValue getblock(const UniValue& params, bool fHelp)
 
     LOCK(cs_main);
 
-    std::string strHash = params[0].get_str();
-
-    // If height is supplied, find the hash
-    if (strHash.size() < (2 * sizeof(uint256))) {
-        // std::stoi allows characters, whereas we want to be strict
-        regex r("[[:digit:]]+");
-        if (!regex_match(strHash, r)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
-        }
-
-        int nHeight = -1;
-        try {
-            nHeight = std::stoi(strHash);
-        }
-        catch (const std::exception &e) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block height parameter");
-        }
+    CBlock block;
+    int verbosity;
+    CBlockIndex* pblockindex = getblock_read(params, block, verbosity);
 
-        if (nHeight < 0 || nHeight > chainActive.Height()) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-        }
-        strHash = chainActive[nHeight]->GetBlockHash().GetHex();
+    if (verbosity == 0)
+    {
+        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock << block;
+        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
+        return strHex;
     }
 
-    uint256 hash(uint256S(strHash));
-
-    int verbosity = 1;
-    if (params.size() > 1) {
-        if(params[1].isNum()) {
-            verbosity = params[1].get_int();
-        } else {
-            verbosity = params[1].get_bool() ? 1 : 0;
-        }
-    }
+    return blockToJSON(block, pblockindex, verbosity >= 2);
+}
 
-    if (verbosity < 0 || verbosity > 2) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Verbosity must be in range from 0 to 2");
-    }
+bool getblock_stream(const UniValue& params, CJSONStream& out)
+{
+    if (params.size() < 1 || params.size() > 2)
+        return false;
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    LOCK(cs_main);
 
     CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
-
-    if(!ReadBlockFromDisk(block, pblockindex,1))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+    int verbosity;
+    CBlockIndex* pblockindex = getblock_read(params, block, verbosity);
 
     if (verbosity == 0)
     {
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        out.Value(HexStr(ssBlock.begin(), ssBlock.end()));
+        return true;
     }
 
-    return blockToJSON(block, pblockindex, verbosity >= 2);
+    blockToJSONStream(block, pblockindex, verbosity >= 2, out);
+    return true;
 }
 
 UniValue gettxoutsetinfo(const UniValue& params, bool fHelp)
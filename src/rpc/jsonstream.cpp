@@ -0,0 +1,117 @@
+// Copyright (c) 2019 The SuperNET Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+CJSONStream::CJSONStream(const sink_type& sinkIn, size_t nFlushSizeIn) :
+    sink(sinkIn), nFlushSize(nFlushSizeIn), fKey(false), fFlushed(false)
+{
+    strBuf.reserve(nFlushSize + nFlushSize / 4);
+}
+
+void CJSONStream::Separator()
+{
+    if (fKey) {
+        fKey = false;
+        return;
+    }
+    if (!vFirst.empty()) {
+        if (!vFirst.back())
+            strBuf += ',';
+        vFirst.back() = false;
+    }
+}
+
+void CJSONStream::MaybeFlush()
+{
+    if (strBuf.size() >= nFlushSize)
+        Flush();
+}
+
+void CJSONStream::BeginObject()
+{
+    Separator();
+    strBuf += '{';
+    vFirst.push_back(true);
+    strClose += '}';
+}
+
+void CJSONStream::EndObject()
+{
+    assert(!vFirst.empty() && !fKey);
+    vFirst.pop_back();
+    strClose.erase(strClose.size() - 1);
+    strBuf += '}';
+    MaybeFlush();
+}
+
+void CJSONStream::BeginArray()
+{
+    Separator();
+    strBuf += '[';
+    vFirst.push_back(true);
+    strClose += ']';
+}
+
+void CJSONStream::EndArray()
+{
+    assert(!vFirst.empty() && !fKey);
+    vFirst.pop_back();
+    strClose.erase(strClose.size() - 1);
+    strBuf += ']';
+    MaybeFlush();
+}
+
+void CJSONStream::Key(const std::string& key)
+{
+    assert(!fKey);
+    Separator();
+    strBuf += UniValue(key).write();
+    strBuf += ':';
+    fKey = true;
+}
+
+void CJSONStream::Value(const UniValue& val)
+{
+    Separator();
+    strBuf += val.write();
+    MaybeFlush();
+}
+
+void CJSONStream::PushKVs(const UniValue& obj)
+{
+    const std::vector<std::string>& keys = obj.getKeys();
+    const std::vector<UniValue>& values = obj.getValues();
+    for (size_t i = 0; i < keys.size(); i++)
+        PushKV(keys[i], values[i]);
+}
+
+void CJSONStream::Raw(const std::string& str)
+{
+    strBuf += str;
+    MaybeFlush();
+}
+
+void CJSONStream::Unwind(size_t nDepth)
+{
+    if (fKey)
+        Value(NullUniValue);
+    while (vFirst.size() > nDepth) {
+        vFirst.pop_back();
+        strBuf += strClose[strClose.size() - 1];
+        strClose.erase(strClose.size() - 1);
+    }
+    MaybeFlush();
+}
+
+void CJSONStream::Flush()
+{
+    if (strBuf.empty())
+        return;
+    sink(strBuf);
+    strBuf.clear();
+    fFlushed = true;
+}
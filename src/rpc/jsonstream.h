@@ -0,0 +1,75 @@
+// Copyright (c) 2019 The SuperNET Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <univalue.h>
+
+/**
+ * Incremental JSON writer for large RPC results.
+ *
+ * Output is collected in a buffer and handed to the sink whenever it grows past
+ * nFlushSize, so a result can be written out element by element instead of being
+ * built up as one UniValue first. Separators are tracked per open container, the
+ * text produced is the same as UniValue::write() of the equivalent value.
+ */
+class CJSONStream
+{
+public:
+    typedef boost::function<void(const std::string&)> sink_type;
+
+    static const size_t DEFAULT_FLUSH_SIZE = 64 * 1024;
+
+    CJSONStream(const sink_type& sinkIn, size_t nFlushSizeIn = DEFAULT_FLUSH_SIZE);
+
+    void BeginObject();
+    void EndObject();
+    void BeginArray();
+    void EndArray();
+
+    /** Write an object key, the next Value or Begin call is its value */
+    void Key(const std::string& key);
+    void Value(const UniValue& val);
+    void PushKV(const std::string& key, const UniValue& val) { Key(key); Value(val); }
+    /** Write all members of obj into the currently open object */
+    void PushKVs(const UniValue& obj);
+
+    /** Append text as is, without separators */
+    void Raw(const std::string& str);
+
+    /** Number of containers currently open */
+    size_t Depth() const { return vFirst.size(); }
+    /**
+     * Close open containers until nDepth are left, giving a pending key a null
+     * value. Used to keep a reply that was cut short by an error valid JSON.
+     */
+    void Unwind(size_t nDepth);
+
+    /** Hand the buffered output to the sink */
+    void Flush();
+    /** Whether anything has been handed to the sink yet */
+    bool Flushed() const { return fFlushed; }
+    /** Output not handed to the sink yet */
+    const std::string& Buffer() const { return strBuf; }
+
+private:
+    sink_type sink;
+    size_t nFlushSize;
+    std::string strBuf;
+    std::vector<bool> vFirst; // per open container, whether no element was written yet
+    std::string strClose; // per open container, the character that closes it
+    bool fKey;
+    bool fFlushed;
+
+    void Separator();
+    void MaybeFlush();
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
@@ -24,6 +24,7 @@
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "timedata.h"
 #include "txmempool.h"
@@ -36,6 +37,7 @@
 #include "wallet/walletdb.h"
 #endif
 
+#include <functional>
 #include <stdint.h>
 
 #include <boost/assign/list_of.hpp>
@@ -1092,40 +1094,11 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     }
 }
 
-UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+/** Parse the getaddressdeltas arguments and collect the index entries, startInfo
+ * and endInfo are only set when chain info was requested. */
+static void getaddressdeltas_read(const UniValue& params, int& start, int& end, UniValue& startInfo, UniValue& endInfo,
+                                  std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex)
 {
-    if (fHelp || params.size() > 2 || params.size() == 0 || !params[0].isObject())
-        throw runtime_error(
-            "getaddressdeltas\n"
-            "\nReturns all changes for an address (requires addressindex to be enabled).\n"
-            "\nArguments:\n"
-            "{\n"
-            "  \"addresses\"\n"
-            "    [\n"
-            "      \"address\"  (string) The base58check encoded address\n"
-            "      ,...\n"
-            "    ]\n"
-            "  \"start\" (number) The start block height\n"
-            "  \"end\" (number) The end block height\n"
-            "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
-            "}\n"
-            "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
-            "\nResult:\n"
-            "[\n"
-            "  {\n"
-            "    \"satoshis\"  (number) The difference of satoshis\n"
-            "    \"txid\"  (string) The related txid\n"
-            "    \"index\"  (number) The related input or output index\n"
-            "    \"height\"  (number) The block height\n"
-            "    \"address\"  (string) The base58check encoded address\n"
-            "  }\n"
-            "]\n"
-            "\nExamples:\n"
-            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
-            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
-        );
-
-
     UniValue startValue = find_value(params[0].get_obj(), "start");
     UniValue endValue = find_value(params[0].get_obj(), "end");
 
@@ -1135,9 +1108,6 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         includeChainInfo = chainInfo.get_bool();
     }
 
-    int start = 0;
-    int end = 0;
-
     if (startValue.isNum() && endValue.isNum()) {
         start = startValue.get_int();
         end = endValue.get_int();
@@ -1155,8 +1125,6 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
@@ -1169,26 +1137,14 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         }
     }
 
-    UniValue deltas(UniValue::VARR);
-
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
+    // entries carry the type of their address, check it here so the streamed reply cannot fail halfway
+    std::string address;
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!getAddressFromIndex((*it).second, (*it).first, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
-
-        UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
-        delta.push_back(Pair("address", address));
-        deltas.push_back(delta);
     }
 
-    UniValue result(UniValue::VOBJ);
-
     if (includeChainInfo && start > 0 && end > 0) {
         LOCK(cs_main);
 
@@ -1199,15 +1155,80 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         CBlockIndex* startIndex = chainActive[start];
         CBlockIndex* endIndex = chainActive[end];
 
-        UniValue startInfo(UniValue::VOBJ);
-        UniValue endInfo(UniValue::VOBJ);
+        startInfo = UniValue(UniValue::VOBJ);
+        endInfo = UniValue(UniValue::VOBJ);
 
         startInfo.push_back(Pair("hash", startIndex->GetBlockHash().GetHex()));
         startInfo.push_back(Pair("height", start));
 
         endInfo.push_back(Pair("hash", endIndex->GetBlockHash().GetHex()));
         endInfo.push_back(Pair("height", end));
+    }
+}
+
+static UniValue addressDeltaToJSON(const std::pair<CAddressIndexKey, CAmount>& entry)
+{
+    std::string address;
+    getAddressFromIndex(entry.first.type, entry.first.hashBytes, address);
+
+    UniValue delta(UniValue::VOBJ);
+    delta.push_back(Pair("satoshis", entry.second));
+    delta.push_back(Pair("txid", entry.first.txhash.GetHex()));
+    delta.push_back(Pair("index", (int)entry.first.index));
+    delta.push_back(Pair("blockindex", (int)entry.first.txindex));
+    delta.push_back(Pair("height", entry.first.blockHeight));
+    delta.push_back(Pair("address", address));
+    return delta;
+}
+
+UniValue getaddressdeltas(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2 || params.size() == 0 || !params[0].isObject())
+        throw runtime_error(
+            "getaddressdeltas\n"
+            "\nReturns all changes for an address (requires addressindex to be enabled).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ]\n"
+            "  \"start\" (number) The start block height\n"
+            "  \"end\" (number) The end block height\n"
+            "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "}\n"
+            "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"satoshis\"  (number) The difference of satoshis\n"
+            "    \"txid\"  (string) The related txid\n"
+            "    \"index\"  (number) The related input or output index\n"
+            "    \"height\"  (number) The block height\n"
+            "    \"address\"  (string) The base58check encoded address\n"
+            "  }\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
+        );
+
+
+    int start = 0;
+    int end = 0;
+    UniValue startInfo, endInfo;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    getaddressdeltas_read(params, start, end, startInfo, endInfo, addressIndex);
 
+    UniValue deltas(UniValue::VARR);
+
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+        deltas.push_back(addressDeltaToJSON(*it));
+    }
+
+    if (!startInfo.isNull()) {
+        UniValue result(UniValue::VOBJ);
         result.push_back(Pair("deltas", deltas));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
@@ -1218,6 +1239,34 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
     }
 }
 
+bool getaddressdeltas_stream(const UniValue& params, CJSONStream& out)
+{
+    if (params.size() > 2 || params.size() == 0 || !params[0].isObject())
+        return false;
+
+    int start = 0;
+    int end = 0;
+    UniValue startInfo, endInfo;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    getaddressdeltas_read(params, start, end, startInfo, endInfo, addressIndex);
+
+    if (!startInfo.isNull()) {
+        out.BeginObject();
+        out.Key("deltas");
+    }
+    out.BeginArray();
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
+        out.Value(addressDeltaToJSON(*it));
+    }
+    out.EndArray();
+    if (!startInfo.isNull()) {
+        out.PushKV("start", startInfo);
+        out.PushKV("end", endInfo);
+        out.EndObject();
+    }
+    return true;
+}
+
 CAmount checkburnaddress(CAmount &received, int64_t &nNotaryPay, int32_t &height, std::string sAddress)
 {
     CBitcoinAddress address(sAddress);
@@ -1376,6 +1425,8 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
 }
 
 UniValue komodo_snapshot(int top);
+bool komodo_snapshotsorted(int top, UniValue &result, std::vector<std::pair<CAmount, std::string> > &vaddr);
+UniValue SnapshotEntryToJSON(const std::pair<CAmount, std::string> &entry);
 
 UniValue getsnapshot(const UniValue& params, bool fHelp)
 {
@@ -1430,33 +1481,41 @@ UniValue getsnapshot(const UniValue& params, bool fHelp)
     return(result);
 }
 
-UniValue getaddresstxids(const UniValue& params, bool fHelp)
+bool getsnapshot_stream(const UniValue& params, CJSONStream& out)
 {
-    if (fHelp || params.size() > 2)
-        throw runtime_error(
-            "getaddresstxids (ccvout)\n"
-            "\nReturns the txids for an address(es) (requires addressindex to be enabled).\n"
-            "\nArguments:\n"
-            "{\n"
-            "  \"addresses\"\n"
-            "    [\n"
-            "      \"address\"  (string) The base58check encoded address\n"
-            "      ,...\n"
-            "    ]\n"
-            "  \"start\" (number) The start block height\n"
-            "  \"end\" (number) The end block height\n"
-            "}\n"
-            "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
-            "\nResult:\n"
-            "[\n"
-            "  \"transactionid\"  (string) The transaction id\n"
-            "  ,...\n"
-            "]\n"
-            "\nExamples:\n"
-            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
-            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
-        );
+    UniValue result(UniValue::VOBJ); int32_t top = 0; bool fSorted;
+    std::vector<std::pair<CAmount, std::string> > vaddr;
+
+    if ( params.size() > 1 )
+        return(false);
+    if (params.size() > 0 && !params[0].isNull()) {
+        top = atoi(params[0].get_str().c_str());
+        if (top < 0)
+            top = -1;
+    }
+    fSorted = komodo_snapshotsorted(top, result, vaddr);
+    out.BeginObject();
+    if ( result.size() > 0 ) {
+        out.PushKVs(result);
+        if ( fSorted ) {
+            // Array of all addreses with balances
+            out.Key("addresses");
+            out.BeginArray();
+            for (std::vector<std::pair<CAmount, std::string> >::const_iterator it = vaddr.begin(); it != vaddr.end(); ++it)
+                out.Value(SnapshotEntryToJSON(*it));
+            out.EndArray();
+        } else out.PushKV("error", "problem doing snapshot");
+        out.PushKV("end_time", (int) time(NULL));
+    } else {
+        out.PushKV("error", "no addressindex");
+    }
+    out.EndObject();
+    return(true);
+}
 
+/** Parse the getaddresstxids arguments and collect the index entries */
+static void getaddresstxids_read(const UniValue& params, bool& fMulti, std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex)
+{
     std::vector<std::pair<uint160, int> > addresses;
 
     if (!getAddressesFromParams(params, addresses)) {
@@ -1474,8 +1533,6 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
         if (start > 0 && end > 0) {
             if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
@@ -1487,33 +1544,88 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             }
         }
     }
+    fMulti = addresses.size() > 1;
+}
 
+/** Pass the distinct txids of the index entries to emit, sorted by height for multiple addresses */
+static void getaddresstxids_each(const std::vector<std::pair<CAddressIndexKey, CAmount> >& addressIndex, bool fMulti,
+                                 const std::function<void(const std::string&)>& emit)
+{
     std::set<std::pair<int, std::string> > txids;
-    UniValue result(UniValue::VARR);
 
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
         int height = it->first.blockHeight;
         std::string txid = it->first.txhash.GetHex();
 
-        if (addresses.size() > 1) {
+        if (fMulti) {
             txids.insert(std::make_pair(height, txid));
         } else {
             if (txids.insert(std::make_pair(height, txid)).second) {
-                result.push_back(txid);
+                emit(txid);
             }
         }
     }
 
-    if (addresses.size() > 1) {
+    if (fMulti) {
         for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
-            result.push_back(it->second);
+            emit(it->second);
         }
     }
+}
+
+UniValue getaddresstxids(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() > 2)
+        throw runtime_error(
+            "getaddresstxids (ccvout)\n"
+            "\nReturns the txids for an address(es) (requires addressindex to be enabled).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ]\n"
+            "  \"start\" (number) The start block height\n"
+            "  \"end\" (number) The end block height\n"
+            "}\n"
+            "\nCCvout (optional) Return CCvouts instead of normal vouts\n"
+            "\nResult:\n"
+            "[\n"
+            "  \"transactionid\"  (string) The transaction id\n"
+            "  ,...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]}' (ccvout)")
+            + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"RY5LccmGiX9bUHYGtSWQouNy1yFhc5rM87\"]} (ccvout)")
+        );
+
+    bool fMulti;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    getaddresstxids_read(params, fMulti, addressIndex);
+
+    UniValue result(UniValue::VARR);
+    getaddresstxids_each(addressIndex, fMulti, [&](const std::string& txid) { result.push_back(txid); });
 
     return result;
 
 }
 
+bool getaddresstxids_stream(const UniValue& params, CJSONStream& out)
+{
+    if (params.size() > 2)
+        return false;
+
+    bool fMulti;
+    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    getaddresstxids_read(params, fMulti, addressIndex);
+
+    out.BeginArray();
+    getaddresstxids_each(addressIndex, fMulti, [&](const std::string& txid) { out.Value(txid); });
+    out.EndArray();
+    return true;
+}
+
 UniValue getspentinfo(const UniValue& params, bool fHelp)
 {
 
@@ -655,6 +655,17 @@ static const CRPCCommand vRPCCommands[] =
 #endif // ENABLE_WALLET
 };
 
+/** Commands whose result is written to the http reply as it is produced */
+static const CRPCStreamCommand vRPCStreamCommands[] =
+{ //  name                      streamer
+  //  ------------------------  -----------------------
+    { "getblock",               &getblock_stream         },
+    { "getrawmempool",          &getrawmempool_stream    },
+    { "getaddressdeltas",       &getaddressdeltas_stream },
+    { "getaddresstxids",        &getaddresstxids_stream  },
+    { "getsnapshot",            &getsnapshot_stream      },
+};
+
 CRPCTable::CRPCTable()
 {
     unsigned int vcidx;
@@ -665,6 +676,8 @@ CRPCTable::CRPCTable()
         pcmd = &vRPCCommands[vcidx];
         mapCommands[pcmd->name] = pcmd;
     }
+    for (vcidx = 0; vcidx < (sizeof(vRPCStreamCommands) / sizeof(vRPCStreamCommands[0])); vcidx++)
+        mapStreamers[vRPCStreamCommands[vcidx].name] = vRPCStreamCommands[vcidx].streamer;
 }
 
 const CRPCCommand *CRPCTable::operator[](const std::string &name) const
@@ -850,6 +863,33 @@ UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params
     g_rpcSignals.PostCommand(*pcmd);
 }
 
+bool CRPCTable::executeStream(const std::string &strMethod, const UniValue &params, CJSONStream &out) const
+{
+    // Leave warmup errors to execute
+    {
+        LOCK(cs_rpcWarmup);
+        if (fRPCInWarmup)
+            return false;
+    }
+
+    std::map<std::string, rpcstreamfn_type>::const_iterator it = mapStreamers.find(strMethod);
+    const CRPCCommand *pcmd = tableRPC[strMethod];
+    if (it == mapStreamers.end() || !pcmd)
+        return false;
+
+    g_rpcSignals.PreCommand(*pcmd);
+
+    try
+    {
+        // Execute
+        return it->second(params, out);
+    }
+    catch (const std::exception& e)
+    {
+        throw JSONRPCError(RPC_MISC_ERROR, e.what());
+    }
+}
+
 std::string HelpExampleCli(const std::string& methodname, const std::string& args)
 {
     return "> komodo-cli " + methodname + " " + args + "\n";
@@ -36,6 +36,7 @@
 #include <univalue.h>
 
 class AsyncRPCQueue;
+class CJSONStream;
 class CRPCCommand;
 
 namespace RPCServer
@@ -133,6 +134,12 @@ void RPCUnregisterTimerInterface(RPCTimerInterface *iface);
 void RPCRunLater(const std::string& name, boost::function<void(void)> func, int64_t nSeconds);
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
+/**
+ * Writes the result of a command to a stream instead of returning it. Returns false,
+ * before writing anything, to leave the call to the plain actor. Errors in the
+ * arguments must be thrown before anything is written.
+ */
+typedef bool(*rpcstreamfn_type)(const UniValue& params, CJSONStream& out);
 
 class CRPCCommand
 {
@@ -143,6 +150,14 @@ public:
     bool okSafeMode;
 };
 
+/** Streaming variant of a command with potentially large results */
+class CRPCStreamCommand
+{
+public:
+    std::string name;
+    rpcstreamfn_type streamer;
+};
+
 /**
  * Bitcoin RPC command dispatcher.
  */
@@ -150,6 +165,7 @@ class CRPCTable
 {
 private:
     std::map<std::string, const CRPCCommand*> mapCommands;
+    std::map<std::string, rpcstreamfn_type> mapStreamers;
 public:
     CRPCTable();
     const CRPCCommand* operator[](const std::string& name) const;
@@ -164,6 +180,16 @@ public:
      */
     UniValue execute(const std::string &method, const UniValue &params) const;
 
+    /**
+     * Execute a method that can stream its result.
+     * @param method   Method to execute
+     * @param params   UniValue Array of arguments (JSON objects)
+     * @param out      Stream the result is written to
+     * @returns false if the method has no streamer or declined, call execute then.
+     * @throws an exception (UniValue) when an error happens.
+     */
+    bool executeStream(const std::string &method, const UniValue &params, CJSONStream &out) const;
+
 
     /**
      * Appends a CRPCCommand to the dispatch table.
@@ -206,8 +232,11 @@ extern UniValue getconnectioncount(const UniValue& params, bool fHelp); // in rp
 extern UniValue getaddressmempool(const UniValue& params, bool fHelp);
 extern UniValue getaddressutxos(const UniValue& params, bool fHelp);
 extern UniValue getaddressdeltas(const UniValue& params, bool fHelp);
+extern bool getaddressdeltas_stream(const UniValue& params, CJSONStream& out);
 extern UniValue getaddresstxids(const UniValue& params, bool fHelp);
+extern bool getaddresstxids_stream(const UniValue& params, CJSONStream& out);
 extern UniValue getsnapshot(const UniValue& params, bool fHelp);
+extern bool getsnapshot_stream(const UniValue& params, CJSONStream& out);
 extern UniValue getaddressbalance(const UniValue& params, bool fHelp);
 extern UniValue getpeerinfo(const UniValue& params, bool fHelp);
 extern UniValue checknotarization(const UniValue& params, bool fHelp);
@@ -425,12 +454,14 @@ extern UniValue getdifficulty(const UniValue& params, bool fHelp);
 extern UniValue settxfee(const UniValue& params, bool fHelp);
 extern UniValue getmempoolinfo(const UniValue& params, bool fHelp);
 extern UniValue getrawmempool(const UniValue& params, bool fHelp);
+extern bool getrawmempool_stream(const UniValue& params, CJSONStream& out);
 extern UniValue getblockhashes(const UniValue& params, bool fHelp);
 extern UniValue getblockdeltas(const UniValue& params, bool fHelp);
 extern UniValue getblockhash(const UniValue& params, bool fHelp);
 extern UniValue getblockheader(const UniValue& params, bool fHelp);
 extern UniValue getlastsegidstakes(const UniValue& params, bool fHelp);
 extern UniValue getblock(const UniValue& params, bool fHelp);
+extern bool getblock_stream(const UniValue& params, CJSONStream& out);
 extern UniValue gettxoutsetinfo(const UniValue& params, bool fHelp);
 extern UniValue gettxout(const UniValue& params, bool fHelp);
 extern UniValue verifychain(const UniValue& params, bool fHelp);
@@ -1392,19 +1392,35 @@ int TransactionSignatureChecker::CheckCryptoCondition(
         fprintf(stderr,"%02x",((uint8_t *)&sighash)[z]);
     fprintf(stderr," sighash nIn.%d nHashType.%d %.8f id.%d\n",(int32_t)nIn,(int32_t)nHashType,(double)amount/COIN,(int32_t)consensusBranchId);
      */
-    VerifyEval eval = [] (CC *cond, void *checker) {
-        //fprintf(stderr,"checker.%p\n",(TransactionSignatureChecker*)checker);
-        return ((TransactionSignatureChecker*)checker)->CheckEvalCondition(cond);
-    };
-    //fprintf(stderr,"non-checker path\n");
-    int out = cc_verify(cond, (const unsigned char*)&sighash, 32, 0,
-                        condBin.data(), condBin.size(), eval, (void*)this);
+    // signatures first, as cc_verify does, then the evals, which depend on the chain and are never cached
+    int out = VerifyCryptoCondition(cond, sighash, condBin, ffillBin);
+    if (out) {
+        CCVisitor visitor = { [] (CC *cond, struct CCVisitor visitor) {
+            if (cc_typeId(cond) != CC_Eval)
+                return 1;
+            //fprintf(stderr,"checker.%p\n",(TransactionSignatureChecker*)visitor.context);
+            return ((TransactionSignatureChecker*)visitor.context)->CheckEvalCondition(cond);
+        }, (uint8_t*)"", 0, (void*)this };
+        out = cc_visit(cond, visitor);
+    }
     //fprintf(stderr,"out.%d from cc_verify\n",(int32_t)out);
     cc_free(cond);
     return out;
 }
 
 
+int TransactionSignatureChecker::VerifyCryptoCondition(
+        const CC *cond,
+        const uint256& sighash,
+        const std::vector<unsigned char>& condBin,
+        const std::vector<unsigned char>& ffillBin) const
+{
+    VerifyEval noEval = [] (CC *cond, void *checker) { return 1; };
+    return cc_verify(cond, (const unsigned char*)&sighash, 32, 0,
+                     condBin.data(), condBin.size(), noEval, NULL);
+}
+
+
 int TransactionSignatureChecker::CheckEvalCondition(const CC *cond) const
 {
     //fprintf(stderr, "Cannot check crypto-condition Eval outside of server, returning true in pre-checks\n");
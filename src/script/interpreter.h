@@ -167,6 +167,8 @@ protected:
     const PrecomputedTransactionData* txdata;
 
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    //! Checks the condition binary and the signatures of a fulfillment, but not its evals
+    virtual int VerifyCryptoCondition(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin) const;
 
 public:
     TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn) : txTo(txToIn), nIn(nInIn), amount(amountIn), txdata(NULL) {}
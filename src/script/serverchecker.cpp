@@ -22,89 +22,41 @@
 #include "script/cc.h"
 #include "cc/eval.h"
 
+#include "script/sigcache.h"
+
 #include "pubkey.h"
-#include "random.h"
 #include "uint256.h"
-#include "util.h"
-
-#undef __cpuid
-#include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
-
-namespace {
 
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
+bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_serverchecker;
+    CSignatureCache& signatureCache = GetSignatureCache();
+    uint256 entry = signatureCache.EntryECDSA(sighash, vchSig, pubkey);
 
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_serverchecker);
+    if (signatureCache.Get(entry))
+        return true;
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
+    if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
-    }
-
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there can be no more than 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxservercheckersize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_serverchecker);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
-        }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
-    }
-};
 
+    if (store)
+        signatureCache.Set(entry);
+    return true;
 }
 
-bool ServerTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+int ServerTransactionSignatureChecker::VerifyCryptoCondition(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
+    uint256 entry = signatureCache.EntryCryptoCondition(sighash, condBin, ffillBin);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
-        return true;
+    if (signatureCache.Get(entry))
+        return 1;
 
-    if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
-        return false;
+    if (!TransactionSignatureChecker::VerifyCryptoCondition(cond, sighash, condBin, ffillBin))
+        return 0;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
-    return true;
+        signatureCache.Set(entry);
+    return 1;
 }
 
 /*
@@ -37,6 +37,7 @@ public:
     ServerTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nIn, const CAmount& amount, bool storeIn) : TransactionSignatureChecker(txToIn, nIn, amount), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash) const;
+    int VerifyCryptoCondition(const CC *cond, const uint256& sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin) const;
     int CheckEvalCondition(const CC *cond) const;
 };
 
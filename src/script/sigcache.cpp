@@ -20,6 +20,8 @@
 
 #include "sigcache.h"
 
+#include "crypto/common.h"
+#include "crypto/sha256.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
@@ -28,80 +30,103 @@
 #undef __cpuid
 #endif
 #include <boost/thread.hpp>
-#include <boost/tuple/tuple_comparison.hpp>
 
-namespace {
+CSignatureCache::CSignatureCache(size_t nBytes)
+{
+    GetRandBytes(salt.begin(), 32);
+    nBuckets = nBytes / (SIGCACHE_BUCKET_SLOTS * sizeof(uint256));
+    table.resize(nBuckets * SIGCACHE_BUCKET_SLOTS);
+}
 
-/**
- * Valid signature cache, to avoid doing expensive ECDSA signature checking
- * twice for every transaction (once when accepted into memory pool, and
- * again when accepted into the block chain)
- */
-class CSignatureCache
+size_t CSignatureCache::Bucket(const uint256 &entry, int n) const
 {
-private:
-     //! sigdata_type is (signature hash, signature, public key):
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
-
-public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
+    return ReadLE64(entry.begin() + 8 * n) % nBuckets;
+}
+
+bool CSignatureCache::Contains(size_t bucket, const uint256 &entry) const
+{
+    boost::unique_lock<boost::mutex> lock(stripes[bucket % SIGCACHE_STRIPES]);
+    for (size_t i = 0; i < SIGCACHE_BUCKET_SLOTS; i++) {
+        if (table[bucket * SIGCACHE_BUCKET_SLOTS + i] == entry)
             return true;
-        return false;
     }
+    return false;
+}
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
-    {
-        // DoS prevention: limit cache size to less than 10MB
-        // (~200 bytes per cache entry times 50,000 entries)
-        // Since there can be no more than 20,000 signature operations per block
-        // 50,000 is a reasonable default.
-        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-
-        while (static_cast<int64_t>(setValid.size()) > nMaxCacheSize)
-        {
-            // Evict a random entry. Random because that helps
-            // foil would-be DoS attackers who might try to pre-generate
-            // and re-use a set of valid signatures just-slightly-greater
-            // than our cache size.
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+bool CSignatureCache::Insert(size_t bucket, const uint256 &entry, bool fEvict)
+{
+    boost::unique_lock<boost::mutex> lock(stripes[bucket % SIGCACHE_STRIPES]);
+    uint256 *slots = &table[bucket * SIGCACHE_BUCKET_SLOTS];
+    for (size_t i = 0; i < SIGCACHE_BUCKET_SLOTS; i++) {
+        if (slots[i].IsNull() || slots[i] == entry) {
+            slots[i] = entry;
+            return true;
         }
-
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
     }
-};
+    if (!fEvict)
+        return false;
+    slots[entry.begin()[16] % SIGCACHE_BUCKET_SLOTS] = entry;
+    return true;
+}
 
+uint256 CSignatureCache::EntryECDSA(const uint256 &sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const
+{
+    uint256 entry;
+    unsigned char type = 'E';
+    CSHA256().Write(salt.begin(), 32).Write(&type, 1).Write(sighash.begin(), 32).Write(pubkey.begin(), pubkey.size()).Write(vchSig.data(), vchSig.size()).Finalize(entry.begin());
+    return entry;
+}
+
+uint256 CSignatureCache::EntryCryptoCondition(const uint256 &sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin) const
+{
+    uint256 entry; unsigned char len[4];
+    unsigned char type = 'C';
+    // the condition length keeps condition and fulfillment bytes from running into each other
+    WriteLE32(len, condBin.size());
+    CSHA256().Write(salt.begin(), 32).Write(&type, 1).Write(sighash.begin(), 32).Write(len, 4).Write(condBin.data(), condBin.size()).Write(ffillBin.data(), ffillBin.size()).Finalize(entry.begin());
+    return entry;
+}
+
+bool CSignatureCache::Get(const uint256 &entry) const
+{
+    if (nBuckets == 0)
+        return false;
+    return Contains(Bucket(entry, 0), entry) || Contains(Bucket(entry, 1), entry);
+}
+
+void CSignatureCache::Set(const uint256 &entry)
+{
+    if (nBuckets == 0)
+        return;
+    if (!Insert(Bucket(entry, 0), entry, false))
+        Insert(Bucket(entry, 1), entry, true);
+}
+
+CSignatureCache& GetSignatureCache()
+{
+    static CSignatureCache *signatureCache;
+    static boost::once_flag initCache = BOOST_ONCE_INIT;
+    boost::call_once(initCache, []() {
+        int64_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE);
+        if (nMaxCacheSize < 0 || nMaxCacheSize > MAX_MAX_SIG_CACHE_SIZE)
+            nMaxCacheSize = DEFAULT_MAX_SIG_CACHE_SIZE; // AppInit2 rejects these, only reached without it
+        signatureCache = new CSignatureCache((size_t)nMaxCacheSize * sizeof(uint256));
+    });
+    return *signatureCache;
 }
 
 bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
 {
-    static CSignatureCache signatureCache;
+    CSignatureCache& signatureCache = GetSignatureCache();
+    uint256 entry = signatureCache.EntryECDSA(sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    if (signatureCache.Get(entry))
         return true;
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
 
     if (store)
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
     return true;
 }
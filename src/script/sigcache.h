@@ -25,8 +25,55 @@
 
 #include <vector>
 
+#include <boost/thread/mutex.hpp>
+
 class CPubKey;
 
+//! Default for -maxsigcachesize, in entries of 32 bytes (32 MiB)
+static const unsigned int DEFAULT_MAX_SIG_CACHE_SIZE = 1 << 20;
+//! Largest -maxsigcachesize accepted (512 MiB), the table is allocated up front
+static const unsigned int MAX_MAX_SIG_CACHE_SIZE = 1 << 24;
+
+/**
+ * Valid signature cache, to avoid doing expensive ECDSA and crypto-condition
+ * signature checking twice for every transaction (once when accepted into
+ * memory pool, and again when accepted into the block chain).
+ *
+ * Entries are salted SHA256 hashes of what was verified. Each entry may live
+ * in one of two buckets of SIGCACHE_BUCKET_SLOTS slots, and each bucket is
+ * guarded by one of SIGCACHE_STRIPES mutexes, so checker threads rarely
+ * contend. When both buckets are full a slot picked by the entry's own bits
+ * is overwritten, which attackers cannot predict without the salt.
+ */
+class CSignatureCache
+{
+private:
+    static const size_t SIGCACHE_BUCKET_SLOTS = 4;
+    static const size_t SIGCACHE_STRIPES = 64;
+
+    uint256 salt;
+    std::vector<uint256> table;
+    size_t nBuckets;
+    mutable boost::mutex stripes[SIGCACHE_STRIPES];
+
+    size_t Bucket(const uint256 &entry, int n) const;
+    bool Contains(size_t bucket, const uint256 &entry) const;
+    bool Insert(size_t bucket, const uint256 &entry, bool fEvict);
+
+public:
+    //! nBytes of storage, 0 disables the cache
+    CSignatureCache(size_t nBytes);
+
+    uint256 EntryECDSA(const uint256 &sighash, const std::vector<unsigned char>& vchSig, const CPubKey& pubkey) const;
+    uint256 EntryCryptoCondition(const uint256 &sighash, const std::vector<unsigned char>& condBin, const std::vector<unsigned char>& ffillBin) const;
+
+    bool Get(const uint256 &entry) const;
+    void Set(const uint256 &entry);
+};
+
+//! The cache shared by all checkers, sized by -maxsigcachesize on first use
+CSignatureCache& GetSignatureCache();
+
 class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
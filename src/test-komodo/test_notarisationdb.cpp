@@ -0,0 +1,121 @@
+#include <gtest/gtest.h>
+
+#include "arith_uint256.h"
+#include "cc/eval.h"
+#include "notarisationdb.h"
+
+#include "testutils.h"
+
+
+namespace TestNotarisationDB {
+
+
+static Notarisation MakeNotarisation(const char *symbol, uint16_t ccId, int n)
+{
+    NotarisationData data(0);
+    strcpy(data.symbol, symbol);
+    data.ccId = ccId;
+    data.MoM = ArithToUint256(n);
+    return Notarisation(ArithToUint256(1000+n), data);
+}
+
+
+class TestNotarisationDB : public ::testing::Test {
+protected:
+    static void SetUpTestCase() { setupChain(); }
+
+    virtual void SetUp() {
+        // heights 10, 20 and 30, two TXSCL notarisations in the last block
+        NotarisationsInBlock nibs[3];
+        nibs[0].push_back(MakeNotarisation("TXSCL", 2, 1));
+        nibs[0].push_back(MakeNotarisation("OTHER", 3, 2));
+        nibs[1].push_back(MakeNotarisation("OTHER", 3, 3));
+        nibs[2].push_back(MakeNotarisation("TXSCL", 2, 4));
+        nibs[2].push_back(MakeNotarisation("TXSCL", 2, 5));
+        CDBBatch batch(*pnotarisations);
+        for (int i=0; i<3; i++)
+            WriteNotarisationIndexes(nibs[i], 10*(i+1), batch);
+        pnotarisations->WriteBatch(batch, true);
+    }
+};
+
+
+TEST_F(TestNotarisationDB, testScanForwards)
+{
+    Notarisation found;
+    auto any = [](int h, const Notarisation &nota) { return true; };
+    EXPECT_EQ(10, ScanSymbolNotarisations("TXSCL", 0, 100, false, any, found));
+    EXPECT_EQ(ArithToUint256(1), found.second.MoM);
+    EXPECT_EQ(30, ScanSymbolNotarisations("TXSCL", 11, 100, false, any, found));
+    EXPECT_EQ(ArithToUint256(4), found.second.MoM);
+    EXPECT_EQ(0, ScanSymbolNotarisations("TXSCL", 11, 29, false, any, found));
+    EXPECT_EQ(0, ScanSymbolNotarisations("TXSC", 0, 100, false, any, found));
+}
+
+
+TEST_F(TestNotarisationDB, testScanBackwardsKeepsBlockOrder)
+{
+    Notarisation found;
+    std::vector<uint256> seen;
+    auto collect = [&](int h, const Notarisation &nota) { seen.push_back(nota.second.MoM); return false; };
+    EXPECT_EQ(0, ScanSymbolNotarisations("TXSCL", 0, 100, true, collect, found));
+    ASSERT_EQ(3, seen.size());
+    EXPECT_EQ(ArithToUint256(4), seen[0]);
+    EXPECT_EQ(ArithToUint256(5), seen[1]);
+    EXPECT_EQ(ArithToUint256(1), seen[2]);
+}
+
+
+TEST_F(TestNotarisationDB, testCCIdRange)
+{
+    NotarisationsInBlock out;
+    GetCCIdNotarisations(3, 0, 100, out);
+    EXPECT_EQ(2, out.size());
+    GetCCIdNotarisations(2, 11, 30, out);
+    EXPECT_EQ(2, out.size());
+    GetCCIdNotarisations(0x10002, 0, 100, out);
+    EXPECT_EQ(0, out.size());
+}
+
+
+TEST_F(TestNotarisationDB, testBareHashInsideRange)
+{
+    // a back notarisation whose txid reads as ccId 3 at height 15, and a block hash right after it
+    uint256 hash, hash2;
+    unsigned char *p = hash.begin();
+    p[0] = 'C'; p[1] = 0; p[2] = 3; p[6] = 15;
+    hash2 = hash;
+    hash2.begin()[31] = 1;
+    CDBBatch batch(*pnotarisations);
+    batch.Write(hash, MakeNotarisation("OTHER", 3, 6));
+    batch.Write(hash2, NotarisationsInBlock());
+    pnotarisations->WriteBatch(batch, true);
+
+    NotarisationsInBlock out;
+    GetCCIdNotarisations(3, 0, 100, out);
+    ASSERT_EQ(2, out.size());
+    EXPECT_EQ(ArithToUint256(2), out[0].second.MoM);
+    EXPECT_EQ(ArithToUint256(3), out[1].second.MoM);
+
+    CDBBatch erase(*pnotarisations);
+    erase.Erase(hash);
+    erase.Erase(hash2);
+    pnotarisations->WriteBatch(erase, true);
+}
+
+
+TEST_F(TestNotarisationDB, testErase)
+{
+    NotarisationsInBlock nibs;
+    nibs.push_back(MakeNotarisation("OTHER", 3, 3));
+    CDBBatch batch(*pnotarisations);
+    EraseNotarisationIndexes(nibs, 20, batch);
+    pnotarisations->WriteBatch(batch, true);
+
+    NotarisationsInBlock out;
+    GetCCIdNotarisations(3, 0, 100, out);
+    EXPECT_EQ(1, out.size());
+}
+
+
+} /* namespace TestNotarisationDB */
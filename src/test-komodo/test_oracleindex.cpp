@@ -0,0 +1,129 @@
+#include <gtest/gtest.h>
+
+#include <functional>
+
+#include "arith_uint256.h"
+#include "oracleindex.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+
+#include "testutils.h"
+
+
+CScript EncodeOraclesData(uint8_t funcid,uint256 oracletxid,uint256 batontxid,CPubKey pk,std::vector <uint8_t>data);
+int32_t OracleSamplesWalk(uint256 reforacletxid,uint256 batontxid,const std::function<bool(uint256 txid,uint256 batontxid,std::vector<uint8_t> &data)> &f);
+
+
+namespace TestOracleIndex {
+
+
+static std::pair<COracleSampleKey, COracleSampleValue> MakeSample(int pub, int height, int txid, int baton)
+{
+    std::vector<unsigned char> data(1, (unsigned char)txid);
+    return std::make_pair(COracleSampleKey(ArithToUint256(77), uint160(std::vector<unsigned char>(20, pub)), height, 1),
+                          COracleSampleValue(ArithToUint256(txid), ArithToUint256(baton), data));
+}
+
+
+class TestOracleIndex : public ::testing::Test {
+protected:
+    static void SetUpTestCase() { setupChain(); }
+
+    virtual void SetUp() {
+        // publisher 1 chains 1 <- 2 <- 4, sample 3 has no baton, publisher 2 has one sample in between
+        std::vector<std::pair<COracleSampleKey, COracleSampleValue> > samples;
+        samples.push_back(MakeSample(1, 10, 1, 0));
+        samples.push_back(MakeSample(1, 11, 2, 1));
+        samples.push_back(MakeSample(1, 12, 3, 0));
+        samples.push_back(MakeSample(2, 12, 5, 0));
+        samples.push_back(MakeSample(1, 13, 4, 2));
+        pblocktree->WriteOracleSamples(samples);
+    }
+};
+
+
+TEST_F(TestOracleIndex, testFollowsBatonChain)
+{
+    std::vector<std::pair<COracleSampleKey, COracleSampleValue> > out;
+    uint160 pub(std::vector<unsigned char>(20, 1));
+    ASSERT_TRUE(pblocktree->ReadOracleSamples(ArithToUint256(77), pub, 100, ArithToUint256(4), 0, out));
+    ASSERT_EQ(3, out.size());
+    EXPECT_EQ(ArithToUint256(4), out[0].second.txid);
+    EXPECT_EQ(ArithToUint256(2), out[1].second.txid);
+    EXPECT_EQ(ArithToUint256(1), out[2].second.txid);
+    EXPECT_EQ(10, out[2].first.height);
+}
+
+
+TEST_F(TestOracleIndex, testLimitAndHeight)
+{
+    std::vector<std::pair<COracleSampleKey, COracleSampleValue> > out;
+    uint160 pub(std::vector<unsigned char>(20, 1));
+    ASSERT_TRUE(pblocktree->ReadOracleSamples(ArithToUint256(77), pub, 13, ArithToUint256(4), 2, out));
+    EXPECT_EQ(2, out.size());
+    out.clear();
+    ASSERT_TRUE(pblocktree->ReadOracleSamples(ArithToUint256(77), pub, 12, ArithToUint256(4), 0, out));
+    EXPECT_EQ(0, out.size());
+}
+
+
+TEST_F(TestOracleIndex, testErase)
+{
+    std::vector<std::pair<COracleSampleKey, COracleSampleValue> > samples, out;
+    samples.push_back(MakeSample(1, 13, 4, 2));
+    pblocktree->EraseOracleSamples(samples);
+    uint160 pub(std::vector<unsigned char>(20, 1));
+    ASSERT_TRUE(pblocktree->ReadOracleSamples(ArithToUint256(77), pub, 100, ArithToUint256(4), 0, out));
+    EXPECT_EQ(0, out.size());
+    ASSERT_TRUE(pblocktree->ReadOracleSamples(ArithToUint256(77), pub, 100, ArithToUint256(2), 0, out));
+    EXPECT_EQ(2, out.size());
+}
+
+
+TEST_F(TestOracleIndex, testWalkFallsBackToTransaction)
+{
+    // three samples of another oracle confirmed in consecutive blocks, each the baton of the next
+    CPubKey pk(ParseHex(notaryPubkey));
+    uint256 oracletxid = ArithToUint256(78), baton;
+    std::vector<uint256> txids;
+    bool fOldOracleIndex = fOracleIndex;
+    fOracleIndex = true;
+    for (int i = 0; i < 3; i++) {
+        CBlock block;
+        generateBlock(&block);
+        CMutableTransaction mtx = spendTx(block.vtx[0]);
+        mtx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        mtx.vout.push_back(CTxOut(0, EncodeOraclesData('D', oracletxid, baton, pk, std::vector<uint8_t>(1, i))));
+        mtx.vin[0].scriptSig << getSig(mtx, block.vtx[0].vout[0].scriptPubKey);
+        acceptTxFail(mtx);
+        baton = mtx.GetHash();
+        txids.push_back(baton);
+    }
+    generateBlock();
+
+    // drop the middle sample from the index, the walk has to read it from its transaction
+    std::vector<std::pair<COracleSampleKey, COracleSampleValue> > samples, missing;
+    ASSERT_TRUE(GetOracleSamples(oracletxid, pk.GetID(), chainActive.Height(), baton, 0, samples));
+    ASSERT_EQ(3, samples.size());
+    missing.push_back(samples[1]);
+    ASSERT_TRUE(pblocktree->EraseOracleSamples(missing));
+
+    std::vector<uint256> seen;
+    std::vector<uint8_t> seenData;
+    int32_t n = OracleSamplesWalk(oracletxid, baton, [&](uint256 txid, uint256 btxid, std::vector<uint8_t> &data) {
+        seen.push_back(txid);
+        seenData.push_back(data.size() == 1 ? data[0] : 0xff);
+        return true;
+    });
+    fOracleIndex = fOldOracleIndex;
+
+    EXPECT_EQ(3, n);
+    ASSERT_EQ(3, seen.size());
+    for (int i = 0; i < 3; i++) {
+        EXPECT_EQ(txids[2-i], seen[i]);
+        EXPECT_EQ(2-i, seenData[i]);
+    }
+}
+
+
+} /* namespace TestOracleIndex */
@@ -0,0 +1,91 @@
+#include <gtest/gtest.h>
+
+#include "chain.h"
+#include "importcoin.h"
+#include "key.h"
+#include "main.h"
+
+#include "testutils.h"
+
+
+int32_t komodo_txnewcoins(int64_t *vinsump,int64_t *voutsump,int64_t *zfundsp,int64_t *sproutfundsp,const CTransaction &tx,int32_t i,const CCoinsViewCache *view);
+void komodo_supplybackfill();
+
+
+namespace TestSupplyTotals {
+
+
+class TestSupplyTotals : public ::testing::Test {
+protected:
+    static void SetUpTestCase() { setupChain(); }
+};
+
+
+TEST_F(TestSupplyTotals, testBackfillMatchesConnectBlock)
+{
+    CTransaction txIn;
+    getInputTx(CScript() << OP_TRUE, txIn);
+    generateBlock();
+    generateBlock();
+
+    std::vector<CBlockIndex*> vIndex;
+    std::vector<int64_t> vTotals;
+    {
+        LOCK(cs_main);
+        for (int h = 1; h <= chainActive.Height(); h++) {
+            CBlockIndex *pindex = chainActive[h];
+            ASSERT_EQ(1, pindex->supplytotals);
+            vIndex.push_back(pindex);
+            vTotals.push_back(pindex->nSupplyTotal);
+            vTotals.push_back(pindex->nZfundsTotal);
+            vTotals.push_back(pindex->nSproutfundsTotal);
+            // as loaded from an index written before the totals existed
+            pindex->supplytotals = 0;
+            pindex->newcoins = pindex->zfunds = pindex->sproutfunds = 0;
+            pindex->nSupplyTotal = pindex->nZfundsTotal = pindex->nSproutfundsTotal = 0;
+        }
+    }
+    EXPECT_GT(vTotals[vTotals.size() - 3], 0);
+
+    komodo_supplybackfill();
+
+    LOCK(cs_main);
+    for (size_t i = 0; i < vIndex.size(); i++) {
+        EXPECT_EQ(1, vIndex[i]->supplytotals);
+        EXPECT_EQ(vTotals[i*3], vIndex[i]->nSupplyTotal);
+        EXPECT_EQ(vTotals[i*3 + 1], vIndex[i]->nZfundsTotal);
+        EXPECT_EQ(vTotals[i*3 + 2], vIndex[i]->nSproutfundsTotal);
+    }
+}
+
+
+TEST_F(TestSupplyTotals, testImportPayoutsAreNewCoins)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    std::vector<CTxOut> payouts;
+    payouts.push_back(CTxOut(100, CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG));
+    CMutableTransaction burnTx;
+    burnTx.vout.push_back(MakeBurnOutput(100, 2, "PIZZA", payouts, std::vector<uint8_t>()));
+    CTransaction importTx = MakeImportCoinTransaction(TxProof(), CTransaction(burnTx), payouts);
+    ASSERT_TRUE(importTx.IsCoinImport());
+
+    // the vin refers to the burn on the source chain, it is in neither the view nor the txindex
+    int64_t vinsum = 0, voutsum = 0, zfunds = 0, sproutfunds = 0;
+    EXPECT_EQ(0, komodo_txnewcoins(&vinsum, &voutsum, &zfunds, &sproutfunds, importTx, 1, pcoinsTip));
+    EXPECT_EQ(0, vinsum);
+    EXPECT_EQ(100, voutsum);
+    EXPECT_EQ(0, komodo_txnewcoins(&vinsum, &voutsum, &zfunds, &sproutfunds, importTx, 1, NULL));
+    EXPECT_EQ(200, voutsum);
+
+    // any other tx with a missing vin adds nothing
+    CMutableTransaction mtx;
+    mtx.vin.push_back(CTxIn(GetRandHash(), 0));
+    mtx.vout = payouts;
+    EXPECT_EQ(-1, komodo_txnewcoins(&vinsum, &voutsum, &zfunds, &sproutfunds, CTransaction(mtx), 1, pcoinsTip));
+    EXPECT_EQ(0, vinsum);
+    EXPECT_EQ(200, voutsum);
+}
+
+
+} /* namespace TestSupplyTotals */
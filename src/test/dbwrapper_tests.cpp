@@ -118,6 +118,36 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+// Test that a snapshot iterator does not see later writes
+BOOST_AUTO_TEST_CASE(dbwrapper_snapshot_iterator)
+{
+    path ph = temp_directory_path() / unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false);
+
+    char key = 'j';
+    uint256 in = GetRandHash();
+    BOOST_CHECK(dbw.Write(key, in));
+
+    CDBSnapshot snapshot(dbw);
+    char key2 = 'k';
+    BOOST_CHECK(dbw.Write(key2, GetRandHash()));
+    BOOST_CHECK(dbw.Write(key, GetRandHash()));
+
+    boost::scoped_ptr<CDBIterator> it(dbw.NewIterator(snapshot));
+    it->Seek(key);
+
+    char key_res;
+    uint256 val_res;
+    BOOST_CHECK(it->Valid());
+    BOOST_CHECK(it->GetKey(key_res));
+    BOOST_CHECK(it->GetValue(val_res));
+    BOOST_CHECK_EQUAL(key_res, key);
+    BOOST_CHECK_EQUAL(val_res.ToString(), in.ToString());
+
+    it->Next();
+    BOOST_CHECK_EQUAL(it->Valid(), false);
+}
+
 BOOST_AUTO_TEST_CASE(iterator_ordering)
 {
     path ph = temp_directory_path() / unique_path();
@@ -0,0 +1,71 @@
+// Copyright (c) 2019 The SuperNET Developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "lrucache.h"
+
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <algorithm>
+#include <list>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(lrucache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(lrucache_evicts_least_recently_used)
+{
+    CLRUCache<int, int> cache(3);
+    int value;
+
+    cache.insert(1, 10);
+    cache.insert(2, 20);
+    cache.insert(3, 30);
+    BOOST_CHECK(cache.get(1, value) && value == 10);
+
+    // 2 is now the oldest entry
+    cache.insert(4, 40);
+    BOOST_CHECK_EQUAL(cache.size(), 3);
+    BOOST_CHECK(!cache.get(2, value));
+    BOOST_CHECK(cache.get(1, value) && value == 10);
+    BOOST_CHECK(cache.get(3, value) && value == 30);
+    BOOST_CHECK(cache.get(4, value) && value == 40);
+
+    // updating refreshes the entry
+    cache.insert(1, 11);
+    cache.insert(5, 50);
+    BOOST_CHECK(!cache.get(3, value));
+    BOOST_CHECK(cache.get(1, value) && value == 11);
+
+    cache.erase(1);
+    BOOST_CHECK(!cache.get(1, value));
+    cache.clear();
+    BOOST_CHECK_EQUAL(cache.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(lrucache_random)
+{
+    CLRUCache<int, int> cache(100);
+    std::list<int> rep; // most recently used first
+    int value;
+
+    for (int j=0; j<10000; j++) {
+        int key = GetRandInt(300);
+        bool found = cache.get(key, value);
+        std::list<int>::iterator it = std::find(rep.begin(), rep.end(), key);
+        BOOST_CHECK_EQUAL(found, it != rep.end());
+        if (found) {
+            BOOST_CHECK_EQUAL(value, key * 2);
+            rep.erase(it);
+        } else {
+            cache.insert(key, key * 2);
+            if (rep.size() == 100)
+                rep.pop_back();
+        }
+        rep.push_front(key);
+        BOOST_CHECK_EQUAL(cache.size(), rep.size());
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
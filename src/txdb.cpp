@@ -26,9 +26,15 @@
 #include "pow.h"
 #include "uint256.h"
 #include "core_io.h"
+#include "crypto/common.h"
+#include "key_io.h"
+#include "kvindex.h"
+#include "oracleindex.h"
 
 #include <stdint.h>
+#include <unordered_map>
 
+#include <boost/filesystem.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -48,6 +54,10 @@ static const char DB_TIMESTAMPINDEX = 'S';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
 static const char DB_BLOCK_INDEX = 'b';
+static const char DB_KVINDEX = 'K';
+static const char DB_KVEXPIRY = 'e';
+static const char DB_KVUNDO = 'U';
+static const char DB_ORACLESAMPLES = 'O';
 
 static const char DB_BEST_BLOCK = 'B';
 static const char DB_BEST_SPROUT_ANCHOR = 'a';
@@ -55,6 +65,7 @@ static const char DB_BEST_SAPLING_ANCHOR = 'z';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_KVHEIGHT = 'k';
 
 
 CCoinsViewDB::CCoinsViewDB(std::string dbName, size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / dbName, nCacheSize, fMemory, fWipe) {
@@ -458,145 +469,297 @@ uint32_t komodo_segid32(char *coinaddr);
     {"RD6GgnrMpPaTSMn8vai6yiGA7mN4QGPVMY", 1} \
 };
 
-bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
+struct CAddressSnapshotHasher
 {
-    int64_t total = 0; int64_t totalAddresses = 0; std::string address;
-    int64_t utxos = 0; int64_t ignoredAddresses = 0, cryptoConditionsUTXOs = 0, cryptoConditionsTotals = 0;
-    DECLARE_IGNORELIST
-    boost::scoped_ptr<CDBIterator> iter(NewIterator());
-    //std::map <std::string, CAmount> addressAmounts;
-    for (iter->SeekToLast(); iter->Valid(); iter->Prev())
+    size_t operator()(const std::pair<unsigned int, uint160> &key) const {
+        return ReadLE64(key.second.begin()) ^ key.first;
+    }
+};
+typedef std::unordered_map<std::pair<unsigned int, uint160>, CAmount, CAddressSnapshotHasher> CAddressSnapshotMap;
+
+struct CAddressSnapshotPart
+{
+    CAddressSnapshotMap amounts;
+    CAmount total, ccTotal;
+    int64_t utxos, ccUtxos, ignoredAddresses;
+    bool fFailed;
+    CAddressSnapshotPart() : total(0), ccTotal(0), utxos(0), ccUtxos(0), ignoredAddresses(0), fFailed(false) {}
+};
+
+// The unspent index is keyed by (type, hash160, txid, n), so the keyspace is split on (type << 8 | hash160[0])
+static void SnapshotAddressRange(CBlockTreeDB *db, const CDBSnapshot *dbsnapshot, unsigned int nBegin, unsigned int nEnd,
+                                 const std::set<std::pair<unsigned int, uint160> > *ignored, CAddressSnapshotPart *part)
+{
+    uint160 seek;
+    *seek.begin() = nBegin & 0xff;
+    boost::scoped_ptr<CDBIterator> iter(db->NewIterator(*dbsnapshot));
+    for (iter->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(nBegin >> 8, seek))); iter->Valid(); iter->Next())
     {
         boost::this_thread::interruption_point();
-        try
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        if (!iter->GetKey(keyObj) || keyObj.first != DB_ADDRESSUNSPENTINDEX)
+            break;
+        const CAddressIndexIteratorKey &indexKey = keyObj.second;
+        if (((indexKey.type << 8) | *indexKey.hashBytes.begin()) >= nEnd)
+            break;
+        CAmount nValue;
+        if (!iter->GetValue(nValue)) {
+            fprintf(stderr, "DONE %s: LevelDB addressindex exception!\n", __func__);
+            part->fFailed = true; // this means failiure of DB? we need to exit here if so for consensus code!
+            return;
+        }
+        if ( nValue == 0 )
+            continue;
+        if ( indexKey.type == 3 )
         {
-            std::vector<unsigned char> slKey = std::vector<unsigned char>();
-            pair<char, CAddressIndexIteratorKey> keyObj;
-            iter->GetKey(keyObj);
-            char chType = keyObj.first;
-            CAddressIndexIteratorKey indexKey = keyObj.second;
-            //fprintf(stderr, "chType=%d\n", chType);
-            if (chType == DB_ADDRESSUNSPENTINDEX)
-            {
-                try {
-                    CAmount nValue;
-                    iter->GetValue(nValue);
-                    if ( nValue == 0 )
-                        continue;
-                    getAddressFromIndex(indexKey.type, indexKey.hashBytes, address);
-                    if ( indexKey.type == 3 )
-                    {
-                        cryptoConditionsUTXOs++;
-                        cryptoConditionsTotals += nValue;
-                        total += nValue;
-                        continue;
-                    }
-                    std::map <std::string, int>::iterator ignored = ignoredMap.find(address);
-                    if (ignored != ignoredMap.end())
-                    {
-                        fprintf(stderr,"ignoring %s\n", address.c_str());
-                        ignoredAddresses++;
-                        continue;
-                    }
-                    std::map <std::string, CAmount>::iterator pos = addressAmounts.find(address);
-                    if ( pos == addressAmounts.end() )
-                    {
-                        // insert new address + utxo amount
-                        //fprintf(stderr, "inserting new address %s with amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] = nValue;
-                        totalAddresses++;
-                    }
-                    else
-                    {
-                        // update unspent tally for this address
-                        //fprintf(stderr, "updating address %s with new utxo amount %li\n", address.c_str(), nValue);
-                        addressAmounts[address] += nValue;
-                    }
-                    //fprintf(stderr,"{\"%s\", %.8f},\n",address.c_str(),(double)nValue/COIN);
-                    // total += nValue;
-                    utxos++;
-                    total += nValue;
-                }
-                catch (const std::exception& e)
-                {
-                    fprintf(stderr, "DONE %s: LevelDB addressindex exception! - %s\n", __func__, e.what());
-                    return false; //break; this means failiure of DB? we need to exit here if so for consensus code!
+            part->ccUtxos++;
+            part->ccTotal += nValue;
+            continue;
+        }
+        std::pair<unsigned int, uint160> key(indexKey.type, indexKey.hashBytes);
+        if (ignored->count(key) != 0)
+        {
+            part->ignoredAddresses++;
+            continue;
+        }
+        part->amounts[key] += nValue;
+        part->utxos++;
+        part->total += nValue;
+    }
+}
+
+void GetSnapshotIgnoredAddresses(std::set<std::pair<unsigned int, uint160> > &ignored)
+{
+    DECLARE_IGNORELIST
+    ignored.clear();
+    for (std::map<std::string, int>::iterator it = ignoredMap.begin(); it != ignoredMap.end(); ++it)
+    {
+        CTxDestination dest = DecodeDestination(it->first);
+        if (CKeyID *keyID = boost::get<CKeyID>(&dest))
+            ignored.insert(make_pair(1, uint160(*keyID)));
+        else if (CScriptID *scriptID = boost::get<CScriptID>(&dest))
+            ignored.insert(make_pair(2, uint160(*scriptID)));
+    }
+}
+
+static boost::filesystem::path GetAddressSnapshotFile()
+{
+    return GetDataDir() / "addresssnapshot.dat";
+}
+
+bool CBlockTreeDB::SnapshotAddresses(CAddressSnapshot &snapshot, int top)
+{
+    // every range is scanned from the same view of the index, taken together with the tip it belongs to.
+    // ConnectBlock and DisconnectBlock write the address index under cs_main.
+    CBlockIndex *pindexTip; boost::scoped_ptr<CDBSnapshot> dbsnapshot;
+    {
+        LOCK(cs_main);
+        pindexTip = chainActive.Tip();
+        dbsnapshot.reset(new CDBSnapshot(*this));
+    }
+    int nHeight = pindexTip != 0 ? pindexTip->GetHeight() : -1;
+    uint256 hashBlock = pindexTip != 0 ? pindexTip->GetBlockHash() : uint256();
+
+    // reuse the last full snapshot if the tip has not moved
+    {
+        FILE *file = fopen(GetAddressSnapshotFile().string().c_str(), "rb");
+        CAutoFile filein(file, SER_DISK, CLIENT_VERSION);
+        if (!filein.IsNull()) {
+            try {
+                filein >> snapshot;
+                if (snapshot.nHeight == nHeight && snapshot.hashBlock == hashBlock) {
+                    if (top > 0 && snapshot.vEntries.size() > top)
+                        snapshot.vEntries.resize(top);
+                    return true;
                 }
+            } catch (const std::exception& e) {
+                LogPrintf("%s: ignoring unreadable %s: %s\n", __func__, GetAddressSnapshotFile().string(), e.what());
             }
         }
-        catch (const std::exception& e)
+    }
+    snapshot.SetNull();
+    snapshot.nHeight = nHeight;
+    snapshot.hashBlock = hashBlock;
+
+    std::set<std::pair<unsigned int, uint160> > ignored;
+    GetSnapshotIgnoredAddresses(ignored);
+
+    // find the (type, first hash byte) range actually in use and split it between the threads
+    unsigned int nFirst = 0, nLast = 0;
+    {
+        boost::scoped_ptr<CDBIterator> iter(NewIterator(*dbsnapshot));
+        pair<char, CAddressIndexIteratorKey> keyObj;
+        iter->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey()));
+        if (!iter->Valid() || !iter->GetKey(keyObj) || keyObj.first != DB_ADDRESSUNSPENTINDEX) {
+            snapshot.vEntries.clear();
+            return true;
+        }
+        nFirst = (keyObj.second.type << 8) | *keyObj.second.hashBytes.begin();
+        iter->Seek(make_pair((char)(DB_ADDRESSUNSPENTINDEX + 1), CAddressIndexIteratorKey()));
+        if (iter->Valid())
+            iter->Prev();
+        else
+            iter->SeekToLast();
+        if (iter->Valid() && iter->GetKey(keyObj) && keyObj.first == DB_ADDRESSUNSPENTINDEX)
+            nLast = (keyObj.second.type << 8) | *keyObj.second.hashBytes.begin();
+        else
+            nLast = 0xffff;
+    }
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_SNAPSHOT_THREADS));
+    unsigned int nSpan = nLast + 1 - nFirst;
+    if (nSpan < (unsigned int)nThreads)
+        nThreads = nSpan;
+    std::vector<CAddressSnapshotPart> parts(nThreads);
+    {
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&SnapshotAddressRange, this, dbsnapshot.get(), nFirst + (nSpan * i) / nThreads,
+                                              nFirst + (nSpan * (i + 1)) / nThreads, &ignored, &parts[i]));
+        threads.join_all();
+    }
+
+    // ranges are disjoint on the address, so merging is just concatenation
+    std::vector<CAddressSnapshotEntry> &entries = snapshot.vEntries;
+    for (int i = 0; i < nThreads; i++)
+    {
+        if (parts[i].fFailed)
+            return false;
+        snapshot.total += parts[i].total + parts[i].ccTotal;
+        snapshot.ccTotal += parts[i].ccTotal;
+        snapshot.utxos += parts[i].utxos;
+        snapshot.ccUtxos += parts[i].ccUtxos;
+        snapshot.ignoredAddresses += parts[i].ignoredAddresses;
+        snapshot.totalAddresses += parts[i].amounts.size();
+        for (CAddressSnapshotMap::const_iterator it = parts[i].amounts.begin(); it != parts[i].amounts.end(); ++it)
         {
-            fprintf(stderr, "DONE reading index entries\n");
-            break;
+            CAddressSnapshotEntry entry(it->second, it->first.first, it->first.second);
+            if (top > 0) {
+                // min-heap of the largest top entries seen so far
+                if (entries.size() < top) {
+                    entries.push_back(entry);
+                    std::push_heap(entries.begin(), entries.end(), std::greater<CAddressSnapshotEntry>());
+                } else if (entries.front() < entry) {
+                    std::pop_heap(entries.begin(), entries.end(), std::greater<CAddressSnapshotEntry>());
+                    entries.back() = entry;
+                    std::push_heap(entries.begin(), entries.end(), std::greater<CAddressSnapshotEntry>());
+                }
+            } else entries.push_back(entry);
         }
+        CAddressSnapshotMap().swap(parts[i].amounts);
     }
-    //fprintf(stderr, "total=%f, totalAddresses=%li, utxos=%li, ignored=%li\n", (double) total / COIN, totalAddresses, utxos, ignoredAddresses);
-    
-    // this is for the snapshot RPC, you can skip this by passing a 0 as the last argument.
-    if (ret)
+    std::sort(entries.rbegin(), entries.rend());
+
+    // only complete snapshots are worth keeping around
+    if (top <= 0)
+    {
+        boost::filesystem::path pathTmp = GetAddressSnapshotFile();
+        pathTmp += ".new";
+        FILE *file = fopen(pathTmp.string().c_str(), "wb");
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        if (!fileout.IsNull()) {
+            try {
+                fileout << snapshot;
+                fileout.fclose();
+                RenameOver(pathTmp, GetAddressSnapshotFile());
+            } catch (const std::exception& e) {
+                LogPrintf("%s: failed to write %s: %s\n", __func__, pathTmp.string(), e.what());
+            }
+        }
+    }
+    return true;
+}
+
+static void SnapshotStats(const CAddressSnapshot &snapshot, UniValue *ret)
+{
+    int64_t total = snapshot.total - snapshot.ccTotal, totalAddresses = snapshot.totalAddresses;
+    // Total circulating supply without CC vouts.
+    ret->push_back(make_pair("total", (double) (total)/ COIN ));
+    // Average amount in each address of this snapshot
+    ret->push_back(make_pair("average",(double) (total/COIN) / totalAddresses ));
+    // Total number of utxos processed in this snaphot
+    ret->push_back(make_pair("utxos", snapshot.utxos));
+    // Total number of addresses in this snaphot
+    ret->push_back(make_pair("total_addresses", totalAddresses ));
+    // Total number of ignored addresses in this snaphot
+    ret->push_back(make_pair("ignored_addresses", snapshot.ignoredAddresses));
+    // Total number of crypto condition utxos we skipped
+    ret->push_back(make_pair("skipped_cc_utxos", snapshot.ccUtxos));
+    // Total value of skipped crypto condition utxos
+    ret->push_back(make_pair("cc_utxo_value", (double) snapshot.ccTotal / COIN));
+    // total of all the address's, does not count coins in CC vouts.
+    ret->push_back(make_pair("total_includeCCvouts", (double) (snapshot.total)/ COIN ));
+    // The snapshot finished at this block height
+    ret->push_back(make_pair("ending_height", snapshot.nHeight));
+}
+
+bool CBlockTreeDB::Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret)
+{
+    CAddressSnapshot snapshot; std::string address;
+    if (!SnapshotAddresses(snapshot, 0))
+        return false;
+    for (std::vector<CAddressSnapshotEntry>::const_iterator it = snapshot.vEntries.begin(); it != snapshot.vEntries.end(); ++it)
     {
-        // Total circulating supply without CC vouts.
-        ret->push_back(make_pair("total", (double) (total)/ COIN ));
-        // Average amount in each address of this snapshot
-        ret->push_back(make_pair("average",(double) (total/COIN) / totalAddresses ));
-        // Total number of utxos processed in this snaphot
-        ret->push_back(make_pair("utxos", utxos));
-        // Total number of addresses in this snaphot
-        ret->push_back(make_pair("total_addresses", totalAddresses ));
-        // Total number of ignored addresses in this snaphot
-        ret->push_back(make_pair("ignored_addresses", ignoredAddresses));
-        // Total number of crypto condition utxos we skipped
-        ret->push_back(make_pair("skipped_cc_utxos", cryptoConditionsUTXOs));
-        // Total value of skipped crypto condition utxos
-        ret->push_back(make_pair("cc_utxo_value", (double) cryptoConditionsTotals / COIN));
-        // total of all the address's, does not count coins in CC vouts.
-        ret->push_back(make_pair("total_includeCCvouts", (double) (total+cryptoConditionsTotals)/ COIN ));
-        // The snapshot finished at this block height
-        ret->push_back(make_pair("ending_height", chainActive.Height()));
+        getAddressFromIndex(it->type, it->hashBytes, address);
+        addressAmounts[address] = it->amount;
     }
+    // this is for the snapshot RPC, you can skip this by passing a 0 as the last argument.
+    if (ret)
+        SnapshotStats(snapshot, ret);
     return true;
 }
 
 extern std::vector <std::pair<CAmount, CTxDestination>> vAddressSnapshot;
 
-UniValue CBlockTreeDB::Snapshot(int top)
+//! sorted (amount, address) pairs of the top addresses, with the snapshot stats in result
+bool CBlockTreeDB::SnapshotSorted(int top, UniValue &result, std::vector<std::pair<CAmount, std::string> > &vaddr)
 {
-    int topN = 0;
-    std::vector <std::pair<CAmount, std::string>> vaddr;
-    //std::vector <std::vector <std::pair<CAmount, CScript>>> tokenids;
-    std::map <std::string, CAmount> addressAmounts;
-    UniValue result(UniValue::VOBJ);
-    UniValue addressesSorted(UniValue::VARR);
+    CAddressSnapshot snapshot;
     result.push_back(Pair("start_time", (int) time(NULL)));
-    if ( (vAddressSnapshot.size() > 0 && top < 0) || (Snapshot2(addressAmounts,&result) && top >= 0) )
+    if ( (vAddressSnapshot.size() > 0 && top < 0) || (top >= 0 && SnapshotAddresses(snapshot, top)) )
     {
         if ( top > -1 )
         {
-            for (std::pair<std::string, CAmount> element : addressAmounts)
-                vaddr.push_back( make_pair(element.second, element.first) );
-            std::sort(vaddr.rbegin(), vaddr.rend());
+            SnapshotStats(snapshot, &result);
+            std::string address;
+            for (std::vector<CAddressSnapshotEntry>::const_iterator it = snapshot.vEntries.begin(); it != snapshot.vEntries.end(); ++it)
+            {
+                getAddressFromIndex(it->type, it->hashBytes, address);
+                vaddr.push_back( make_pair(it->amount, address) );
+            }
         }
         else 
         {
             for ( auto address : vAddressSnapshot )
                 vaddr.push_back(make_pair(address.first, CBitcoinAddress(address.second).ToString()));
-            top = vAddressSnapshot.size();
         }
-        int topN = 0;
+        // If requested, only show top N addresses in output JSON
+        if ( top > 0 && vaddr.size() > (size_t)top )
+            vaddr.resize(top);
+        return(true);
+    }
+    return(false);
+}
+
+UniValue SnapshotEntryToJSON(const std::pair<CAmount, std::string> &entry)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back( make_pair("addr", entry.second.c_str() ) );
+    char amount[32];
+    sprintf(amount, "%.8f", (double) entry.first / COIN);
+    obj.push_back( make_pair("amount", amount) );
+    obj.push_back( make_pair("segid",(int32_t)komodo_segid32((char *)entry.second.c_str()) & 0x3f) );
+    return(obj);
+}
+
+UniValue CBlockTreeDB::Snapshot(int top)
+{
+    std::vector <std::pair<CAmount, std::string>> vaddr;
+    UniValue result(UniValue::VOBJ);
+    if ( SnapshotSorted(top, result, vaddr) )
+    {
+        UniValue addressesSorted(UniValue::VARR);
         for (std::vector<std::pair<CAmount, std::string>>::iterator it = vaddr.begin(); it!=vaddr.end(); ++it)
-        {
-          	UniValue obj(UniValue::VOBJ);
-          	obj.push_back( make_pair("addr", it->second.c_str() ) );
-          	char amount[32];
-          	sprintf(amount, "%.8f", (double) it->first / COIN);
-          	obj.push_back( make_pair("amount", amount) );
-            obj.push_back( make_pair("segid",(int32_t)komodo_segid32((char *)it->second.c_str()) & 0x3f) );
-          	addressesSorted.push_back(obj);
-            topN++;
-            // If requested, only show top N addresses in output JSON
-           	if ( top == topN )
-                break;
-        }
+            addressesSorted.push_back(SnapshotEntryToJSON(*it));
     	// Array of all addreses with balances
         result.push_back(make_pair("addresses", addressesSorted));
     } else result.push_back(make_pair("error", "problem doing snapshot"));
@@ -660,6 +823,147 @@ bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &lt
     return true;
 }
 
+bool CBlockTreeDB::ReadKVIndex(const std::vector<unsigned char> &key, CKVIndexValue &value) {
+    return Read(make_pair(DB_KVINDEX, key), value);
+}
+
+bool CBlockTreeDB::ReadKVIndexHeight(int &nHeight) {
+    return Read(DB_KVHEIGHT, nHeight);
+}
+
+bool CBlockTreeDB::ReadKVExpired(int nHeight, std::vector<std::vector<unsigned char> > &keys) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_KVEXPIRY, CKVExpiryKey()));
+
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        pair<char, CKVExpiryKey> keyObj;
+        if (pcursor->GetKey(keyObj) && keyObj.first == DB_KVEXPIRY && keyObj.second.expiry < nHeight) {
+            keys.push_back(keyObj.second.key);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    return true;
+}
+
+bool CBlockTreeDB::UpdateKVIndex(int nHeight, const std::vector<std::pair<std::vector<unsigned char>, CKVIndexValue> > &vect, int nUndoDepth) {
+    CDBBatch batch(*this);
+    unsigned int n = 0;
+    for (std::vector<std::pair<std::vector<unsigned char>, CKVIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CKVIndexValue prev;
+        if (Read(make_pair(DB_KVINDEX, it->first), prev))
+            batch.Erase(make_pair(DB_KVEXPIRY, CKVExpiryKey(prev.expiry, it->first)));
+        else
+            prev.SetNull();
+        batch.Write(make_pair(DB_KVUNDO, CKVUndoKey(nHeight, n++)), make_pair(it->first, prev));
+        if (it->second.IsNull()) {
+            batch.Erase(make_pair(DB_KVINDEX, it->first));
+        } else {
+            batch.Write(make_pair(DB_KVINDEX, it->first), it->second);
+            batch.Write(make_pair(DB_KVEXPIRY, CKVExpiryKey(it->second.expiry, it->first)), 0);
+        }
+    }
+
+    // undo data is only needed as deep as a reorg can go
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(make_pair(DB_KVUNDO, CKVUndoKey()));
+    while (pcursor->Valid()) {
+        pair<char, CKVUndoKey> keyObj;
+        if (pcursor->GetKey(keyObj) && keyObj.first == DB_KVUNDO && keyObj.second.height <= nHeight - nUndoDepth) {
+            batch.Erase(keyObj);
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    batch.Write(DB_KVHEIGHT, nHeight);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::RewindKVIndex(int nHeight) {
+    std::vector<std::pair<CKVUndoKey, std::pair<std::vector<unsigned char>, CKVIndexValue> > > undo;
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(make_pair(DB_KVUNDO, CKVUndoKey(nHeight, 0)));
+    while (pcursor->Valid()) {
+        pair<char, CKVUndoKey> keyObj;
+        if (pcursor->GetKey(keyObj) && keyObj.first == DB_KVUNDO && keyObj.second.height == nHeight) {
+            std::pair<std::vector<unsigned char>, CKVIndexValue> record;
+            if (!pcursor->GetValue(record))
+                return error("RewindKVIndex: failed to read undo record at height %d", nHeight);
+            undo.push_back(make_pair(keyObj.second, record));
+            pcursor->Next();
+        } else {
+            break;
+        }
+    }
+
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<CKVUndoKey, std::pair<std::vector<unsigned char>, CKVIndexValue> > >::const_reverse_iterator it=undo.rbegin(); it!=undo.rend(); it++) {
+        const std::vector<unsigned char> &key = it->second.first;
+        const CKVIndexValue &prev = it->second.second;
+        CKVIndexValue cur;
+        if (Read(make_pair(DB_KVINDEX, key), cur))
+            batch.Erase(make_pair(DB_KVEXPIRY, CKVExpiryKey(cur.expiry, key)));
+        if (prev.IsNull()) {
+            batch.Erase(make_pair(DB_KVINDEX, key));
+        } else {
+            batch.Write(make_pair(DB_KVINDEX, key), prev);
+            batch.Write(make_pair(DB_KVEXPIRY, CKVExpiryKey(prev.expiry, key)), 0);
+        }
+        batch.Erase(make_pair(DB_KVUNDO, it->first));
+    }
+    batch.Write(DB_KVHEIGHT, nHeight - 1);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::WriteOracleSamples(const std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<COracleSampleKey, COracleSampleValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Write(make_pair(DB_ORACLESAMPLES, it->first), it->second);
+    return WriteBatch(batch);
+}
+
+bool CBlockTreeDB::EraseOracleSamples(const std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &vect) {
+    CDBBatch batch(*this);
+    for (std::vector<std::pair<COracleSampleKey, COracleSampleValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        batch.Erase(make_pair(DB_ORACLESAMPLES, it->first));
+    return WriteBatch(batch);
+}
+
+// Follows the baton chain of publisher from batontxid down from nHeight, collecting at most nMax samples (0 for all).
+// Samples of the publisher that are not on the chain are skipped.
+bool CBlockTreeDB::ReadOracleSamples(const uint256 &oracletxid, const uint160 &publisher, int nHeight, uint256 batontxid, size_t nMax,
+                                     std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &vect) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(make_pair(DB_ORACLESAMPLES, COracleSampleKey(oracletxid, publisher, nHeight + 1, 0)));
+    if (pcursor->Valid()) pcursor->Prev(); else pcursor->SeekToLast();
+
+    for (; pcursor->Valid() && !batontxid.IsNull() && (nMax == 0 || vect.size() < nMax); pcursor->Prev()) {
+        boost::this_thread::interruption_point();
+        pair<char, COracleSampleKey> keyObj;
+        if (!pcursor->GetKey(keyObj) || keyObj.first != DB_ORACLESAMPLES || keyObj.second.oracletxid != oracletxid || keyObj.second.publisher != publisher)
+            break;
+        COracleSampleValue value;
+        if (!pcursor->GetValue(value))
+            return error("failed to get oracle sample value");
+        if (value.txid == batontxid) {
+            batontxid = value.batontxid;
+            vect.push_back(make_pair(keyObj.second, value));
+        }
+    }
+
+    return true;
+}
+
 bool CBlockTreeDB::WriteFlag(const std::string &name, bool fValue) {
     return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
 }
@@ -719,6 +1023,12 @@ bool CBlockTreeDB::LoadBlockIndexGuts()
                 pindexNew->nSproutValue   = diskindex.nSproutValue;
                 pindexNew->nSaplingValue  = diskindex.nSaplingValue;
                 pindexNew->segid          = diskindex.segid;
+                pindexNew->stakesegid     = diskindex.stakesegid;
+                memcpy(pindexNew->pubkey33,diskindex.pubkey33,sizeof(pindexNew->pubkey33));
+                pindexNew->nSupplyTotal   = diskindex.nSupplyTotal;
+                pindexNew->nZfundsTotal   = diskindex.nZfundsTotal;
+                pindexNew->nSproutfundsTotal = diskindex.nSproutfundsTotal;
+                pindexNew->supplytotals   = diskindex.supplytotals;
                 pindexNew->nNotaryPay     = diskindex.nNotaryPay;
 //fprintf(stderr,"loadguts ht.%d\n",pindexNew->GetHeight());
                 // Consistency checks
@@ -25,6 +25,7 @@
 #include "dbwrapper.h"
 
 #include <map>
+#include <set>
 #include <string>
 #include <utility>
 #include <vector>
@@ -44,8 +45,15 @@ struct CTimestampBlockIndexKey;
 struct CTimestampBlockIndexValue;
 struct CSpentIndexKey;
 struct CSpentIndexValue;
+struct CKVIndexValue;
+struct COracleSampleKey;
+struct COracleSampleValue;
+struct CAddressSnapshot;
 class uint256;
 
+//! Maximum number of threads scanning the address index for a snapshot
+static const int MAX_SNAPSHOT_THREADS = 8;
+
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
 //! max. -dbcache (MiB)
@@ -111,12 +119,28 @@ public:
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
+    bool ReadKVIndex(const std::vector<unsigned char> &key, CKVIndexValue &value);
+    bool ReadKVIndexHeight(int &nHeight);
+    bool ReadKVExpired(int nHeight, std::vector<std::vector<unsigned char> > &keys);
+    bool UpdateKVIndex(int nHeight, const std::vector<std::pair<std::vector<unsigned char>, CKVIndexValue> > &vect, int nUndoDepth);
+    bool RewindKVIndex(int nHeight);
+    bool WriteOracleSamples(const std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &vect);
+    bool EraseOracleSamples(const std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &vect);
+    bool ReadOracleSamples(const uint256 &oracletxid, const uint160 &publisher, int nHeight, uint256 batontxid, size_t nMax,
+                           std::vector<std::pair<COracleSampleKey, COracleSampleValue> > &vect);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts();
     bool blockOnchainActive(const uint256 &hash);
+    bool SnapshotAddresses(CAddressSnapshot &snapshot, int top);
+    bool SnapshotSorted(int top, UniValue &result, std::vector<std::pair<CAmount, std::string> > &vaddr);
     UniValue Snapshot(int top);
     bool Snapshot2(std::map <std::string, CAmount> &addressAmounts, UniValue *ret);
 };
 
+//! (type, hash160) of the addresses left out of every address snapshot
+void GetSnapshotIgnoredAddresses(std::set<std::pair<unsigned int, uint160> > &ignored);
+//! one (amount, address) entry of the snapshot addresses array
+UniValue SnapshotEntryToJSON(const std::pair<CAmount, std::string> &entry);
+
 #endif // BITCOIN_TXDB_H
@@ -62,6 +62,16 @@ public:
     void DecrementNoteWitnesses(const CBlockIndex* pindex) {
         CWallet::DecrementNoteWitnesses(pindex);
     }
+    void StartRescan(int nHeight) {
+        nRescanHeight = nHeight;
+        nRescanWitnessHeight = nHeight;
+    }
+    void RescanNoteWitnesses(const CBlockIndex* pindex,
+                             const CBlock* pblock,
+                             SproutMerkleTree& sproutTree,
+                             SaplingMerkleTree& saplingTree) {
+        CWallet::RescanNoteWitnesses(pindex, pblock, sproutTree, saplingTree);
+    }
     void SetBestChain(MockWalletDB& walletdb, const CBlockLocator& loc) {
         CWallet::SetBestChainINTERNAL(walletdb, loc);
     }
@@ -526,6 +536,62 @@ TEST(WalletTests, FindMySaplingNotes) {
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
 }
 
+TEST(WalletTests, FindMySaplingNotesWithManyIvks) {
+    SelectParams(CBaseChainParams::REGTEST);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
+    auto consensusParams = Params().GetConsensus();
+
+    TestWallet wallet;
+
+    // Enough unrelated viewing keys that the outputs go to the decryption queue
+    for (int i = 1; i <= 40; i++) {
+        std::vector<unsigned char, secure_allocator<unsigned char>> rawSeed(32, i);
+        HDSeed seed(rawSeed);
+        auto sk = libzcash::SaplingExtendedSpendingKey::Master(seed);
+        auto fvk = sk.expsk.full_viewing_key();
+        ASSERT_TRUE(wallet.AddSaplingIncomingViewingKey(fvk.in_viewing_key(), sk.DefaultAddress()));
+    }
+
+    std::vector<unsigned char, secure_allocator<unsigned char>> rawSeed(32);
+    HDSeed seed(rawSeed);
+    auto sk = libzcash::SaplingExtendedSpendingKey::Master(seed);
+    auto expsk = sk.expsk;
+    auto fvk = expsk.full_viewing_key();
+    auto pk = sk.DefaultAddress();
+    auto ivk = fvk.in_viewing_key();
+
+    libzcash::SaplingNote note(pk, 50000);
+    auto cm = note.cm().get();
+    SaplingMerkleTree tree;
+    tree.append(cm);
+    auto anchor = tree.root();
+    auto witness = tree.witness();
+
+    auto builder = TransactionBuilder(consensusParams, 1);
+    ASSERT_TRUE(builder.AddSaplingSpend(expsk, note, anchor, witness));
+    builder.AddSaplingOutput(fvk.ovk, pk, 25000, {});
+    auto maybe_tx = builder.Build();
+    ASSERT_EQ(static_cast<bool>(maybe_tx), true);
+    auto tx = maybe_tx.get();
+    ASSERT_GE(tx.vShieldedOutput.size() * 41, SAPLING_DECRYPT_PARALLEL_MIN);
+
+    CWalletTx wtx {&wallet, tx};
+    auto noteMap = wallet.FindMySaplingNotes(wtx).first;
+    EXPECT_EQ(0, noteMap.size());
+
+    ASSERT_TRUE(wallet.AddSaplingIncomingViewingKey(ivk, pk));
+    noteMap = wallet.FindMySaplingNotes(wtx).first;
+    EXPECT_EQ(2, noteMap.size());
+    for (auto &entry : noteMap) {
+        EXPECT_EQ(ivk, entry.second.ivk);
+    }
+
+    // Revert to default
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_SAPLING, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+    UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::NO_ACTIVATION_HEIGHT);
+}
+
 TEST(WalletTests, FindMySaplingNotesWithIvkOnly) {
     SelectParams(CBaseChainParams::REGTEST);
     UpdateNetworkUpgradeParameters(Consensus::UPGRADE_OVERWINTER, Consensus::NetworkUpgrade::ALWAYS_ACTIVE);
@@ -1545,6 +1611,83 @@ TEST(WalletTests, CachedWitnessesCleanIndex) {
     }
 }
 
+TEST(WalletTests, CachedWitnessesReorgDuringRescan) {
+    TestWallet wallet;
+    SproutMerkleTree sproutTree;
+    SaplingMerkleTree saplingTree;
+
+    auto sk = libzcash::SproutSpendingKey::random();
+    wallet.AddSproutSpendingKey(sk);
+
+    CBlock block1;
+    CBlockIndex index1(block1);
+    index1.SetHeight(1);
+    auto outpts = CreateValidBlock(wallet, sk, index1, block1, sproutTree, saplingTree);
+
+    std::vector<JSOutPoint> sproutNotes {outpts.first};
+    std::vector<SaplingOutPoint> saplingNotes {outpts.second};
+    std::vector<boost::optional<SproutWitness>> sproutWitnesses;
+    std::vector<boost::optional<SaplingWitness>> saplingWitnesses;
+    auto anchors1 = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+
+    // A rescan is running with the chain at block 1 when block 2 comes in
+    wallet.StartRescan(1);
+    CBlock block2;
+    block2.hashPrevBlock = block1.GetHash();
+    block2.vtx.push_back(GetValidReceive(sk, 10, true, 4));
+    CBlockIndex index2(block2);
+    index2.SetHeight(2);
+
+    // The chain leaves block 2 to the rescan, which commits it
+    wallet.ChainTip(&index2, &block2, sproutTree, saplingTree, true);
+    auto anchors = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+    EXPECT_EQ(anchors1, anchors);
+    wallet.RescanNoteWitnesses(&index2, &block2, sproutTree, saplingTree);
+    auto anchors2 = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+    EXPECT_NE(anchors1.first, anchors2.first);
+    EXPECT_NE(anchors1.second, anchors2.second);
+
+    // Block 2 is reorged out before the rescan finishes, its commitments must go
+    wallet.ChainTip(&index2, &block2, sproutTree, saplingTree, false);
+    anchors = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+    EXPECT_EQ(anchors1, anchors);
+
+    // The rescan then commits the replacement block
+    CBlock block2b;
+    block2b.hashPrevBlock = block1.GetHash();
+    block2b.vtx.push_back(GetValidReceive(sk, 20, true, 4));
+    CBlockIndex index2b(block2b);
+    index2b.SetHeight(2);
+    wallet.ChainTip(&index2b, &block2b, sproutTree, saplingTree, true);
+    wallet.RescanNoteWitnesses(&index2b, &block2b, sproutTree, saplingTree);
+    auto anchors2b = GetWitnessesAndAnchors(wallet, sproutNotes, saplingNotes, sproutWitnesses, saplingWitnesses);
+
+    // Same witnesses as when block 2b is connected without a rescan
+    TestWallet wallet2;
+    SproutMerkleTree sproutTree2;
+    SaplingMerkleTree saplingTree2;
+    wallet2.AddSproutSpendingKey(sk);
+    CWalletTx wtx1 = wallet.mapWallet[outpts.first.hash];
+    for (auto& nd : wtx1.mapSproutNoteData) {
+        nd.second.witnesses.clear();
+        nd.second.witnessHeight = -1;
+    }
+    for (auto& nd : wtx1.mapSaplingNoteData) {
+        nd.second.witnesses.clear();
+        nd.second.witnessHeight = -1;
+    }
+    wallet2.AddToWallet(wtx1, true, NULL);
+    wallet2.IncrementNoteWitnesses(&index1, &block1, sproutTree2, saplingTree2);
+    wallet2.IncrementNoteWitnesses(&index2b, &block2b, sproutTree2, saplingTree2);
+    std::vector<boost::optional<SproutWitness>> sproutWitnesses2;
+    std::vector<boost::optional<SaplingWitness>> saplingWitnesses2;
+    auto anchors2bExpected = GetWitnessesAndAnchors(wallet2, sproutNotes, saplingNotes, sproutWitnesses2, saplingWitnesses2);
+    EXPECT_NE(anchors2.first, anchors2b.first);
+    EXPECT_EQ(anchors2bExpected, anchors2b);
+    EXPECT_EQ(sproutWitnesses2, sproutWitnesses);
+    EXPECT_EQ(saplingWitnesses2, saplingWitnesses);
+}
+
 TEST(WalletTests, ClearNoteWitnessCache) {
     TestWallet wallet;
 
@@ -2103,3 +2246,63 @@ TEST(WalletTests, SaplingNoteLocking) {
     EXPECT_FALSE(wallet.IsLockedNote(sop1));
     EXPECT_FALSE(wallet.IsLockedNote(sop2));
 }
+
+uint64_t komodo_interestnew(int32_t txheight,uint64_t nValue,uint32_t nLockTime,uint32_t tiptime);
+
+TEST(WalletTests, CachedAccruedInterest) {
+    LOCK(cs_main);
+    CMutableTransaction mtx;
+    mtx.nLockTime = 1550000000;
+    mtx.vout.resize(2);
+    mtx.vout[0].nValue = 1000 * COIN;
+    mtx.vout[1].nValue = 1 * COIN;
+    CTransaction tx {mtx};
+    CWalletTx wtx {NULL, tx};
+
+    CBlock block;
+    block.nTime = mtx.nLockTime + 10 * 24 * 3600;
+    CBlockIndex fakeIndex {block};
+    fakeIndex.SetHeight(200000);
+    auto blockHash = block.GetHash();
+    fakeIndex.phashBlock = &blockHash;
+    mapBlockIndex.insert(std::make_pair(blockHash, &fakeIndex));
+    chainActive.SetTip(&fakeIndex);
+
+    // Unconfirmed transactions accrue nothing
+    EXPECT_EQ(0, wtx.GetAccruedInterest(0, &fakeIndex));
+    wtx.hashBlock = blockHash;
+    wtx.MarkDirty();
+
+    CAmount interest = wtx.GetAccruedInterest(0, &fakeIndex);
+    EXPECT_EQ(200000, wtx.GetInterestHeight(&fakeIndex));
+    EXPECT_EQ(komodo_interestnew(200000, 1000 * COIN, mtx.nLockTime, block.nTime), interest);
+    EXPECT_GT(interest, 0);
+    EXPECT_EQ(0, wtx.GetAccruedInterest(1, &fakeIndex));
+
+    // A new tip invalidates the cached values
+    CBlock block2;
+    block2.nTime = block.nTime + 24 * 3600;
+    block2.hashPrevBlock = blockHash;
+    CBlockIndex fakeIndex2 {block2};
+    fakeIndex2.SetHeight(200001);
+    fakeIndex2.pprev = &fakeIndex;
+    auto blockHash2 = block2.GetHash();
+    fakeIndex2.phashBlock = &blockHash2;
+    mapBlockIndex.insert(std::make_pair(blockHash2, &fakeIndex2));
+    chainActive.SetTip(&fakeIndex2);
+    EXPECT_EQ(komodo_interestnew(200000, 1000 * COIN, mtx.nLockTime, block2.nTime), wtx.GetAccruedInterest(0, &fakeIndex2));
+    EXPECT_GT(wtx.GetAccruedInterest(0, &fakeIndex2), interest);
+
+    // Once the block leaves the active chain the output no longer accrues
+    CBlockIndex fakeIndex3 {block2};
+    fakeIndex3.SetHeight(200000);
+    uint256 blockHash3 {GetRandHash()};
+    fakeIndex3.phashBlock = &blockHash3;
+    chainActive.SetTip(&fakeIndex3);
+    EXPECT_EQ(0, wtx.GetAccruedInterest(0, &fakeIndex3));
+
+    // Tear down
+    chainActive.SetTip(NULL);
+    mapBlockIndex.erase(blockHash);
+    mapBlockIndex.erase(blockHash2);
+}
@@ -119,54 +119,62 @@ UniValue importprivkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("importprivkey", "\"mykey\", \"testing\", true, 1000")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex *pindexRescan = NULL;
+    CKeyID vchAddress;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    EnsureWalletIsUnlocked();
+        EnsureWalletIsUnlocked();
+
+        string strSecret = params[0].get_str();
+        string strLabel = "";
+        int32_t height = 0;
+        if (params.size() > 1)
+            strLabel = params[1].get_str();
+
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        if (params.size() > 2)
+            fRescan = params[2].get_bool();
+        if ( fRescan && params.size() == 4 )
+            height = params[3].get_int();
 
-    string strSecret = params[0].get_str();
-    string strLabel = "";
-    int32_t height = 0;
-    if (params.size() > 1)
-        strLabel = params[1].get_str();
-
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    if (params.size() > 2)
-        fRescan = params[2].get_bool();
-    if ( fRescan && params.size() == 4 )
-        height = params[3].get_int();
-
-    if ( height < 0 || height > chainActive.Height() )
-        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan height is out of range.");
+        if ( height < 0 || height > chainActive.Height() )
+            throw JSONRPCError(RPC_WALLET_ERROR, "Rescan height is out of range.");
     
-    CKey key = DecodeSecret(strSecret);
-    if (!key.IsValid()) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
+        CKey key = DecodeSecret(strSecret);
+        if (!key.IsValid()) throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid private key encoding");
 
-    CPubKey pubkey = key.GetPubKey();
-    assert(key.VerifyPubKey(pubkey));
-    CKeyID vchAddress = pubkey.GetID();
-    {
-        pwalletMain->MarkDirty();
-        pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
+        CPubKey pubkey = key.GetPubKey();
+        assert(key.VerifyPubKey(pubkey));
+        vchAddress = pubkey.GetID();
+        {
+            pwalletMain->MarkDirty();
+            pwalletMain->SetAddressBook(vchAddress, strLabel, "receive");
 
-        // Don't throw error in case a key is already there
-        if (pwalletMain->HaveKey(vchAddress)) {
-            return EncodeDestination(vchAddress);
-        }
+            // Don't throw error in case a key is already there
+            if (pwalletMain->HaveKey(vchAddress)) {
+                return EncodeDestination(vchAddress);
+            }
 
-        pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
+            pwalletMain->mapKeyMetadata[vchAddress].nCreateTime = 1;
 
-        if (!pwalletMain->AddKeyPubKey(key, pubkey))
-            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
+            if (!pwalletMain->AddKeyPubKey(key, pubkey))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding key to wallet");
 
-        // whenever a key is imported, we need to scan the whole chain
-        pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+            // whenever a key is imported, we need to scan the whole chain
+            pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
 
-        if (fRescan) {
-            pwalletMain->ScanForWalletTransactions(chainActive[height], true);
+            if (fRescan) {
+                pindexRescan = chainActive[height];
+            }
         }
     }
 
+    // the rescan only takes the locks while it commits each batch of blocks
+    if (pindexRescan != NULL)
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+
     return EncodeDestination(vchAddress);
 }
 
@@ -193,53 +201,60 @@ UniValue importaddress(const UniValue& params, bool fHelp)
             + HelpExampleRpc("importaddress", "\"myaddress\", \"testing\", false")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex *pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    CScript script;
+        CScript script;
 
-    CTxDestination dest = DecodeDestination(params[0].get_str());
-    if (IsValidDestination(dest)) {
-        script = GetScriptForDestination(dest);
-    } else if (IsHex(params[0].get_str())) {
-        std::vector<unsigned char> data(ParseHex(params[0].get_str()));
-        script = CScript(data.begin(), data.end());
-    } else {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Komodo address or script");
-    }
+        CTxDestination dest = DecodeDestination(params[0].get_str());
+        if (IsValidDestination(dest)) {
+            script = GetScriptForDestination(dest);
+        } else if (IsHex(params[0].get_str())) {
+            std::vector<unsigned char> data(ParseHex(params[0].get_str()));
+            script = CScript(data.begin(), data.end());
+        } else {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Komodo address or script");
+        }
 
-    string strLabel = "";
-    if (params.size() > 1)
-        strLabel = params[1].get_str();
+        string strLabel = "";
+        if (params.size() > 1)
+            strLabel = params[1].get_str();
 
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    if (params.size() > 2)
-        fRescan = params[2].get_bool();
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        if (params.size() > 2)
+            fRescan = params[2].get_bool();
 
-    {
-        if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
-            throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
+        {
+            if (::IsMine(*pwalletMain, script) == ISMINE_SPENDABLE)
+                throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this address or script");
 
-        // add to address book or update label
-        if (IsValidDestination(dest))
-            pwalletMain->SetAddressBook(dest, strLabel, "receive");
+            // add to address book or update label
+            if (IsValidDestination(dest))
+                pwalletMain->SetAddressBook(dest, strLabel, "receive");
 
-        // Don't throw error in case an address is already there
-        if (pwalletMain->HaveWatchOnly(script))
-            return NullUniValue;
+            // Don't throw error in case an address is already there
+            if (pwalletMain->HaveWatchOnly(script))
+                return NullUniValue;
 
-        pwalletMain->MarkDirty();
+            pwalletMain->MarkDirty();
 
-        if (!pwalletMain->AddWatchOnly(script))
-            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
+            if (!pwalletMain->AddWatchOnly(script))
+                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding address to wallet");
 
-        if (fRescan)
-        {
-            pwalletMain->ScanForWalletTransactions(chainActive.Genesis(), true);
-            pwalletMain->ReacceptWalletTransactions();
+            if (fRescan)
+                pindexRescan = chainActive.Genesis();
         }
     }
 
+    // the rescan only takes the locks while it commits each batch of blocks
+    if (pindexRescan != NULL)
+    {
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+        pwalletMain->ReacceptWalletTransactions();
+    }
+
     return NullUniValue;
 }
 
@@ -291,104 +306,108 @@ UniValue importwallet(const UniValue& params, bool fHelp)
 
 UniValue importwallet_impl(const UniValue& params, bool fHelp, bool fImportZKeys)
 {
-    LOCK2(cs_main, pwalletMain->cs_wallet);
+    CBlockIndex *pindex;
+    bool fGood = true;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
 
-    EnsureWalletIsUnlocked();
+        EnsureWalletIsUnlocked();
 
-    ifstream file;
-    file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
-    if (!file.is_open())
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
+        ifstream file;
+        file.open(params[0].get_str().c_str(), std::ios::in | std::ios::ate);
+        if (!file.is_open())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Cannot open wallet dump file");
 
-    int64_t nTimeBegin = chainActive.LastTip()->GetBlockTime();
+        int64_t nTimeBegin = chainActive.LastTip()->GetBlockTime();
 
-    bool fGood = true;
+        int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
+        file.seekg(0, file.beg);
+
+        pwalletMain->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
+        while (file.good()) {
+            pwalletMain->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
+            std::string line;
+            std::getline(file, line);
+            if (line.empty() || line[0] == '#')
+                continue;
 
-    int64_t nFilesize = std::max((int64_t)1, (int64_t)file.tellg());
-    file.seekg(0, file.beg);
-
-    pwalletMain->ShowProgress(_("Importing..."), 0); // show progress dialog in GUI
-    while (file.good()) {
-        pwalletMain->ShowProgress("", std::max(1, std::min(99, (int)(((double)file.tellg() / (double)nFilesize) * 100))));
-        std::string line;
-        std::getline(file, line);
-        if (line.empty() || line[0] == '#')
-            continue;
-
-        std::vector<std::string> vstr;
-        boost::split(vstr, line, boost::is_any_of(" "));
-        if (vstr.size() < 2)
-            continue;
-
-        // Let's see if the address is a valid Zcash spending key
-        if (fImportZKeys) {
-            auto spendingkey = DecodeSpendingKey(vstr[0]);
+            std::vector<std::string> vstr;
+            boost::split(vstr, line, boost::is_any_of(" "));
+            if (vstr.size() < 2)
+                continue;
+
+            // Let's see if the address is a valid Zcash spending key
+            if (fImportZKeys) {
+                auto spendingkey = DecodeSpendingKey(vstr[0]);
+                int64_t nTime = DecodeDumpTime(vstr[1]);
+                // Only include hdKeypath and seedFpStr if we have both
+                boost::optional<std::string> hdKeypath = (vstr.size() > 3) ? boost::optional<std::string>(vstr[2]) : boost::none;
+                boost::optional<std::string> seedFpStr = (vstr.size() > 3) ? boost::optional<std::string>(vstr[3]) : boost::none;
+                if (IsValidSpendingKey(spendingkey)) {
+                    auto addResult = boost::apply_visitor(
+                        AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus(), nTime, hdKeypath, seedFpStr, true), spendingkey);
+                    if (addResult == KeyAlreadyExists){
+                        LogPrint("zrpc", "Skipping import of zaddr (key already present)\n");
+                    } else if (addResult == KeyNotAdded) {
+                        // Something went wrong
+                        fGood = false;
+                    }
+                    continue;
+                } else {
+                    LogPrint("zrpc", "Importing detected an error: invalid spending key. Trying as a transparent key...\n");
+                    // Not a valid spending key, so carry on and see if it's a Zcash style t-address.
+                }
+            }
+
+            CKey key = DecodeSecret(vstr[0]);
+            if (!key.IsValid())
+                continue;
+            CPubKey pubkey = key.GetPubKey();
+            assert(key.VerifyPubKey(pubkey));
+            CKeyID keyid = pubkey.GetID();
+            if (pwalletMain->HaveKey(keyid)) {
+                LogPrintf("Skipping import of %s (key already present)\n", EncodeDestination(keyid));
+                continue;
+            }
             int64_t nTime = DecodeDumpTime(vstr[1]);
-            // Only include hdKeypath and seedFpStr if we have both
-            boost::optional<std::string> hdKeypath = (vstr.size() > 3) ? boost::optional<std::string>(vstr[2]) : boost::none;
-            boost::optional<std::string> seedFpStr = (vstr.size() > 3) ? boost::optional<std::string>(vstr[3]) : boost::none;
-            if (IsValidSpendingKey(spendingkey)) {
-                auto addResult = boost::apply_visitor(
-                    AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus(), nTime, hdKeypath, seedFpStr, true), spendingkey);
-                if (addResult == KeyAlreadyExists){
-                    LogPrint("zrpc", "Skipping import of zaddr (key already present)\n");
-                } else if (addResult == KeyNotAdded) {
-                    // Something went wrong
-                    fGood = false;
+            std::string strLabel;
+            bool fLabel = true;
+            for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
+                if (boost::algorithm::starts_with(vstr[nStr], "#"))
+                    break;
+                if (vstr[nStr] == "change=1")
+                    fLabel = false;
+                if (vstr[nStr] == "reserve=1")
+                    fLabel = false;
+                if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
+                    strLabel = DecodeDumpString(vstr[nStr].substr(6));
+                    fLabel = true;
                 }
+            }
+            LogPrintf("Importing %s...\n", EncodeDestination(keyid));
+            if (!pwalletMain->AddKeyPubKey(key, pubkey)) {
+                fGood = false;
                 continue;
-            } else {
-                LogPrint("zrpc", "Importing detected an error: invalid spending key. Trying as a transparent key...\n");
-                // Not a valid spending key, so carry on and see if it's a Zcash style t-address.
             }
+            pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
+            if (fLabel)
+                pwalletMain->SetAddressBook(keyid, strLabel, "receive");
+            nTimeBegin = std::min(nTimeBegin, nTime);
         }
+        file.close();
+        pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
 
-        CKey key = DecodeSecret(vstr[0]);
-        if (!key.IsValid())
-            continue;
-        CPubKey pubkey = key.GetPubKey();
-        assert(key.VerifyPubKey(pubkey));
-        CKeyID keyid = pubkey.GetID();
-        if (pwalletMain->HaveKey(keyid)) {
-            LogPrintf("Skipping import of %s (key already present)\n", EncodeDestination(keyid));
-            continue;
-        }
-        int64_t nTime = DecodeDumpTime(vstr[1]);
-        std::string strLabel;
-        bool fLabel = true;
-        for (unsigned int nStr = 2; nStr < vstr.size(); nStr++) {
-            if (boost::algorithm::starts_with(vstr[nStr], "#"))
-                break;
-            if (vstr[nStr] == "change=1")
-                fLabel = false;
-            if (vstr[nStr] == "reserve=1")
-                fLabel = false;
-            if (boost::algorithm::starts_with(vstr[nStr], "label=")) {
-                strLabel = DecodeDumpString(vstr[nStr].substr(6));
-                fLabel = true;
-            }
-        }
-        LogPrintf("Importing %s...\n", EncodeDestination(keyid));
-        if (!pwalletMain->AddKeyPubKey(key, pubkey)) {
-            fGood = false;
-            continue;
-        }
-        pwalletMain->mapKeyMetadata[keyid].nCreateTime = nTime;
-        if (fLabel)
-            pwalletMain->SetAddressBook(keyid, strLabel, "receive");
-        nTimeBegin = std::min(nTimeBegin, nTime);
-    }
-    file.close();
-    pwalletMain->ShowProgress("", 100); // hide progress dialog in GUI
+        pindex = chainActive.LastTip();
+        while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
+            pindex = pindex->pprev;
 
-    CBlockIndex *pindex = chainActive.LastTip();
-    while (pindex && pindex->pprev && pindex->GetBlockTime() > nTimeBegin - 7200)
-        pindex = pindex->pprev;
+        if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
+            pwalletMain->nTimeFirstKey = nTimeBegin;
 
-    if (!pwalletMain->nTimeFirstKey || nTimeBegin < pwalletMain->nTimeFirstKey)
-        pwalletMain->nTimeFirstKey = nTimeBegin;
+        LogPrintf("Rescanning last %i blocks\n", chainActive.Height() - pindex->GetHeight() + 1);
+    }
 
-    LogPrintf("Rescanning last %i blocks\n", chainActive.Height() - pindex->GetHeight() + 1);
+    // the rescan only takes the locks while it commits each batch of blocks
     pwalletMain->ScanForWalletTransactions(pindex);
     pwalletMain->MarkDirty();
 
@@ -625,67 +644,74 @@ UniValue z_importkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_importkey", "\"mykey\", \"no\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    EnsureWalletIsUnlocked();
-
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    bool fIgnoreExistingKey = true;
-    if (params.size() > 1) {
-        auto rescan = params[1].get_str();
-        if (rescan.compare("whenkeyisnew") != 0) {
-            fIgnoreExistingKey = false;
-            if (rescan.compare("yes") == 0) {
-                fRescan = true;
-            } else if (rescan.compare("no") == 0) {
-                fRescan = false;
-            } else {
-                // Handle older API
-                UniValue jVal;
-                if (!jVal.read(std::string("[")+rescan+std::string("]")) ||
-                    !jVal.isArray() || jVal.size()!=1 || !jVal[0].isBool()) {
-                    throw JSONRPCError(
-                        RPC_INVALID_PARAMETER,
-                        "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+    CBlockIndex *pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        EnsureWalletIsUnlocked();
+
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        bool fIgnoreExistingKey = true;
+        if (params.size() > 1) {
+            auto rescan = params[1].get_str();
+            if (rescan.compare("whenkeyisnew") != 0) {
+                fIgnoreExistingKey = false;
+                if (rescan.compare("yes") == 0) {
+                    fRescan = true;
+                } else if (rescan.compare("no") == 0) {
+                    fRescan = false;
+                } else {
+                    // Handle older API
+                    UniValue jVal;
+                    if (!jVal.read(std::string("[")+rescan+std::string("]")) ||
+                        !jVal.isArray() || jVal.size()!=1 || !jVal[0].isBool()) {
+                        throw JSONRPCError(
+                            RPC_INVALID_PARAMETER,
+                            "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+                    }
+                    fRescan = jVal[0].getBool();
                 }
-                fRescan = jVal[0].getBool();
             }
         }
-    }
 
-    // Height to rescan from
-    int nRescanHeight = 0;
-    if (params.size() > 2)
-        nRescanHeight = params[2].get_int();
-    if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-    }
+        // Height to rescan from
+        int nRescanHeight = 0;
+        if (params.size() > 2)
+            nRescanHeight = params[2].get_int();
+        if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        }
 
-    string strSecret = params[0].get_str();
-    auto spendingkey = DecodeSpendingKey(strSecret);
-    if (!IsValidSpendingKey(spendingkey)) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending key");
-    }
+        string strSecret = params[0].get_str();
+        auto spendingkey = DecodeSpendingKey(strSecret);
+        if (!IsValidSpendingKey(spendingkey)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid spending key");
+        }
 
-    // Sapling support
-    auto addResult = boost::apply_visitor(AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus()), spendingkey);
-    if (addResult == KeyAlreadyExists && fIgnoreExistingKey) {
-        return NullUniValue;
-    }
-    pwalletMain->MarkDirty();
-    if (addResult == KeyNotAdded) {
-        throw JSONRPCError(RPC_WALLET_ERROR, "Error adding spending key to wallet");
-    }
+        // Sapling support
+        auto addResult = boost::apply_visitor(AddSpendingKeyToWallet(pwalletMain, Params().GetConsensus()), spendingkey);
+        if (addResult == KeyAlreadyExists && fIgnoreExistingKey) {
+            return NullUniValue;
+        }
+        pwalletMain->MarkDirty();
+        if (addResult == KeyNotAdded) {
+            throw JSONRPCError(RPC_WALLET_ERROR, "Error adding spending key to wallet");
+        }
     
-    // whenever a key is imported, we need to scan the whole chain
-    pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
+        // whenever a key is imported, we need to scan the whole chain
+        pwalletMain->nTimeFirstKey = 1; // 0 would be considered 'no value'
     
-    // We want to scan for transactions and notes
-    if (fRescan) {
-        pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true);
+        // We want to scan for transactions and notes
+        if (fRescan) {
+            pindexRescan = chainActive[nRescanHeight];
+        }
     }
 
+    // the rescan only takes the locks while it commits each batch of blocks
+    if (pindexRescan != NULL)
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+
     return NullUniValue;
 }
 
@@ -719,91 +745,99 @@ UniValue z_importviewingkey(const UniValue& params, bool fHelp)
             + HelpExampleRpc("z_importviewingkey", "\"vkey\", \"no\"")
         );
 
-    LOCK2(cs_main, pwalletMain->cs_wallet);
-
-    EnsureWalletIsUnlocked();
-
-    // Whether to perform rescan after import
-    bool fRescan = true;
-    bool fIgnoreExistingKey = true;
-    if (params.size() > 1) {
-        auto rescan = params[1].get_str();
-        if (rescan.compare("whenkeyisnew") != 0) {
-            fIgnoreExistingKey = false;
-            if (rescan.compare("no") == 0) {
-                fRescan = false;
-            } else if (rescan.compare("yes") != 0) {
-                throw JSONRPCError(
-                    RPC_INVALID_PARAMETER,
-                    "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+    CBlockIndex *pindexRescan = NULL;
+    {
+        LOCK2(cs_main, pwalletMain->cs_wallet);
+
+        EnsureWalletIsUnlocked();
+
+        // Whether to perform rescan after import
+        bool fRescan = true;
+        bool fIgnoreExistingKey = true;
+        if (params.size() > 1) {
+            auto rescan = params[1].get_str();
+            if (rescan.compare("whenkeyisnew") != 0) {
+                fIgnoreExistingKey = false;
+                if (rescan.compare("no") == 0) {
+                    fRescan = false;
+                } else if (rescan.compare("yes") != 0) {
+                    throw JSONRPCError(
+                        RPC_INVALID_PARAMETER,
+                        "rescan must be \"yes\", \"no\" or \"whenkeyisnew\"");
+                }
             }
         }
-    }
-
-    // Height to rescan from
-    int nRescanHeight = 0;
-    if (params.size() > 2) {
-        nRescanHeight = params[2].get_int();
-    }
-    if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
-    }
-
-    string strVKey = params[0].get_str();
-    auto viewingkey = DecodeViewingKey(strVKey);
-    if (!IsValidViewingKey(viewingkey)) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid viewing key");
-    }
 
-    if (boost::get<libzcash::SproutViewingKey>(&viewingkey) == nullptr) {
-        if (params.size() < 4) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Missing zaddr for Sapling viewing key.");
+        // Height to rescan from
+        int nRescanHeight = 0;
+        if (params.size() > 2) {
+            nRescanHeight = params[2].get_int();
         }
-        string strAddress = params[3].get_str();
-        auto address = DecodePaymentAddress(strAddress);
-        if (!IsValidPaymentAddress(address)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid zaddr");
+        if (nRescanHeight < 0 || nRescanHeight > chainActive.Height()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
         }
 
-        auto addr = boost::get<libzcash::SaplingPaymentAddress>(address);
-        auto ivk = boost::get<libzcash::SaplingIncomingViewingKey>(viewingkey);
+        string strVKey = params[0].get_str();
+        auto viewingkey = DecodeViewingKey(strVKey);
+        if (!IsValidViewingKey(viewingkey)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid viewing key");
+        }
 
-        if (pwalletMain->HaveSaplingIncomingViewingKey(addr)) {
-            if (fIgnoreExistingKey) {
-                return NullUniValue;
+        if (boost::get<libzcash::SproutViewingKey>(&viewingkey) == nullptr) {
+            if (params.size() < 4) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Missing zaddr for Sapling viewing key.");
             }
-        } else {
-            pwalletMain->MarkDirty();
-
-            if (!pwalletMain->AddSaplingIncomingViewingKey(ivk, addr)) {
-                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding viewing key to wallet");
+            string strAddress = params[3].get_str();
+            auto address = DecodePaymentAddress(strAddress);
+            if (!IsValidPaymentAddress(address)) {
+                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid zaddr");
             }
-        }
-    } else {
-        auto vkey = boost::get<libzcash::SproutViewingKey>(viewingkey);
-        auto addr = vkey.address();
-        if (pwalletMain->HaveSproutSpendingKey(addr)) {
-            throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this viewing key");
-        }
 
-        // Don't throw error in case a viewing key is already there
-        if (pwalletMain->HaveSproutViewingKey(addr)) {
-            if (fIgnoreExistingKey) {
-                return NullUniValue;
+            auto addr = boost::get<libzcash::SaplingPaymentAddress>(address);
+            auto ivk = boost::get<libzcash::SaplingIncomingViewingKey>(viewingkey);
+
+            if (pwalletMain->HaveSaplingIncomingViewingKey(addr)) {
+                if (fIgnoreExistingKey) {
+                    return NullUniValue;
+                }
+            } else {
+                pwalletMain->MarkDirty();
+
+                if (!pwalletMain->AddSaplingIncomingViewingKey(ivk, addr)) {
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding viewing key to wallet");
+                }
             }
         } else {
-            pwalletMain->MarkDirty();
+            auto vkey = boost::get<libzcash::SproutViewingKey>(viewingkey);
+            auto addr = vkey.address();
+            if (pwalletMain->HaveSproutSpendingKey(addr)) {
+                throw JSONRPCError(RPC_WALLET_ERROR, "The wallet already contains the private key for this viewing key");
+            }
+
+            // Don't throw error in case a viewing key is already there
+            if (pwalletMain->HaveSproutViewingKey(addr)) {
+                if (fIgnoreExistingKey) {
+                    return NullUniValue;
+                }
+            } else {
+                pwalletMain->MarkDirty();
 
-            if (!pwalletMain->AddSproutViewingKey(vkey)) {
-                throw JSONRPCError(RPC_WALLET_ERROR, "Error adding viewing key to wallet");
+                if (!pwalletMain->AddSproutViewingKey(vkey)) {
+                    throw JSONRPCError(RPC_WALLET_ERROR, "Error adding viewing key to wallet");
+                }
             }
         }
-    }
 
-    // We want to scan for transactions and notes
-    if (fRescan) {
-        pwalletMain->ScanForWalletTransactions(chainActive[nRescanHeight], true);
+        // We want to scan for transactions and notes
+        if (fRescan) {
+            pindexRescan = chainActive[nRescanHeight];
+        }
     }
+
+    // the rescan only takes the locks while it commits each batch of blocks
+    if (pindexRescan != NULL)
+        pwalletMain->ScanForWalletTransactions(pindexRescan, true);
+
     return NullUniValue;
 }
 
@@ -22,6 +22,7 @@
 
 #include "checkpoints.h"
 #include "coincontrol.h"
+#include "crypto/sha256.h"
 #include "consensus/upgrades.h"
 #include "consensus/validation.h"
 #include "consensus/consensus.h"
@@ -39,11 +40,14 @@
 #include "coins.h"
 #include "zcash/zip32.h"
 #include "cc/CCinclude.h"
+#include "checkqueue.h"
 
 #include <assert.h>
+#include <atomic>
 
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -582,12 +586,23 @@ void CWallet::ChainTip(const CBlockIndex *pindex,
                        SaplingMerkleTree saplingTree,
                        bool added)
 {
+    LOCK(cs_wallet);
     if (added) {
-        IncrementNoteWitnesses(pindex, pblock, sproutTree, saplingTree);
+        // a running rescan increments the witnesses of this block itself once it gets there
+        if (nRescanHeight < 0 || pindex->GetHeight() <= nRescanHeight)
+            IncrementNoteWitnesses(pindex, pblock, sproutTree, saplingTree);
     } else {
-        DecrementNoteWitnesses(pindex);
+        // blocks the rescan has not reached yet were never incremented, so there is nothing to undo
+        if (nRescanHeight < 0 || pindex->GetHeight() <= nRescanWitnessHeight)
+            DecrementNoteWitnesses(pindex);
+        if (nRescanHeight >= 0)
+        {
+            nRescanWitnessHeight = std::min(nRescanWitnessHeight, pindex->GetHeight() - 1);
+            nRescanHeight = std::min(nRescanHeight, pindex->GetHeight() - 1);
+        }
     }
     UpdateSaplingNullifierNoteMapForBlock(pblock);
+    UpdateStakingCandidates(pindex, pblock, added);
 }
 
 void CWallet::SetBestChain(const CBlockLocator& loc)
@@ -880,6 +895,101 @@ bool CWallet::IsSpent(const uint256& hash, unsigned int n) const
     return false;
 }
 
+void CWallet::AddStakingCandidate(const CTransaction& tx, unsigned int n, const CBlockIndex* pindex)
+{
+    CTxDestination address; CStakingCandidate candidate;
+    const CTxOut& txout = tx.vout[n];
+    if ( txout.nValue < COIN || (IsMine(txout) & ISMINE_SPENDABLE) == ISMINE_NO )
+        return;
+    if ( ExtractDestination(txout.scriptPubKey,address) == 0 || ::IsMine(*this,address) == ISMINE_NO )
+        return;
+    candidate.outpoint = COutPoint(tx.GetHash(),n);
+    candidate.scriptPubKey = txout.scriptPubKey;
+    candidate.nValue = txout.nValue;
+    candidate.txtime = pindex->nTime;
+    candidate.nHeight = pindex->GetHeight();
+    candidate.fCoinBase = tx.IsCoinBase();
+    candidate.address = EncodeDestination(address);
+    CSHA256().Write((const unsigned char *)candidate.address.data(),candidate.address.size()).Finalize(candidate.addrhash.begin());
+    mapStakingCandidates[candidate.outpoint] = candidate;
+}
+
+void CWallet::UpdateStakingCandidates(const CBlockIndex* pindex, const CBlock* pblock, bool added)
+{
+    LOCK2(cs_main, cs_wallet);
+    if ( !fStakingCandidatesInit || pblock == NULL )
+        return;
+    for (const CTransaction& tx : pblock->vtx)
+    {
+        if ( added )
+        {
+            for (const CTxIn& txin : tx.vin)
+                mapStakingCandidates.erase(txin.prevout);
+            for (unsigned int i = 0; i < tx.vout.size(); i++)
+                AddStakingCandidate(tx, i, pindex);
+        }
+        else
+        {
+            // outputs of a disconnected block are no longer confirmed, and
+            // anything of ours it spent becomes stakeable again
+            for (unsigned int i = 0; i < tx.vout.size(); i++)
+                mapStakingCandidates.erase(COutPoint(tx.GetHash(), i));
+            if ( tx.IsCoinBase() )
+                continue;
+            for (const CTxIn& txin : tx.vin)
+            {
+                std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(txin.prevout.hash);
+                if ( mi == mapWallet.end() || txin.prevout.n >= mi->second.vout.size() )
+                    continue;
+                BlockMap::const_iterator bi = mapBlockIndex.find(mi->second.hashBlock);
+                if ( bi != mapBlockIndex.end() && bi->second != 0 && bi->second != pindex && chainActive.Contains(bi->second) )
+                    AddStakingCandidate(mi->second, txin.prevout.n, bi->second);
+            }
+        }
+    }
+}
+
+/**
+ * Fills vCandidates with the staking candidates that are currently
+ * spendable. The first call builds the set from mapWallet, after that it is
+ * maintained incrementally by ChainTip() and no disk access is needed.
+ */
+void CWallet::GetStakingCandidates(std::vector<CStakingCandidate>& vCandidates)
+{
+    vCandidates.clear();
+    LOCK2(cs_main, cs_wallet);
+    if ( !fStakingCandidatesInit )
+    {
+        mapStakingCandidates.clear();
+        for (std::map<uint256, CWalletTx>::const_iterator it = mapWallet.begin(); it != mapWallet.end(); ++it)
+        {
+            const CWalletTx& wtx = it->second;
+            BlockMap::const_iterator bi = mapBlockIndex.find(wtx.hashBlock);
+            if ( bi == mapBlockIndex.end() || bi->second == 0 || !chainActive.Contains(bi->second) )
+                continue;
+            for (unsigned int i = 0; i < wtx.vout.size(); i++)
+                AddStakingCandidate(wtx, i, bi->second);
+        }
+        fStakingCandidatesInit = true;
+        LogPrintf("GetStakingCandidates: %u staking candidates in wallet\n", (unsigned int)mapStakingCandidates.size());
+    }
+    vCandidates.reserve(mapStakingCandidates.size());
+    for (std::map<COutPoint, CStakingCandidate>::const_iterator it = mapStakingCandidates.begin(); it != mapStakingCandidates.end(); ++it)
+    {
+        const COutPoint& outpoint = it->first;
+        // mempool spends and coin locks are not tracked by the set itself
+        if ( IsSpent(outpoint.hash, outpoint.n) || IsLockedCoin(outpoint.hash, outpoint.n) )
+            continue;
+        if ( it->second.fCoinBase )
+        {
+            std::map<uint256, CWalletTx>::const_iterator mi = mapWallet.find(outpoint.hash);
+            if ( mi == mapWallet.end() || mi->second.GetBlocksToMaturity() > 0 )
+                continue;
+        }
+        vCandidates.push_back(it->second);
+    }
+}
+
 /**
  * Note is spent if any non-conflicted transaction
  * spends it:
@@ -1136,12 +1246,16 @@ void CWallet::IncrementNoteWitnesses(const CBlockIndex* pindex,
 }
 
 template<typename NoteDataMap>
-bool DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize)
+bool DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t nWitnessCacheSize, bool fRescanning)
 {
     extern int32_t KOMODO_REWIND;
 
     for (auto& item : noteDataMap) {
         auto* nd = &(item.second);
+        // Notes a running rescan has not brought up to this block yet were
+        // never incremented for it, the rescan continues from below
+        if (fRescanning && nd->witnessHeight < indexHeight)
+            continue;
         // Only decrement witnesses that are not above the current height
         if (nd->witnessHeight <= indexHeight) {
             // Check the validity of the cache
@@ -1187,10 +1301,11 @@ bool DecrementNoteWitnesses(NoteDataMap& noteDataMap, int indexHeight, int64_t n
 void CWallet::DecrementNoteWitnesses(const CBlockIndex* pindex)
 {
     LOCK(cs_wallet);
+    bool fRescanning = nRescanHeight >= 0 && pindex->GetHeight() > nRescanHeight;
     for (std::pair<const uint256, CWalletTx>& wtxItem : mapWallet) {
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize))
+        if (!::DecrementNoteWitnesses(wtxItem.second.mapSproutNoteData, pindex->GetHeight(), nWitnessCacheSize, fRescanning))
             needsRescan = true;
-        if (!::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize))
+        if (!::DecrementNoteWitnesses(wtxItem.second.mapSaplingNoteData, pindex->GetHeight(), nWitnessCacheSize, fRescanning))
             needsRescan = true;
     }
     if ( WITNESS_CACHE_SIZE == _COINBASE_MATURITY+10 )
@@ -1976,6 +2091,105 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
 }
 
 
+/** Trial-decrypts one output against a run of viewing keys, see TrialDecryptSaplingOutputs */
+class CSaplingDecryptCheck
+{
+private:
+    const OutputDescription* poutput;
+    const SaplingIncomingViewingKey* pivks;
+    size_t nBegin, nEnd;
+    std::atomic<int>* pnMatch;
+
+public:
+    CSaplingDecryptCheck() : poutput(NULL), pivks(NULL), nBegin(0), nEnd(0), pnMatch(NULL) {}
+    CSaplingDecryptCheck(const OutputDescription* poutputIn, const SaplingIncomingViewingKey* pivksIn, size_t nBeginIn, size_t nEndIn, std::atomic<int>* pnMatchIn) :
+        poutput(poutputIn), pivks(pivksIn), nBegin(nBeginIn), nEnd(nEndIn), pnMatch(pnMatchIn) {}
+
+    bool operator()()
+    {
+        for (size_t k = nBegin; k < nEnd; k++) {
+            // an earlier key already matched, it wins whatever this run finds
+            if ((int)k >= pnMatch->load())
+                break;
+            if (SaplingNotePlaintext::decrypt(poutput->encCiphertext, pivks[k], poutput->ephemeralKey, poutput->cm)) {
+                int nMatch = pnMatch->load();
+                while ((int)k < nMatch && !pnMatch->compare_exchange_weak(nMatch, (int)k))
+                    ;
+                break;
+            }
+        }
+        return true;
+    }
+
+    void swap(CSaplingDecryptCheck& check)
+    {
+        std::swap(poutput, check.poutput);
+        std::swap(pivks, check.pivks);
+        std::swap(nBegin, check.nBegin);
+        std::swap(nEnd, check.nEnd);
+        std::swap(pnMatch, check.pnMatch);
+    }
+};
+
+static CCheckQueue<CSaplingDecryptCheck> saplingdecryptqueue(8);
+// CCheckQueueControl allows a single master, callers that find it busy decrypt on their own thread
+static boost::mutex cs_saplingdecryptqueue;
+
+void ThreadSaplingDecrypt()
+{
+    RenameThread("zcash-decrypt");
+    saplingdecryptqueue.Thread();
+}
+
+/**
+ * For each Sapling output of tx, the index of the first of ivks that decrypts it, or -1.
+ * Large (output x key) sets are split into runs of SAPLING_DECRYPT_CHUNK keys and spread
+ * over the decryption threads; keeping the lowest matching index makes the result the same
+ * as trying the keys in order.
+ */
+void TrialDecryptSaplingOutputs(const CTransaction& tx, const std::vector<SaplingIncomingViewingKey>& ivks, std::vector<int>& vMatch)
+{
+    size_t nOutputs = tx.vShieldedOutput.size();
+    vMatch.assign(nOutputs, -1);
+    if (nOutputs == 0 || ivks.empty())
+        return;
+
+    boost::unique_lock<boost::mutex> lock(cs_saplingdecryptqueue, boost::try_to_lock);
+    if (nOutputs * ivks.size() < SAPLING_DECRYPT_PARALLEL_MIN || !lock.owns_lock()) {
+        for (size_t i = 0; i < nOutputs; i++) {
+            const OutputDescription& output = tx.vShieldedOutput[i];
+            for (size_t k = 0; k < ivks.size(); k++) {
+                if (SaplingNotePlaintext::decrypt(output.encCiphertext, ivks[k], output.ephemeralKey, output.cm)) {
+                    vMatch[i] = k;
+                    break;
+                }
+            }
+        }
+        return;
+    }
+
+    std::vector<std::atomic<int> > vFound(nOutputs);
+    std::vector<CSaplingDecryptCheck> vChecks;
+    vChecks.reserve(nOutputs * ((ivks.size() + SAPLING_DECRYPT_CHUNK - 1) / SAPLING_DECRYPT_CHUNK));
+    for (size_t i = 0; i < nOutputs; i++) {
+        vFound[i].store(std::numeric_limits<int>::max());
+        for (size_t k = 0; k < ivks.size(); k += SAPLING_DECRYPT_CHUNK)
+            vChecks.push_back(CSaplingDecryptCheck(&tx.vShieldedOutput[i], ivks.data(), k, std::min(ivks.size(), k + SAPLING_DECRYPT_CHUNK), &vFound[i]));
+    }
+    // the queue hands out work from the back, so queue the first keys last
+    std::reverse(vChecks.begin(), vChecks.end());
+    {
+        CCheckQueueControl<CSaplingDecryptCheck> control(&saplingdecryptqueue);
+        control.Add(vChecks);
+        control.Wait();
+    }
+    for (size_t i = 0; i < nOutputs; i++) {
+        int nMatch = vFound[i].load();
+        if (nMatch != std::numeric_limits<int>::max())
+            vMatch[i] = nMatch;
+    }
+}
+
 /**
  * Finds all output notes in the given transaction that have been sent to
  * SaplingPaymentAddresses in this wallet.
@@ -1986,50 +2200,45 @@ mapSproutNoteData_t CWallet::FindMySproutNotes(const CTransaction &tx) const
  */
 std::pair<mapSaplingNoteData_t, SaplingIncomingViewingKeyMap> CWallet::FindMySaplingNotes(const CTransaction &tx) const
 {
-    LOCK(cs_SpendingKeyStore);
     uint256 hash = tx.GetHash();
 
     mapSaplingNoteData_t noteData;
     SaplingIncomingViewingKeyMap viewingKeysToAdd;
+    if (tx.vShieldedOutput.empty())
+        return std::make_pair(noteData, viewingKeysToAdd);
+
+    LOCK(cs_SpendingKeyStore);
+    // full viewing keys are tried before the incoming viewing keys
+    std::vector<SaplingIncomingViewingKey> ivks;
+    ivks.reserve(mapSaplingFullViewingKeys.size() + mapSaplingIncomingViewingKeys.size());
+    for (auto it = mapSaplingFullViewingKeys.begin(); it != mapSaplingFullViewingKeys.end(); ++it)
+        ivks.push_back(it->first);
+    size_t nFullViewingKeys = ivks.size();
+    for (auto it = mapSaplingIncomingViewingKeys.begin(); it != mapSaplingIncomingViewingKeys.end(); ++it)
+        ivks.push_back(it->second);
 
     // Protocol Spec: 4.19 Block Chain Scanning (Sapling)
+    std::vector<int> vMatch;
+    TrialDecryptSaplingOutputs(tx, ivks, vMatch);
     for (uint32_t i = 0; i < tx.vShieldedOutput.size(); ++i) {
-        const OutputDescription output = tx.vShieldedOutput[i];
-        bool found = false;
-        for (auto it = mapSaplingFullViewingKeys.begin(); it != mapSaplingFullViewingKeys.end(); ++it) {
-            SaplingIncomingViewingKey ivk = it->first;
+        if (vMatch[i] < 0)
+            continue;
+        const OutputDescription& output = tx.vShieldedOutput[i];
+        SaplingIncomingViewingKey ivk = ivks[vMatch[i]];
+        if ((size_t)vMatch[i] < nFullViewingKeys) {
             auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cm);
-            if (result) {
-                auto address = ivk.address(result.get().d);
-                if (address && mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
-                    viewingKeysToAdd[address.get()] = ivk;
-                }
-                // We don't cache the nullifier here as computing it requires knowledge of the note position
-                // in the commitment tree, which can only be determined when the transaction has been mined.
-                SaplingOutPoint op {hash, i};
-                SaplingNoteData nd;
-                nd.ivk = ivk;
-                noteData.insert(std::make_pair(op, nd));
-                found = true;
-                break;
-            }
-        }
-        if (!found) {
-            for (auto it = mapSaplingIncomingViewingKeys.begin(); it != mapSaplingIncomingViewingKeys.end(); ++it) {
-                SaplingIncomingViewingKey ivk = it-> second;
-                auto result = SaplingNotePlaintext::decrypt(output.encCiphertext, ivk, output.ephemeralKey, output.cm);
-                if (!result) {
-                    continue;
-                }
-                // We don't cache the nullifier here as computing it requires knowledge of the note position
-                // in the commitment tree, which can only be determined when the transaction has been mined.
-                SaplingOutPoint op {hash, i};
-                SaplingNoteData nd;
-                nd.ivk = ivk;
-                noteData.insert(std::make_pair(op, nd));
-                break;
+            assert(result);
+            auto address = ivk.address(result.get().d);
+            if (address && mapSaplingIncomingViewingKeys.count(address.get()) == 0) {
+                viewingKeysToAdd[address.get()] = ivk;
             }
         }
+        // We don't cache the nullifier here as computing it requires knowledge of the note position
+        // in the commitment tree, which can only be determined when the transaction has been mined.
+        SaplingOutPoint op {hash, i};
+        SaplingNoteData nd;
+        nd.ivk = ivk;
+        noteData.insert(std::make_pair(op, nd));
     }
 
     return std::make_pair(noteData, viewingKeysToAdd);
@@ -2756,10 +2965,114 @@ void CWallet::WitnessNoteCommitment(std::vector<uint256> commitments,
     }
 }
 
+/** One block of a rescan as prepared by the rescan threads */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    std::vector<bool> vCandidate; // outputs or notes of the tx are ours
+    CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn) {}
+};
+
+static bool RescanIsCandidate(CWallet* pwallet, const CTransaction& tx, const std::vector<SaplingIncomingViewingKey>& ivks)
+{
+    if (pwallet->IsMine(tx))
+        return true;
+    if (tx.vjoinsplit.size() > 0 && pwallet->FindMySproutNotes(tx).size() > 0)
+        return true;
+    std::vector<int> vMatch;
+    TrialDecryptSaplingOutputs(tx, ivks, vMatch);
+    for (int nMatch : vMatch) {
+        if (nMatch >= 0)
+            return true;
+    }
+    return false;
+}
+
+// blocks nThread, nThread+nThreads, ... of the batch: read from disk and trial-decrypt, no wallet locks needed
+static void RescanBlocks(CWallet* pwallet, CRescanBlock* blocks, size_t nBlocks, int nThread, int nThreads, const std::vector<SaplingIncomingViewingKey>* ivks)
+{
+    for (size_t i = nThread; i < nBlocks; i += nThreads) {
+        CRescanBlock& item = blocks[i];
+        // already on the active chain, so the proof of work was checked when it connected
+        if (!ReadBlockFromDisk(item.block, item.pindex, false))
+            LogPrintf("Rescanning... failed to read block %d\n", item.pindex->GetHeight());
+        item.vCandidate.resize(item.block.vtx.size());
+        for (size_t j = 0; j < item.block.vtx.size(); j++)
+            item.vCandidate[j] = RescanIsCandidate(pwallet, item.block.vtx[j], *ivks);
+    }
+}
+
+static void CollectRescanBlocks(CBlockIndex*& pindexNext, std::vector<CRescanBlock>& blocks)
+{
+    LOCK(cs_main);
+    while (pindexNext && blocks.size() < RESCAN_BATCH_BLOCKS) {
+        blocks.push_back(CRescanBlock(pindexNext));
+        pindexNext = chainActive.Next(pindexNext);
+    }
+}
+
+static boost::thread_group* StartRescanThreads(CWallet* pwallet, std::vector<CRescanBlock>& blocks, int nThreads, const std::vector<SaplingIncomingViewingKey>* ivks)
+{
+    boost::thread_group* threads = new boost::thread_group();
+    // the threads hold on to the buffer, not the vector, so the caller may swap it away
+    for (int i = 0; i < nThreads && i < (int)blocks.size(); i++)
+        threads->create_thread(boost::bind(&RescanBlocks, pwallet, blocks.data(), blocks.size(), i, nThreads, ivks));
+    return threads;
+}
+
+int CWallet::CommitRescanBlock(CBlockIndex* pindex, const CBlock& block, const std::vector<bool>& vCandidate, bool fUpdate, std::vector<uint256>& myTxHashes)
+{
+    AssertLockHeld(cs_main);
+    AssertLockHeld(cs_wallet);
+    int ret = 0;
+    for (size_t i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction& tx = block.vtx[i];
+        // spends depend on what the blocks before this one added, so only they are checked here
+        if (!vCandidate[i] && mapWallet.count(tx.GetHash()) == 0 && !IsFromMe(tx))
+            continue;
+        if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
+            myTxHashes.push_back(tx.GetHash());
+            ret++;
+        }
+    }
+
+    SproutMerkleTree sproutTree;
+    SaplingMerkleTree saplingTree;
+    // This should never fail: we should always be able to get the tree
+    // state on the path to the tip of our chain
+    assert(pcoinsTip->GetSproutAnchorAt(pindex->hashSproutAnchor, sproutTree));
+    if (pindex->pprev) {
+        if (NetworkUpgradeActive(pindex->pprev->GetHeight(), Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
+            assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
+        }
+    }
+    RescanNoteWitnesses(pindex, &block, sproutTree, saplingTree);
+    return ret;
+}
+
+void CWallet::RescanNoteWitnesses(const CBlockIndex* pindex,
+                                  const CBlock* pblock,
+                                  SproutMerkleTree sproutTree,
+                                  SaplingMerkleTree saplingTree)
+{
+    LOCK(cs_wallet);
+    // Increment note witnesses caches, a reorg of this block has to undo them again
+    nRescanHeight = pindex->GetHeight();
+    nRescanWitnessHeight = std::max(nRescanWitnessHeight, nRescanHeight);
+    ChainTip(pindex, pblock, sproutTree, saplingTree, true);
+}
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
+ *
+ * Blocks are read and trial-decrypted by up to MAX_RESCAN_THREADS threads
+ * one batch ahead, while this thread commits the previous batch in order.
+ * cs_main and cs_wallet are only held for each commit, so the caller must
+ * not hold them.
  */
 int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
 {
@@ -2770,7 +3083,10 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
     CBlockIndex* pindex = pindexStart;
 
     std::vector<uint256> myTxHashes;
+    std::vector<SaplingIncomingViewingKey> ivks;
+    double dProgressStart, dProgressTip;
 
+    LOCK(cs_rescan);
     {
         LOCK2(cs_main, cs_wallet);
 
@@ -2780,42 +3096,96 @@ int CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
             pindex = chainActive.Next(pindex);
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
-        double dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
-        double dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.LastTip(), false);
-        while (pindex)
-        {
-            if (pindex->GetHeight() % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+        dProgressStart = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false);
+        dProgressTip = Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), chainActive.LastTip(), false);
 
-            CBlock block;
-            ReadBlockFromDisk(block, pindex,1);
-            BOOST_FOREACH(CTransaction& tx, block.vtx)
+        // the rescan threads decrypt with a copy of the viewing keys, FindMySaplingNotes has them all locked
+        {
+            LOCK(cs_SpendingKeyStore);
+            std::set<SaplingIncomingViewingKey> setIvks;
+            for (auto it = mapSaplingFullViewingKeys.begin(); it != mapSaplingFullViewingKeys.end(); ++it)
+                setIvks.insert(it->first);
+            for (auto it = mapSaplingIncomingViewingKeys.begin(); it != mapSaplingIncomingViewingKeys.end(); ++it)
+                setIvks.insert(it->second);
+            ivks.assign(setIvks.begin(), setIvks.end());
+        }
+        nRescanHeight = pindex ? pindex->GetHeight() - 1 : chainActive.Height();
+        nRescanWitnessHeight = chainActive.Height();
+    }
+
+    int nThreads = std::max(1, std::min(GetNumCores(), MAX_RESCAN_THREADS));
+    CBlockIndex* pindexNext = NULL;
+    std::vector<CRescanBlock> batch, next;
+    boost::scoped_ptr<boost::thread_group> threads;
+    auto joinThreads = [&threads]() {
+        if (threads) {
+            threads->join_all();
+            threads.reset();
+        }
+    };
+    try {
+        while (true)
+        {
+            if (batch.empty())
             {
-                if (AddToWalletIfInvolvingMe(tx, &block, fUpdate)) {
-                    myTxHashes.push_back(tx.GetHash());
-                    ret++;
+                // nothing in flight, start over right after the last committed block
+                LOCK2(cs_main, cs_wallet);
+                if (nRescanHeight >= chainActive.Height()) {
+                    nRescanHeight = -1;
+                    break;
                 }
+                pindexNext = chainActive[nRescanHeight + 1];
+                CollectRescanBlocks(pindexNext, batch);
+                threads.reset(StartRescanThreads(this, batch, nThreads, &ivks));
             }
+            joinThreads();
+
+            // prepare the next batch while this one is committed
+            CollectRescanBlocks(pindexNext, next);
+            threads.reset(StartRescanThreads(this, next, nThreads, &ivks));
+
+            bool fReorg = false;
+            {
+                LOCK2(cs_main, cs_wallet);
+                for (CRescanBlock& item : batch)
+                {
+                    pindex = item.pindex;
+                    if (!chainActive.Contains(pindex) || pindex->GetHeight() != nRescanHeight + 1) {
+                        fReorg = true;
+                        break;
+                    }
+                    if (pindex->GetHeight() % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                        ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex, false) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
 
-            SproutMerkleTree sproutTree;
-            SaplingMerkleTree saplingTree;
-            // This should never fail: we should always be able to get the tree
-            // state on the path to the tip of our chain
-            assert(pcoinsTip->GetSproutAnchorAt(pindex->hashSproutAnchor, sproutTree));
-            if (pindex->pprev) {
-                if (NetworkUpgradeActive(pindex->pprev->GetHeight(), Params().GetConsensus(), Consensus::UPGRADE_SAPLING)) {
-                    assert(pcoinsTip->GetSaplingAnchorAt(pindex->pprev->hashFinalSaplingRoot, saplingTree));
+                    ret += CommitRescanBlock(pindex, item.block, item.vCandidate, fUpdate, myTxHashes);
+
+                    if (GetTime() >= nNow + 60) {
+                        nNow = GetTime();
+                        LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->GetHeight(), Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+                    }
                 }
             }
-            // Increment note witness caches
-            ChainTip(pindex, &block, sproutTree, saplingTree, true);
-
-            pindex = chainActive.Next(pindex);
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->GetHeight(), Checkpoints::GuessVerificationProgress(chainParams.Checkpoints(), pindex));
+            if (fReorg) {
+                joinThreads();
+                batch.clear();
+                next.clear();
+            } else {
+                batch.swap(next);
+                next.clear();
             }
         }
+    } catch (...) {
+        joinThreads();
+        LOCK2(cs_main, cs_wallet);
+        nRescanHeight = -1;
+        throw;
+    }
+
+    {
+        LOCK2(cs_main, cs_wallet);
+
+        // rescanned blocks may have added outputs behind the staking set's back
+        fStakingCandidatesInit = false;
 
         // After rescanning, persist Sapling note data that might have changed, e.g. nullifiers.
         // Do not flush the wallet here for performance reasons.
@@ -3032,6 +3402,39 @@ CAmount CWalletTx::GetAvailableCredit(bool fUseCache) const
     return nCredit;
 }
 
+uint64_t komodo_interestnew(int32_t txheight,uint64_t nValue,uint32_t nLockTime,uint32_t tiptime);
+
+int CWalletTx::GetInterestHeight(const CBlockIndex *tipindex) const
+{
+    AssertLockHeld(cs_main);
+    if (tipindex == NULL)
+        return 0;
+    if (hashInterestTip != tipindex->GetBlockHash() || vInterestCached.size() != vout.size())
+    {
+        // everything komodo_interest_args used to look up with GetTransaction is already in the wallet tx
+        nInterestHeight = 0;
+        BlockMap::const_iterator mi = mapBlockIndex.find(hashBlock);
+        if (mi != mapBlockIndex.end() && mi->second != NULL && chainActive.Contains(mi->second))
+            nInterestHeight = mi->second->GetHeight();
+        vInterestCached.assign(vout.size(), 0);
+        if (nInterestHeight != 0)
+        {
+            for (unsigned int i = 0; i < vout.size(); i++)
+                if (vout[i].nValue >= 10*COIN)
+                    vInterestCached[i] = komodo_interestnew(nInterestHeight, vout[i].nValue, nLockTime, tipindex->nTime);
+        }
+        hashInterestTip = tipindex->GetBlockHash();
+    }
+    return nInterestHeight;
+}
+
+CAmount CWalletTx::GetAccruedInterest(unsigned int n, const CBlockIndex *tipindex) const
+{
+    if (GetInterestHeight(tipindex) == 0 || n >= vInterestCached.size())
+        return 0;
+    return vInterestCached[n];
+}
+
 CAmount CWalletTx::GetImmatureWatchOnlyCredit(const bool& fUseCache) const
 {
     if (IsCoinBase() && GetBlocksToMaturity() > 0 && IsInMainChain())
@@ -3277,9 +3680,6 @@ CAmount CWallet::GetImmatureWatchOnlyBalance() const
 /**
  * populate vCoins with vector of available COutputs.
  */
-uint64_t komodo_interestnew(int32_t txheight,uint64_t nValue,uint32_t nLockTime,uint32_t tiptime);
-uint64_t komodo_accrued_interest(int32_t *txheightp,uint32_t *locktimep,uint256 hash,int32_t n,int32_t checkheight,uint64_t checkvalue,int32_t tipheight);
-
 void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const CCoinControl *coinControl, bool fIncludeZeroValue, bool fIncludeCoinBase) const
 {
     uint64_t interest,*ptr;
@@ -3317,16 +3717,14 @@ void CWallet::AvailableCoins(vector<COutput>& vCoins, bool fOnlyConfirmed, const
                 {
                     if ( KOMODO_EXCHANGEWALLET == 0 )
                     {
-                        uint32_t locktime; int32_t txheight; CBlockIndex *tipindex;
+                        CBlockIndex *tipindex;
                         if ( ASSETCHAINS_SYMBOL[0] == 0 && chainActive.LastTip() != 0 && chainActive.LastTip()->GetHeight() >= 60000 )
                         {
                             if ( pcoin->vout[i].nValue >= 10*COIN )
                             {
                                 if ( (tipindex= chainActive.LastTip()) != 0 )
-                                {
-                                    komodo_accrued_interest(&txheight,&locktime,wtxid,i,0,pcoin->vout[i].nValue,(int32_t)tipindex->GetHeight());
-                                    interest = komodo_interestnew(txheight,pcoin->vout[i].nValue,locktime,tipindex->nTime);
-                                } else interest = 0;
+                                    interest = pcoin->GetAccruedInterest(i,tipindex);
+                                else interest = 0;
                                 //interest = komodo_interestnew(chainActive.LastTip()->GetHeight()+1,pcoin->vout[i].nValue,pcoin->nLockTime,chainActive.LastTip()->nTime);
                                 if ( interest != 0 )
                                 {
@@ -80,6 +80,14 @@ extern unsigned int WITNESS_CACHE_SIZE;
 
 //! Size of HD seed in bytes
 static const size_t HD_WALLET_SEED_LENGTH = 32;
+//! Maximum number of threads reading and trial-decrypting blocks during a rescan
+static const int MAX_RESCAN_THREADS = 8;
+//! Blocks handed to the rescan threads at a time, also the size of each locked commit window
+static const int RESCAN_BATCH_BLOCKS = 64;
+//! Fewest (output x viewing key) trial decryptions of a transaction worth handing to the decryption threads
+static const size_t SAPLING_DECRYPT_PARALLEL_MIN = 64;
+//! Viewing keys tried by one decryption job
+static const size_t SAPLING_DECRYPT_CHUNK = 16;
 
 class CBlockIndex;
 class CCoinControl;
@@ -442,6 +450,9 @@ public:
     mutable CAmount nImmatureWatchCreditCached;
     mutable CAmount nAvailableWatchCreditCached;
     mutable CAmount nChangeCached;
+    mutable uint256 hashInterestTip; //! tip nInterestHeight and vInterestCached were computed for
+    mutable int nInterestHeight;
+    mutable std::vector<CAmount> vInterestCached;
 
     CWalletTx()
     {
@@ -493,6 +504,9 @@ public:
         nAvailableWatchCreditCached = 0;
         nImmatureWatchCreditCached = 0;
         nChangeCached = 0;
+        hashInterestTip.SetNull();
+        nInterestHeight = 0;
+        vInterestCached.clear();
         nOrderPos = -1;
     }
 
@@ -556,6 +570,7 @@ public:
         fImmatureWatchCreditCached = false;
         fDebitCached = false;
         fChangeCached = false;
+        hashInterestTip.SetNull();
     }
 
     void BindWallet(CWallet *pwalletIn)
@@ -575,6 +590,10 @@ public:
     CAmount GetImmatureWatchOnlyCredit(const bool& fUseCache=true) const;
     CAmount GetAvailableWatchOnlyCredit(const bool& fUseCache=true) const;
     CAmount GetChange() const;
+    //! height of the active chain block holding this tx (0 if none) and KMD interest accrued by
+    //! output n at tipindex, both cached for every output until the tip changes
+    int GetInterestHeight(const CBlockIndex *tipindex) const;
+    CAmount GetAccruedInterest(unsigned int n, const CBlockIndex *tipindex) const;
 
     void GetAmounts(std::list<COutputEntry>& listReceived,
                     std::list<COutputEntry>& listSent, CAmount& nFee, std::string& strSentAccount, const isminefilter& filter) const;
@@ -618,6 +637,22 @@ public:
     std::string ToString() const;
 };
 
+/** A confirmed wallet output that can be used to stake a PoS block */
+class CStakingCandidate
+{
+public:
+    COutPoint outpoint;
+    CScript scriptPubKey;
+    CAmount nValue;
+    uint32_t txtime;    //! time of the block the output was mined in
+    int nHeight;        //! height of the block the output was mined in
+    bool fCoinBase;
+    std::string address;
+    uint256 addrhash;   //! sha256 of address, the per-utxo half of komodo_stakehash
+
+    CStakingCandidate() : nValue(0), txtime(0), nHeight(0), fCoinBase(false) {}
+};
+
 
 
 
@@ -774,6 +809,21 @@ private:
     void AddToSaplingSpends(const uint256& nullifier, const uint256& wtxid);
     void AddToSpends(const uint256& wtxid);
 
+    /**
+     * Outputs komodo_staked() can stake with, keyed by outpoint. Built from
+     * mapWallet on first use and then kept current from ChainTip(), so each
+     * new tip only needs the eligibility test rerun over this set.
+     */
+    std::map<COutPoint, CStakingCandidate> mapStakingCandidates;
+    bool fStakingCandidatesInit;
+
+    void AddStakingCandidate(const CTransaction& tx, unsigned int n, const CBlockIndex* pindex);
+    void UpdateStakingCandidates(const CBlockIndex* pindex, const CBlock* pblock, bool added);
+
+    CCriticalSection cs_rescan;
+
+    int CommitRescanBlock(CBlockIndex* pindex, const CBlock& block, const std::vector<bool>& vCandidate, bool fUpdate, std::vector<uint256>& myTxHashes);
+
 public:
     /*
      * Size of the incremental witness cache for the notes in our wallet.
@@ -798,6 +848,23 @@ protected:
      */
     void DecrementNoteWitnesses(const CBlockIndex* pindex);
 
+    /**
+     * ScanForWalletTransactions only holds cs_main and cs_wallet while committing a batch of blocks.
+     * In between, nRescanHeight is the last block it committed (-1 when no rescan is running) and
+     * ChainTip leaves the note witnesses of newer blocks to the scanner, which reaches them in order.
+     * nRescanWitnessHeight is the last block the witnesses have been incremented for, by the chain
+     * before the rescan started or by the rescan itself. ChainTip undoes disconnected blocks up to it.
+     */
+    int nRescanHeight;
+    int nRescanWitnessHeight;
+    /**
+     * pindex is the block a running rescan commits, after its transactions were added.
+     */
+    void RescanNoteWitnesses(const CBlockIndex* pindex,
+                             const CBlock* pblock,
+                             SproutMerkleTree sproutTree,
+                             SaplingMerkleTree saplingTree);
+
     template <typename WalletDB>
     void SetBestChainINTERNAL(WalletDB& walletdb, const CBlockLocator& loc) {
         if (!walletdb.TxnBegin()) {
@@ -902,6 +969,9 @@ public:
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
         nWitnessCacheSize = 0;
+        fStakingCandidatesInit = false;
+        nRescanHeight = -1;
+        nRescanWitnessHeight = -1;
     }
 
     /**
@@ -980,6 +1050,7 @@ public:
     bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
+    void GetStakingCandidates(std::vector<CStakingCandidate>& vCandidates);
     bool IsSproutSpent(const uint256& nullifier) const;
     bool IsSaplingSpent(const uint256& nullifier) const;
 
@@ -1501,6 +1572,10 @@ public:
     SpendingKeyAddResult operator()(const libzcash::InvalidEncoding& no) const;    
 };
 
+/** Worker thread for TrialDecryptSaplingOutputs */
+void ThreadSaplingDecrypt();
+void TrialDecryptSaplingOutputs(const CTransaction& tx, const std::vector<libzcash::SaplingIncomingViewingKey>& ivks, std::vector<int>& vMatch);
+
 #define RETURN_IF_ERROR(CCerror) if ( CCerror != "" ) { ERR_RESULT(CCerror); return(result); }
 
 #endif // BITCOIN_WALLET_WALLET_H
@@ -1,6 +1,7 @@
 #include <cstdio>
 #include <future>
 #include <map>
+#include <memory>
 #include <thread>
 #include <unistd.h>
 #include <boost/filesystem.hpp>
@@ -434,6 +435,72 @@ double benchmark_connectblock_slow()
     return duration;
 }
 
+// Puts the real coins tip back and drops the fake transactions from the mempool,
+// also when CreateNewBlock throws
+class FakeMempoolTxs {
+    CCoinsViewCache *pcoinsOrig;
+
+public:
+    std::vector<CTransaction> vtx;
+
+    FakeMempoolTxs(CCoinsViewCache *fakeCoins) : pcoinsOrig(pcoinsTip) { pcoinsTip = fakeCoins; }
+    ~FakeMempoolTxs() {
+        std::list<CTransaction> removed;
+        for (const CTransaction &tx : vtx)
+            mempool.remove(tx, removed, false);
+        pcoinsTip = pcoinsOrig;
+    }
+};
+
+double benchmark_createnewblock(size_t nTxs)
+{
+    CKey priv;
+    priv.MakeNewKey(true);
+    CBasicKeyStore tempKeystore;
+    tempKeystore.AddKey(priv);
+    CScript prevPubKey = GetScriptForDestination(priv.GetPubKey().GetID());
+
+    // No block may be connected to the fake coins, and the fake transactions
+    // must never be seen by the miner or relay, so hold both locks throughout
+    LOCK2(cs_main, mempool.cs);
+
+    // Keep the fake coins out of the real coins cache
+    CCoinsViewCache fakeCoins(pcoinsTip);
+    FakeMempoolTxs fake(&fakeCoins);
+
+    int nHeight = chainActive.Height();
+    auto consensusBranchId = CurrentEpochBranchId(nHeight + 1, Params().GetConsensus());
+    for (size_t i = 0; i < nTxs; i++) {
+        uint256 prevHash = GetRandHash();
+        CCoinsModifier coins = fakeCoins.ModifyCoins(prevHash);
+        coins->fCoinBase = false;
+        coins->nVersion = 1;
+        coins->nHeight = nHeight;
+        coins->vout.resize(1);
+        coins->vout[0].nValue = 100000;
+        coins->vout[0].scriptPubKey = prevPubKey;
+
+        CMutableTransaction mtx = CreateNewContextualCMutableTransaction(Params().GetConsensus(), nHeight + 1);
+        mtx.vin.emplace_back(prevHash, 0);
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = 100000 - 1000 - i % 1000;
+        mtx.vout[0].scriptPubKey = prevPubKey;
+        SignSignature(tempKeystore, prevPubKey, mtx, 0, 100000, SIGHASH_ALL, consensusBranchId);
+        CTransaction tx(mtx);
+        fake.vtx.push_back(tx);
+        mempool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(tx, 1000 + i % 1000, GetTime(), 0, nHeight, true, false, consensusBranchId));
+    }
+
+    // The first template fills the candidate cache, time the one after it
+    std::unique_ptr<CBlockTemplate> pblocktemplate(CreateNewBlock(priv.GetPubKey(), prevPubKey, 1));
+    struct timeval tv_start;
+    timer_start(tv_start);
+    pblocktemplate.reset(CreateNewBlock(priv.GetPubKey(), prevPubKey, 1));
+    auto duration = timer_stop(tv_start);
+
+    return duration;
+}
+
 extern UniValue getnewaddress(const UniValue& params, bool fHelp); // in rpcwallet.cpp
 extern UniValue sendtoaddress(const UniValue& params, bool fHelp);
 
@@ -16,6 +16,7 @@ extern double benchmark_large_tx(size_t nInputs);
 extern double benchmark_try_decrypt_notes(size_t nAddrs);
 extern double benchmark_increment_note_witnesses(size_t nTxs);
 extern double benchmark_connectblock_slow();
+extern double benchmark_createnewblock(size_t nTxs);
 extern double benchmark_sendtoaddress(CAmount amount);
 extern double benchmark_loadwallet();
 extern double benchmark_listunspent();